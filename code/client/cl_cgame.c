@@ -729,6 +729,7 @@ void CL_InitCGame( void ) {
 	info = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_SERVERINFO ];
 	mapname = Info_ValueForKey( info, "mapname" );
 	Com_sprintf( cl.mapname, sizeof( cl.mapname ), "maps/%s.bsp", mapname );
+	FS_PrefetchMap( cl.mapname );
 
 	// load the dll or bytecode
 	if ( cl_connectedToPureServer != 0 ) {
@@ -738,7 +739,7 @@ void CL_InitCGame( void ) {
 	else {
 		interpret = Cvar_VariableValue( "vm_cgame" );
 	}
-	cgvm = VM_Create( "cgame", CL_CgameSystemCalls, interpret );
+	cgvm = VM_Create( "cgame", CL_CgameSystemCalls, NULL, 0, interpret );
 	if ( !cgvm ) {
 		Com_Error( ERR_DROP, "VM_Create on cgame failed" );
 	}
@@ -760,6 +761,7 @@ void CL_InitCGame( void ) {
 	t2 = Sys_Milliseconds();
 
 	Com_Printf( "CL_InitCGame: %5.2f seconds\n", (t2-t1)/1000.0 );
+	FS_PrefetchDone( "CL_InitCGame", qtrue );
 
 	// have the renderer touch all its images, so they are present
 	// on the card even if the driver does deferred loading
@@ -911,6 +913,10 @@ void CL_FirstSnapshot( void ) {
 	}
 	
 	Sys_BeginProfiling();
+
+	if ( clc.demoplaying ) {
+		CL_DemoFirstSnapshot();
+	}
 }
 
 /*
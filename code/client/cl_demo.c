@@ -0,0 +1,737 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// cl_demo.c -- reading the demo file being played, plain or compressed
+
+#include "client.h"
+#include "../qcommon/puff.h"
+
+/*
+=============================================================================
+
+CL_PlayDemo_f and CL_ReadDemoMessage read the demo through CL_DemoRead,
+which hands out a plain demo as it is in the file and a compressed one
+(see demoBlockHeader_t) a block at a time, inflated.  The keyframe
+gamestate a block may lead with is skipped, playing straight through
+only needs the one at the start.
+
+The keyframes of a compressed demo are loaded when it is opened, from
+the index at its end, or found by walking the block headers when the
+demo was never finished.
+
+CL_DemoSeek moves a demo being played to another server time without
+drawing the frames in between.  Going forward it jumps to the last
+keyframe before the time, if there is one past the current frame, and
+decodes the messages from there on.  Going back restarts the demo,
+because the cgame can't take time running backwards.  The configstrings
+that changed are handed to the cgame as server commands, or when there
+are too many for the command buffer the cgame is restarted on the new
+gamestate.
+
+=============================================================================
+*/
+
+typedef struct {
+	qboolean		compressed;
+	qboolean		ended;				// no more blocks to read
+	int				fileLength;
+
+	// the inflated block, or the bytes read to tell the formats apart
+	byte			raw[DEMO_BLOCK_SIZE];
+	int				rawLength;
+	int				rawPos;
+	int				blockKeyframe;		// gamestate bytes at the start of raw
+
+	demoKeyframe_t	*keyframes;
+	int				numKeyframes;
+
+	int				startTime;			// serverTime of the first snapshot
+} demoStream_t;
+
+typedef struct {
+	qboolean		pending;			// seek once the restarted demo is active
+	int				pendingTime;
+
+	int				lastCommand;		// newest command read while seeking
+	qboolean		mapRestart;
+	char			bigConfigString[BIG_INFO_STRING];
+	gameState_t		oldGameState;		// what the cgame has seen
+} demoSeek_t;
+
+static demoStream_t		demo;
+static demoSeek_t		seek;
+static byte				demoPacked[DEMO_BLOCK_SIZE];
+
+/*
+=================
+CL_DemoReadBlock
+
+Reads and inflates the block at the file position, qfalse at the end
+of the demo
+=================
+*/
+static qboolean CL_DemoReadBlock( void ) {
+	demoBlockHeader_t	header;
+	uint32_t			rawLength, packedLength;
+
+	if ( demo.ended ) {
+		return qfalse;
+	}
+
+	// until it is read whole
+	demo.ended = qtrue;
+
+	if ( FS_Read( &header, sizeof( header ), clc.demofile ) != sizeof( header ) ) {
+		return qfalse;
+	}
+	header.packedLength = LittleLong( header.packedLength );
+	header.rawLength = LittleLong( header.rawLength );
+	header.keyframeLength = LittleLong( header.keyframeLength );
+	header.serverTime = LittleLong( header.serverTime );
+	header.method = LittleLong( header.method );
+
+	if ( header.packedLength == -1 ) {
+		return qfalse;
+	}
+	if ( header.packedLength < 0 || header.packedLength > DEMO_BLOCK_SIZE
+		|| header.rawLength < 0 || header.rawLength > DEMO_BLOCK_SIZE
+		|| header.keyframeLength < 0 || header.keyframeLength > header.rawLength ) {
+		Com_Printf( "Demo file is corrupt.\n" );
+		return qfalse;
+	}
+
+	if ( header.method == DEMO_BLOCK_STORED ) {
+		if ( header.packedLength != header.rawLength ) {
+			Com_Printf( "Demo file is corrupt.\n" );
+			return qfalse;
+		}
+		if ( FS_Read( demo.raw, header.rawLength, clc.demofile ) != header.rawLength ) {
+			Com_Printf( "Demo file was truncated.\n" );
+			return qfalse;
+		}
+	} else if ( header.method == DEMO_BLOCK_DEFLATED ) {
+		if ( FS_Read( demoPacked, header.packedLength, clc.demofile ) != header.packedLength ) {
+			Com_Printf( "Demo file was truncated.\n" );
+			return qfalse;
+		}
+		rawLength = sizeof( demo.raw );
+		packedLength = header.packedLength;
+		if ( puff( demo.raw, &rawLength, demoPacked, &packedLength ) || rawLength != header.rawLength ) {
+			Com_Printf( "Demo file is corrupt.\n" );
+			return qfalse;
+		}
+	} else {
+		Com_Printf( "Demo file is corrupt.\n" );
+		return qfalse;
+	}
+
+	demo.ended = qfalse;
+	demo.rawLength = header.rawLength;
+	demo.rawPos = header.keyframeLength;
+	demo.blockKeyframe = header.keyframeLength;
+
+	return qtrue;
+}
+
+/*
+=================
+CL_DemoRead
+
+Returns the bytes read, fewer at the end of the demo
+=================
+*/
+int CL_DemoRead( void *buffer, int length ) {
+	byte	*out = buffer;
+	int		count, total;
+
+	total = 0;
+	while ( length > 0 ) {
+		if ( demo.rawPos == demo.rawLength ) {
+			if ( !demo.compressed ) {
+				count = FS_Read( out, length, clc.demofile );
+				return count > 0 ? total + count : total;
+			}
+			if ( !CL_DemoReadBlock() ) {
+				break;
+			}
+			continue;
+		}
+
+		count = demo.rawLength - demo.rawPos;
+		if ( count > length ) {
+			count = length;
+		}
+		Com_Memcpy( out, demo.raw + demo.rawPos, count );
+		demo.rawPos += count;
+		out += count;
+		length -= count;
+		total += count;
+	}
+
+	return total;
+}
+
+/*
+=================
+CL_DemoAddKeyframe
+=================
+*/
+static void CL_DemoAddKeyframe( int serverTime, int offset, int *maxKeyframes ) {
+	demoKeyframe_t	*keyframes;
+
+	if ( demo.numKeyframes == *maxKeyframes ) {
+		*maxKeyframes = *maxKeyframes ? *maxKeyframes * 2 : 64;
+		keyframes = Z_Malloc( *maxKeyframes * sizeof( *keyframes ) );
+		if ( demo.keyframes ) {
+			Com_Memcpy( keyframes, demo.keyframes, demo.numKeyframes * sizeof( *keyframes ) );
+			Z_Free( demo.keyframes );
+		}
+		demo.keyframes = keyframes;
+	}
+
+	demo.keyframes[demo.numKeyframes].serverTime = serverTime;
+	demo.keyframes[demo.numKeyframes].offset = offset;
+	demo.numKeyframes++;
+}
+
+/*
+=================
+CL_DemoReadIndex
+
+The index at the end of a finished demo
+=================
+*/
+static qboolean CL_DemoReadIndex( void ) {
+	demoBlockHeader_t	header;
+	int					v[2], count, offset, i, maxKeyframes;
+
+	if ( demo.fileLength < (int)( sizeof( int ) + sizeof( header ) + 3 * sizeof( int ) ) ) {
+		return qfalse;
+	}
+
+	FS_Seek( clc.demofile, demo.fileLength - sizeof( v ), FS_SEEK_SET );
+	if ( FS_Read( v, sizeof( v ), clc.demofile ) != sizeof( v ) || LittleLong( v[1] ) != DEMO_INDEX_MAGIC ) {
+		return qfalse;
+	}
+	offset = LittleLong( v[0] );
+	if ( offset < (int)sizeof( int ) || offset > demo.fileLength - (int)( sizeof( header ) + 3 * sizeof( int ) ) ) {
+		return qfalse;
+	}
+
+	FS_Seek( clc.demofile, offset + sizeof( header ), FS_SEEK_SET );
+	if ( FS_Read( &count, sizeof( count ), clc.demofile ) != sizeof( count ) ) {
+		return qfalse;
+	}
+	count = LittleLong( count );
+	if ( count < 0 || count > demo.fileLength / (int)sizeof( v ) || offset + (int)( sizeof( header ) + 3 * sizeof( int ) ) + count * (int)sizeof( v ) != demo.fileLength ) {
+		return qfalse;
+	}
+
+	maxKeyframes = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( FS_Read( v, sizeof( v ), clc.demofile ) != sizeof( v ) ) {
+			return qfalse;
+		}
+		CL_DemoAddKeyframe( LittleLong( v[0] ), LittleLong( v[1] ), &maxKeyframes );
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+CL_DemoScanKeyframes
+
+Finds the keyframes of a demo without an index, which wasn't stopped
+=================
+*/
+static void CL_DemoScanKeyframes( void ) {
+	demoBlockHeader_t	header;
+	int					offset, maxKeyframes;
+
+	maxKeyframes = 0;
+	offset = sizeof( int );
+	while ( 1 ) {
+		FS_Seek( clc.demofile, offset, FS_SEEK_SET );
+		if ( FS_Read( &header, sizeof( header ), clc.demofile ) != sizeof( header ) ) {
+			break;
+		}
+		header.packedLength = LittleLong( header.packedLength );
+		if ( header.packedLength < 0 || header.packedLength > DEMO_BLOCK_SIZE
+			|| offset + (int)sizeof( header ) + header.packedLength > demo.fileLength ) {
+			break;
+		}
+		if ( header.keyframeLength ) {
+			CL_DemoAddKeyframe( LittleLong( header.serverTime ), offset, &maxKeyframes );
+		}
+		offset += sizeof( header ) + header.packedLength;
+	}
+}
+
+/*
+=================
+CL_DemoOpenStream
+
+Called once clc.demofile is opened for playing, fileLength as
+FS_FOpenFileRead returned it
+=================
+*/
+void CL_DemoOpenStream( int fileLength ) {
+	int		magic, r;
+
+	CL_DemoCloseStream();
+	demo.fileLength = fileLength;
+	seek.pending = qfalse;
+
+	r = FS_Read( &magic, sizeof( magic ), clc.demofile );
+	if ( r != sizeof( magic ) || LittleLong( magic ) != DEMO_COMPRESSED_MAGIC ) {
+		// a plain demo, hand back what was read
+		if ( r > 0 ) {
+			Com_Memcpy( demo.raw, &magic, r );
+			demo.rawLength = r;
+		}
+		return;
+	}
+
+	demo.compressed = qtrue;
+	if ( !CL_DemoReadIndex() ) {
+		if ( demo.keyframes ) {
+			Z_Free( demo.keyframes );
+			demo.keyframes = NULL;
+			demo.numKeyframes = 0;
+		}
+		CL_DemoScanKeyframes();
+	}
+	FS_Seek( clc.demofile, sizeof( magic ), FS_SEEK_SET );
+
+	Com_DPrintf( "compressed demo, %i keyframes\n", demo.numKeyframes );
+}
+
+/*
+=================
+CL_DemoCloseStream
+=================
+*/
+void CL_DemoCloseStream( void ) {
+	if ( demo.keyframes ) {
+		Z_Free( demo.keyframes );
+	}
+	demo.keyframes = NULL;
+	demo.numKeyframes = 0;
+	demo.compressed = qfalse;
+	demo.ended = qfalse;
+	demo.fileLength = 0;
+	demo.rawLength = 0;
+	demo.rawPos = 0;
+	demo.blockKeyframe = 0;
+	demo.startTime = 0;
+}
+
+/*
+=============================================================================
+
+SEEKING
+
+=============================================================================
+*/
+
+/*
+=================
+CL_DemoSeekCommand
+
+A server command read while seeking.  Configstrings are applied right
+away, everything else is of no use once the time it was sent for is
+skipped.
+=================
+*/
+void CL_DemoSeekCommand( int sequence, const char *s ) {
+	char	*cmd;
+
+	if ( sequence <= seek.lastCommand ) {
+		return;
+	}
+	seek.lastCommand = sequence;
+
+	Cmd_TokenizeString( s );
+	cmd = Cmd_Argv( 0 );
+
+	if ( !strcmp( cmd, "bcs0" ) ) {
+		Com_sprintf( seek.bigConfigString, sizeof( seek.bigConfigString ), "cs %s \"%s", Cmd_Argv( 1 ), Cmd_Argv( 2 ) );
+	} else if ( !strcmp( cmd, "bcs1" ) ) {
+		Q_strcat( seek.bigConfigString, sizeof( seek.bigConfigString ), Cmd_Argv( 2 ) );
+	} else if ( !strcmp( cmd, "bcs2" ) ) {
+		Q_strcat( seek.bigConfigString, sizeof( seek.bigConfigString ), Cmd_Argv( 2 ) );
+		Q_strcat( seek.bigConfigString, sizeof( seek.bigConfigString ), "\"" );
+		Cmd_TokenizeString( seek.bigConfigString );
+		CL_ConfigstringModified();
+	} else if ( !strcmp( cmd, "cs" ) ) {
+		CL_ConfigstringModified();
+	} else if ( !strcmp( cmd, "map_restart" ) ) {
+		seek.mapRestart = qtrue;
+	}
+}
+
+/*
+=================
+CL_DemoAddCommand
+
+Hands the cgame a command that was never in the demo
+=================
+*/
+static void CL_DemoAddCommand( const char *s ) {
+	clc.serverCommandSequence++;
+	Q_strncpyz( clc.serverCommands[clc.serverCommandSequence & ( MAX_RELIABLE_COMMANDS - 1 )],
+		s, sizeof( clc.serverCommands[0] ) );
+}
+
+#define	DEMO_CS_CHUNK	( MAX_STRING_CHARS - 24 )
+
+/*
+=================
+CL_DemoConfigstringCommands
+
+How many commands CL_DemoAddConfigstring takes for s
+=================
+*/
+static int CL_DemoConfigstringCommands( const char *s ) {
+	int		length;
+
+	length = strlen( s );
+	if ( length < DEMO_CS_CHUNK ) {
+		return 1;
+	}
+	return ( length + DEMO_CS_CHUNK - 2 ) / ( DEMO_CS_CHUNK - 1 );
+}
+
+/*
+=================
+CL_DemoAddConfigstring
+
+Sent as the server would, in pieces when it is too long for a command
+=================
+*/
+static void CL_DemoAddConfigstring( int index, const char *s ) {
+	char	buf[MAX_STRING_CHARS];
+	char	*cmd;
+	int		maxChunkSize, sent, remaining;
+
+	maxChunkSize = DEMO_CS_CHUNK;
+	remaining = strlen( s );
+	if ( remaining < maxChunkSize ) {
+		CL_DemoAddCommand( va( "cs %i \"%s\"", index, s ) );
+		return;
+	}
+
+	for ( sent = 0 ; remaining > 0 ; sent += maxChunkSize - 1, remaining -= maxChunkSize - 1 ) {
+		if ( sent == 0 ) {
+			cmd = "bcs0";
+		} else if ( remaining < maxChunkSize ) {
+			cmd = "bcs2";
+		} else {
+			cmd = "bcs1";
+		}
+		Q_strncpyz( buf, s + sent, maxChunkSize );
+		CL_DemoAddCommand( va( "%s %i \"%s\"", cmd, index, buf ) );
+	}
+}
+
+/*
+=================
+CL_DemoParseKeyframe
+
+Takes the configstrings and baselines from the gamestate the current
+block starts with, leaving the cgame and everything else as it is
+=================
+*/
+static void CL_DemoParseKeyframe( void ) {
+	msg_t			msg;
+	entityState_t	nullstate;
+	int				sequence, length, cmd, i, len;
+	char			*s;
+
+	Com_Memcpy( &sequence, demo.raw, 4 );
+	Com_Memcpy( &length, demo.raw + 4, 4 );
+	sequence = LittleLong( sequence );
+	length = LittleLong( length );
+	if ( length < 0 || 8 + length > demo.blockKeyframe ) {
+		Com_Error( ERR_DROP, "CL_DemoParseKeyframe: bad keyframe length" );
+	}
+
+	MSG_Init( &msg, demo.raw + 8, length );
+	msg.cursize = length;
+	MSG_Bitstream( &msg );
+	MSG_ReadLong( &msg );	// reliableAcknowledge
+	if ( MSG_ReadByte( &msg ) != svc_gamestate ) {
+		Com_Error( ERR_DROP, "CL_DemoParseKeyframe: not a gamestate" );
+	}
+
+	clc.serverMessageSequence = sequence;
+	sequence = MSG_ReadLong( &msg ) + clc.demoCommandOffset;
+	if ( sequence > seek.lastCommand ) {
+		seek.lastCommand = sequence;
+	}
+
+	Com_Memset( &cl.gameState, 0, sizeof( cl.gameState ) );
+	Com_Memset( cl.entityBaselines, 0, sizeof( cl.entityBaselines ) );
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+
+	cl.gameState.dataCount = 1;	// leave a 0 at the beginning for uninitialized configstrings
+	while ( 1 ) {
+		cmd = MSG_ReadByte( &msg );
+
+		if ( cmd == svc_EOF ) {
+			break;
+		}
+
+		if ( cmd == svc_configstring ) {
+			i = MSG_ReadShort( &msg );
+			if ( i < 0 || i >= MAX_CONFIGSTRINGS ) {
+				Com_Error( ERR_DROP, "configstring > MAX_CONFIGSTRINGS" );
+			}
+			s = MSG_ReadBigString( &msg );
+			len = strlen( s );
+			if ( len + 1 + cl.gameState.dataCount > MAX_GAMESTATE_CHARS ) {
+				Com_Error( ERR_DROP, "MAX_GAMESTATE_CHARS exceeded" );
+			}
+			cl.gameState.stringOffsets[i] = cl.gameState.dataCount;
+			Com_Memcpy( cl.gameState.stringData + cl.gameState.dataCount, s, len + 1 );
+			cl.gameState.dataCount += len + 1;
+		} else if ( cmd == svc_baseline ) {
+			i = MSG_ReadBits( &msg, GENTITYNUM_BITS );
+			if ( i < 0 || i >= MAX_GENTITIES ) {
+				Com_Error( ERR_DROP, "Baseline number out of range: %i", i );
+			}
+			MSG_ReadDeltaEntity( &msg, &nullstate, &cl.entityBaselines[i], i );
+		} else {
+			Com_Error( ERR_DROP, "CL_DemoParseKeyframe: bad command byte" );
+		}
+	}
+
+	CL_SystemInfoChanged();
+}
+
+/*
+=================
+CL_DemoJump
+
+Moves a compressed demo to the last keyframe at or before serverTime,
+if that is past the current frame
+=================
+*/
+static void CL_DemoJump( int serverTime ) {
+	int		i;
+
+	for ( i = demo.numKeyframes - 1 ; i >= 0 ; i-- ) {
+		if ( demo.keyframes[i].serverTime <= serverTime ) {
+			break;
+		}
+	}
+	if ( i < 0 || demo.keyframes[i].serverTime <= cl.snap.serverTime ) {
+		return;
+	}
+
+	FS_Seek( clc.demofile, demo.keyframes[i].offset, FS_SEEK_SET );
+	demo.ended = qfalse;
+	if ( !CL_DemoReadBlock() ) {
+		return;		// the next read ends the demo
+	}
+	if ( !demo.blockKeyframe ) {
+		Com_Error( ERR_DROP, "CL_DemoJump: no keyframe at %i", demo.keyframes[i].offset );
+	}
+
+	CL_DemoParseKeyframe();
+}
+
+/*
+=================
+CL_DemoFastForward
+
+Reads messages up to the first snapshot at or past serverTime, then
+tells the cgame about the configstrings that changed on the way and
+moves its clock along.  When there are more changes than the reliable
+command buffer can hold the cgame is restarted instead, it reads them
+all from the gamestate.
+=================
+*/
+static void CL_DemoFastForward( int serverTime ) {
+	int		start, oldTime, shift, i, count;
+	char	*old, *s;
+
+	start = Sys_Milliseconds();
+	oldTime = cl.snap.serverTime;
+
+	seek.oldGameState = cl.gameState;
+	seek.lastCommand = clc.serverCommandSequence;
+	seek.mapRestart = qfalse;
+	clc.demoSeeking = qtrue;
+
+	if ( demo.compressed ) {
+		CL_DemoJump( serverTime );
+	}
+
+	while ( cl.snap.serverTime < serverTime ) {
+		CL_ReadDemoMessage();
+		if ( cls.state != CA_ACTIVE ) {
+			clc.demoSeeking = qfalse;
+			return;		// end of demo, or a new map
+		}
+	}
+	clc.demoSeeking = qfalse;
+
+	// the commands the cgame missed, they have to fit in the buffer
+	// along with the ones it hasn't executed yet
+	count = seek.mapRestart ? 1 : 0;
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		old = seek.oldGameState.stringData + seek.oldGameState.stringOffsets[i];
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[i];
+		if ( strcmp( old, s ) ) {
+			count += CL_DemoConfigstringCommands( s );
+		}
+	}
+
+	if ( count + clc.serverCommandSequence - clc.lastExecutedServerCommand > MAX_RELIABLE_COMMANDS ) {
+		clc.demoCommandOffset += clc.serverCommandSequence - seek.lastCommand;
+		cl.snap.serverCommandNum = clc.serverCommandSequence;
+		cl.snapshots[cl.snap.messageNum & PACKET_MASK].serverCommandNum = clc.serverCommandSequence;
+
+		// the new cgame starts from the gamestate and the next snapshot
+		Com_DPrintf( "demo seek: %i commands, restarting the cgame\n", count );
+		clc.lastExecutedServerCommand = clc.serverCommandSequence;
+		CL_ShutdownCGame();
+		cls.cgameStarted = qtrue;
+		CL_InitCGame();
+		return;
+	}
+
+	if ( seek.mapRestart ) {
+		CL_DemoAddCommand( "map_restart" );
+	}
+	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
+		old = seek.oldGameState.stringData + seek.oldGameState.stringOffsets[i];
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[i];
+		if ( strcmp( old, s ) ) {
+			CL_DemoAddConfigstring( i, s );
+		}
+	}
+
+	// the commands still to come in the demo are numbered after them
+	clc.demoCommandOffset += clc.serverCommandSequence - seek.lastCommand;
+	cl.snap.serverCommandNum = clc.serverCommandSequence;
+	cl.snapshots[cl.snap.messageNum & PACKET_MASK].serverCommandNum = clc.serverCommandSequence;
+
+	shift = cl.snap.serverTime - oldTime;
+	cl.serverTimeDelta += shift;
+	cl.serverTime += shift;
+	cl.oldServerTime += shift;
+	clc.timeDemoBaseTime += shift;
+
+	Com_DPrintf( "demo seek: %i msec of demo in %i msec\n", shift, Sys_Milliseconds() - start );
+}
+
+/*
+=================
+CL_DemoSeek
+
+Returns qfalse when no demo is being played
+=================
+*/
+qboolean CL_DemoSeek( int serverTime ) {
+	if ( !clc.demoplaying || cls.state != CA_ACTIVE ) {
+		return qfalse;
+	}
+
+	if ( serverTime < cl.snap.serverTime ) {
+		Cbuf_ExecuteText( EXEC_NOW, va( "demo \"%s\"\n", clc.demoName ) );
+		if ( clc.demoplaying ) {
+			seek.pending = qtrue;
+			seek.pendingTime = serverTime;
+		}
+		return qtrue;
+	}
+
+	CL_DemoFastForward( serverTime );
+	return qtrue;
+}
+
+/*
+=================
+CL_DemoFirstSnapshot
+
+The demo just went active
+=================
+*/
+void CL_DemoFirstSnapshot( void ) {
+	if ( !demo.startTime ) {
+		demo.startTime = cl.snap.serverTime;
+	}
+
+	if ( seek.pending ) {
+		seek.pending = qfalse;
+		CL_DemoFastForward( seek.pendingTime );
+	}
+}
+
+/*
+=================
+CL_DemoSeek_f
+
+demoseek <[+|-]seconds | mm:ss>, times without a sign are from the start
+=================
+*/
+void CL_DemoSeek_f( void ) {
+	char	*arg, *colon;
+	int		msec, now, sign;
+
+	if ( !clc.demoplaying || cls.state != CA_ACTIVE ) {
+		Com_Printf( "Not playing a demo.\n" );
+		return;
+	}
+
+	now = cl.snap.serverTime - demo.startTime;
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "demoseek <[+|-]seconds | mm:ss>\n" );
+		Com_Printf( "at %i:%02i, %i keyframes\n", now / 60000, ( now / 1000 ) % 60, demo.numKeyframes );
+		return;
+	}
+
+	arg = Cmd_Argv( 1 );
+	sign = 0;
+	if ( arg[0] == '+' || arg[0] == '-' ) {
+		sign = ( arg[0] == '+' ) ? 1 : -1;
+		arg++;
+	}
+
+	colon = strchr( arg, ':' );
+	if ( colon ) {
+		msec = atoi( arg ) * 60000 + atof( colon + 1 ) * 1000;
+	} else {
+		msec = atof( arg ) * 1000;
+	}
+
+	if ( sign ) {
+		msec = now + sign * msec;
+	}
+	if ( msec < 0 ) {
+		msec = 0;
+	}
+
+	CL_DemoSeek( demo.startTime + msec );
+}
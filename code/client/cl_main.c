@@ -517,7 +517,7 @@ void CL_ReadDemoMessage( void ) {
 	}
 
 	// get the sequence number
-	r = FS_Read( &s, 4, clc.demofile);
+	r = CL_DemoRead( &s, 4 );
 	if ( r != 4 ) {
 		CL_DemoCompleted ();
 		return;
@@ -528,7 +528,7 @@ void CL_ReadDemoMessage( void ) {
 	MSG_Init( &buf, bufData, sizeof( bufData ) );
 
 	// get the length
-	r = FS_Read (&buf.cursize, 4, clc.demofile);
+	r = CL_DemoRead( &buf.cursize, 4 );
 	if ( r != 4 ) {
 		CL_DemoCompleted ();
 		return;
@@ -549,7 +549,7 @@ void CL_ReadDemoMessage( void ) {
 	if ( buf.cursize > buf.maxsize ) {
 		Com_Error (ERR_DROP, "CL_ReadDemoMessage: demoMsglen > MAX_MSGLEN");
 	}
-	r = FS_Read( buf.data, buf.cursize, clc.demofile );
+	r = CL_DemoRead( buf.data, buf.cursize );
 	if ( r != buf.cursize ) {
 		Com_Printf( "Demo file was truncated.\n");
 		CL_DemoCompleted ();
@@ -558,7 +558,7 @@ void CL_ReadDemoMessage( void ) {
 	
 	#ifdef USE_DEMO_FORMAT_42
 		// skip the end length (read it a second time) ... Is usefull only in backward read /* holblin */
-		r = FS_Read (&length_backward, 4, clc.demofile);
+		r = CL_DemoRead( &length_backward, 4 );
 		if ( r != 4 ) {
 			CL_DemoCompleted ();
 			return;
@@ -579,18 +579,22 @@ void CL_ReadDemoMessage( void ) {
 /*
 ====================
 CL_WalkDemoExt
+
+Returns the length of the demo file
 ====================
 */
-static void CL_WalkDemoExt(char *arg, char *name, int *demofile)
+static int CL_WalkDemoExt(char *arg, char *name, int *demofile)
 {
+	int length;
 	#ifndef USE_DEMO_FORMAT_42
 		int i;
 	#endif
 
 	*demofile = 0;
+	length = 0;
 	#ifdef USE_DEMO_FORMAT_42
 		Com_sprintf (name, MAX_OSPATH, "demos/%s.urtdemo", arg );
-		FS_FOpenFileRead( name, demofile, qtrue );
+		length = FS_FOpenFileRead( name, demofile, qtrue );
 		if (*demofile)
 			Com_Printf("Demo file: %s\n", name);
 		else
@@ -601,7 +605,7 @@ static void CL_WalkDemoExt(char *arg, char *name, int *demofile)
 		while(demo_protocols[i])
 		{
 			Com_sprintf (name, MAX_OSPATH, "demos/%s.dm_%d", arg, demo_protocols[i]);
-			FS_FOpenFileRead( name, demofile, qtrue );
+			length = FS_FOpenFileRead( name, demofile, qtrue );
 			if (*demofile)
 			{
 				Com_Printf("Demo file: %s\n", name);
@@ -613,6 +617,8 @@ static void CL_WalkDemoExt(char *arg, char *name, int *demofile)
 			i++;
 		}
 	#endif
+
+	return length;
 }
 
 /*
@@ -626,6 +632,7 @@ demo <demoname>
 void CL_PlayDemo_f( void ) {
 	char		name[MAX_OSPATH];
 	char		*arg, *ext_test;
+	int			length;
 #ifdef USE_DEMO_FORMAT_42
 	int			r, len, v1, v2;
 	char		*s2;
@@ -654,7 +661,7 @@ void CL_PlayDemo_f( void ) {
 		if(!strcmp(ext_test, ".urtdemo") || !strcmp(ext_test, ".URTDEMO"))
 		{
 			Com_sprintf (name, sizeof(name), "demos/%s", arg);
-			FS_FOpenFileRead( name, &clc.demofile, qtrue );
+			length = FS_FOpenFileRead( name, &clc.demofile, qtrue );
 	#else
 		// check for an extension .dm_?? (?? is protocol)
 		ext_test = arg + strlen(arg) - 6;
@@ -672,16 +679,16 @@ void CL_PlayDemo_f( void ) {
 			if (demo_protocols[i])
 			{
 				Com_sprintf (name, sizeof(name), "demos/%s", arg);
-				FS_FOpenFileRead( name, &clc.demofile, qtrue );
+				length = FS_FOpenFileRead( name, &clc.demofile, qtrue );
 			} else {
 				Com_Printf("Protocol %d not supported for demos\n", protocol);
 				Q_strncpyz(retry, arg, sizeof(retry));
 				retry[strlen(retry)-6] = 0;
-				CL_WalkDemoExt( retry, name, &clc.demofile );
+				length = CL_WalkDemoExt( retry, name, &clc.demofile );
 			}
 	#endif
 	} else {
-		CL_WalkDemoExt( arg, name, &clc.demofile );
+		length = CL_WalkDemoExt( arg, name, &clc.demofile );
 	}
 	
 	if (!clc.demofile) {
@@ -689,6 +696,7 @@ void CL_PlayDemo_f( void ) {
 		return;
 	}
 	Q_strncpyz( clc.demoName, Cmd_Argv(1), sizeof( clc.demoName ) );
+	CL_DemoOpenStream( length );
 
 	Con_Close();
 
@@ -702,7 +710,7 @@ void CL_PlayDemo_f( void ) {
 	//s1 = Info_ValueForKey(serverInfo, "g_modversion");
 	
 	
-	r = FS_Read( &len, 4, clc.demofile );
+	r = CL_DemoRead( &len, 4 );
 	if ( r != 4 ) {
 		CL_DemoCompleted ();
 		return;
@@ -711,7 +719,7 @@ void CL_PlayDemo_f( void ) {
 	len = LittleLong( len );
 		
 	s2 = malloc( len + 1 );
-	r = FS_Read( s2 , len ,  clc.demofile );
+	r = CL_DemoRead( s2, len );
 	if ( r != len ) {
 		CL_DemoCompleted ();
 		free(s2);
@@ -720,7 +728,7 @@ void CL_PlayDemo_f( void ) {
 	s2[len] = '\0';
 		
 	v1 = LittleLong( DEMO_VERSION );
-	r = FS_Read ( &v2, 4 , clc.demofile );
+	r = CL_DemoRead( &v2, 4 );
 	if ( r != 4 ) {
 		CL_DemoCompleted ();
 		free(s2);
@@ -743,14 +751,14 @@ void CL_PlayDemo_f( void ) {
 		return;
 	}
 
-	r = FS_Read( &len, 4, clc.demofile );
+	r = CL_DemoRead( &len, 4 );
 	len = LittleLong( len );
 	if ( r != 4 || len != 0) {
 		CL_DemoCompleted ();
 		return;
 	}
 		
-	r = FS_Read( &len, 4, clc.demofile );
+	r = CL_DemoRead( &len, 4 );
 	len = LittleLong( len );
 	if ( r != 4 || len != 0) {
 		CL_DemoCompleted ();
@@ -982,6 +990,7 @@ void CL_Disconnect( qboolean showMainMenu ) {
 		FS_FCloseFile( clc.demofile );
 		clc.demofile = 0;
 	}
+	CL_DemoCloseStream();
 
 	if ( uivm && showMainMenu ) {
 		VM_Call( uivm, UI_SET_ACTIVE_MENU, UIMENU_NONE );
@@ -2684,9 +2693,13 @@ void CL_InitRef( void ) {
 #endif
 	ri.Hunk_AllocateTempMemory = Hunk_AllocateTempMemory;
 	ri.Hunk_FreeTempMemory = Hunk_FreeTempMemory;
+	ri.JobThreadCount = Com_JobThreadCount;
+	ri.ParallelFor = Com_ParallelFor;
 	ri.CM_DrawDebugSurface = CM_DrawDebugSurface;
 	ri.FS_ReadFile = FS_ReadFile;
 	ri.FS_FreeFile = FS_FreeFile;
+	ri.FS_ReadFileView = FS_ReadFileView;
+	ri.FS_FreeFileView = FS_FreeFileView;
 	ri.FS_WriteFile = FS_WriteFile;
 	ri.FS_FreeFileList = FS_FreeFileList;
 	ri.FS_ListFiles = FS_ListFiles;
@@ -2995,6 +3008,7 @@ void CL_Init( void ) {
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
 	Cmd_AddCommand ("record", CL_Record_f);
 	Cmd_AddCommand ("demo", CL_PlayDemo_f);
+	Cmd_AddCommand ("demoseek", CL_DemoSeek_f);
 	Cmd_AddCommand ("cinematic", CL_PlayCinematic_f);
 	Cmd_AddCommand ("stoprecord", CL_StopRecord_f);
 	Cmd_AddCommand ("connect", CL_Connect_f);
@@ -3063,6 +3077,7 @@ void CL_Shutdown( void ) {
 	Cmd_RemoveCommand ("disconnect");
 	Cmd_RemoveCommand ("record");
 	Cmd_RemoveCommand ("demo");
+	Cmd_RemoveCommand ("demoseek");
 	Cmd_RemoveCommand ("cinematic");
 	Cmd_RemoveCommand ("stoprecord");
 	Cmd_RemoveCommand ("connect");
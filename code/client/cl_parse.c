@@ -651,6 +651,8 @@ void CL_ParseGamestate( msg_t *msg ) {
 
 	// a gamestate always marks a server command sequence
 	clc.serverCommandSequence = MSG_ReadLong( msg );
+	clc.demoCommandOffset = 0;
+	clc.demoSeeking = qfalse;
 
 	// parse all the configstrings and baselines
 	cl.gameState.dataCount = 1;	// leave a 0 at the beginning for uninitialized configstrings
@@ -851,9 +853,15 @@ void CL_ParseCommandString( msg_t *msg ) {
 	int		seq;
 	int		index;
 
-	seq = MSG_ReadLong( msg );
+	seq = MSG_ReadLong( msg ) + clc.demoCommandOffset;
 	s = MSG_ReadString( msg );
 
+	// a demo being fast-forwarded has no cgame to hand it to
+	if ( clc.demoSeeking ) {
+		CL_DemoSeekCommand( seq, s );
+		return;
+	}
+
 	// see if we have already executed stored it off
 	if ( clc.serverCommandSequence >= seq ) {
 		return;
@@ -1186,7 +1186,7 @@ void CL_InitUI( void ) {
 	else {
 		interpret = Cvar_VariableValue( "vm_ui" );
 	}
-	uivm = VM_Create( "ui", CL_UISystemCalls, interpret );
+	uivm = VM_Create( "ui", CL_UISystemCalls, NULL, 0, interpret );
 	if ( !uivm ) {
 		Com_Error( ERR_FATAL, "VM_Create on UI failed. It may be because you are running a different version from this server. Please check that you are up to date on www.urbanterror.info\n" );
 	}
@@ -216,6 +216,8 @@ typedef struct {
 	qboolean	demoplaying;
 	qboolean	demowaiting;	// don't record until a non-delta message is received
 	qboolean	firstDemoFrameSkipped;
+	qboolean	demoSeeking;		// fast-forwarding, commands are applied as read
+	int			demoCommandOffset;	// added to demo command numbers after a seek
 	fileHandle_t	demofile;
 
 	int			timeDemoFrames;		// counter of rendered frames
@@ -550,6 +552,7 @@ void CL_CGameRendering( stereoFrame_t stereo );
 void CL_SetCGameTime( void );
 void CL_FirstSnapshot( void );
 void CL_ShaderStateChanged(void);
+void CL_ConfigstringModified( void );
 
 //
 // cl_ui.c
@@ -562,6 +565,17 @@ void LAN_LoadCachedServers( void );
 void LAN_SaveServersToCache( void );
 
 
+//
+// cl_demo.c
+//
+void CL_DemoOpenStream( int fileLength );
+int CL_DemoRead( void *buffer, int length );
+void CL_DemoCloseStream( void );
+void CL_DemoSeekCommand( int sequence, const char *s );
+qboolean CL_DemoSeek( int serverTime );
+void CL_DemoFirstSnapshot( void );
+void CL_DemoSeek_f( void );
+
 //
 // cl_net_chan.c
 //
@@ -96,6 +96,20 @@ typedef struct {
 	entityShared_t	r;				// shared by both the server system and game
 } sharedEntity_t;
 
+#define	MAX_TRACE_BATCH		256		// more traces in one G_TRACE_BATCH are dropped
+
+// one trace of a G_TRACE_BATCH, results is filled in by the server
+typedef struct {
+	vec3_t		start;
+	vec3_t		mins;
+	vec3_t		maxs;
+	vec3_t		end;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;		// qtrue for G_TRACECAPSULE
+	trace_t		results;
+} gameTrace_t;
+
 
 
 //===============================================================
@@ -228,6 +242,8 @@ typedef enum {
 	
 	// 1.32
 	G_FS_SEEK,
+
+	G_TRACE_BATCH,	// ( gameTrace_t *traces, int numTraces );
 	
 	BOTLIB_SETUP = 200,				// ( void );
 	BOTLIB_SHUTDOWN,				// ( void );
@@ -82,6 +82,10 @@ int		Sys_Milliseconds (void) {
 	return 0;
 }
 
+int64_t	Sys_Microseconds (void) {
+	return 0;
+}
+
 void	Sys_Mkdir (char *path) {
 }
 
@@ -52,6 +52,12 @@ Sys_SendPacket
 void Sys_SendPacket( int length, void *data, netadr_t to ) {
 }
 
+void Sys_BeginPacketBatch( void ) {
+}
+
+void Sys_FlushPacketBatch( void ) {
+}
+
 /*
 ==================
 Sys_GetPacket
@@ -59,6 +65,6 @@ Sys_GetPacket
 Never called by the game logic, just the system event queing
 ==================
 */
-qboolean	Sys_GetPacket ( netadr_t *net_from, msg_t *net_message ) {
-	return false;
+netPacket_t	*Sys_GetPacket( int *length ) {
+	return NULL;
 }
@@ -261,6 +261,56 @@ void CMod_LoadBrushes( lump_t *l ) {
 
 }
 
+/*
+=================
+CMod_PackBrushPlanes
+
+Copies the planes of every brush into cbrushPlanes_t groups.  Unused
+lanes of the last group get a plane nothing can be in front of.
+=================
+*/
+void CMod_PackBrushPlanes( void ) {
+#ifdef CM_SIMD_BRUSHES
+	cbrush_t		*brush;
+	cbrushPlanes_t	*group;
+	cplane_t		*plane;
+	int				i, j, k, lane;
+	int				numGroups;
+
+	numGroups = 0;
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++ ) {
+		numGroups += ( brush->numsides + 3 ) >> 2;
+	}
+
+	group = Hunk_Alloc( numGroups * sizeof( *group ), h_high );
+
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++ ) {
+		brush->planes = group;
+
+		for ( j = 0 ; j < ( ( brush->numsides + 3 ) & ~3 ) ; j++ ) {
+			lane = j & 3;
+			if ( j >= brush->numsides ) {
+				for ( k = 0 ; k < 3 ; k++ ) {
+					group->normal[k][lane] = 0;
+					group->signs[k][lane] = 0;
+				}
+				group->dist[lane] = 1e30f;
+			} else {
+				plane = brush->sides[j].plane;
+				for ( k = 0 ; k < 3 ; k++ ) {
+					group->normal[k][lane] = plane->normal[k];
+					group->signs[k][lane] = ( plane->signbits & ( 1 << k ) ) ? ~0 : 0;
+				}
+				group->dist[lane] = plane->dist;
+			}
+			if ( lane == 3 ) {
+				group++;
+			}
+		}
+	}
+#endif
+}
+
 /*
 =================
 CMod_LoadLeafs
@@ -606,7 +656,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile( name, (void **)&buf );
+	length = FS_ReadFileView( name, (const void **)&buf );
 #else
 	length = LoadQuakeFile((quakefile_t *) name, (void **)&buf);
 #endif
@@ -638,6 +688,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadPlanes (&header.lumps[LUMP_PLANES]);
 	CMod_LoadBrushSides (&header.lumps[LUMP_BRUSHSIDES]);
 	CMod_LoadBrushes (&header.lumps[LUMP_BRUSHES]);
+	CMod_PackBrushPlanes ();
 	CMod_LoadSubmodels (&header.lumps[LUMP_MODELS]);
 	CMod_LoadNodes (&header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
@@ -645,7 +696,11 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
 
 	// we are NOT freeing the file, because it is cached for the ref
+#ifndef BSPC
+	FS_FreeFileView (buf);
+#else
 	FS_FreeFile (buf);
+#endif
 
 	CM_InitBoxHull ();
 
@@ -56,12 +56,34 @@ typedef struct {
 	int			shaderNum;
 } cbrushside_t;
 
+// brush planes packed four at a time for the SSE2 kernels that skip
+// brushes a trace clearly misses.  -ffast-math would let the compiler
+// reorder the kernels, so they are built without it (CM_EXACT_MATH),
+// and where that can't be done they are left out.
+#if defined(__GNUC__) && !defined(__clang__)
+#define CM_EXACT_MATH	__attribute__((optimize("no-fast-math")))
+#else
+#define CM_EXACT_MATH
+#endif
+
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(_M_X64)) \
+	&& ( !defined(__FAST_MATH__) || ( defined(__GNUC__) && !defined(__clang__) ) )
+#define CM_SIMD_BRUSHES
+#endif
+
+typedef struct {
+	float		normal[3][4];	// x, y and z of four planes
+	float		dist[4];
+	int			signs[3][4];	// ~0 where the plane's signbit is set, picks the tw->offsets corner
+} cbrushPlanes_t;
+
 typedef struct {
 	int			shaderNum;		// the shader that determined the contents
 	int			contents;
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
+	cbrushPlanes_t	*planes;	// (numsides+3)/4 groups, NULL for the box brush
 	int			checkcount;		// to avoid repeated testings
 } cbrush_t;
 
@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#ifdef CM_SIMD_BRUSHES
+#include <emmintrin.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -156,6 +160,179 @@ POSITION TESTING
 ===============================================================================
 */
 
+#ifdef CM_SIMD_BRUSHES
+/*
+===============================================================================
+
+SSE2 BRUSH KERNELS
+
+Most brushes a trace reaches have a plane with the whole trace in front
+of it, and CM_TraceThroughBrush and CM_TestBoxInBrush return at that
+plane without touching the trace.  The kernels look for such a plane
+four at a time and skip the brush when they find one, anything else
+still goes through the scalar functions, which stay as they were.
+
+A plane only counts when it is further away than CM_REJECT_EPSILON.
+The scalar code is built with -ffast-math and may round differently
+from the kernels, which are CM_EXACT_MATH, but by far less than that
+at map coordinates, so both always agree on a skipped brush.
+
+===============================================================================
+*/
+
+#define	CM_REJECT_EPSILON	0.5f
+
+/*
+================
+CM_DotPlanes
+
+DotProduct( v, normal ) for four planes
+================
+*/
+static ID_INLINE CM_EXACT_MATH __m128 CM_DotPlanes( const cbrushPlanes_t *p, __m128 x, __m128 y, __m128 z ) {
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, _mm_loadu_ps( p->normal[0] ) ),
+		_mm_mul_ps( y, _mm_loadu_ps( p->normal[1] ) ) ),
+		_mm_mul_ps( z, _mm_loadu_ps( p->normal[2] ) ) );
+}
+
+/*
+================
+CM_SelectPlanes
+
+mask ? a : b per lane
+================
+*/
+static ID_INLINE CM_EXACT_MATH __m128 CM_SelectPlanes( __m128 mask, __m128 a, __m128 b ) {
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+/*
+================
+CM_BoxPlaneDists
+
+plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal )
+================
+*/
+static ID_INLINE CM_EXACT_MATH __m128 CM_BoxPlaneDists( const traceWork_t *tw, const cbrushPlanes_t *p ) {
+	__m128	ox, oy, oz;
+
+	ox = CM_SelectPlanes( _mm_loadu_ps( (const float *)p->signs[0] ), _mm_set1_ps( tw->size[1][0] ), _mm_set1_ps( tw->size[0][0] ) );
+	oy = CM_SelectPlanes( _mm_loadu_ps( (const float *)p->signs[1] ), _mm_set1_ps( tw->size[1][1] ), _mm_set1_ps( tw->size[0][1] ) );
+	oz = CM_SelectPlanes( _mm_loadu_ps( (const float *)p->signs[2] ), _mm_set1_ps( tw->size[1][2] ), _mm_set1_ps( tw->size[0][2] ) );
+
+	return _mm_sub_ps( _mm_loadu_ps( p->dist ), CM_DotPlanes( p, ox, oy, oz ) );
+}
+
+/*
+================
+CM_SpherePlaneDists
+
+Distances of the capsule point closest to each plane, d2 only if end is set
+================
+*/
+static ID_INLINE CM_EXACT_MATH void CM_SpherePlaneDists( const traceWork_t *tw, const cbrushPlanes_t *p, __m128 *d1, __m128 *d2, qboolean end ) {
+	__m128	dist, t, closer;
+	vec3_t	startm, startp, endm, endp;
+
+	// adjust the plane distance apropriately for radius
+	dist = _mm_add_ps( _mm_loadu_ps( p->dist ), _mm_set1_ps( tw->sphere.radius ) );
+
+	// find the closest point on the capsule to the plane
+	t = CM_DotPlanes( p, _mm_set1_ps( tw->sphere.offset[0] ), _mm_set1_ps( tw->sphere.offset[1] ), _mm_set1_ps( tw->sphere.offset[2] ) );
+	closer = _mm_cmpgt_ps( t, _mm_setzero_ps() );
+
+	VectorSubtract( tw->start, tw->sphere.offset, startm );
+	VectorAdd( tw->start, tw->sphere.offset, startp );
+	*d1 = _mm_sub_ps( CM_DotPlanes( p,
+		CM_SelectPlanes( closer, _mm_set1_ps( startm[0] ), _mm_set1_ps( startp[0] ) ),
+		CM_SelectPlanes( closer, _mm_set1_ps( startm[1] ), _mm_set1_ps( startp[1] ) ),
+		CM_SelectPlanes( closer, _mm_set1_ps( startm[2] ), _mm_set1_ps( startp[2] ) ) ), dist );
+
+	if ( !end ) {
+		return;
+	}
+
+	VectorSubtract( tw->end, tw->sphere.offset, endm );
+	VectorAdd( tw->end, tw->sphere.offset, endp );
+	*d2 = _mm_sub_ps( CM_DotPlanes( p,
+		CM_SelectPlanes( closer, _mm_set1_ps( endm[0] ), _mm_set1_ps( endp[0] ) ),
+		CM_SelectPlanes( closer, _mm_set1_ps( endm[1] ), _mm_set1_ps( endp[1] ) ),
+		CM_SelectPlanes( closer, _mm_set1_ps( endm[2] ), _mm_set1_ps( endp[2] ) ) ), dist );
+}
+
+/*
+================
+CM_BoxOutsideBrush
+
+qtrue if a plane other than the axial ones has the test position in
+front of it by more than CM_REJECT_EPSILON, CM_TestBoxInBrush then
+returns at that plane without touching the trace
+================
+*/
+static CM_EXACT_MATH qboolean CM_BoxOutsideBrush( traceWork_t *tw, cbrush_t *brush ) {
+	const cbrushPlanes_t	*p;
+	__m128		d1, dist;
+	int			i, front;
+
+	// the first six planes are the axial planes, lanes 0 and 1 of the
+	// second group are the last two of them
+	for ( i = 4, p = brush->planes + 1 ; i < brush->numsides ; i += 4, p++ ) {
+		if ( tw->sphere.use ) {
+			CM_SpherePlaneDists( tw, p, &d1, NULL, qfalse );
+		} else {
+			dist = CM_BoxPlaneDists( tw, p );
+			d1 = _mm_sub_ps( CM_DotPlanes( p, _mm_set1_ps( tw->start[0] ), _mm_set1_ps( tw->start[1] ), _mm_set1_ps( tw->start[2] ) ), dist );
+		}
+
+		front = _mm_movemask_ps( _mm_cmpgt_ps( d1, _mm_set1_ps( CM_REJECT_EPSILON ) ) );
+		if ( i == 4 ) {
+			front &= ~3;
+		}
+		if ( front ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+/*
+================
+CM_TraceMissesBrush
+
+qtrue if a plane has the whole trace in front of it by more than
+CM_REJECT_EPSILON, CM_TraceThroughBrush then returns at that plane
+without touching the trace
+================
+*/
+static CM_EXACT_MATH qboolean CM_TraceMissesBrush( traceWork_t *tw, cbrush_t *brush ) {
+	const cbrushPlanes_t	*p;
+	__m128		d1, d2, dist, margin;
+	int			i;
+
+	margin = _mm_set1_ps( CM_REJECT_EPSILON );
+
+	for ( i = 0, p = brush->planes ; i < brush->numsides ; i += 4, p++ ) {
+		if ( tw->sphere.use ) {
+			CM_SpherePlaneDists( tw, p, &d1, &d2, qtrue );
+		} else {
+			dist = CM_BoxPlaneDists( tw, p );
+			d1 = _mm_sub_ps( CM_DotPlanes( p, _mm_set1_ps( tw->start[0] ), _mm_set1_ps( tw->start[1] ), _mm_set1_ps( tw->start[2] ) ), dist );
+			d2 = _mm_sub_ps( CM_DotPlanes( p, _mm_set1_ps( tw->end[0] ), _mm_set1_ps( tw->end[1] ), _mm_set1_ps( tw->end[2] ) ), dist );
+		}
+
+		// d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 ), with room to spare
+		if ( _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( d1, margin ),
+			_mm_or_ps( _mm_cmpge_ps( d2, _mm_set1_ps( SURFACE_CLIP_EPSILON + CM_REJECT_EPSILON ) ),
+				_mm_cmpge_ps( d2, _mm_add_ps( d1, margin ) ) ) ) ) ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+#endif
+
 /*
 ================
 CM_TestBoxInBrush
@@ -261,6 +438,12 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 			continue;
 		}
 		
+#ifdef CM_SIMD_BRUSHES
+		if ( b->planes && CM_BoxOutsideBrush( tw, b ) ) {
+			continue;
+		}
+#endif
+
 		CM_TestBoxInBrush( tw, b );
 		if ( tw->trace.allsolid ) {
 			return;
@@ -690,6 +873,13 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 			continue;
 		}
 
+#ifdef CM_SIMD_BRUSHES
+		if ( b->planes && CM_TraceMissesBrush( tw, b ) ) {
+			c_brush_traces++;
+			continue;
+		}
+#endif
+
 		CM_TraceThroughBrush( tw, b );
 		if ( !tw->trace.fraction ) {
 			return;
@@ -288,6 +288,10 @@ void QDECL Com_Error( int code, const char *fmt, ... ) {
 	if (code != ERR_DISCONNECT && code != ERR_NEED_CD)
 		Cvar_Set("com_errorMessage", com_errorMessage);
 
+	// the error may have come from inside a packet batch, send what was
+	// queued and stop batching before the longjmp skips the flush
+	Sys_FlushPacketBatch();
+
 	if (code == ERR_DISCONNECT || code == ERR_SERVERDISCONNECT) {
 		CL_Disconnect( qtrue );
 		CL_FlushMemory( );
@@ -730,12 +734,25 @@ The rover can be left pointing at a non-empty block
 
 The zone calls are pretty much only used for small strings and structures,
 all big things are allocated on the hunk.
+
+Blocks of up to ZONE_CLASS_MAX bytes come in a few size classes.  A freed
+one stays a zone block, tagged TAG_POOLED, on a free list of its class:
+first in a list private to the thread that freed it, then in the zone's
+shared pool when that list grows past ZONE_CACHE_MAX.  Allocating it again
+is a pop off the thread's list, so small allocations and frees don't take
+the zone lock or walk the block list.  A thread's lists go to the shared
+pools when it exits.  The pools are only given back to the block list
+when the zone runs out.
 ==============================================================================
 */
 
 #define	ZONEID	0x1d4a11
 #define MINFRAGMENT	64
 
+#define	ZONE_CLASSES		14
+#define	ZONE_CLASS_MAX		512			// largest pooled block, header included
+#define	ZONE_CACHE_MAX		32			// blocks a thread keeps per class
+
 typedef struct zonedebug_s {
 	char *label;
 	char *file;
@@ -753,11 +770,21 @@ typedef struct memblock_s {
 #endif
 } memblock_t;
 
+// next pooled block of the same class, kept in the data
+#define	POOL_NEXT( block )	( *(memblock_t **)( (block) + 1 ) )
+
+typedef struct {
+	memblock_t	*blocks;
+	int			count;
+} zonePool_t;
+
 typedef struct {
 	int		size;			// total bytes malloced, including header
-	int		used;			// total bytes used
+	int		used;			// total bytes used, pooled blocks included
+	int		pooled;			// bytes in pools
 	memblock_t	blocklist;	// start / end cap for linked list
 	memblock_t	*rover;
+	zonePool_t	pools[ZONE_CLASSES];
 } memzone_t;
 
 // main zone for all "dynamic" memory allocation
@@ -766,8 +793,64 @@ memzone_t	*mainzone;
 // fragment the main zone (think of cvar and cmd strings)
 memzone_t	*smallzone;
 
+static const int	zoneClassSize[ZONE_CLASSES] = {
+	48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512
+};
+
+// by size / 8, the smallest class a block fits in and the largest a
+// freed block can serve
+static byte		zoneClassFit[ZONE_CLASS_MAX / 8 + 1];
+static byte		zoneClassFloor[ZONE_CLASS_MAX / 8 + 1];
+
+static qboolean	zonePools = qtrue;		// cleared by zonebench
+
+#ifndef _WIN32
+#include <pthread.h>
+
+static pthread_mutex_t	zoneMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define	Z_Lock()		pthread_mutex_lock( &zoneMutex )
+#define	Z_Unlock()		pthread_mutex_unlock( &zoneMutex )
+
+// the pools of the thread, [0] for the main zone and [1] for the small one
+static __thread zonePool_t	zoneCache[2][ZONE_CLASSES];
+static __thread qboolean	zoneCacheKept;		// zoneCacheKey set for this thread
+
+static pthread_key_t		zoneCacheKey;		// returns the pools at thread exit
+static pthread_once_t		zoneCacheOnce = PTHREAD_ONCE_INIT;
+#else
+// no other threads allocate
+#define	Z_Lock()
+#define	Z_Unlock()
+#define	Z_KeepCache()
+
+static zonePool_t	zoneCache[2][ZONE_CLASSES];
+#endif
+
 void Z_CheckHeap( void );
 
+/*
+========================
+Z_InitClasses
+========================
+*/
+static void Z_InitClasses( void ) {
+	int		i, c;
+
+	for ( i = 0, c = 0 ; i <= ZONE_CLASS_MAX / 8 ; i++ ) {
+		while ( zoneClassSize[c] < i * 8 ) {
+			c++;
+		}
+		zoneClassFit[i] = c;
+	}
+	for ( i = 0, c = 0 ; i <= ZONE_CLASS_MAX / 8 ; i++ ) {
+		while ( c < ZONE_CLASSES - 1 && zoneClassSize[c + 1] <= i * 8 ) {
+			c++;
+		}
+		zoneClassFloor[i] = c;
+	}
+}
+
 /*
 ========================
 Z_ClearZone
@@ -786,20 +869,26 @@ void Z_ClearZone( memzone_t *zone, int size ) {
 	zone->rover = block;
 	zone->size = size;
 	zone->used = 0;
+	zone->pooled = 0;
+	Com_Memset( zone->pools, 0, sizeof( zone->pools ) );
 	
 	block->prev = block->next = &zone->blocklist;
 	block->tag = 0;			// free block
 	block->id = ZONEID;
 	block->size = size - sizeof(memzone_t);
+
+	Z_InitClasses();
 }
 
 /*
 ========================
 Z_AvailableZoneMemory
+
+Blocks in the threads' own pools count as used
 ========================
 */
 int Z_AvailableZoneMemory( memzone_t *zone ) {
-	return zone->size - zone->used;
+	return zone->size - zone->used + zone->pooled;
 }
 
 /*
@@ -811,14 +900,174 @@ int Z_AvailableMemory( void ) {
 	return Z_AvailableZoneMemory( mainzone );
 }
 
+/*
+========================
+Z_ZoneForBlock
+========================
+*/
+static memzone_t *Z_ZoneForBlock( memblock_t *block ) {
+	if ( (byte *)block > (byte *)smallzone && (byte *)block < (byte *)smallzone + smallzone->size ) {
+		return smallzone;
+	}
+	return mainzone;
+}
+
+/*
+========================
+Z_FreeBlock
+
+Puts the block back in the block list, with the lock held
+========================
+*/
+static void Z_FreeBlock( memzone_t *zone, memblock_t *block ) {
+	memblock_t	*other;
+
+	zone->used -= block->size;
+
+	block->tag = 0;		// mark as free
+	
+	other = block->prev;
+	if (!other->tag) {
+		// merge with previous free block
+		other->size += block->size;
+		other->next = block->next;
+		other->next->prev = other;
+		if (block == zone->rover) {
+			zone->rover = other;
+		}
+		block = other;
+	}
+
+	zone->rover = block;
+
+	other = block->next;
+	if ( !other->tag ) {
+		// merge the next free block onto the end
+		block->size += other->size;
+		block->next = other->next;
+		block->next->prev = block;
+		if (other == zone->rover) {
+			zone->rover = block;
+		}
+	}
+}
+
+/*
+========================
+Z_PoolBlock
+
+Adds a freed block to the zone's pool, with the lock held
+========================
+*/
+static void Z_PoolBlock( memzone_t *zone, memblock_t *block ) {
+	zonePool_t	*pool;
+
+	pool = &zone->pools[ zoneClassFloor[ block->size >> 3 ] ];
+	block->tag = TAG_POOLED;
+	POOL_NEXT( block ) = pool->blocks;
+	pool->blocks = block;
+	pool->count++;
+	zone->pooled += block->size;
+}
+
+#ifndef _WIN32
+/*
+========================
+Z_ReturnCache
+
+Thread exit, moves the thread's pools to the zones' shared ones
+========================
+*/
+static void Z_ReturnCache( void *data ) {
+	zonePool_t	(*cache)[ZONE_CLASSES] = data;
+	zonePool_t	*pool;
+	memblock_t	*block;
+	int			z, c;
+
+	Z_Lock();
+	for ( z = 0 ; z < 2 ; z++ ) {
+		for ( c = 0 ; c < ZONE_CLASSES ; c++ ) {
+			pool = &cache[z][c];
+			while ( pool->blocks ) {
+				block = pool->blocks;
+				pool->blocks = POOL_NEXT( block );
+				Z_PoolBlock( z ? smallzone : mainzone, block );
+			}
+			pool->count = 0;
+		}
+	}
+	Z_Unlock();
+}
+
+/*
+========================
+Z_CreateCacheKey
+========================
+*/
+static void Z_CreateCacheKey( void ) {
+	pthread_key_create( &zoneCacheKey, Z_ReturnCache );
+}
+
+/*
+========================
+Z_KeepCache
+
+Before the thread first keeps a block, so it's handed back at exit
+========================
+*/
+static void Z_KeepCache( void ) {
+	if ( !zoneCacheKept ) {
+		pthread_once( &zoneCacheOnce, Z_CreateCacheKey );
+		pthread_setspecific( zoneCacheKey, zoneCache );
+		zoneCacheKept = qtrue;
+	}
+}
+#endif
+
+/*
+========================
+Z_FlushPools
+
+Gives the pooled blocks of the zone, and of this thread, back to the
+block list, with the lock held.  Other threads' pools are theirs until
+they exit.
+========================
+*/
+static void Z_FlushPools( memzone_t *zone ) {
+	zonePool_t	*pool;
+	memblock_t	*block;
+	int			c;
+
+	for ( c = 0 ; c < ZONE_CLASSES ; c++ ) {
+		pool = &zone->pools[c];
+		while ( pool->blocks ) {
+			block = pool->blocks;
+			pool->blocks = POOL_NEXT( block );
+			Z_FreeBlock( zone, block );
+		}
+		pool->count = 0;
+
+		pool = &zoneCache[ zone == smallzone ][c];
+		while ( pool->blocks ) {
+			block = pool->blocks;
+			pool->blocks = POOL_NEXT( block );
+			Z_FreeBlock( zone, block );
+		}
+		pool->count = 0;
+	}
+	zone->pooled = 0;
+}
+
 /*
 ========================
 Z_Free
 ========================
 */
 void Z_Free( void *ptr ) {
-	memblock_t	*block, *other;
-	memzone_t *zone;
+	memblock_t	*block;
+	memzone_t	*zone;
+	zonePool_t	*cache;
+	int			c;
 	
 	if (!ptr) {
 		Com_Error( ERR_DROP, "Z_Free: NULL pointer" );
@@ -828,7 +1077,7 @@ void Z_Free( void *ptr ) {
 	if (block->id != ZONEID) {
 		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
 	}
-	if (block->tag == 0) {
+	if (block->tag == 0 || block->tag == TAG_POOLED) {
 		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
 	}
 	// if static memory
@@ -841,43 +1090,38 @@ void Z_Free( void *ptr ) {
 		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
 	}
 
-	if (block->tag == TAG_SMALL) {
-		zone = smallzone;
-	}
-	else {
-		zone = mainzone;
-	}
+	zone = Z_ZoneForBlock( block );
 
-	zone->used -= block->size;
 	// set the block to something that should cause problems
 	// if it is referenced...
 	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
 
-	block->tag = 0;		// mark as free
-	
-	other = block->prev;
-	if (!other->tag) {
-		// merge with previous free block
-		other->size += block->size;
-		other->next = block->next;
-		other->next->prev = other;
-		if (block == zone->rover) {
-			zone->rover = other;
-		}
-		block = other;
+	if ( !zonePools || block->size < zoneClassSize[0] || block->size > ZONE_CLASS_MAX ) {
+		Z_Lock();
+		Z_FreeBlock( zone, block );
+		Z_Unlock();
+		return;
 	}
 
-	zone->rover = block;
+	// keep it for this thread
+	Z_KeepCache();
+	c = zoneClassFloor[ block->size >> 3 ];
+	cache = &zoneCache[ zone == smallzone ][c];
+	block->tag = TAG_POOLED;
+	POOL_NEXT( block ) = cache->blocks;
+	cache->blocks = block;
+	cache->count++;
 
-	other = block->next;
-	if ( !other->tag ) {
-		// merge the next free block onto the end
-		block->size += other->size;
-		block->next = other->next;
-		block->next->prev = block;
-		if (other == zone->rover) {
-			zone->rover = block;
+	if ( cache->count > ZONE_CACHE_MAX ) {
+		// hand half of them to the other threads
+		Z_Lock();
+		while ( cache->count > ZONE_CACHE_MAX / 2 ) {
+			block = cache->blocks;
+			cache->blocks = POOL_NEXT( block );
+			cache->count--;
+			Z_PoolBlock( zone, block );
 		}
+		Z_Unlock();
 	}
 }
 
@@ -888,8 +1132,8 @@ Z_FreeTags
 ================
 */
 void Z_FreeTags( int tag ) {
-	int			count;
 	memzone_t	*zone;
+	memblock_t	*block;
 
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
@@ -897,65 +1141,47 @@ void Z_FreeTags( int tag ) {
 	else {
 		zone = mainzone;
 	}
-	count = 0;
+
+	Z_Lock();
 	// use the rover as our pointer, because
-	// Z_Free automatically adjusts it
+	// Z_FreeBlock automatically adjusts it
 	zone->rover = zone->blocklist.next;
 	do {
 		if ( zone->rover->tag == tag ) {
-			count++;
-			Z_Free( (void *)(zone->rover + 1) );
+			block = zone->rover;
+			Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
+			if ( zonePools && block->size >= zoneClassSize[0] && block->size <= ZONE_CLASS_MAX ) {
+				Z_PoolBlock( zone, block );
+				zone->rover = block->next;
+			} else {
+				Z_FreeBlock( zone, block );
+			}
 			continue;
 		}
 		zone->rover = zone->rover->next;
 	} while ( zone->rover != &zone->blocklist );
+	Z_Unlock();
 }
 
-
 /*
 ================
-Z_TagMalloc
+Z_CarveBlock
+
+First fit from the block list, with the lock held.  NULL when there is
+no free block big enough.  Leftovers of at least minFragment bytes are
+split off.
 ================
 */
-#ifdef ZONE_DEBUG
-void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
-#else
-void *Z_TagMalloc( int size, int tag ) {
-#endif
+static memblock_t *Z_CarveBlock( memzone_t *zone, int size, int minFragment ) {
 	int		extra;
 	memblock_t	*start, *rover, *new, *base;
-	memzone_t *zone;
-
-	if (!tag) {
-		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
-	}
-
-	if ( tag == TAG_SMALL ) {
-		zone = smallzone;
-	}
-	else {
-		zone = mainzone;
-	}
 
-	//
-	// scan through the block list looking for the first free block
-	// of sufficient size
-	//
-	size += sizeof(memblock_t);	// account for size of block header
-	size += 4;					// space for memory trash tester
-	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
-	
 	base = rover = zone->rover;
 	start = base->prev;
 	
 	do {
 		if (rover == start)	{
-#ifdef ZONE_DEBUG
-			Z_LogHeap();
-#endif
 			// scaned all the way around the list
-			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-								size, zone == smallzone ? "small" : "main");
 			return NULL;
 		}
 		if (rover->tag) {
@@ -969,7 +1195,7 @@ void *Z_TagMalloc( int size, int tag ) {
 	// found a block big enough
 	//
 	extra = base->size - size;
-	if (extra > MINFRAGMENT) {
+	if (extra > minFragment) {
 		// there will be a free fragment after the allocated block
 		new = (memblock_t *) ((byte *)base + size );
 		new->size = extra;
@@ -982,13 +1208,107 @@ void *Z_TagMalloc( int size, int tag ) {
 		base->size = size;
 	}
 	
-	base->tag = tag;			// no longer a free block
+	base->tag = TAG_POOLED;		// no longer a free block
 	
 	zone->rover = base->next;	// next allocation will start looking here
 	zone->used += base->size;	//
 	
 	base->id = ZONEID;
 
+	return base;
+}
+
+/*
+================
+Z_AllocBlock
+
+Takes a block from the block list, giving the pools back first if it's full
+================
+*/
+static memblock_t *Z_AllocBlock( memzone_t *zone, int size, int minFragment ) {
+	memblock_t	*base;
+
+	Z_Lock();
+	base = Z_CarveBlock( zone, size, minFragment );
+	if ( !base ) {
+		Z_FlushPools( zone );
+		base = Z_CarveBlock( zone, size, minFragment );
+	}
+	Z_Unlock();
+
+	if ( !base ) {
+#ifdef ZONE_DEBUG
+		Z_LogHeap();
+#endif
+		Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+							size, zone == smallzone ? "small" : "main");
+	}
+	return base;
+}
+
+/*
+================
+Z_TagMalloc
+================
+*/
+#ifdef ZONE_DEBUG
+void *Z_TagMallocDebug( int size, int tag, char *label, char *file, int line ) {
+#else
+void *Z_TagMalloc( int size, int tag ) {
+#endif
+	memblock_t	*base;
+	memzone_t *zone;
+	zonePool_t	*cache, *pool;
+	int			c;
+
+	if (!tag) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use a 0 tag" );
+	}
+
+	if ( tag == TAG_SMALL ) {
+		zone = smallzone;
+	}
+	else {
+		zone = mainzone;
+	}
+
+	size += sizeof(memblock_t);	// account for size of block header
+	size += 4;					// space for memory trash tester
+	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
+
+	if ( !zonePools || size > ZONE_CLASS_MAX ) {
+		base = Z_AllocBlock( zone, size, MINFRAGMENT );
+	} else {
+		c = zoneClassFit[ ( size + 7 ) >> 3 ];
+		cache = &zoneCache[ zone == smallzone ][c];
+		if ( !cache->blocks ) {
+			// take some from the other threads
+			Z_KeepCache();
+			pool = &zone->pools[c];
+			Z_Lock();
+			while ( pool->blocks && cache->count < ZONE_CACHE_MAX / 2 ) {
+				base = pool->blocks;
+				pool->blocks = POOL_NEXT( base );
+				pool->count--;
+				zone->pooled -= base->size;
+				POOL_NEXT( base ) = cache->blocks;
+				cache->blocks = base;
+				cache->count++;
+			}
+			Z_Unlock();
+		}
+		if ( cache->blocks ) {
+			base = cache->blocks;
+			cache->blocks = POOL_NEXT( base );
+			cache->count--;
+		} else {
+			// split off all it can so the block goes back to this class
+			base = Z_AllocBlock( zone, zoneClassSize[c], sizeof( memblock_t ) + sizeof( intptr_t ) );
+		}
+	}
+
+	base->tag = tag;			// no longer a free block
+
 #ifdef ZONE_DEBUG
 	base->d.label = label;
 	base->d.file = file;
@@ -1242,25 +1562,62 @@ static	int		s_smallZoneTotal;
 /*
 =================
 Com_Meminfo_f
+
+Everything is copied out under the zone lock and printed after it,
+Com_Printf may allocate
 =================
 */
+typedef struct {
+	void	*block;
+	int		size;
+	int		tag;
+} meminfoBlock_t;
+
 void Com_Meminfo_f( void ) {
 	memblock_t	*block;
 	int			zoneBytes, zoneBlocks;
 	int			smallZoneBytes, smallZoneBlocks;
 	int			botlibBytes, rendererBytes;
+	int			pooledBytes;
 	int			unused;
+	int			badSizes, badLinks, freePairs;
+	meminfoBlock_t	*list;
+	int			i, listed, maxListed;
+
+	// the listing is sized under one lock and filled under the next,
+	// with some room for blocks split in between
+	list = NULL;
+	listed = 0;
+	maxListed = 0;
+	if ( Cmd_Argc() != 1 ) {
+		Z_Lock();
+		for ( block = mainzone->blocklist.next ; block != &mainzone->blocklist ; block = block->next ) {
+			maxListed++;
+		}
+		Z_Unlock();
+		maxListed += 256;
+		list = Hunk_AllocateTempMemory( maxListed * sizeof( *list ) );
+	}
 
 	zoneBytes = 0;
 	botlibBytes = 0;
 	rendererBytes = 0;
+	pooledBytes = 0;
 	zoneBlocks = 0;
+	badSizes = 0;
+	badLinks = 0;
+	freePairs = 0;
+	Z_Lock();
 	for (block = mainzone->blocklist.next ; ; block = block->next) {
-		if ( Cmd_Argc() != 1 ) {
-			Com_Printf ("block:%p    size:%7i    tag:%3i\n",
-				(void *)block, block->size, block->tag);
-		}
-		if ( block->tag ) {
+		if ( list && listed < maxListed ) {
+			list[listed].block = block;
+			list[listed].size = block->size;
+			list[listed].tag = block->tag;
+			listed++;
+		}
+		if ( block->tag == TAG_POOLED ) {
+			pooledBytes += block->size;
+		} else if ( block->tag ) {
 			zoneBytes += block->size;
 			zoneBlocks++;
 			if ( block->tag == TAG_BOTLIB ) {
@@ -1274,20 +1631,22 @@ void Com_Meminfo_f( void ) {
 			break;			// all blocks have been hit	
 		}
 		if ( (byte *)block + block->size != (byte *)block->next) {
-			Com_Printf ("ERROR: block size does not touch the next block\n");
+			badSizes++;
 		}
 		if ( block->next->prev != block) {
-			Com_Printf ("ERROR: next block doesn't have proper back link\n");
+			badLinks++;
 		}
 		if ( !block->tag && !block->next->tag ) {
-			Com_Printf ("ERROR: two consecutive free blocks\n");
+			freePairs++;
 		}
 	}
 
 	smallZoneBytes = 0;
 	smallZoneBlocks = 0;
 	for (block = smallzone->blocklist.next ; ; block = block->next) {
-		if ( block->tag ) {
+		if ( block->tag == TAG_POOLED ) {
+			pooledBytes += block->size;
+		} else if ( block->tag ) {
 			smallZoneBytes += block->size;
 			smallZoneBlocks++;
 		}
@@ -1296,6 +1655,24 @@ void Com_Meminfo_f( void ) {
 			break;			// all blocks have been hit	
 		}
 	}
+	Z_Unlock();
+
+	for ( i = 0 ; i < listed ; i++ ) {
+		Com_Printf ("block:%p    size:%7i    tag:%3i\n",
+			list[i].block, list[i].size, list[i].tag);
+	}
+	if ( list ) {
+		Hunk_FreeTempMemory( list );
+	}
+	if ( badSizes ) {
+		Com_Printf ("ERROR: block size does not touch the next block (%i times)\n", badSizes);
+	}
+	if ( badLinks ) {
+		Com_Printf ("ERROR: next block doesn't have proper back link (%i times)\n", badLinks);
+	}
+	if ( freePairs ) {
+		Com_Printf ("ERROR: two consecutive free blocks (%i times)\n", freePairs);
+	}
 
 	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
 	Com_Printf( "%8i bytes total zone\n", s_zoneTotal );
@@ -1329,6 +1706,102 @@ void Com_Meminfo_f( void ) {
 	Com_Printf( "        %8i bytes in dynamic renderer\n", rendererBytes );
 	Com_Printf( "        %8i bytes in dynamic other\n", zoneBytes - ( botlibBytes + rendererBytes ) );
 	Com_Printf( "        %8i bytes in small Zone memory\n", smallZoneBytes );
+	Com_Printf( "%8i bytes cached in zone size classes\n", pooledBytes );
+}
+
+/*
+=================
+Com_ZoneBenchRun
+
+Allocates and frees a mix of sizes in the main zone like a level of
+entity strings, model names and scoreboard buffers would
+=================
+*/
+#define	ZONEBENCH_SLOTS		4096
+
+static void Com_ZoneBenchRun( int ops, qboolean pools ) {
+	static void	*slots[ZONEBENCH_SLOTS];
+	memblock_t	*block;
+	int64_t		start, usec;
+	int			i, slot, size, r;
+	int			freeBlocks, freeBytes, largest, pooledBytes;
+	unsigned	seed;
+
+	zonePools = pools;
+	Com_Memset( slots, 0, sizeof( slots ) );
+	seed = 0x5eed;
+
+	start = Sys_Microseconds();
+	for ( i = 0 ; i < ops ; i++ ) {
+		seed = seed * 1664525 + 1013904223;
+		slot = ( seed >> 8 ) & ( ZONEBENCH_SLOTS - 1 );
+		if ( slots[slot] ) {
+			Z_Free( slots[slot] );
+			slots[slot] = NULL;
+			continue;
+		}
+		seed = seed * 1664525 + 1013904223;
+		r = ( seed >> 8 ) % 100;
+		seed = seed * 1664525 + 1013904223;
+		if ( r < 70 ) {
+			size = 8 + ( seed >> 8 ) % 56;
+		} else if ( r < 95 ) {
+			size = 64 + ( seed >> 8 ) % 448;
+		} else {
+			size = 512 + ( seed >> 8 ) % 7680;
+		}
+		slots[slot] = Z_TagMalloc( size, TAG_GENERAL );
+	}
+	usec = Sys_Microseconds() - start;
+
+	freeBlocks = freeBytes = largest = pooledBytes = 0;
+	Z_Lock();
+	for ( block = mainzone->blocklist.next ; block != &mainzone->blocklist ; block = block->next ) {
+		if ( block->tag == TAG_POOLED ) {
+			pooledBytes += block->size;
+		} else if ( !block->tag ) {
+			freeBlocks++;
+			freeBytes += block->size;
+			if ( block->size > largest ) {
+				largest = block->size;
+			}
+		}
+	}
+	Z_Unlock();
+
+	Com_Printf( "%-12s %7.3f %8i %10i %7.1f%% %10i\n", pools ? "size classes" : "first fit",
+		(double)usec / ops, freeBlocks, largest,
+		freeBytes ? 100.0 * ( freeBytes - largest ) / freeBytes : 0.0, pooledBytes );
+
+	for ( i = 0 ; i < ZONEBENCH_SLOTS ; i++ ) {
+		if ( slots[i] ) {
+			Z_Free( slots[i] );
+		}
+	}
+	Z_Lock();
+	Z_FlushPools( mainzone );
+	Z_Unlock();
+}
+
+/*
+=================
+Com_ZoneBench_f
+
+"zonebench [ops]", times the zone with and without the size classes
+=================
+*/
+static void Com_ZoneBench_f( void ) {
+	int		ops;
+
+	ops = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 1000000;
+	if ( ops <= 0 ) {
+		Com_Printf( "usage: zonebench [ops]\n" );
+		return;
+	}
+
+	Com_Printf( "allocator    usec/op   free blocks  largest    frag     pooled\n" );
+	Com_ZoneBenchRun( ops, qfalse );
+	Com_ZoneBenchRun( ops, qtrue );
 }
 
 /*
@@ -1549,6 +2022,7 @@ void Com_InitHunkMemory( void ) {
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "zonebench", Com_ZoneBench_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -2024,7 +2498,7 @@ void Com_PushEvent( sysEvent_t *event ) {
 		}
 
 		if ( ev->evPtr ) {
-			Z_Free( ev->evPtr );
+			Com_FreeEventPtr( ev->evPtr );
 		}
 		com_pushedEventsTail++;
 	} else {
@@ -2073,6 +2547,46 @@ void Com_RunAndTimeServerPacket( netadr_t *evFrom, msg_t *buf ) {
 	}
 }
 
+// evPtr blocks of the events being handled, Com_EventLoop nests when
+// the client loads a map while parsing a packet
+#define	MAX_EVENT_NESTING	8
+
+static void	*com_eventPtrs[MAX_EVENT_NESTING];
+static int	com_eventDepth;
+
+/*
+=================
+Com_FreeEventPtr
+
+Gives back the evPtr block of a handled or discarded event
+=================
+*/
+void Com_FreeEventPtr( void *ptr ) {
+	if ( NET_IsRingPacket( ptr ) ) {
+		NET_ReleasePacket( (netPacket_t *)ptr );
+	} else {
+		Z_Free( ptr );
+	}
+}
+
+/*
+=================
+Com_FreeAbortedEvents
+
+An error longjmp skips freeing the blocks of the events being handled,
+which would keep packet ring slots busy for good
+=================
+*/
+static void Com_FreeAbortedEvents( void ) {
+	while ( com_eventDepth > 0 ) {
+		com_eventDepth--;
+		if ( com_eventPtrs[com_eventDepth] ) {
+			Com_FreeEventPtr( com_eventPtrs[com_eventDepth] );
+			com_eventPtrs[com_eventDepth] = NULL;
+		}
+	}
+}
+
 /*
 =================
 Com_EventLoop
@@ -2085,9 +2599,16 @@ int Com_EventLoop( void ) {
 	netadr_t	evFrom;
 	byte		bufData[MAX_MSGLEN];
 	msg_t		buf;
+	msg_t		packet;
+	int			depth;
 
 	MSG_Init( &buf, bufData, sizeof( bufData ) );
 
+	if ( com_eventDepth == MAX_EVENT_NESTING ) {
+		Com_Error( ERR_FATAL, "Com_EventLoop: nested too deep" );
+	}
+	depth = com_eventDepth++;
+
 	while ( 1 ) {
 		NET_FlushPacketQueue();
 		ev = Com_GetEvent();
@@ -2106,10 +2627,13 @@ int Com_EventLoop( void ) {
 				}
 			}
 
+			com_eventDepth--;
 			return ev.evTime;
 		}
 
 
+		com_eventPtrs[depth] = ev.evPtr;
+
 		switch ( ev.evType ) {
 		default:
 		  // bk001129 - was ev.evTime
@@ -2146,29 +2670,37 @@ int Com_EventLoop( void ) {
 			}
 
 			evFrom = *(netadr_t *)ev.evPtr;
-			buf.cursize = ev.evPtrLength - sizeof( evFrom );
-
-			// we must copy the contents of the message out, because
-			// the event buffers are only large enough to hold the
-			// exact payload, but channel messages need to be large
-			// enough to hold fragment reassembly
-			if ( (unsigned)buf.cursize > buf.maxsize ) {
-				Com_Printf("Com_EventLoop: oversize packet\n");
-				continue;
+			if ( NET_IsRingPacket( ev.evPtr ) ) {
+				// ring slots are as big as a message, so the channel
+				// can reassemble fragments in place
+				MSG_Init( &packet, ((netPacket_t *)ev.evPtr)->data, MAX_MSGLEN );
+				packet.cursize = ev.evPtrLength - sizeof( evFrom );
+			} else {
+				// we must copy the contents of the message out, because
+				// the journal buffers are only large enough to hold the
+				// exact payload, but channel messages need to be large
+				// enough to hold fragment reassembly
+				packet = buf;
+				packet.cursize = ev.evPtrLength - sizeof( evFrom );
+				if ( (unsigned)packet.cursize > packet.maxsize ) {
+					Com_Printf("Com_EventLoop: oversize packet\n");
+					break;
+				}
+				Com_Memcpy( packet.data, (byte *)((netadr_t *)ev.evPtr + 1), packet.cursize );
 			}
-			Com_Memcpy( buf.data, (byte *)((netadr_t *)ev.evPtr + 1), buf.cursize );
 			if ( com_sv_running->integer ) {
-				Com_RunAndTimeServerPacket( &evFrom, &buf );
+				Com_RunAndTimeServerPacket( &evFrom, &packet );
 			} else {
-				CL_PacketEvent( evFrom, &buf );
+				CL_PacketEvent( evFrom, &packet );
 			}
 			break;
 		}
 
 		// free any block data
 		if ( ev.evPtr ) {
-			Z_Free( ev.evPtr );
+			Com_FreeEventPtr( ev.evPtr );
 		}
+		com_eventPtrs[depth] = NULL;
 	}
 
 	return 0;	// never reached
@@ -2509,12 +3041,15 @@ void Com_Init( char *commandLine ) {
 	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand ("huffbench", MSG_HuffBench_f );
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 
 	s = va("%s %s %s", Q3_VERSION, PLATFORM_STRING, __DATE__ );
 	com_version = Cvar_Get ("version", s, CVAR_ROM | CVAR_SERVERINFO );
 
 	Sys_Init();
+	Com_InitJobs();
+	Com_InitProfile();
 	Netchan_Init( Com_Milliseconds() & 0xffff );	// pick a port value that should be nice and random
 	VM_Init();
 	SV_Init();
@@ -2702,12 +3237,14 @@ void Com_Frame( void ) {
 	int           timeBeforeEvents;
 	int           timeBeforeClient;
 	int           timeAfter;
+	int64_t       profStart;
   
 
 
 
 
 	if ( setjmp (abortframe) ) {
+		Com_FreeAbortedEvents();
 		return;			// an ERR_DROP was thrown
 	}
 
@@ -2748,7 +3285,9 @@ void Com_Frame( void ) {
 		minMsec = 1;
 	}
 	do {
+		profStart = Com_ProfileStart();
 		com_frameTime = Com_EventLoop();
+		Com_ProfileStop( PROF_EVENTS, profStart );
 		if ( lastTime > com_frameTime ) {
 			lastTime = com_frameTime;		// possible on first frame
 		}
@@ -2856,6 +3395,8 @@ void Com_Frame( void ) {
 		c_pointcontents = 0;
 	}
 
+	Com_ProfileFrame();
+
 	// old net chan encryption key
 	// key = lastTime * 0x87243987;
 
@@ -2868,6 +3409,8 @@ Com_Shutdown
 =================
 */
 void Com_Shutdown (void) {
+	Com_ShutdownJobs();
+
 	if (logfile) {
 		FS_FCloseFile (logfile);
 		logfile = 0;
@@ -0,0 +1,316 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// deflate.c -- a small raw deflate compressor
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+=============================================================================
+
+Com_Deflate packs a buffer into one raw deflate stream (RFC 1951, no
+zlib header) that puff() and any inflater unpack.  Matches are found
+greedily through hash chains over the last DEFLATE_WINDOW bytes and
+coded with the fixed Huffman codes, so there are no code tables to
+build or send.  Data that doesn't shrink is sent in stored blocks,
+which never grow it by more than DEFLATE_BOUND allows.
+
+All state is in the caller's deflateWork_t, so threads can compress at
+the same time with a work area each.
+
+=============================================================================
+*/
+
+#define	DEFLATE_MIN_MATCH	3
+#define	DEFLATE_MAX_MATCH	258
+#define	DEFLATE_CHAIN		32			// candidates tried per position
+#define	DEFLATE_NICE_MATCH	64			// stop looking once one is this long
+#define	DEFLATE_STORED_MAX	65535
+
+static const short deflateLengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const byte deflateLengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const short deflateDistBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const byte deflateDistExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+typedef struct {
+	byte			*out;
+	int				size;
+	int				length;			// whole bytes written
+	unsigned int	bits;			// not yet written, lsb first
+	int				numBits;
+	qboolean		overflowed;
+} deflateOut_t;
+
+/*
+=================
+Deflate_PutBits
+=================
+*/
+static void Deflate_PutBits( deflateOut_t *d, unsigned int value, int count ) {
+	d->bits |= value << d->numBits;
+	d->numBits += count;
+	while ( d->numBits >= 8 ) {
+		if ( d->length < d->size ) {
+			d->out[d->length++] = d->bits;
+		} else {
+			d->overflowed = qtrue;
+		}
+		d->bits >>= 8;
+		d->numBits -= 8;
+	}
+}
+
+/*
+=================
+Deflate_PutCode
+
+Huffman codes go out msb first
+=================
+*/
+static void Deflate_PutCode( deflateOut_t *d, unsigned int code, int count ) {
+	unsigned int	reversed;
+	int				i;
+
+	reversed = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		reversed = ( reversed << 1 ) | ( ( code >> i ) & 1 );
+	}
+	Deflate_PutBits( d, reversed, count );
+}
+
+/*
+=================
+Deflate_PutSymbol
+
+A literal/length symbol in the fixed code
+=================
+*/
+static void Deflate_PutSymbol( deflateOut_t *d, int symbol ) {
+	if ( symbol < 144 ) {
+		Deflate_PutCode( d, 0x30 + symbol, 8 );
+	} else if ( symbol < 256 ) {
+		Deflate_PutCode( d, 0x190 + symbol - 144, 9 );
+	} else if ( symbol < 280 ) {
+		Deflate_PutCode( d, symbol - 256, 7 );
+	} else {
+		Deflate_PutCode( d, 0xc0 + symbol - 280, 8 );
+	}
+}
+
+/*
+=================
+Deflate_PutMatch
+=================
+*/
+static void Deflate_PutMatch( deflateOut_t *d, int length, int distance ) {
+	int		code;
+
+	for ( code = 28 ; deflateLengthBase[code] > length ; code-- ) {
+	}
+	Deflate_PutSymbol( d, 257 + code );
+	Deflate_PutBits( d, length - deflateLengthBase[code], deflateLengthExtra[code] );
+
+	for ( code = 29 ; deflateDistBase[code] > distance ; code-- ) {
+	}
+	Deflate_PutCode( d, code, 5 );
+	Deflate_PutBits( d, distance - deflateDistBase[code], deflateDistExtra[code] );
+}
+
+/*
+=================
+Deflate_Hash
+=================
+*/
+static ID_INLINE int Deflate_Hash( const byte *p ) {
+	return ( ( p[0] << 10 ) ^ ( p[1] << 5 ) ^ p[2] ) & ( DEFLATE_HASH_SIZE - 1 );
+}
+
+/*
+=================
+Deflate_Insert
+
+Puts a position at the head of its hash chain, positions are stored
+plus one so a cleared table means empty chains
+=================
+*/
+static ID_INLINE void Deflate_Insert( deflateWork_t *work, const byte *in, int pos ) {
+	int		h;
+
+	h = Deflate_Hash( in + pos );
+	work->prev[pos & ( DEFLATE_WINDOW - 1 )] = work->head[h];
+	work->head[h] = pos + 1;
+}
+
+/*
+=================
+Deflate_Fixed
+
+Returns qfalse when the output doesn't fit
+=================
+*/
+static qboolean Deflate_Fixed( deflateOut_t *d, const byte *in, int inLength, deflateWork_t *work ) {
+	const byte	*scan, *match;
+	int			pos, cand, chain, limit;
+	int			len, best, bestDist;
+
+	Com_Memset( work->head, 0, sizeof( work->head ) );
+
+	Deflate_PutBits( d, 1, 1 );		// last block
+	Deflate_PutBits( d, 1, 2 );		// fixed codes
+
+	pos = 0;
+	while ( pos < inLength ) {
+		if ( d->overflowed ) {
+			return qfalse;
+		}
+
+		best = 0;
+		bestDist = 0;
+		if ( pos + DEFLATE_MIN_MATCH <= inLength ) {
+			limit = inLength - pos;
+			if ( limit > DEFLATE_MAX_MATCH ) {
+				limit = DEFLATE_MAX_MATCH;
+			}
+
+			scan = in + pos;
+			cand = work->head[Deflate_Hash( scan )] - 1;
+			for ( chain = DEFLATE_CHAIN ; cand >= 0 && chain ; chain-- ) {
+				if ( pos - cand > DEFLATE_WINDOW ) {
+					break;
+				}
+				match = in + cand;
+				if ( match[best] == scan[best] ) {
+					for ( len = 0 ; len < limit && match[len] == scan[len] ; len++ ) {
+					}
+					if ( len > best ) {
+						best = len;
+						bestDist = pos - cand;
+						if ( len >= DEFLATE_NICE_MATCH || len == limit ) {
+							break;
+						}
+					}
+				}
+				cand = work->prev[cand & ( DEFLATE_WINDOW - 1 )] - 1;
+			}
+
+			Deflate_Insert( work, in, pos );
+		}
+
+		if ( best >= DEFLATE_MIN_MATCH ) {
+			Deflate_PutMatch( d, best, bestDist );
+			// chain the covered positions too, the last two can't start a match
+			for ( len = 1 ; len < best ; len++ ) {
+				if ( pos + len + DEFLATE_MIN_MATCH <= inLength ) {
+					Deflate_Insert( work, in, pos + len );
+				}
+			}
+			pos += best;
+		} else {
+			Deflate_PutSymbol( d, in[pos] );
+			pos++;
+		}
+	}
+
+	Deflate_PutSymbol( d, 256 );	// end of block
+	Deflate_PutBits( d, 0, 7 );		// flush the last byte
+
+	return !d->overflowed;
+}
+
+/*
+=================
+Deflate_Stored
+=================
+*/
+static qboolean Deflate_Stored( deflateOut_t *d, const byte *in, int inLength ) {
+	int		pos, length;
+
+	pos = 0;
+	do {
+		length = inLength - pos;
+		if ( length > DEFLATE_STORED_MAX ) {
+			length = DEFLATE_STORED_MAX;
+		}
+		if ( d->length + 5 + length > d->size ) {
+			return qfalse;
+		}
+
+		d->out[d->length++] = ( pos + length == inLength );	// last block, stored
+		d->out[d->length++] = length & 0xff;
+		d->out[d->length++] = length >> 8;
+		d->out[d->length++] = ~length & 0xff;
+		d->out[d->length++] = ( ~length >> 8 ) & 0xff;
+		Com_Memcpy( d->out + d->length, in + pos, length );
+		d->length += length;
+		pos += length;
+	} while ( pos < inLength );
+
+	return qtrue;
+}
+
+/*
+=================
+Com_Deflate
+
+Returns the packed length, or -1 when it doesn't fit in outSize.  An
+out buffer of DEFLATE_BOUND( inLength ) always fits.
+=================
+*/
+int Com_Deflate( byte *out, int outSize, const byte *in, int inLength, deflateWork_t *work ) {
+	deflateOut_t	d;
+
+	Com_Memset( &d, 0, sizeof( d ) );
+	d.out = out;
+	d.size = outSize;
+
+	// the fixed codes give up once they are no smaller than storing
+	if ( d.size > inLength ) {
+		d.size = inLength;
+	}
+	if ( Deflate_Fixed( &d, in, inLength, work ) ) {
+		return d.length;
+	}
+
+	Com_Memset( &d, 0, sizeof( d ) );
+	d.out = out;
+	d.size = outSize;
+	if ( Deflate_Stored( &d, in, inLength ) ) {
+		return d.length;
+	}
+
+	return -1;
+}
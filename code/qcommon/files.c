@@ -119,6 +119,10 @@ cd path + BASEGAME's directory
 
 server download, to be written to home path + current game's directory
 
+The files in all the zip files on the path are also kept in one hash table
+(see FS_BuildIndex), which finds the zip file a file comes from without
+looking in each of them.
+
 
 The filesystem can be safely shutdown and reinitialized with different
 basedir / cddir / game combinations, but all other subsystems that rely on it
@@ -222,6 +226,13 @@ typedef struct {
 	int				hashSize;					// hash table size (power of 2)
 	fileInPack_t*	*hashTable;					// hash table
 	fileInPack_t*	buildBuffer;				// buffer with the filenames etc.
+	int				fileSize;					// of the pk3, for the pak cache
+	int				fileTime;
+	int				*crcs;						// checksum feed and file crcs, until the pak cache is written
+	int				numCrcs;
+	byte			*mapped;					// the whole pk3, once a file has been read from the mapping
+	int				mappedLength;
+	qboolean		mapFailed;
 } pack_t;
 
 typedef struct {
@@ -275,6 +286,8 @@ typedef struct {
 	int			fileSize;
 	int			zipFilePos;
 	qboolean	zipFile;
+	pack_t		*zipPak;
+	fileInPack_t	*zipEntry;
 	qboolean	streamed;
 	char		name[MAX_ZPATH];
 } fileHandleData_t;
@@ -316,18 +329,21 @@ qboolean FS_Initialized( void ) {
 
 /*
 =================
-FS_PakIsPure
+FS_PakOnList
+
+Whether the pak is on a list of pure checksums, an empty list lets
+everything through
 =================
 */
-qboolean FS_PakIsPure( pack_t *pack ) {
+static qboolean FS_PakOnList( pack_t *pack, const int *checksums, int numChecksums ) {
 	int i;
 
-	if ( fs_numServerPaks ) {
-		for ( i = 0 ; i < fs_numServerPaks ; i++ ) {
+	if ( numChecksums ) {
+		for ( i = 0 ; i < numChecksums ; i++ ) {
 			// FIXME: also use hashed file names
 			// NOTE TTimo: a pk3 with same checksum but different name would be validated too
 			//   I don't see this as allowing for any exploit, it would only happen if the client does manips of it's file names 'not a bug'
-			if ( pack->checksum == fs_serverPaks[i] ) {
+			if ( pack->checksum == checksums[i] ) {
 				return qtrue;		// on the aproved list
 			}
 		}
@@ -336,6 +352,15 @@ qboolean FS_PakIsPure( pack_t *pack ) {
 	return qtrue;
 }
 
+/*
+=================
+FS_PakIsPure
+=================
+*/
+qboolean FS_PakIsPure( pack_t *pack ) {
+	return FS_PakOnList( pack, fs_serverPaks, fs_numServerPaks );
+}
+
 
 /*
 =================
@@ -385,7 +410,7 @@ static fileHandle_t	FS_HandleForFile(void) {
 	return 0;
 }
 
-static FILE	*FS_FileForHandle( fileHandle_t f ) {
+FILE	*FS_FileForHandle( fileHandle_t f ) {
 	if ( f < 0 || f > MAX_FILE_HANDLES ) {
 		Com_Error( ERR_DROP, "FS_FileForHandle: out of reange" );
 	}
@@ -937,6 +962,422 @@ qboolean FS_FilenameCompare( const char *s1, const char *s2 ) {
 	return qfalse;		// strings are equal
 }
 
+/*
+=============================================================================
+
+FILE INDEX
+
+Every file in every zip file on the search path goes in one hash table
+when the search path is set up, the entries for a name chained in
+search order, so finding a file costs one hash lookup rather than one
+per zip file.  Directories are not indexed, their files can come and go
+while running; the ones ahead of the zip file a file was found in are
+still looked in first, as before.
+
+=============================================================================
+*/
+
+typedef struct fileIndex_s {
+	fileInPack_t		*pakFile;
+	pack_t				*pack;
+	int					rank;			// place on the search path
+	struct fileIndex_s	*next;			// same hash, later on the search path
+} fileIndex_t;
+
+typedef struct {
+	directory_t			*dir;
+	int					rank;
+} indexDir_t;
+
+static	cvar_t		*fs_index;
+static	fileIndex_t	**fs_indexTable;
+static	int			fs_indexSize;			// power of 2
+static	indexDir_t	*fs_indexDirs;			// in search order
+static	int			fs_numIndexDirs;
+
+/*
+================
+FS_BuildIndex
+
+Called whenever the search path is set up or changed
+================
+*/
+static void FS_BuildIndex( void ) {
+	searchpath_t	*search;
+	fileIndex_t		*entries;
+	fileInPack_t	*pakFile;
+	int				numFiles, numDirs, rank, count, i;
+	long			hash;
+
+	numFiles = 0;
+	numDirs = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		} else {
+			numDirs++;
+		}
+	}
+
+	for ( fs_indexSize = 1 ; fs_indexSize < numFiles ; fs_indexSize <<= 1 ) {
+	}
+
+	// one block for all of it
+	fs_indexTable = Z_Malloc( fs_indexSize * sizeof( *fs_indexTable )
+		+ numFiles * sizeof( *entries ) + numDirs * sizeof( *fs_indexDirs ) );
+	entries = (fileIndex_t *)( fs_indexTable + fs_indexSize );
+	fs_indexDirs = (indexDir_t *)( entries + numFiles );
+
+	// in search order, and within a pak in the order of its own hash chains
+	count = 0;
+	fs_numIndexDirs = 0;
+	for ( search = fs_searchpaths, rank = 0 ; search ; search = search->next, rank++ ) {
+		if ( search->dir ) {
+			fs_indexDirs[fs_numIndexDirs].dir = search->dir;
+			fs_indexDirs[fs_numIndexDirs].rank = rank;
+			fs_numIndexDirs++;
+			continue;
+		}
+		for ( i = search->pack->numfiles - 1 ; i >= 0 ; i-- ) {
+			pakFile = &search->pack->buildBuffer[i];
+			if ( !pakFile->name ) {
+				continue;	// the zip directory was cut short
+			}
+			entries[count].pakFile = pakFile;
+			entries[count].pack = search->pack;
+			entries[count].rank = rank;
+			count++;
+		}
+	}
+
+	// pushed on the chains back to front to keep them in that order
+	for ( i = count - 1 ; i >= 0 ; i-- ) {
+		hash = FS_HashFileName( entries[i].pakFile->name, fs_indexSize );
+		entries[i].next = fs_indexTable[hash];
+		fs_indexTable[hash] = &entries[i];
+	}
+}
+
+/*
+================
+FS_FreeIndex
+================
+*/
+static void FS_FreeIndex( void ) {
+	if ( fs_indexTable ) {
+		Z_Free( fs_indexTable );
+	}
+	fs_indexTable = NULL;
+	fs_indexSize = 0;
+	fs_indexDirs = NULL;
+	fs_numIndexDirs = 0;
+}
+
+/*
+================
+FS_IndexFindOnList
+
+The first pak on the search path with the file that is on the list
+of checksums, any pak when the list is empty
+================
+*/
+static fileIndex_t *FS_IndexFindOnList( const char *filename, const int *checksums, int numChecksums ) {
+	fileIndex_t		*entry;
+
+	entry = fs_indexTable[FS_HashFileName( filename, fs_indexSize )];
+	for ( ; entry ; entry = entry->next ) {
+		// case and separator insensitive comparisons
+		if ( FS_FilenameCompare( entry->pakFile->name, filename ) ) {
+			continue;
+		}
+		if ( !FS_PakOnList( entry->pack, checksums, numChecksums ) ) {
+			continue;
+		}
+		return entry;
+	}
+
+	return NULL;
+}
+
+/*
+================
+FS_IndexFind
+
+The first pak on the search path with the file, only looking at the
+ones on the pure list when pure is set
+================
+*/
+static fileIndex_t *FS_IndexFind( const char *filename, qboolean pure ) {
+	if ( pure ) {
+		return FS_IndexFindOnList( filename, fs_serverPaks, fs_numServerPaks );
+	}
+	return FS_IndexFindOnList( filename, NULL, 0 );
+}
+
+/*
+================
+FS_DirHasFile
+================
+*/
+static qboolean FS_DirHasFile( directory_t *dir, const char *filename ) {
+	FILE	*temp;
+
+	temp = fopen( FS_BuildOSPath( dir->path, dir->gamedir, filename ), "rb" );
+	if ( !temp ) {
+		return qfalse;
+	}
+	fclose( temp );
+	return qtrue;
+}
+
+/*
+================
+FS_FileInPath
+
+Whether the file is anywhere on the search path, pure or not
+================
+*/
+static qboolean FS_FileInPath( const char *filename, qboolean useIndex ) {
+	searchpath_t	*search;
+	fileInPack_t	*pakFile;
+	fileIndex_t		*entry;
+	long			hash;
+	int				i;
+
+	if ( useIndex ) {
+		entry = FS_IndexFind( filename, qfalse );
+		for ( i = 0 ; i < fs_numIndexDirs ; i++ ) {
+			if ( entry && fs_indexDirs[i].rank > entry->rank ) {
+				break;
+			}
+			if ( FS_DirHasFile( fs_indexDirs[i].dir, filename ) ) {
+				return qtrue;
+			}
+		}
+		return ( entry != NULL );
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			// look through all the pak file elements
+			hash = FS_HashFileName( filename, search->pack->hashSize );
+			for ( pakFile = search->pack->hashTable[hash] ; pakFile ; pakFile = pakFile->next ) {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+					// found it!
+					return qtrue;
+				}
+			}
+		} else if ( FS_DirHasFile( search->dir, filename ) ) {
+			return qtrue;
+		}
+	}
+	return qfalse;
+}
+
+/*
+================
+FS_LookupBench_f
+
+Times looking up the files a map load would, through the index and by
+walking the search path: a sample of the files in the paks, and as many
+names that aren't there, as when an image is tried with each extension
+================
+*/
+#define	MAX_BENCH_LOOKUPS	4096
+
+static void FS_LookupBench_f( void ) {
+	static char		names[MAX_BENCH_LOOKUPS][MAX_ZPATH];
+	searchpath_t	*search;
+	int				total, step, count, found, i, j, pass;
+	int64_t			start, usec[2];
+	char			*ext;
+
+	total = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			total += search->pack->numfiles;
+		}
+	}
+	step = total / ( MAX_BENCH_LOOKUPS / 2 ) + 1;
+
+	count = 0;
+	i = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( !search->pack ) {
+			continue;
+		}
+		for ( j = 0 ; j < search->pack->numfiles ; j++, i++ ) {
+			if ( i % step || !search->pack->buildBuffer[j].name || count + 2 > MAX_BENCH_LOOKUPS ) {
+				continue;
+			}
+			Q_strncpyz( names[count], search->pack->buildBuffer[j].name, sizeof( names[0] ) );
+			Q_strncpyz( names[count + 1], names[count], sizeof( names[0] ) - 4 );
+			ext = strrchr( names[count + 1], '.' );
+			if ( ext && !strchr( ext, '/' ) ) {
+				*ext = 0;
+			}
+			Q_strcat( names[count + 1], sizeof( names[0] ), ".xyz" );
+			count += 2;
+		}
+	}
+
+	if ( !count ) {
+		Com_Printf( "No pak files to look in.\n" );
+		return;
+	}
+
+	found = 0;
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		start = Sys_Microseconds();
+		for ( i = 0 ; i < count ; i++ ) {
+			if ( FS_FileInPath( names[i], pass ) ) {
+				found++;
+			}
+		}
+		usec[pass] = Sys_Microseconds() - start;
+	}
+
+	Com_Printf( "%i lookups in %i files, %i found\n", count, total, found / 2 );
+	Com_Printf( "search path walk: %8.2f usec per lookup\n", (double)usec[0] / count );
+	Com_Printf( "index:            %8.2f usec per lookup\n", (double)usec[1] / count );
+}
+
+/*
+===========
+FS_OpenFileInPak
+
+Opens the file found in a pak on a free handle
+===========
+*/
+static int FS_OpenFileInPak( pack_t *pak, fileInPack_t *pakFile, const char *filename, fileHandle_t f, qboolean uniqueFILE ) {
+	unz_s			*zfi;
+	FILE			*temp;
+	int				l;
+
+	// mark the pak as having been referenced and mark specifics on cgame and ui
+	// shaders, txt, arena files  by themselves do not count as a reference as
+	// these are loaded from all pk3s
+	// from every pk3 file..
+	l = strlen( filename );
+	if ( !(pak->referenced & FS_GENERAL_REF)) {
+		if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
+			Q_stricmp(filename + l - 4, ".txt") != 0 &&
+			Q_stricmp(filename + l - 4, ".cfg") != 0 &&
+			Q_stricmp(filename + l - 7, ".config") != 0 &&
+			strstr(filename, "levelshots") == NULL &&
+			Q_stricmp(filename + l - 4, ".bot") != 0 &&
+			Q_stricmp(filename + l - 6, ".arena") != 0 &&
+			Q_stricmp(filename + l - 5, ".menu") != 0) {
+			pak->referenced |= FS_GENERAL_REF;
+		}
+	}
+
+	if (!(pak->referenced & FS_QAGAME_REF) && strstr(filename, "qagame.qvm")) {
+		pak->referenced |= FS_QAGAME_REF;
+	}
+	if (!(pak->referenced & FS_CGAME_REF) && strstr(filename, "cgame.qvm")) {
+		pak->referenced |= FS_CGAME_REF;
+	}
+	if (!(pak->referenced & FS_UI_REF) && strstr(filename, "ui.qvm")) {
+		pak->referenced |= FS_UI_REF;
+	}
+
+	if ( uniqueFILE ) {
+		// open a new file on the pakfile
+		fsh[f].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
+		if (fsh[f].handleFiles.file.z == NULL) {
+			Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
+		}
+	} else {
+		fsh[f].handleFiles.file.z = pak->handle;
+	}
+	Q_strncpyz( fsh[f].name, filename, sizeof( fsh[f].name ) );
+	fsh[f].zipFile = qtrue;
+	fsh[f].zipPak = pak;
+	fsh[f].zipEntry = pakFile;
+	zfi = (unz_s *)fsh[f].handleFiles.file.z;
+	// in case the file was new
+	temp = zfi->file;
+	// set the file position in the zip file (also sets the current file info)
+	unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
+	// copy the file info into the unzip structure
+	Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
+	// we copy this back into the structure
+	zfi->file = temp;
+	// open the file in the zip
+	unzOpenCurrentFile( fsh[f].handleFiles.file.z );
+	fsh[f].zipFilePos = pakFile->pos;
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
+			filename, pak->pakFilename );
+	}
+	return zfi->cur_file_info.uncompressed_size;
+}
+
+/*
+===========
+FS_OpenFileInDir
+
+Opens the file in a directory on a free handle, -1 when it isn't there
+or isn't allowed to come from a directory
+===========
+*/
+static int FS_OpenFileInDir( directory_t *dir, const char *filename, fileHandle_t f ) {
+	char			*netpath;
+	int				l;
+	char demoExt[16];
+
+	#ifdef USE_DEMO_FORMAT_42
+		Com_sprintf (demoExt, sizeof(demoExt), ".urtdemo" );
+	#else
+		Com_sprintf (demoExt, sizeof(demoExt), ".dm_%d",PROTOCOL_VERSION );
+	#endif
+
+	// if we are running restricted, the only files we
+	// will allow to come from the directory are .cfg files
+	l = strlen( filename );
+	// FIXME TTimo I'm not sure about the fs_numServerPaks test
+	// if you are using FS_ReadFile to find out if a file exists,
+	//   this test can make the search fail although the file is in the directory
+	// I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
+	// turned out I used FS_FileExists instead
+	if ( fs_numServerPaks ) {
+
+		if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
+			&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
+			&& Q_stricmp( filename + l - 5, ".game" )	// menu files
+			&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
+			&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+			return -1;
+		}
+	}
+
+	netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+	fsh[f].handleFiles.file.o = fopen (netpath, "rb");
+	if ( !fsh[f].handleFiles.file.o ) {
+		return -1;
+	}
+
+	if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
+		&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
+		&& Q_stricmp( filename + l - 5, ".game" )	// menu files
+		&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
+		&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+		fs_fakeChkSum = random();
+	}
+
+	Q_strncpyz( fsh[f].name, filename, sizeof( fsh[f].name ) );
+	fsh[f].zipFile = qfalse;
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
+			dir->path, dir->gamedir );
+	}
+
+	return FS_filelength (f);
+}
+
 /*
 ===========
 FS_FOpenFileRead
@@ -951,15 +1392,11 @@ extern qboolean		com_fullyInitialized;
 
 int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
 	searchpath_t	*search;
-	char			*netpath;
 	pack_t			*pak;
 	fileInPack_t	*pakFile;
-	directory_t		*dir;
+	fileIndex_t		*entry;
 	long			hash;
-	unz_s			*zfi;
-	FILE			*temp;
-	int				l;
-	char demoExt[16];
+	int				len, i;
 
 	hash = 0;
 
@@ -969,49 +1406,13 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 
 	if ( file == NULL ) {
 		// just wants to see if file is there
-		for ( search = fs_searchpaths ; search ; search = search->next ) {
-			//
-			if ( search->pack ) {
-				hash = FS_HashFileName(filename, search->pack->hashSize);
-			}
-			// is the element a pak file?
-			if ( search->pack && search->pack->hashTable[hash] ) {
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do {
-					// case and separator insensitive comparisons
-					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-						// found it!
-						return qtrue;
-					}
-					pakFile = pakFile->next;
-				} while(pakFile != NULL);
-			} else if ( search->dir ) {
-				dir = search->dir;
-			
-				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-				temp = fopen (netpath, "rb");
-				if ( !temp ) {
-					continue;
-				}
-				fclose(temp);
-				return qtrue;
-			}
-		}
-		return qfalse;
+		return FS_FileInPath( filename, fs_index->integer && fs_indexTable );
 	}
 
 	if ( !filename ) {
 		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
 	}
 	
-	#ifdef USE_DEMO_FORMAT_42
-		Com_sprintf (demoExt, sizeof(demoExt), ".urtdemo" );
-	#else
-		Com_sprintf (demoExt, sizeof(demoExt), ".dm_%d",PROTOCOL_VERSION );
-	#endif
-	
 	// qpaths are not supposed to have a leading slash
 	if ( filename[0] == '/' || filename[0] == '\\' ) {
 		filename++;
@@ -1039,133 +1440,53 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 	*file = FS_HandleForFile();
 	fsh[*file].handleFiles.unique = uniqueFILE;
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if ( search->pack ) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
+	if ( fs_index->integer && fs_indexTable ) {
+		// only the directories ahead of the pak need looking in
+		entry = FS_IndexFind( filename, qtrue );
+		for ( i = 0 ; i < fs_numIndexDirs ; i++ ) {
+			if ( entry && fs_indexDirs[i].rank > entry->rank ) {
+				break;
+			}
+			len = FS_OpenFileInDir( fs_indexDirs[i].dir, filename, *file );
+			if ( len >= 0 ) {
+				return len;
+			}
 		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
+		if ( entry ) {
+			return FS_OpenFileInPak( entry->pack, entry->pakFile, filename, *file, uniqueFILE );
+		}
+	} else {
+		for ( search = fs_searchpaths ; search ; search = search->next ) {
+			//
+			if ( search->pack ) {
+				hash = FS_HashFileName(filename, search->pack->hashSize);
 			}
-
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as
-					// these are loaded from all pk3s
-					// from every pk3 file..
-					l = strlen( filename );
-					if ( !(pak->referenced & FS_GENERAL_REF)) {
-						if ( Q_stricmp(filename + l - 7, ".shader") != 0 &&
-							Q_stricmp(filename + l - 4, ".txt") != 0 &&
-							Q_stricmp(filename + l - 4, ".cfg") != 0 &&
-							Q_stricmp(filename + l - 7, ".config") != 0 &&
-							strstr(filename, "levelshots") == NULL &&
-							Q_stricmp(filename + l - 4, ".bot") != 0 &&
-							Q_stricmp(filename + l - 6, ".arena") != 0 &&
-							Q_stricmp(filename + l - 5, ".menu") != 0) {
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
-
-					if (!(pak->referenced & FS_QAGAME_REF) && strstr(filename, "qagame.qvm")) {
-						pak->referenced |= FS_QAGAME_REF;
-					}
-					if (!(pak->referenced & FS_CGAME_REF) && strstr(filename, "cgame.qvm")) {
-						pak->referenced |= FS_CGAME_REF;
-					}
-					if (!(pak->referenced & FS_UI_REF) && strstr(filename, "ui.qvm")) {
-						pak->referenced |= FS_UI_REF;
-					}
-
-					if ( uniqueFILE ) {
-						// open a new file on the pakfile
-						fsh[*file].handleFiles.file.z = unzReOpen (pak->pakFilename, pak->handle);
-						if (fsh[*file].handleFiles.file.z == NULL) {
-							Com_Error (ERR_FATAL, "Couldn't reopen %s", pak->pakFilename);
-						}
-					} else {
-						fsh[*file].handleFiles.file.z = pak->handle;
-					}
-					Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-					fsh[*file].zipFile = qtrue;
-					zfi = (unz_s *)fsh[*file].handleFiles.file.z;
-					// in case the file was new
-					temp = zfi->file;
-					// set the file position in the zip file (also sets the current file info)
-					unzSetCurrentFileInfoPosition(pak->handle, pakFile->pos);
-					// copy the file info into the unzip structure
-					Com_Memcpy( zfi, pak->handle, sizeof(unz_s) );
-					// we copy this back into the structure
-					zfi->file = temp;
-					// open the file in the zip
-					unzOpenCurrentFile( fsh[*file].handleFiles.file.z );
-					fsh[*file].zipFilePos = pakFile->pos;
-
-					if ( fs_debug->integer ) {
-						Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
-							filename, pak->pakFilename );
-					}
-					return zfi->cur_file_info.uncompressed_size;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
-		} else if ( search->dir ) {
-			// check a file in the directory tree
-
-			// if we are running restricted, the only files we
-			// will allow to come from the directory are .cfg files
-			l = strlen( filename );
-			// FIXME TTimo I'm not sure about the fs_numServerPaks test
-			// if you are using FS_ReadFile to find out if a file exists,
-			//   this test can make the search fail although the file is in the directory
-			// I had the problem on https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=8
-			// turned out I used FS_FileExists instead
-			if ( fs_numServerPaks ) {
-
-				if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-					&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-					&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-					&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-					&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
+			// is the element a pak file?
+			if ( search->pack && search->pack->hashTable[hash] ) {
+				// disregard if it doesn't match one of the allowed pure pak files
+				if ( !FS_PakIsPure(search->pack) ) {
 					continue;
 				}
-			}
-
-			dir = search->dir;
-			
-			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-			fsh[*file].handleFiles.file.o = fopen (netpath, "rb");
-			if ( !fsh[*file].handleFiles.file.o ) {
-				continue;
-			}
-
-			if ( Q_stricmp( filename + l - 4, ".cfg" )		// for config files
-				&& Q_stricmp( filename + l - 5, ".menu" )	// menu files
-				&& Q_stricmp( filename + l - 5, ".game" )	// menu files
-				&& Q_stricmp( filename + l - strlen(demoExt), demoExt )	// menu files
-				&& Q_stricmp( filename + l - 4, ".dat" ) ) {	// for journal files
-				fs_fakeChkSum = random();
-			}
 
-			Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
-			fsh[*file].zipFile = qfalse;
-			if ( fs_debug->integer ) {
-				Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
-					dir->path, dir->gamedir );
+				// look through all the pak file elements
+				pak = search->pack;
+				pakFile = pak->hashTable[hash];
+				do {
+					// case and separator insensitive comparisons
+					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+						// found it!
+						return FS_OpenFileInPak( pak, pakFile, filename, *file, uniqueFILE );
+					}
+					pakFile = pakFile->next;
+				} while(pakFile != NULL);
+			} else if ( search->dir ) {
+				// check a file in the directory tree
+				len = FS_OpenFileInDir( search->dir, filename, *file );
+				if ( len >= 0 ) {
+					return len;
+				}
 			}
-
-			return FS_filelength (*file);
-		}		
+		}
 	}
 	
 #ifdef FS_MISSING
@@ -1397,67 +1718,775 @@ int FS_Seek( fileHandle_t f, long offset, int origin ) {
 
 CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 
-======================================================================================
+======================================================================================
+*/
+
+int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
+	searchpath_t	*search;
+	pack_t			*pak;
+	fileInPack_t	*pakFile;
+	fileIndex_t		*entry;
+	long			hash = 0;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	if ( !filename ) {
+		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
+	}
+
+	// qpaths are not supposed to have a leading slash
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+
+	// make absolutely sure that it can't back up the path.
+	// The searchpaths do guarantee that something will always
+	// be prepended, so we don't need to worry about "c:" or "//limbo"
+	if ( strstr( filename, ".." ) || strstr( filename, "::" ) ) {
+		return -1;
+	}
+
+	if ( fs_index->integer && fs_indexTable ) {
+		entry = FS_IndexFind( filename, qtrue );
+		if ( !entry ) {
+			return -1;
+		}
+		if (pChecksum) {
+			*pChecksum = entry->pack->pure_checksum;
+		}
+		return 1;
+	}
+
+	//
+	// search through the path, one element at a time
+	//
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		//
+		if (search->pack) {
+			hash = FS_HashFileName(filename, search->pack->hashSize);
+		}
+		// is the element a pak file?
+		if ( search->pack && search->pack->hashTable[hash] ) {
+			// disregard if it doesn't match one of the allowed pure pak files
+			if ( !FS_PakIsPure(search->pack) ) {
+				continue;
+			}
+
+			// look through all the pak file elements
+			pak = search->pack;
+			pakFile = pak->hashTable[hash];
+			do {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+					if (pChecksum) {
+						*pChecksum = pak->pure_checksum;
+					}
+					return 1;
+				}
+				pakFile = pakFile->next;
+			} while(pakFile != NULL);
+		}
+	}
+	return -1;
+}
+
+/*
+==========================================================================
+
+MAPPED PK3 READS
+
+A pk3 is mapped the first time a whole file is read out of it and stays
+mapped until the filesystem shuts down.  FS_ReadFile copies stored files
+straight out of the mapping and inflates deflated ones into its buffer in
+one call, instead of going through the zip read buffer a block at a
+time.  FS_ReadFileView hands out stored files without any copy at all,
+as a read only view of the mapping.  The pk3 is stat'ed before each
+read, once it has changed on disk its files are read the usual way.
+
+==========================================================================
+*/
+
+#define	MAX_FILE_VIEWS	16
+
+static	cvar_t		*fs_mmap;
+static	const void	*fs_views[MAX_FILE_VIEWS];	// handed out by FS_ReadFileView
+
+/*
+=================
+FS_MappedEntry
+
+Where the data of the pk3 file open on f starts in its mapped pk3, NULL
+if it can't be had from the mapping
+=================
+*/
+static const byte *FS_MappedEntry( fileHandle_t f, int *method, int *compressedSize ) {
+	pack_t						*pak;
+	unz_s						*zfi;
+	file_in_zip_read_info_s		*info;
+	unsigned long				offset;
+	int							size, mtime;
+
+	pak = fsh[f].zipPak;
+	if ( !fs_mmap->integer || !fsh[f].zipFile || !pak || pak->mapFailed ) {
+		return NULL;
+	}
+
+	// a pk3 replaced since it was opened has other offsets, and reading a
+	// mapping past the end of one cut short raises SIGBUS, the zip handle
+	// still has the file as it was open
+	if ( !Sys_FileStat( pak->pakFilename, &size, &mtime ) || size != pak->fileSize || mtime != pak->fileTime
+		|| ( pak->mapped && size != pak->mappedLength ) ) {
+		Com_DPrintf( "%s changed on disk, not reading it from a mapping\n", pak->pakFilename );
+		pak->mapFailed = qtrue;
+		return NULL;
+	}
+
+	if ( !pak->mapped ) {
+		pak->mapped = Sys_MapFile( pak->pakFilename, &pak->mappedLength );
+		if ( !pak->mapped ) {
+			Com_DPrintf( "Couldn't map %s\n", pak->pakFilename );
+			pak->mapFailed = qtrue;
+			return NULL;
+		}
+	}
+
+	zfi = (unz_s *)fsh[f].handleFiles.file.z;
+	info = zfi->pfile_in_zip_read;
+	if ( !info ) {
+		return NULL;
+	}
+
+	// unzOpenCurrentFile has already checked the local header
+	offset = info->pos_in_zipfile + info->byte_before_the_zipfile;
+	if ( offset > pak->mappedLength || info->rest_read_compressed > pak->mappedLength - offset ) {
+		return NULL;
+	}
+
+	*method = info->compression_method;
+	*compressedSize = info->rest_read_compressed;
+	return pak->mapped + offset;
+}
+
+/*
+=================
+FS_ReadMapped
+
+Reads all len bytes of the pk3 file open on f out of its mapped pk3,
+qfalse if they have to be read the usual way
+=================
+*/
+static qboolean FS_ReadMapped( fileHandle_t f, byte *buf, int len ) {
+	const byte	*data;
+	int			method, compressedSize;
+
+	data = FS_MappedEntry( f, &method, &compressedSize );
+	if ( !data ) {
+		return qfalse;
+	}
+
+	if ( method == 0 ) {
+		if ( compressedSize != len ) {
+			return qfalse;
+		}
+		Com_Memcpy( buf, data, len );
+		return qtrue;
+	}
+
+	// the inflater wants a byte past the end, there's always the central directory
+	if ( data + compressedSize < fsh[f].zipPak->mapped + fsh[f].zipPak->mappedLength ) {
+		compressedSize++;
+	}
+	return unzInflateBuffer( buf, len, data, compressedSize ) == UNZ_OK;
+}
+
+/*
+============
+FS_ReadFileView
+
+Like FS_ReadFile, but a file stored in a pk3 without compression comes
+back as a view of the mapped pk3 instead of a copy.  The buffer is read
+only, isn't zero terminated if it is a view, and goes back through
+FS_FreeFileView.
+============
+*/
+int FS_ReadFileView( const char *qpath, const void **buffer ) {
+	fileHandle_t	h;
+	const byte		*data;
+	int				len, method, compressedSize, i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	}
+
+	// configs may be journalled, that's up to FS_ReadFile
+	if ( !qpath || !qpath[0] || strstr( qpath, ".cfg" ) ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
+
+	for ( i = 0 ; i < MAX_FILE_VIEWS ; i++ ) {
+		if ( !fs_views[i] ) {
+			break;
+		}
+	}
+	if ( i == MAX_FILE_VIEWS ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
+
+	len = FS_FOpenFileRead( qpath, &h, qfalse );
+	if ( h == 0 ) {
+		*buffer = NULL;
+		return -1;
+	}
+
+	data = FS_MappedEntry( h, &method, &compressedSize );
+	FS_FCloseFile( h );
+	if ( !data || method != 0 || compressedSize != len ) {
+		return FS_ReadFile( qpath, (void **)buffer );
+	}
+
+	fs_loadCount++;
+	fs_views[i] = data;
+	*buffer = data;
+	return len;
+}
+
+/*
+=============
+FS_FreeFileView
+=============
+*/
+void FS_FreeFileView( const void *buffer ) {
+	int		i;
+
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFileView( NULL )" );
+	}
+
+	for ( i = 0 ; i < MAX_FILE_VIEWS ; i++ ) {
+		if ( fs_views[i] == buffer ) {
+			fs_views[i] = NULL;
+			return;
+		}
+	}
+
+	FS_FreeFile( (void *)buffer );
+}
+
+/*
+==========================================================================
+
+MAP PREFETCH
+
+FS_PrefetchMap starts a thread that reads the files a map load is going
+to ask for out of their pk3s while the main thread gets on with the rest
+of the load: the bsp first, then the images its shaders are named after
+and the models and sounds its entities name, then everything else in the
+pk3 the bsp is in.  They are read and inflated into a buffer of
+fs_prefetchSize megabytes, and FS_ReadFile copies a file out of it when
+it's there instead of reading it.  Files that don't fit are left to be
+read as usual.  The buffer goes once FS_PrefetchDone releases it.
+
+Every FS_ReadFile from FS_PrefetchMap to FS_PrefetchDone is timed, and
+FS_PrefetchDone prints how the load split into time spent reading files
+(including waiting on the thread for one it was in the middle of) and
+everything else.
+
+The thread doesn't touch the zone, the file handles, the unzip state or
+anything with a static buffer (va, COM_Parse, FS_BuildOSPath): it reads
+with its own FILE, inflates with unzInflateBuffer and builds names in
+local buffers with Com_sprintf.  It looks things up in the file index,
+which doesn't change until FS_Shutdown stops the thread, and checks the
+paks against its own copy of the pure list, taken when it starts, as
+the main thread sets fs_serverPaks while a map loads.
+
+Without pthreads (win32) nothing is prefetched, the load is still timed.
+
+==========================================================================
+*/
+
+#define	MAX_PREFETCH_FILES	4096
+
+typedef enum {
+	PREFETCH_READING,
+	PREFETCH_DONE,
+	PREFETCH_FAILED
+} prefetchState_t;
+
+typedef struct {
+	fileInPack_t	*pakFile;
+	int				offset;				// in fs_prefetchBuffer
+	int				length;
+	prefetchState_t	state;
+} prefetchFile_t;
+
+typedef struct {
+	qboolean	active;
+	int64_t		start;
+	int64_t		readUsec;				// inside FS_ReadFile
+	int64_t		waitUsec;				// of that, waiting on the thread
+	int			reads;
+	int			readBytes;
+	int			hits;
+	int			hitBytes;
+} loadStats_t;
+
+static	cvar_t			*fs_prefetch;
+static	cvar_t			*fs_prefetchSize;
+static	char			fs_prefetchMap[MAX_QPATH];
+static	fileIndex_t		*fs_prefetchBsp;
+static	byte			*fs_prefetchBuffer;
+static	int				fs_prefetchBufferSize;
+static	int				fs_prefetchUsed;		// reserved by the thread
+static	prefetchFile_t	fs_prefetchFiles[MAX_PREFETCH_FILES];
+static	int				fs_numPrefetchFiles;
+static	loadStats_t		fs_loadStats;
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+static	pthread_t		fs_prefetchThread;
+static	qboolean		fs_prefetchRunning;
+static	volatile qboolean	fs_prefetchQuit;
+static	int				fs_prefetchPure[MAX_SEARCH_PATHS];	// fs_serverPaks for the thread
+static	int				fs_numPrefetchPure;
+
+static	pthread_mutex_t	fs_prefetchMutex = PTHREAD_MUTEX_INITIALIZER;
+static	pthread_cond_t	fs_prefetchRead = PTHREAD_COND_INITIALIZER;	// a file is done
+
+typedef struct {
+	FILE		*file;
+	pack_t		*pak;					// that file is open on
+	byte		*scratch;				// compressed data
+	int			scratchSize;
+} prefetchReader_t;
+
+/*
+=================
+FS_ZipShort / FS_ZipLong
+=================
+*/
+static int FS_ZipShort( const byte *p ) {
+	return p[0] | ( p[1] << 8 );
+}
+
+static int FS_ZipLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( p[3] << 24 );
+}
+
+/*
+=================
+FS_PrefetchFile
+
+Reads a file out of its pk3 into the buffer and returns it, NULL if it
+wasn't read.  Runs on the thread.
+=================
+*/
+static byte *FS_PrefetchFile( prefetchReader_t *r, pack_t *pak, fileInPack_t *pakFile, int *length ) {
+	prefetchFile_t	*p;
+	byte			header[46], *data;
+	int				method, compressedSize, size, offset, i;
+	qboolean		ok;
+
+	for ( i = 0 ; i < fs_numPrefetchFiles ; i++ ) {
+		if ( fs_prefetchFiles[i].pakFile == pakFile ) {
+			return NULL;
+		}
+	}
+	if ( fs_numPrefetchFiles == MAX_PREFETCH_FILES ) {
+		return NULL;
+	}
+
+	if ( r->pak != pak ) {
+		if ( r->file ) {
+			fclose( r->file );
+		}
+		r->pak = pak;
+		r->file = fopen( pak->pakFilename, "rb" );
+	}
+	if ( !r->file ) {
+		return NULL;
+	}
+
+	// the central directory entry, then the local header, which can have
+	// a different extra field; pk3s don't have anything in front of the zip
+	if ( fseek( r->file, pakFile->pos, SEEK_SET ) || fread( header, 46, 1, r->file ) != 1
+		|| FS_ZipLong( header ) != 0x02014b50 ) {
+		return NULL;
+	}
+	method = FS_ZipShort( header + 10 );
+	compressedSize = FS_ZipLong( header + 20 );
+	size = FS_ZipLong( header + 24 );
+	offset = FS_ZipLong( header + 42 );
+	// only stored and deflated files
+	if ( ( method != 0 && method != 8 ) || size <= 0 || compressedSize <= 0 ) {
+		return NULL;
+	}
+
+	if ( fseek( r->file, offset, SEEK_SET ) || fread( header, 30, 1, r->file ) != 1
+		|| FS_ZipLong( header ) != 0x04034b50 ) {
+		return NULL;
+	}
+	offset += 30 + FS_ZipShort( header + 26 ) + FS_ZipShort( header + 28 );
+
+	// claim the space before reading into it
+	pthread_mutex_lock( &fs_prefetchMutex );
+	if ( size > fs_prefetchBufferSize - fs_prefetchUsed ) {
+		pthread_mutex_unlock( &fs_prefetchMutex );
+		return NULL;
+	}
+	p = &fs_prefetchFiles[fs_numPrefetchFiles++];
+	p->pakFile = pakFile;
+	p->offset = fs_prefetchUsed;
+	p->length = size;
+	p->state = PREFETCH_READING;
+	fs_prefetchUsed += ( size + 15 ) & ~15;
+	pthread_mutex_unlock( &fs_prefetchMutex );
+
+	data = fs_prefetchBuffer + p->offset;
+	ok = qfalse;
+	if ( !fseek( r->file, offset, SEEK_SET ) ) {
+		if ( method == 0 ) {
+			ok = ( compressedSize == size && fread( data, size, 1, r->file ) == 1 );
+		} else {
+			// the inflater wants a byte past the end, there's always the central directory
+			if ( compressedSize + 1 > r->scratchSize ) {
+				free( r->scratch );
+				r->scratchSize = compressedSize + 1;
+				r->scratch = malloc( r->scratchSize );
+			}
+			ok = ( r->scratch && fread( r->scratch, compressedSize + 1, 1, r->file ) == 1
+				&& unzInflateBuffer( data, size, r->scratch, compressedSize + 1 ) == UNZ_OK );
+		}
+	}
+
+	pthread_mutex_lock( &fs_prefetchMutex );
+	p->state = ok ? PREFETCH_DONE : PREFETCH_FAILED;
+	pthread_cond_broadcast( &fs_prefetchRead );
+	pthread_mutex_unlock( &fs_prefetchMutex );
+
+	*length = size;
+	return ok ? data : NULL;
+}
+
+/*
+=================
+FS_PrefetchName
+
+Prefetches a file by name if one of the pure paks has it
+=================
+*/
+static void FS_PrefetchName( prefetchReader_t *r, const char *name ) {
+	fileIndex_t		*entry;
+	int				length;
+
+	if ( fs_prefetchQuit || !name[0] ) {
+		return;
+	}
+	entry = FS_IndexFindOnList( name, fs_prefetchPure, fs_numPrefetchPure );
+	if ( entry ) {
+		FS_PrefetchFile( r, entry->pack, entry->pakFile, &length );
+	}
+}
+
+/*
+=================
+FS_PrefetchShaders
+
+The images named like the shaders of the bsp
+=================
+*/
+static void FS_PrefetchShaders( prefetchReader_t *r, const byte *bsp, const lump_t *l ) {
+	const dshader_t	*in;
+	char			name[MAX_QPATH], image[MAX_QPATH];
+	int				i, count;
+
+	in = (const dshader_t *)( bsp + l->fileofs );
+	count = l->filelen / sizeof( *in );
+	for ( i = 0 ; i < count ; i++ ) {
+		// leave room for the extension, Com_sprintf would print on overflow
+		Q_strncpyz( name, in[i].shader, sizeof( name ) );
+		COM_StripExtension( name, name, sizeof( name ) - 4 );
+		Com_sprintf( image, sizeof( image ), "%s.tga", name );
+		FS_PrefetchName( r, image );
+		Com_sprintf( image, sizeof( image ), "%s.jpg", name );
+		FS_PrefetchName( r, image );
+	}
+}
+
+/*
+=================
+FS_PrefetchEntities
+
+The models, sounds and music named in the entities of the bsp.  This
+can't use COM_Parse, the main thread is parsing too.
+=================
+*/
+static void FS_PrefetchEntities( prefetchReader_t *r, const byte *bsp, const lump_t *l ) {
+	const char	*p, *end;
+	char		key[MAX_QPATH], value[MAX_QPATH], *s;
+	char		*token;
+	int			i, n;
+
+	p = (const char *)( bsp + l->fileofs );
+	end = p + l->filelen;
+	n = 0;
+	while ( p < end && *p && !fs_prefetchQuit ) {
+		if ( *p != '"' ) {
+			p++;
+			continue;
+		}
+
+		// alternate between keys and values
+		token = ( n++ & 1 ) ? value : key;
+		for ( p++, i = 0 ; p < end && *p && *p != '"' ; p++ ) {
+			if ( i < MAX_QPATH - 1 ) {
+				token[i++] = *p;
+			}
+		}
+		token[i] = 0;
+		p++;
+
+		if ( token == key ) {
+			continue;
+		}
+		if ( ( !Q_stricmp( key, "model" ) || !Q_stricmp( key, "model2" ) ) && value[0] != '*' ) {
+			FS_PrefetchName( r, value );
+		} else if ( !Q_stricmp( key, "noise" ) ) {
+			FS_PrefetchName( r, value );
+		} else if ( !Q_stricmp( key, "music" ) ) {
+			// an intro and a loop
+			s = strchr( value, ' ' );
+			if ( s ) {
+				*s++ = 0;
+				FS_PrefetchName( r, s );
+			}
+			FS_PrefetchName( r, value );
+		}
+	}
+}
+
+/*
+=================
+FS_PrefetchThread
+=================
+*/
+static void *FS_PrefetchThread( void *arg ) {
+	prefetchReader_t	r;
+	dheader_t			header;
+	pack_t				*pak;
+	const byte			*bsp;
+	int					length, i;
+
+	Com_Memset( &r, 0, sizeof( r ) );
+	pak = fs_prefetchBsp->pack;
+
+	bsp = FS_PrefetchFile( &r, pak, fs_prefetchBsp->pakFile, &length );
+	if ( bsp && length >= sizeof( header ) ) {
+		header = *(const dheader_t *)bsp;
+		for ( i = 0 ; i < sizeof( dheader_t ) / 4 ; i++ ) {
+			((int *)&header)[i] = LittleLong( ((int *)&header)[i] );
+		}
+
+		for ( i = 0 ; i < HEADER_LUMPS ; i++ ) {
+			if ( header.lumps[i].fileofs < 0 || header.lumps[i].filelen < 0
+				|| header.lumps[i].fileofs > length - header.lumps[i].filelen ) {
+				break;
+			}
+		}
+		if ( header.version == BSP_VERSION && i == HEADER_LUMPS ) {
+			FS_PrefetchShaders( &r, bsp, &header.lumps[LUMP_SHADERS] );
+			FS_PrefetchEntities( &r, bsp, &header.lumps[LUMP_ENTITIES] );
+		}
+	}
+
+	// what is left of the map's own pk3
+	for ( i = 0 ; i < pak->numfiles && !fs_prefetchQuit ; i++ ) {
+		if ( pak->buildBuffer[i].name[strlen( pak->buildBuffer[i].name ) - 1] != '/' ) {
+			FS_PrefetchFile( &r, pak, &pak->buildBuffer[i], &length );
+		}
+	}
+
+	if ( r.file ) {
+		fclose( r.file );
+	}
+	free( r.scratch );
+
+	return NULL;
+}
+
+/*
+=================
+FS_StartPrefetch
+=================
+*/
+static void FS_StartPrefetch( void ) {
+	fs_numPrefetchPure = fs_numServerPaks;
+	Com_Memcpy( fs_prefetchPure, fs_serverPaks, fs_numServerPaks * sizeof( fs_serverPaks[0] ) );
+
+	fs_prefetchQuit = qfalse;
+	if ( pthread_create( &fs_prefetchThread, NULL, FS_PrefetchThread, NULL ) ) {
+		Com_Printf( "WARNING: FS_StartPrefetch: couldn't create the prefetch thread\n" );
+		return;
+	}
+	fs_prefetchRunning = qtrue;
+}
+
+/*
+=================
+FS_StopPrefetch
+
+Stops the thread and lets go of the buffer
+=================
+*/
+static void FS_StopPrefetch( void ) {
+	if ( fs_prefetchRunning ) {
+		fs_prefetchQuit = qtrue;
+		pthread_join( fs_prefetchThread, NULL );
+		fs_prefetchRunning = qfalse;
+	}
+
+	free( fs_prefetchBuffer );
+	fs_prefetchBuffer = NULL;
+	fs_prefetchBufferSize = 0;
+	fs_prefetchUsed = 0;
+	fs_numPrefetchFiles = 0;
+	fs_prefetchBsp = NULL;
+	fs_prefetchMap[0] = 0;
+}
+
+/*
+=================
+FS_ReadPrefetched
+
+Copies the pk3 file open on f out of the prefetch buffer, qfalse if it
+isn't there
+=================
+*/
+static qboolean FS_ReadPrefetched( fileHandle_t f, byte *buf, int len ) {
+	prefetchFile_t	*p;
+	int64_t			start;
+	int				i;
+
+	if ( !fs_prefetchBuffer || !fsh[f].zipEntry ) {
+		return qfalse;
+	}
+
+	pthread_mutex_lock( &fs_prefetchMutex );
+	for ( i = 0, p = fs_prefetchFiles ; i < fs_numPrefetchFiles ; i++, p++ ) {
+		if ( p->pakFile == fsh[f].zipEntry ) {
+			break;
+		}
+	}
+	if ( i < fs_numPrefetchFiles && p->state == PREFETCH_READING ) {
+		start = Sys_Microseconds();
+		while ( p->state == PREFETCH_READING ) {
+			pthread_cond_wait( &fs_prefetchRead, &fs_prefetchMutex );
+		}
+		fs_loadStats.waitUsec += Sys_Microseconds() - start;
+	}
+	pthread_mutex_unlock( &fs_prefetchMutex );
+
+	if ( i == fs_numPrefetchFiles || p->state != PREFETCH_DONE || p->length != len ) {
+		return qfalse;
+	}
+
+	Com_Memcpy( buf, fs_prefetchBuffer + p->offset, len );
+	fs_loadStats.hits++;
+	fs_loadStats.hitBytes += len;
+	return qtrue;
+}
+
+#else
+
+static void FS_StartPrefetch( void ) {
+}
+
+static void FS_StopPrefetch( void ) {
+	free( fs_prefetchBuffer );
+	fs_prefetchBuffer = NULL;
+	fs_prefetchBsp = NULL;
+	fs_prefetchMap[0] = 0;
+}
+
+static qboolean FS_ReadPrefetched( fileHandle_t f, byte *buf, int len ) {
+	return qfalse;
+}
+
+#endif
+
+/*
+=================
+FS_PrefetchMap
+
+Starts reading what loading the bsp is going to need, and timing the
+load.  A listen server's client carries on with what the server started.
+=================
 */
+void FS_PrefetchMap( const char *name ) {
+	Com_Memset( &fs_loadStats, 0, sizeof( fs_loadStats ) );
+	fs_loadStats.active = qtrue;
+	fs_loadStats.start = Sys_Microseconds();
 
-int	FS_FileIsInPAK(const char *filename, int *pChecksum ) {
-	searchpath_t	*search;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
-	long			hash = 0;
-
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
+	if ( fs_prefetchBuffer && !Q_stricmp( name, fs_prefetchMap ) ) {
+		return;
 	}
+	FS_StopPrefetch();
 
-	if ( !filename ) {
-		Com_Error( ERR_FATAL, "FS_FOpenFileRead: NULL 'filename' parameter passed\n" );
+#ifndef _WIN32
+	if ( !fs_prefetch->integer || fs_prefetchSize->integer <= 0 || !fs_index->integer || !fs_indexTable ) {
+		return;
 	}
 
-	// qpaths are not supposed to have a leading slash
-	if ( filename[0] == '/' || filename[0] == '\\' ) {
-		filename++;
+	fs_prefetchBsp = FS_IndexFind( name, qtrue );
+	if ( !fs_prefetchBsp ) {
+		return;
 	}
 
-	// make absolutely sure that it can't back up the path.
-	// The searchpaths do guarantee that something will always
-	// be prepended, so we don't need to worry about "c:" or "//limbo"
-	if ( strstr( filename, ".." ) || strstr( filename, "::" ) ) {
-		return -1;
+	fs_prefetchBufferSize = fs_prefetchSize->integer << 20;
+	fs_prefetchBuffer = malloc( fs_prefetchBufferSize );
+	if ( !fs_prefetchBuffer ) {
+		Com_DPrintf( "FS_PrefetchMap: couldn't allocate %i MB\n", fs_prefetchSize->integer );
+		return;
 	}
 
-	//
-	// search through the path, one element at a time
-	//
+	Q_strncpyz( fs_prefetchMap, name, sizeof( fs_prefetchMap ) );
+	FS_StartPrefetch();
+#endif
+}
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		//
-		if (search->pack) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure(search->pack) ) {
-				continue;
-			}
+/*
+=================
+FS_PrefetchDone
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if (pChecksum) {
-						*pChecksum = pak->pure_checksum;
-					}
-					return 1;
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
+Prints how the load went, and gets rid of the prefetched files unless
+someone else is still to load the same map
+=================
+*/
+void FS_PrefetchDone( const char *loader, qboolean release ) {
+	int		total, reading;
+
+	if ( fs_loadStats.active ) {
+		fs_loadStats.active = qfalse;
+		total = ( Sys_Microseconds() - fs_loadStats.start ) / 1000;
+		reading = fs_loadStats.readUsec / 1000;
+
+		Com_Printf( "%s: %i msec, %i reading %i files (%i KB) of which %i waiting on the prefetch, %i everything else\n",
+			loader, total, reading, fs_loadStats.reads, fs_loadStats.readBytes >> 10,
+			(int)( fs_loadStats.waitUsec / 1000 ), total - reading );
+		if ( fs_prefetchMap[0] ) {
+			Com_Printf( "%s: %i files (%i KB) came from the prefetch, %i files (%i KB) prefetched\n",
+				loader, fs_loadStats.hits, fs_loadStats.hitBytes >> 10,
+				fs_numPrefetchFiles, fs_prefetchUsed >> 10 );
 		}
 	}
-	return -1;
+
+	if ( release ) {
+		FS_StopPrefetch();
+	}
 }
 
 /*
@@ -1473,6 +2502,7 @@ int FS_ReadFile( const char *qpath, void **buffer ) {
 	byte*			buf;
 	qboolean		isConfig;
 	int				len;
+	int64_t			start;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization\n" );
@@ -1482,6 +2512,8 @@ int FS_ReadFile( const char *qpath, void **buffer ) {
 		Com_Error( ERR_FATAL, "FS_ReadFile with empty name\n" );
 	}
 
+	start = fs_loadStats.active ? Sys_Microseconds() : 0;
+
 	buf = NULL;	// quiet compiler warning
 
 	// if this is a .cfg file and we are playing back a journal, read
@@ -1561,12 +2593,20 @@ int FS_ReadFile( const char *qpath, void **buffer ) {
 	buf = Hunk_AllocateTempMemory(len+1);
 	*buffer = buf;
 
-	FS_Read (buf, len, h);
+	if ( !FS_ReadPrefetched( h, buf, len ) && !FS_ReadMapped( h, buf, len ) ) {
+		FS_Read (buf, len, h);
+	}
 
 	// guarantee that it will have a trailing 0 for string operations
 	buf[len] = 0;
 	FS_FCloseFile( h );
 
+	if ( fs_loadStats.active ) {
+		fs_loadStats.readUsec += Sys_Microseconds() - start;
+		fs_loadStats.reads++;
+		fs_loadStats.readBytes += len;
+	}
+
 	// if we are journalling and it is a config file, write it to the journal file
 	if ( isConfig && com_journal && com_journal->integer == 1 ) {
 		Com_DPrintf( "Writing %s to journal file.\n", qpath );
@@ -1638,6 +2678,393 @@ ZIP FILE LOADING
 ==========================================================================
 */
 
+/*
+==========================================================================
+
+PAK DIRECTORY CACHE
+
+What FS_LoadZipFile reads out of each pk3 is kept for the next start in
+one file in the home path, keyed by the pk3's path, size and modification
+time.  A pk3 that hasn't changed gets its file list and the crcs its
+checksums are made from out of the cache, without its zip directory
+being read.  The pk3 is still opened before it is stat'ed, as
+FS_LoadZipFile would, so the cached offsets are for the file the handle
+has open even when the pk3 is replaced while the game is running.  The
+cache is written again whenever the paks on the search path don't match
+it.
+
+The file is PAKCACHE_MAGIC and a record per pak, in the order they are
+loaded.  A record is little endian ints: recordLength, size, mtime,
+numFiles, numCrcs, pathLength, namesLength, the zip directory position
+of each file and the crcs, followed by the path, the file names one
+after another with their terminating zeros, and padding to four bytes.
+
+==========================================================================
+*/
+
+#define	PAKCACHE_NAME		"pakcache.dat"
+#define	PAKCACHE_MAGIC		0x31434b50		// "PKC1"
+#define	PAKCACHE_HEADER		7				// ints ahead of the file positions
+
+static	cvar_t		*fs_pakCache;
+static	byte		*fs_pakCacheData;		// as read, until the search path is set up
+static	int			fs_pakCacheLength;
+static	int			fs_pakCachePos;			// the record the next pak is likely in
+static	int			fs_pakCacheRecords;
+static	int			fs_pakCacheHits;
+static	qboolean	fs_pakCacheDirty;
+
+/*
+=================
+FS_PakCachePath
+=================
+*/
+static char *FS_PakCachePath( void ) {
+	static char	path[MAX_OSPATH];
+
+	Com_sprintf( path, sizeof( path ), "%s/%s", fs_homepath->string, PAKCACHE_NAME );
+	FS_ReplaceSeparators( path );
+	return path;
+}
+
+/*
+=================
+FS_FreePakCache
+=================
+*/
+static void FS_FreePakCache( void ) {
+	if ( fs_pakCacheData ) {
+		Z_Free( fs_pakCacheData );
+	}
+	fs_pakCacheData = NULL;
+	fs_pakCacheLength = 0;
+	fs_pakCachePos = 0;
+	fs_pakCacheRecords = 0;
+}
+
+/*
+=================
+FS_ReadPakCache
+
+Reads the whole cache in one go, before any pk3 is loaded
+=================
+*/
+static void FS_ReadPakCache( void ) {
+	FILE	*f;
+	int		length, pos, recordLength;
+
+	FS_FreePakCache();
+	fs_pakCacheHits = 0;
+	fs_pakCacheDirty = qtrue;
+
+	if ( !fs_pakCache->integer || !fs_homepath->string[0] ) {
+		return;
+	}
+
+	f = fopen( FS_PakCachePath(), "rb" );
+	if ( !f ) {
+		return;
+	}
+	fseek( f, 0, SEEK_END );
+	length = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	if ( length < 4 || length & 3 ) {
+		fclose( f );
+		return;
+	}
+
+	fs_pakCacheData = Z_Malloc( length );
+	fs_pakCacheLength = length;
+	if ( fread( fs_pakCacheData, 1, length, f ) != length
+		|| LittleLong( ((int *)fs_pakCacheData)[0] ) != PAKCACHE_MAGIC ) {
+		fclose( f );
+		FS_FreePakCache();
+		return;
+	}
+	fclose( f );
+
+	// the records have to at least chain up to the end
+	for ( pos = 4 ; pos < length ; pos += recordLength ) {
+		recordLength = LittleLong( *(int *)( fs_pakCacheData + pos ) );
+		if ( recordLength < PAKCACHE_HEADER * 4 || recordLength & 3 || recordLength > length - pos ) {
+			Com_Printf( "Ignoring a damaged %s\n", PAKCACHE_NAME );
+			FS_FreePakCache();
+			return;
+		}
+		fs_pakCacheRecords++;
+	}
+
+	fs_pakCachePos = 4;
+	fs_pakCacheDirty = qfalse;
+}
+
+/*
+=================
+FS_PakFromCache
+
+Builds the pak_t FS_LoadZipFile would from a cache record, NULL if the
+record doesn't hold together
+=================
+*/
+static pack_t *FS_PakFromCache( const int *record, const char *zipfile, const char *basename ) {
+	fileInPack_t	*buildBuffer;
+	pack_t			*pack;
+	const char		*names, *p, *end;
+	int				recordLength, numFiles, numCrcs, pathLength, namesLength;
+	int				i, j;
+	long			hash;
+	qboolean		alreadyForeign = qfalse;
+
+	recordLength = LittleLong( record[0] );
+	numFiles = LittleLong( record[3] );
+	numCrcs = LittleLong( record[4] );
+	pathLength = LittleLong( record[5] );
+	namesLength = LittleLong( record[6] );
+
+	if ( numFiles < 0 || numCrcs < 0 || numCrcs > numFiles || namesLength < numFiles
+		|| numFiles > recordLength / 4 || namesLength > recordLength
+		|| PAKCACHE_HEADER * 4 + ( numFiles + numCrcs ) * 4 + pathLength + namesLength > recordLength ) {
+		return NULL;
+	}
+
+	// one name per file, all there
+	names = (const char *)( record + PAKCACHE_HEADER + numFiles + numCrcs ) + pathLength;
+	end = names + namesLength;
+	for ( i = 0, p = names ; i < numFiles ; i++ ) {
+		while ( p < end && *p ) {
+			p++;
+		}
+		if ( p == end ) {
+			return NULL;
+		}
+		p++;
+	}
+	if ( p != end ) {
+		return NULL;
+	}
+
+	fs_packFiles += numFiles;
+
+	buildBuffer = Z_Malloc( ( numFiles * sizeof( fileInPack_t ) ) + namesLength );
+	Com_Memcpy( buildBuffer + numFiles, names, namesLength );
+
+	// get the hash table size from the number of files in the zip
+	// because lots of custom pk3 files have less than 32 or 64 files
+	for ( i = 1; i <= MAX_FILEHASH_SIZE; i <<= 1 ) {
+		if ( i > numFiles ) {
+			break;
+		}
+	}
+
+	pack = Z_Malloc( sizeof( pack_t ) + i * sizeof( fileInPack_t * ) );
+	pack->hashSize = i;
+	pack->hashTable = (fileInPack_t **) (((char *) pack) + sizeof( pack_t ));
+
+	Q_strncpyz( pack->pakFilename, zipfile, sizeof( pack->pakFilename ) );
+	Q_strncpyz( pack->pakBasename, basename, sizeof( pack->pakBasename ) );
+
+	// strip .pk3 if needed
+	if ( strlen( pack->pakBasename ) > 4 && !Q_stricmp( pack->pakBasename + strlen( pack->pakBasename ) - 4, ".pk3" ) ) {
+		pack->pakBasename[strlen( pack->pakBasename ) - 4] = 0;
+	}
+
+	pack->numfiles = numFiles;
+	pack->buildBuffer = buildBuffer;
+
+	p = (const char *)( buildBuffer + numFiles );
+	for ( i = 0 ; i < numFiles ; i++ ) {
+		if ( strstr( p, ".qvm" ) && strstr( pack->pakFilename, "download/" ) ) {
+			for ( j = 0 ; j < foreignQVMsFound ; j++ ) {
+				if ( !strcmp( foreignQVMNames[j], pack->pakBasename ) ) {
+					alreadyForeign = qtrue;
+				}
+			}
+
+			if ( !alreadyForeign ) {
+				Com_sprintf( foreignQVMNames[foreignQVMsFound], MAX_ZPATH, pack->pakBasename );
+				foreignQVMsFound++;
+			}
+		}
+
+		hash = FS_HashFileName( p, pack->hashSize );
+		buildBuffer[i].name = (char *)p;
+		buildBuffer[i].pos = (unsigned int)LittleLong( record[PAKCACHE_HEADER + i] );
+		buildBuffer[i].next = pack->hashTable[hash];
+		pack->hashTable[hash] = &buildBuffer[i];
+		p += strlen( p ) + 1;
+	}
+
+	// the crcs are kept as they go into the checksums
+	pack->numCrcs = numCrcs;
+	pack->crcs = Z_Malloc( ( numCrcs + 1 ) * sizeof( int ) );
+	Com_Memcpy( pack->crcs + 1, record + PAKCACHE_HEADER + numFiles, numCrcs * sizeof( int ) );
+	pack->crcs[0] = LittleLong( fs_checksumFeed );
+
+	pack->checksum = Com_BlockChecksum( &pack->crcs[ 1 ], 4 * numCrcs );
+	pack->pure_checksum = Com_BlockChecksum( pack->crcs, 4 * ( numCrcs + 1 ) );
+	pack->checksum = LittleLong( pack->checksum );
+	pack->pure_checksum = LittleLong( pack->pure_checksum );
+
+	return pack;
+}
+
+/*
+=================
+FS_LoadCachedPak
+
+NULL when the pk3 isn't in the cache as it is now
+=================
+*/
+static pack_t *FS_LoadCachedPak( const char *zipfile, const char *basename, int size, int mtime ) {
+	const int	*record;
+	pack_t		*pack;
+	int			pos, pathLength, i;
+
+	if ( !fs_pakCacheData ) {
+		return NULL;
+	}
+
+	// the paks load in the order they were written, so this is usually the first try
+	pathLength = strlen( zipfile );
+	pos = fs_pakCachePos;
+	for ( i = 0 ; i < fs_pakCacheRecords ; i++ ) {
+		if ( pos >= fs_pakCacheLength ) {
+			pos = 4;
+		}
+		record = (const int *)( fs_pakCacheData + pos );
+		pos += LittleLong( record[0] );
+
+		if ( LittleLong( record[1] ) != size || LittleLong( record[2] ) != mtime
+			|| LittleLong( record[5] ) != pathLength ) {
+			continue;
+		}
+		if ( PAKCACHE_HEADER * 4 + ( LittleLong( record[3] ) + LittleLong( record[4] ) ) * 4 + pathLength > LittleLong( record[0] )
+			|| LittleLong( record[3] ) < 0 || LittleLong( record[4] ) < 0 ) {
+			continue;
+		}
+		if ( memcmp( record + PAKCACHE_HEADER + LittleLong( record[3] ) + LittleLong( record[4] ), zipfile, pathLength ) ) {
+			continue;
+		}
+
+		pack = FS_PakFromCache( record, zipfile, basename );
+		if ( pack ) {
+			fs_pakCachePos = pos;
+			fs_pakCacheHits++;
+		}
+		return pack;
+	}
+
+	return NULL;
+}
+
+/*
+=================
+FS_WritePakRecord
+=================
+*/
+static void FS_WritePakRecord( FILE *f, pack_t *pack ) {
+	static const byte	pad[4];
+	int					header[PAKCACHE_HEADER], pos, i;
+	int					pathLength, namesLength;
+
+	pathLength = strlen( pack->pakFilename );
+	namesLength = 0;
+	for ( i = 0 ; i < pack->numfiles ; i++ ) {
+		namesLength += strlen( pack->buildBuffer[i].name ) + 1;
+	}
+
+	header[0] = PAKCACHE_HEADER * 4 + ( pack->numfiles + pack->numCrcs ) * 4 + pathLength + namesLength;
+	header[0] = ( header[0] + 3 ) & ~3;
+	header[1] = pack->fileSize;
+	header[2] = pack->fileTime;
+	header[3] = pack->numfiles;
+	header[4] = pack->numCrcs;
+	header[5] = pathLength;
+	header[6] = namesLength;
+	for ( i = 0 ; i < PAKCACHE_HEADER ; i++ ) {
+		header[i] = LittleLong( header[i] );
+	}
+	fwrite( header, sizeof( header ), 1, f );
+
+	for ( i = 0 ; i < pack->numfiles ; i++ ) {
+		pos = LittleLong( (int)pack->buildBuffer[i].pos );
+		fwrite( &pos, sizeof( pos ), 1, f );
+	}
+	fwrite( pack->crcs + 1, sizeof( int ), pack->numCrcs, f );
+	fwrite( pack->pakFilename, 1, pathLength, f );
+
+	// the names are one after another, as they were loaded
+	if ( pack->numfiles ) {
+		fwrite( pack->buildBuffer[0].name, 1, namesLength, f );
+	}
+	fwrite( pad, 1, ( 4 - ( ( pathLength + namesLength ) & 3 ) ) & 3, f );
+}
+
+/*
+=================
+FS_WritePakCache
+
+Called once the search path is set up.  Writes the cache again if it
+didn't have every pak, or had others, and lets go of what only the cache
+needs.
+=================
+*/
+static void FS_WritePakCache( void ) {
+	searchpath_t	*search;
+	pack_t			**packs;
+	FILE			*f;
+	int				numPacks, i, magic;
+
+	numPacks = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			numPacks++;
+		}
+	}
+
+	if ( fs_pakCacheHits != fs_pakCacheRecords || fs_pakCacheHits != numPacks ) {
+		fs_pakCacheDirty = qtrue;
+	}
+	if ( fs_pakCacheHits ) {
+		Com_Printf( "%d of %d pk3 files from %s\n", fs_pakCacheHits, numPacks, PAKCACHE_NAME );
+	}
+	FS_FreePakCache();
+
+	if ( fs_pakCacheDirty && fs_pakCache->integer && fs_homepath->string[0] && numPacks ) {
+		// in the order they were loaded, the search path has them the other way round
+		packs = Z_Malloc( numPacks * sizeof( *packs ) );
+		i = numPacks;
+		for ( search = fs_searchpaths ; search ; search = search->next ) {
+			if ( search->pack ) {
+				packs[--i] = search->pack;
+			}
+		}
+
+		f = fopen( FS_PakCachePath(), "wb" );
+		if ( f ) {
+			magic = LittleLong( PAKCACHE_MAGIC );
+			fwrite( &magic, sizeof( magic ), 1, f );
+			for ( i = 0 ; i < numPacks ; i++ ) {
+				if ( packs[i]->crcs ) {
+					FS_WritePakRecord( f, packs[i] );
+				}
+			}
+			fclose( f );
+		} else {
+			Com_DPrintf( "Couldn't write %s\n", FS_PakCachePath() );
+		}
+
+		Z_Free( packs );
+	}
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->crcs ) {
+			Z_Free( search->pack->crcs );
+			search->pack->crcs = NULL;
+		}
+	}
+}
+
 /*
 =================
 FS_LoadZipFile
@@ -1757,7 +3184,13 @@ static pack_t *FS_LoadZipFile( char *zipfile, const char *basename )
 	pack->checksum = LittleLong( pack->checksum );
 	pack->pure_checksum = LittleLong( pack->pure_checksum );
 
-	Z_Free(fs_headerLongs);
+	// keep the crcs for the pak cache, unless the directory was cut short
+	if ( i == gi.number_entry ) {
+		pack->crcs = fs_headerLongs;
+		pack->numCrcs = fs_numHeaderLongs - 1;
+	} else {
+		Z_Free(fs_headerLongs);
+	}
 
 	pack->buildBuffer = buildBuffer;
 	return pack;
@@ -2432,6 +3865,8 @@ void FS_AddGameDirectory( const char *path, const char *dir ) {
 	char			*pakfile;
 	int				numfiles;
 	char			**pakfiles;
+	int				size, mtime;
+	unzFile			uf;
 
 	// Unique
 	for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
@@ -2463,8 +3898,25 @@ void FS_AddGameDirectory( const char *path, const char *dir ) {
 
 	for ( i = 0 ; i < numfiles ; i++ ) {
 		pakfile = FS_BuildOSPath( path, dir, pakfiles[i] );
-		if ( ( pak = FS_LoadZipFile( pakfile, pakfiles[i] ) ) == 0 )
+		uf = unzOpen( pakfile );
+		if ( !uf ) {
+			continue;
+		}
+		if ( !Sys_FileStat( pakfile, &size, &mtime ) ) {
+			unzClose( uf );
 			continue;
+		}
+		pak = FS_LoadCachedPak( pakfile, pakfiles[i], size, mtime );
+		if ( pak ) {
+			pak->handle = uf;
+		} else {
+			unzClose( uf );
+			fs_pakCacheDirty = qtrue;
+			if ( ( pak = FS_LoadZipFile( pakfile, pakfiles[i] ) ) == 0 )
+				continue;
+		}
+		pak->fileSize = size;
+		pak->fileTime = mtime;
 		// store the game name for downloading
 		strcpy(pak->pakGamename, dir);
 
@@ -2655,12 +4107,23 @@ void FS_Shutdown( qboolean closemfp ) {
 		}
 	}
 
+	FS_StopPrefetch();
+	FS_FreeIndex();
+
 	// free everything
 	for ( p = fs_searchpaths ; p ; p = next ) {
 		next = p->next;
 
 		if ( p->pack ) {
-			unzClose(p->pack->handle);
+			if ( p->pack->handle ) {
+				unzClose(p->pack->handle);
+			}
+			if ( p->pack->crcs ) {
+				Z_Free( p->pack->crcs );
+			}
+			if ( p->pack->mapped ) {
+				Sys_UnmapFile( p->pack->mapped, p->pack->mappedLength );
+			}
 			Z_Free( p->pack->buildBuffer );
 			Z_Free( p->pack );
 		}
@@ -2670,6 +4133,9 @@ void FS_Shutdown( qboolean closemfp ) {
 		Z_Free( p );
 	}
 
+	// the views went with the mappings
+	Com_Memset( fs_views, 0, sizeof( fs_views ) );
+
 	// any FS_ calls will now be an error until reinitialized
 	fs_searchpaths = NULL;
 
@@ -2677,6 +4143,7 @@ void FS_Shutdown( qboolean closemfp ) {
 	Cmd_RemoveCommand( "dir" );
 	Cmd_RemoveCommand( "fdir" );
 	Cmd_RemoveCommand( "touchFile" );
+	Cmd_RemoveCommand( "lookupBench" );
 
 #ifdef FS_MISSING
 	if (closemfp) {
@@ -2744,6 +4211,11 @@ static void FS_Startup( const char *gameName )
 	foreignQVMsFound = 0;
 
 	fs_debug = Cvar_Get( "fs_debug", "0", 0 );
+	fs_index = Cvar_Get( "fs_index", "1", 0 );
+	fs_pakCache = Cvar_Get( "fs_pakCache", "1", 0 );
+	fs_mmap = Cvar_Get( "fs_mmap", "1", 0 );
+	fs_prefetch = Cvar_Get( "fs_prefetch", "1", 0 );
+	fs_prefetchSize = Cvar_Get( "fs_prefetchSize", "64", 0 );
 	fs_basepath = Cvar_Get ("fs_basepath", Sys_DefaultInstallPath(), CVAR_INIT );
 	fs_basegame = Cvar_Get ("fs_basegame", "", CVAR_INIT );
 	
@@ -2759,6 +4231,8 @@ static void FS_Startup( const char *gameName )
 	fs_homepath = Cvar_Get ("fs_homepath", homePath, CVAR_INIT );
 	fs_gamedirvar = Cvar_Get ("fs_game", "q3ut4", CVAR_INIT|CVAR_SYSTEMINFO );
 
+	FS_ReadPakCache();
+
 	// add search path elements in reverse priority order
 	if (fs_basepath->string[0]) {
 		FS_AddGameDirectory(va("%s/q3ut4", fs_basepath->string), "download");
@@ -2811,11 +4285,15 @@ static void FS_Startup( const char *gameName )
 	Cmd_AddCommand ("dir", FS_Dir_f );
 	Cmd_AddCommand ("fdir", FS_NewDir_f );
 	Cmd_AddCommand ("touchFile", FS_TouchFile_f );
+	Cmd_AddCommand ("lookupBench", FS_LookupBench_f );
 
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=506
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
 
+	FS_WritePakCache();
+	FS_BuildIndex();
+
 	// print the current search paths
 	FS_Path_f();
 
@@ -29,22 +29,23 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static int			bloc = 0;
 
+// the offset versions keep their position in locals instead of bloc,
+// so messages can be written on several threads at once
+
 void	Huff_putBit( int bit, byte *fout, int *offset) {
-	bloc = *offset;
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
+	int pos = *offset;
+	if ((pos&7) == 0) {
+		fout[(pos>>3)] = 0;
 	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
-	*offset = bloc;
+	fout[(pos>>3)] |= bit << (pos&7);
+	*offset = pos + 1;
 }
 
 int		Huff_getBit( byte *fin, int *offset) {
 	int t;
-	bloc = *offset;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	*offset = bloc;
+	int pos = *offset;
+	t = (fin[(pos>>3)] >> (pos&7)) & 0x1;
+	*offset = pos + 1;
 	return t;
 }
 
@@ -270,13 +271,14 @@ int Huff_Receive (node_t *node, int *ch, byte *fin) {
 
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
-	bloc = *offset;
+	int pos = *offset;
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if ((fin[(pos>>3)] >> (pos&7)) & 0x1) {
 			node = node->right;
 		} else {
 			node = node->left;
 		}
+		pos++;
 	}
 	if (!node) {
 		*ch = 0;
@@ -284,7 +286,7 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset) {
 //		Com_Error(ERR_DROP, "Illegal tree!\n");
 	}
 	*ch = node->symbol;
-	*offset = bloc;
+	*offset = pos;
 }
 
 /* Send the prefix code for this node */
@@ -316,9 +318,18 @@ void Huff_transmit (huff_t *huff, int ch, byte *fout) {
 }
 
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset) {
-	bloc = *offset;
-	send(huff->loc[ch], NULL, fout);
-	*offset = bloc;
+	byte	path[HMAX+2];
+	int		depth;
+	node_t	*node;
+
+	// walk up to the root, then emit the branches top down
+	depth = 0;
+	for (node = huff->loc[ch]; node->parent; node = node->parent) {
+		path[depth++] = (node->parent->right == node);
+	}
+	while (depth--) {
+		Huff_putBit(path[depth], fout, offset);
+	}
 }
 
 void Huff_Decompress(msg_t *mbuf, int offset) {
@@ -373,8 +384,6 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern 	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
 	int			i, ch, size;
 	byte		seq[65536];
@@ -435,3 +444,125 @@ void Huff_Init(huffman_t *huff) {
 	huff->compressor.loc[NYT] = huff->compressor.tree;
 }
 
+
+/*
+=============================================================================
+
+Static codec
+
+Once a tree stops being updated, as with the fixed table msg.c builds
+from msg_hData, its codes can be listed for writing and resolved
+HUFF_LOOKUP_BITS at a time for reading.  This produces exactly the bits
+Huff_offsetTransmit and Huff_offsetReceive do, without walking the tree
+one bit at a time.
+
+=============================================================================
+*/
+
+/*
+=================
+Huff_BuildCodec
+=================
+*/
+void Huff_BuildCodec( huffCodec_t *codec, huff_t *huff ) {
+	node_t	*node;
+	int		ch, depth, i;
+	int		code, fill;
+
+	Com_Memset( codec, 0, sizeof( *codec ) );
+	codec->huff = huff;
+	codec->tree = huff->tree;
+
+	for ( ch = 0 ; ch <= HMAX ; ch++ ) {
+		if ( !huff->loc[ch] ) {
+			continue;
+		}
+
+		// the branch out of the root is sent first, so it goes in bit 0
+		code = 0;
+		depth = 0;
+		for ( node = huff->loc[ch]; node->parent; node = node->parent ) {
+			code = ( code << 1 ) | ( node->parent->right == node );
+			depth++;
+		}
+
+		if ( depth > HUFF_MAX_CODE_BITS ) {
+			continue;		// left to the tree walkers
+		}
+		if ( ch < HMAX ) {
+			codec->code[ch] = code;
+			codec->length[ch] = depth;
+		}
+
+		// every lookup index starting with this code resolves to it
+		if ( depth <= HUFF_LOOKUP_BITS ) {
+			for ( fill = 0 ; fill < ( 1 << ( HUFF_LOOKUP_BITS - depth ) ) ; fill++ ) {
+				i = code | ( fill << depth );
+				codec->lookup[i] = ch | ( depth << 9 );
+			}
+		}
+	}
+}
+
+/*
+=================
+Huff_putBits
+
+Writes the low count bits of value, count can be up to 57
+=================
+*/
+void Huff_putBits( uint64_t value, int count, byte *fout, int *offset ) {
+	int		pos = *offset;
+	byte	*out = fout + ( pos >> 3 );
+	int		i;
+
+	// keep the bits already in the partial byte, clear the rest like
+	// Huff_putBit does when it starts a byte
+	value = ( value << ( pos & 7 ) ) | ( *out & ( ( 1 << ( pos & 7 ) ) - 1 ) );
+	count += pos & 7;
+
+	for ( i = 0 ; i < count ; i += 8 ) {
+		*out++ = (byte)value;
+		value >>= 8;
+	}
+
+	*offset = pos + count - ( pos & 7 );
+}
+
+/*
+=================
+Huff_codecTransmit
+=================
+*/
+void Huff_codecTransmit( const huffCodec_t *codec, int ch, byte *fout, int *offset ) {
+	if ( !codec->length[ch] ) {
+		Huff_offsetTransmit( codec->huff, ch, fout, offset );
+		return;
+	}
+	Huff_putBits( codec->code[ch], codec->length[ch], fout, offset );
+}
+
+/*
+=================
+Huff_codecReceive
+
+Reads up to two bytes past the byte holding the offset
+=================
+*/
+void Huff_codecReceive( const huffCodec_t *codec, int *ch, byte *fin, int *offset ) {
+	int		pos = *offset;
+	byte	*in = fin + ( pos >> 3 );
+	int		bits;
+	int		entry;
+
+	bits = ( in[0] | ( in[1] << 8 ) | ( in[2] << 16 ) ) >> ( pos & 7 );
+	entry = codec->lookup[bits & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 )];
+
+	if ( !entry ) {
+		Huff_offsetReceive( codec->tree, ch, fin, offset );
+		return;
+	}
+
+	*ch = entry & 511;
+	*offset = pos + ( entry >> 9 );
+}
@@ -0,0 +1,255 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// jobs.c -- worker threads for splitting a loop across cores
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+=============================================================================
+
+Com_ParallelFor hands the indexes 0 .. count-1 of a loop out to
+com_jobThreads worker threads and the calling thread, and returns once
+all of them have been processed.
+
+Jobs run outside of the frame's setjmp, so they must not call Com_Error,
+Com_Printf or anything else that touches shared engine state.  Anything
+that needs reporting has to be stored in the job data and dealt with by
+the caller after Com_ParallelFor returns.
+
+Without pthreads (win32) the loop simply runs on the calling thread.
+
+=============================================================================
+*/
+
+cvar_t		*com_jobThreads;
+
+#ifndef _WIN32
+
+#include <pthread.h>
+
+static pthread_t		jobThreads[MAX_JOB_THREADS];
+static int				numJobThreads;
+
+static pthread_mutex_t	jobMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	jobWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	jobDone = PTHREAD_COND_INITIALIZER;
+
+static jobFunc_t		jobFunc;
+static void				*jobData;
+static int				jobCount;
+static volatile int		jobNext;			// next index to hand out, bumped atomically
+static int				jobBusy;			// workers still inside the current loop
+static int				jobGeneration;		// bumped for every loop so workers see new work
+static qboolean			jobQuit;
+
+/*
+=================
+Com_RunJobs
+
+Takes indexes until the current loop runs out
+=================
+*/
+static void Com_RunJobs( int thread ) {
+	int		index;
+
+	while ( 1 ) {
+		index = __sync_fetch_and_add( &jobNext, 1 );
+		if ( index >= jobCount ) {
+			return;
+		}
+		jobFunc( jobData, index, thread );
+	}
+}
+
+/*
+=================
+Com_JobThread
+=================
+*/
+static void *Com_JobThread( void *arg ) {
+	int		thread = (int)(intptr_t)arg;
+	int		generation = 0;
+
+	pthread_mutex_lock( &jobMutex );
+	while ( 1 ) {
+		while ( !jobQuit && generation == jobGeneration ) {
+			pthread_cond_wait( &jobWake, &jobMutex );
+		}
+		if ( jobQuit ) {
+			break;
+		}
+		generation = jobGeneration;
+		pthread_mutex_unlock( &jobMutex );
+
+		Com_RunJobs( thread );
+
+		pthread_mutex_lock( &jobMutex );
+		if ( --jobBusy == 0 ) {
+			pthread_cond_signal( &jobDone );
+		}
+	}
+	pthread_mutex_unlock( &jobMutex );
+
+	return NULL;
+}
+
+/*
+=================
+Com_ShutdownJobs
+=================
+*/
+void Com_ShutdownJobs( void ) {
+	int		i;
+
+	if ( !numJobThreads ) {
+		return;
+	}
+
+	pthread_mutex_lock( &jobMutex );
+	jobQuit = qtrue;
+	pthread_cond_broadcast( &jobWake );
+	pthread_mutex_unlock( &jobMutex );
+
+	for ( i = 0 ; i < numJobThreads ; i++ ) {
+		pthread_join( jobThreads[i], NULL );
+	}
+
+	numJobThreads = 0;
+	jobQuit = qfalse;
+}
+
+/*
+=================
+Com_StartJobs
+=================
+*/
+static void Com_StartJobs( void ) {
+	int		count;
+
+	Com_ShutdownJobs();
+
+	count = com_jobThreads->integer;
+	if ( count > MAX_JOB_THREADS ) {
+		count = MAX_JOB_THREADS;
+	}
+
+	// new workers wait for the next generation
+	jobGeneration = 0;
+
+	for ( numJobThreads = 0 ; numJobThreads < count ; numJobThreads++ ) {
+		if ( pthread_create( &jobThreads[numJobThreads], NULL, Com_JobThread, (void *)(intptr_t)(numJobThreads + 1) ) ) {
+			Com_Printf( "WARNING: Com_StartJobs: couldn't create worker thread %i\n", numJobThreads + 1 );
+			break;
+		}
+	}
+
+	if ( numJobThreads ) {
+		Com_Printf( "Started %i job threads\n", numJobThreads );
+	}
+}
+
+/*
+=================
+Com_JobThreadCount
+
+Number of worker threads, the thread argument of a job is in 0 .. count
+=================
+*/
+int Com_JobThreadCount( void ) {
+	if ( com_jobThreads && com_jobThreads->modified ) {
+		com_jobThreads->modified = qfalse;
+		Com_StartJobs();
+	}
+
+	return numJobThreads;
+}
+
+/*
+=================
+Com_ParallelFor
+=================
+*/
+void Com_ParallelFor( jobFunc_t func, void *data, int count ) {
+	int		i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	// nothing to gain from waking the workers for a single job
+	if ( !Com_JobThreadCount() || count == 1 ) {
+		for ( i = 0 ; i < count ; i++ ) {
+			func( data, i, 0 );
+		}
+		return;
+	}
+
+	pthread_mutex_lock( &jobMutex );
+	jobFunc = func;
+	jobData = data;
+	jobCount = count;
+	jobNext = 0;
+	jobBusy = numJobThreads;
+	jobGeneration++;
+	pthread_cond_broadcast( &jobWake );
+	pthread_mutex_unlock( &jobMutex );
+
+	// the calling thread works too
+	Com_RunJobs( 0 );
+
+	pthread_mutex_lock( &jobMutex );
+	while ( jobBusy ) {
+		pthread_cond_wait( &jobDone, &jobMutex );
+	}
+	pthread_mutex_unlock( &jobMutex );
+}
+
+#else
+
+void Com_ShutdownJobs( void ) {
+}
+
+int Com_JobThreadCount( void ) {
+	return 0;
+}
+
+void Com_ParallelFor( jobFunc_t func, void *data, int count ) {
+	int		i;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		func( data, i, 0 );
+	}
+}
+
+#endif
+
+/*
+=================
+Com_InitJobs
+=================
+*/
+void Com_InitJobs( void ) {
+	com_jobThreads = Cvar_Get( "com_jobThreads", "0", CVAR_ARCHIVE );
+	// started on first use
+	com_jobThreads->modified = qtrue;
+}
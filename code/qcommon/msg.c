@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 
 static huffman_t		msgHuff;
+static huffCodec_t		msgCodec;				// msgHuff never changes after MSG_initHuffman
 
 static qboolean			msgInit = qfalse;
 
@@ -37,7 +38,15 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-int oldsize = 0;
+// bit counters for debugging, per thread as the parallel snapshot
+// jobs write messages too
+#ifndef _WIN32
+static __thread int	oldsize;
+static __thread int	overflows;
+#else
+static int	oldsize;
+static int	overflows;
+#endif
 
 void MSG_initHuffman( void );
 
@@ -101,8 +110,6 @@ bit functions
 =============================================================================
 */
 
-int	overflows;
-
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	int	i;
@@ -158,29 +165,93 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			Com_Error(ERR_DROP, "can't read %d bits\n", bits);
 		}
 	} else {
-//		fp = fopen("c:\\netchan.bin", "a");
+		uint64_t	acc;
+		int			accBits, ch;
+
 		value &= (0xffffffff>>(32-bits));
+
+		// the raw low bits and the code for each byte are gathered
+		// up and written to the message at once
+		acc = 0;
+		accBits = 0;
 		if (bits&7) {
 			int nbits;
 			nbits = bits&7;
-			for(i=0;i<nbits;i++) {
-				Huff_putBit((value&1), msg->data, &msg->bit);
-				value = (value>>1);
-			}
+			acc = value & ((1<<nbits)-1);
+			accBits = nbits;
+			value = (value>>nbits);
 			bits = bits - nbits;
 		}
-		if (bits) {
-			for(i=0;i<bits;i+=8) {
-//				fwrite(bp, 1, 1, fp);
-				Huff_offsetTransmit (&msgHuff.compressor, (value&0xff), msg->data, &msg->bit);
-				value = (value>>8);
+		for(i=0;i<bits;i+=8) {
+			ch = value&0xff;
+			if ( !msgCodec.length[ch] || accBits + msgCodec.length[ch] > 57 ) {
+				Huff_putBits( acc, accBits, msg->data, &msg->bit );
+				acc = 0;
+				accBits = 0;
+				if ( !msgCodec.length[ch] ) {
+					Huff_offsetTransmit (&msgHuff.compressor, ch, msg->data, &msg->bit);
+					value = (value>>8);
+					continue;
+				}
 			}
+			acc |= (uint64_t)msgCodec.code[ch] << accBits;
+			accBits += msgCodec.length[ch];
+			value = (value>>8);
+		}
+		if ( accBits ) {
+			Huff_putBits( acc, accBits, msg->data, &msg->bit );
 		}
 		msg->cursize = (msg->bit>>3)+1;
-//		fclose(fp);
 	}
 }
 
+/*
+=================
+MSG_WriteEncodedBits
+
+Appends numBits bits that were already written to another bitstream
+message, starting at startBit of its data.  The huffman table is fixed,
+so the bits decode the same wherever they are placed.
+=================
+*/
+void MSG_WriteEncodedBits( msg_t *msg, const byte *data, int startBit, int numBits ) {
+	int		shift, value;
+
+	if ( msg->oob ) {
+		Com_Error( ERR_DROP, "MSG_WriteEncodedBits: oob message" );
+	}
+
+	// same slack as MSG_WriteBits
+	if ( msg->maxsize - msg->cursize < ( numBits >> 3 ) + 4 ) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	// whole bytes, read across the source byte boundary and
+	// split across the destination one
+	for ( ; numBits >= 8 ; numBits -= 8, startBit += 8 ) {
+		value = data[startBit >> 3];
+		if ( startBit & 7 ) {
+			value = ( ( value | ( data[(startBit >> 3) + 1] << 8 ) ) >> ( startBit & 7 ) ) & 0xff;
+		}
+
+		shift = msg->bit & 7;
+		if ( shift ) {
+			msg->data[msg->bit >> 3] |= value << shift;
+			msg->data[(msg->bit >> 3) + 1] = value >> ( 8 - shift );
+		} else {
+			msg->data[msg->bit >> 3] = value;
+		}
+		msg->bit += 8;
+	}
+
+	for ( ; numBits > 0 ; numBits--, startBit++ ) {
+		Huff_putBit( ( data[startBit >> 3] >> ( startBit & 7 ) ) & 1, msg->data, &msg->bit );
+	}
+
+	msg->cursize = (msg->bit>>3)+1;
+}
+
 int MSG_ReadBits( msg_t *msg, int bits ) {
 	int			value;
 	int			get;
@@ -225,13 +296,15 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 			bits = bits - nbits;
 		}
 		if (bits) {
-//			fp = fopen("c:\\netchan.bin", "a");
 			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
-//				fwrite(&get, 1, 1, fp);
+				// the lookup reads a couple of bytes ahead
+				if ( (msg->bit>>3) + 3 <= msg->maxsize ) {
+					Huff_codecReceive (&msgCodec, &get, msg->data, &msg->bit);
+				} else {
+					Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit);
+				}
 				value |= (get<<(i+nbits));
 			}
-//			fclose(fp);
 		}
 		msg->readcount = (msg->bit>>3)+1;
 	}
@@ -1726,6 +1799,143 @@ void MSG_initHuffman( void ) {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+
+	// both trees got the same updates, so one codec does for both
+	Huff_BuildCodec( &msgCodec, &msgHuff.compressor );
+}
+
+/*
+=================
+MSG_HuffBench_f
+
+huffbench [demo]
+
+Times the tree walking huffman coder against the table driven one
+msg.c uses, on the messages of a recorded demo read as one stream of
+symbols, or on symbols drawn from msg_hData.  Also checks that both
+produce the same bits.
+=================
+*/
+#define	HUFFBENCH_SYMBOLS	(1<<20)
+
+static int MSG_HuffBenchSymbols( byte *symbols, const char *name ) {
+	byte	*data, *buf;
+	int		len, size, count, pos, ch, total, r;
+	int		i, j;
+
+	if ( !*name ) {
+		for ( i = 0, total = 0 ; i < 256 ; i++ ) {
+			total += msg_hData[i];
+		}
+		for ( count = 0 ; count < HUFFBENCH_SYMBOLS ; count++ ) {
+			r = ( ( rand() & 0x7fff ) << 15 | ( rand() & 0x7fff ) ) % total;
+			for ( j = 0 ; r >= msg_hData[j] ; j++ ) {
+				r -= msg_hData[j];
+			}
+			symbols[count] = j;
+		}
+		return count;
+	}
+
+	size = FS_ReadFile( name, (void **)&buf );
+	if ( size <= 0 ) {
+		Com_Printf( "Couldn't read %s\n", name );
+		return 0;
+	}
+
+	// sequence, length, huffman coded message
+	count = 0;
+	data = buf;
+	while ( data + 8 <= buf + size && count < HUFFBENCH_SYMBOLS ) {
+		len = LittleLong( ((int *)data)[1] );
+		data += 8;
+		if ( len <= 0 || data + len > buf + size ) {
+			break;
+		}
+		for ( pos = 0 ; pos + 8 <= len * 8 && count < HUFFBENCH_SYMBOLS ; ) {
+			Huff_offsetReceive( msgHuff.decompressor.tree, &ch, data, &pos );
+			if ( ch < HMAX ) {
+				symbols[count++] = ch;
+			}
+		}
+		data += len;
+	}
+
+	FS_FreeFile( buf );
+	return count;
+}
+
+void MSG_HuffBench_f( void ) {
+	byte	*symbols, *bitsA, *bitsB, *decoded;
+	int		count, passes, pass, i, ch;
+	int		posA, posB;
+	int64_t	start, tree[2], table[2];
+
+	if ( !msgInit ) {
+		MSG_initHuffman();
+	}
+
+	symbols = Hunk_AllocateTempMemory( HUFFBENCH_SYMBOLS * 2 + 2 * ( HUFFBENCH_SYMBOLS * 2 + 4 ) );
+	decoded = symbols + HUFFBENCH_SYMBOLS;
+	bitsA = decoded + HUFFBENCH_SYMBOLS;
+	bitsB = bitsA + HUFFBENCH_SYMBOLS * 2 + 4;
+
+	count = MSG_HuffBenchSymbols( symbols, Cmd_Argv( 1 ) );
+	if ( !count ) {
+		Hunk_FreeTempMemory( symbols );
+		return;
+	}
+
+	passes = 1 + 16 * HUFFBENCH_SYMBOLS / count;
+	posA = posB = 0;
+	tree[0] = tree[1] = table[0] = table[1] = 0;
+
+	for ( pass = 0 ; pass < passes ; pass++ ) {
+		start = Sys_Microseconds();
+		for ( i = 0, posA = 0 ; i < count ; i++ ) {
+			Huff_offsetTransmit( &msgHuff.compressor, symbols[i], bitsA, &posA );
+		}
+		tree[0] += Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		for ( i = 0, posB = 0 ; i < count ; i++ ) {
+			Huff_codecTransmit( &msgCodec, symbols[i], bitsB, &posB );
+		}
+		table[0] += Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		for ( i = 0, posA = 0 ; i < count ; i++ ) {
+			Huff_offsetReceive( msgHuff.decompressor.tree, &ch, bitsA, &posA );
+			decoded[i] = ch;
+		}
+		tree[1] += Sys_Microseconds() - start;
+
+		start = Sys_Microseconds();
+		for ( i = 0, posB = 0 ; i < count ; i++ ) {
+			Huff_codecReceive( &msgCodec, &ch, bitsB, &posB );
+			decoded[i] ^= ch;
+		}
+		table[1] += Sys_Microseconds() - start;
+	}
+
+	Com_Printf( "%i symbols, %i bits, %i passes\n", count, posA, passes );
+	Com_Printf( "encode: tree %.2f ns/symbol, table %.2f ns/symbol\n",
+		1000.0 * tree[0] / ( (double)count * passes ), 1000.0 * table[0] / ( (double)count * passes ) );
+	Com_Printf( "decode: tree %.2f ns/symbol, table %.2f ns/symbol\n",
+		1000.0 * tree[1] / ( (double)count * passes ), 1000.0 * table[1] / ( (double)count * passes ) );
+
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( decoded[i] ) {
+			break;
+		}
+	}
+	if ( posA != posB || memcmp( bitsA, bitsB, posA >> 3 ) || i != count ) {
+		Com_Printf( "^1MISMATCH between the tree and table coders\n" );
+	} else {
+		Com_Printf( "bit exact\n" );
+	}
+
+	Hunk_FreeTempMemory( symbols );
 }
 
 /*
@@ -20,6 +20,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#ifdef USE_NET_MMSG
+#define _GNU_SOURCE		// recvmmsg / sendmmsg
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -64,6 +68,11 @@ static qboolean	winsockInitialized = qfalse;
 #include <sys/filio.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 typedef int SOCKET;
 #define INVALID_SOCKET		-1
 #define SOCKET_ERROR			-1
@@ -92,6 +101,68 @@ static SOCKET	socks_socket;
 static	int		numIP;
 static	byte	localIP[MAX_IPS][4];
 
+#ifdef __linux__
+// NET_SleepUntil waits on the socket and a monotonic timer in one epoll set
+static int		sleepEpoll = -1;
+static int		sleepTimer = -1;
+static SOCKET	sleepSocket = INVALID_SOCKET;	// socket currently registered with sleepEpoll
+static qboolean	sleepFailed;		// registering the socket failed, use NET_Sleep
+#endif
+
+/*
+packet ring
+
+Datagrams are received straight into a free netPacket_t of the ring and
+Sys_GetPacket hands that out as it is, so the event loop processes the
+packet where the kernel copied it.  A slot is busy until the event loop
+gives it back with NET_ReleasePacket.  When every slot is busy nothing
+more is read, the datagrams wait in the socket.
+*/
+#define	NET_PACKET_RING		64			// power of two
+
+static netPacket_t	netPackets[NET_PACKET_RING];
+static qboolean		netPacketBusy[NET_PACKET_RING];
+static int			netPacketHead;		// next slot to hand out
+
+#ifdef USE_NET_MMSG
+/*
+recvmmsg / sendmmsg batching
+
+Incoming datagrams are drained into free slots of the packet ring with a
+single recvmmsg and handed out one at a time by Sys_GetPacket.  Outgoing
+packets sent between Sys_BeginPacketBatch and Sys_FlushPacketBatch
+are queued and pushed to the kernel with as few sendmmsg calls as
+possible.
+*/
+#define	NET_MMSG_BATCH		32
+#define	NET_MMSG_SENDLEN	1500		// anything larger goes out through sendto
+
+typedef struct {
+	struct mmsghdr		hdrs[NET_MMSG_BATCH];
+	struct iovec		iovs[NET_MMSG_BATCH];
+	struct sockaddr		addrs[NET_MMSG_BATCH];
+	netadrtype_t		types[NET_MMSG_BATCH];	// send only, for error reporting
+	netPacket_t			*packets[NET_MMSG_BATCH];	// receive only
+	int					count;			// number of filled slots
+	int					current;		// next slot to hand out (receive only)
+} netBatch_t;
+
+static netBatch_t	recvBatch;
+
+static netBatch_t	sendBatch;
+static byte			sendBatchData[NET_MMSG_BATCH][NET_MMSG_SENDLEN];
+static qboolean		sendBatching;
+
+static struct {
+	unsigned int	recvCalls;
+	unsigned int	recvPackets;
+	unsigned int	sendCalls;
+	unsigned int	sendPackets;
+} netBatchStats;
+
+static cvar_t	*net_mmsg;
+#endif
+
 //=============================================================================
 
 
@@ -223,74 +294,351 @@ qboolean Sys_StringToAdr( const char *s, netadr_t *a ) {
 
 //=============================================================================
 
+/*
+==================
+NET_ReceivedPacket
+
+Finishes a datagram of length ret from "from" that has already
+been copied into net_message
+==================
+*/
+static qboolean NET_ReceivedPacket( struct sockaddr *from, socklen_t fromlen, int ret, netadr_t *net_from, msg_t *net_message ) {
+	memset( ((struct sockaddr_in *)from)->sin_zero, 0, 8 );
+
+	if ( usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 ) {
+		if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
+			return qfalse;
+		}
+		net_from->type = NA_IP;
+		net_from->ip[0] = net_message->data[4];
+		net_from->ip[1] = net_message->data[5];
+		net_from->ip[2] = net_message->data[6];
+		net_from->ip[3] = net_message->data[7];
+		net_from->port = *(short *)&net_message->data[8];
+		net_message->readcount = 10;
+	}
+	else {
+		SockadrToNetadr( from, net_from );
+		net_message->readcount = 0;
+	}
+
+	if( ret == net_message->maxsize ) {
+		Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
+		return qfalse;
+	}
+
+	net_message->cursize = ret;
+	return qtrue;
+}
+
+/*
+==================
+NET_AllocPacket
+
+Takes the first free slot from the head on, NULL if every slot is busy.
+Slots are given back in any order, a single packet held on to must not
+stop the ring.
+==================
+*/
+static netPacket_t *NET_AllocPacket( void ) {
+	int		i, slot;
+
+	for( i = 0 ; i < NET_PACKET_RING ; i++ ) {
+		slot = ( netPacketHead + i ) & ( NET_PACKET_RING - 1 );
+		if( !netPacketBusy[slot] ) {
+			netPacketBusy[slot] = qtrue;
+			netPacketHead = slot + 1;
+			return &netPackets[slot];
+		}
+	}
+	return NULL;
+}
+
+/*
+==================
+NET_UnallocPacket
+
+Gives back the last slot NET_AllocPacket took, unused
+==================
+*/
+static void NET_UnallocPacket( netPacket_t *packet ) {
+	netPacketBusy[packet - netPackets] = qfalse;
+	netPacketHead = packet - netPackets;
+}
+
+/*
+==================
+NET_ReleasePacket
+==================
+*/
+void NET_ReleasePacket( netPacket_t *packet ) {
+	netPacketBusy[packet - netPackets] = qfalse;
+}
+
+/*
+==================
+NET_IsRingPacket
+==================
+*/
+qboolean NET_IsRingPacket( const void *ptr ) {
+	return (const byte *)ptr >= (const byte *)netPackets && (const byte *)ptr < (const byte *)( netPackets + NET_PACKET_RING );
+}
+
+/*
+==================
+NET_FinishPacket
+
+Moves the payload past a SOCKS header to the start of the slot
+==================
+*/
+static netPacket_t *NET_FinishPacket( netPacket_t *packet, msg_t *net_message, int *length ) {
+	*length = net_message->cursize - net_message->readcount;
+	if( net_message->readcount ) {
+		memmove( packet->data, packet->data + net_message->readcount, *length );
+	}
+	return packet;
+}
+
+#ifdef USE_NET_MMSG
+/*
+==================
+NET_DropBatchedPackets
+
+Gives back the slots received but not handed out yet
+==================
+*/
+static void NET_DropBatchedPackets( void ) {
+	while( recvBatch.current < recvBatch.count ) {
+		NET_ReleasePacket( recvBatch.packets[recvBatch.current++] );
+	}
+	recvBatch.current = recvBatch.count = 0;
+}
+
+/*
+==================
+NET_GetBatchedPacket
+
+Hands out the next datagram from the receive ring, refilling it
+with a single recvmmsg when it runs dry
+==================
+*/
+static netPacket_t *NET_GetBatchedPacket( int *length ) {
+	struct mmsghdr	*hdr;
+	netPacket_t		*packet;
+	msg_t			net_message;
+	int				ret;
+	int				i, slots;
+
+	while( 1 ) {
+		if( recvBatch.current >= recvBatch.count ) {
+			recvBatch.current = recvBatch.count = 0;
+
+			if( !net_mmsg->integer ) {
+				return NULL;
+			}
+
+			for( slots = 0 ; slots < NET_MMSG_BATCH ; slots++ ) {
+				recvBatch.packets[slots] = NET_AllocPacket();
+				if( !recvBatch.packets[slots] ) {
+					break;
+				}
+				recvBatch.iovs[slots].iov_base = recvBatch.packets[slots]->data;
+				recvBatch.iovs[slots].iov_len = sizeof( recvBatch.packets[slots]->data );
+				memset( &recvBatch.hdrs[slots], 0, sizeof( recvBatch.hdrs[slots] ) );
+				recvBatch.hdrs[slots].msg_hdr.msg_name = &recvBatch.addrs[slots];
+				recvBatch.hdrs[slots].msg_hdr.msg_namelen = sizeof( recvBatch.addrs[slots] );
+				recvBatch.hdrs[slots].msg_hdr.msg_iov = &recvBatch.iovs[slots];
+				recvBatch.hdrs[slots].msg_hdr.msg_iovlen = 1;
+			}
+			if( !slots ) {
+				return NULL;
+			}
+
+			netBatchStats.recvCalls++;
+			ret = recvmmsg( ip_socket, recvBatch.hdrs, slots, MSG_DONTWAIT, NULL );
+			if( ret == SOCKET_ERROR ) {
+				int err = socketError;
+
+				ret = 0;
+				if( err != EAGAIN && err != ECONNRESET ) {
+					Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+				}
+			}
+
+			for( i = slots - 1 ; i >= ret ; i-- ) {
+				NET_UnallocPacket( recvBatch.packets[i] );
+			}
+			if( ret == 0 ) {
+				return NULL;
+			}
+			netBatchStats.recvPackets += ret;
+			recvBatch.count = ret;
+		}
+
+		hdr = &recvBatch.hdrs[recvBatch.current];
+		packet = recvBatch.packets[recvBatch.current];
+		recvBatch.current++;
+
+		MSG_Init( &net_message, packet->data, sizeof( packet->data ) );
+		ret = hdr->msg_len;
+		if( ret >= net_message.maxsize || ( hdr->msg_hdr.msg_flags & MSG_TRUNC ) ) {
+			ret = net_message.maxsize;
+		}
+
+		if( NET_ReceivedPacket( &recvBatch.addrs[recvBatch.current - 1], hdr->msg_hdr.msg_namelen, ret, &packet->from, &net_message ) ) {
+			return NET_FinishPacket( packet, &net_message, length );
+		}
+		NET_ReleasePacket( packet );
+	}
+}
+#endif
+
 /*
 ==================
 Sys_GetPacket
 
-Never called by the game logic, just the system event queing
+Never called by the game logic, just the system event queing.
+Returns a slot of the packet ring with the payload length in length,
+or NULL.
 ==================
 */
 #ifdef _DEBUG
 int	recvfromCount;
 #endif
 
-qboolean Sys_GetPacket( netadr_t *net_from, msg_t *net_message ) {
+netPacket_t *Sys_GetPacket( int *length ) {
 	int 	ret;
 	struct sockaddr from;
 	socklen_t	fromlen;
 	int		err;
+	netPacket_t	*packet;
+	msg_t	net_message;
 
 	if( !ip_socket ) {
-		return qfalse;
+		return NULL;
 	}
 
+#ifdef USE_NET_MMSG
+	// keep handing out what is left in the ring even if net_mmsg was just turned off
+	if( net_mmsg->integer || recvBatch.current < recvBatch.count ) {
+		return NET_GetBatchedPacket( length );
+	}
+#endif
+
+	packet = NET_AllocPacket();
+	if( !packet ) {
+		return NULL;
+	}
+	MSG_Init( &net_message, packet->data, sizeof( packet->data ) );
+
 	fromlen = sizeof(from);
 #ifdef _DEBUG
 	recvfromCount++;		// performance check
 #endif
-	ret = recvfrom( ip_socket, net_message->data, net_message->maxsize, 0, (struct sockaddr *)&from, &fromlen );
+	ret = recvfrom( ip_socket, net_message.data, net_message.maxsize, 0, (struct sockaddr *)&from, &fromlen );
 	if (ret == SOCKET_ERROR)
 	{
 		err = socketError;
 
-		if( err == EAGAIN || err == ECONNRESET ) {
-			return qfalse;
+		if( err != EAGAIN && err != ECONNRESET ) {
+			Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
 		}
-		Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
-		return qfalse;
+		NET_UnallocPacket( packet );
+		return NULL;
 	}
 
-	memset( ((struct sockaddr_in *)&from)->sin_zero, 0, 8 );
+	if( !NET_ReceivedPacket( &from, fromlen, ret, &packet->from, &net_message ) ) {
+		NET_UnallocPacket( packet );
+		return NULL;
+	}
+	return NET_FinishPacket( packet, &net_message, length );
+}
 
-	if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 ) {
-		if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
-			return qfalse;
-		}
-		net_from->type = NA_IP;
-		net_from->ip[0] = net_message->data[4];
-		net_from->ip[1] = net_message->data[5];
-		net_from->ip[2] = net_message->data[6];
-		net_from->ip[3] = net_message->data[7];
-		net_from->port = *(short *)&net_message->data[8];
-		net_message->readcount = 10;
+//=============================================================================
+
+static char socksBuf[4096];
+
+/*
+==================
+NET_SendError
+
+Reports a failed send, wouldblock and broadcast refusals are silent
+==================
+*/
+static void NET_SendError( netadrtype_t type ) {
+	int err = socketError;
+
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
 	}
-	else {
-		SockadrToNetadr( &from, net_from );
-		net_message->readcount = 0;
+
+	// some PPP links do not allow broadcasts and return an error
+	if( ( err == EADDRNOTAVAIL ) && ( ( type == NA_BROADCAST ) ) ) {
+		return;
 	}
 
-	if( ret == net_message->maxsize ) {
-		Com_Printf( "Oversize packet from %s\n", NET_AdrToString (*net_from) );
-		return qfalse;
+	Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+}
+
+#ifdef USE_NET_MMSG
+/*
+==================
+NET_FlushSendBatch
+
+Pushes the queued packets out with as few sendmmsg calls as possible
+==================
+*/
+static void NET_FlushSendBatch( void ) {
+	int		sent;
+	int		ret;
+
+	sent = 0;
+	while( sent < sendBatch.count ) {
+		netBatchStats.sendCalls++;
+		ret = sendmmsg( ip_socket, &sendBatch.hdrs[sent], sendBatch.count - sent, 0 );
+		if( ret == SOCKET_ERROR ) {
+			// the socket buffer is full, the rest would be dropped anyway
+			if( socketError == EAGAIN ) {
+				break;
+			}
+			// skip the packet that failed and carry on with the rest
+			NET_SendError( sendBatch.types[sent] );
+			sent++;
+			continue;
+		}
+		netBatchStats.sendPackets += ret;
+		sent += ret;
 	}
 
-	net_message->cursize = ret;
-	return qtrue;
+	sendBatch.count = 0;
 }
 
-//=============================================================================
+/*
+==================
+NET_QueueBatchedPacket
+==================
+*/
+static void NET_QueueBatchedPacket( int length, const void *data, struct sockaddr *addr, netadrtype_t type ) {
+	int		i;
 
-static char socksBuf[4096];
+	if( sendBatch.count == NET_MMSG_BATCH ) {
+		NET_FlushSendBatch();
+	}
+
+	i = sendBatch.count++;
+	Com_Memcpy( sendBatchData[i], data, length );
+	sendBatch.addrs[i] = *addr;
+	sendBatch.types[i] = type;
+	sendBatch.iovs[i].iov_base = sendBatchData[i];
+	sendBatch.iovs[i].iov_len = length;
+	memset( &sendBatch.hdrs[i], 0, sizeof( sendBatch.hdrs[i] ) );
+	sendBatch.hdrs[i].msg_hdr.msg_name = &sendBatch.addrs[i];
+	sendBatch.hdrs[i].msg_hdr.msg_namelen = sizeof( sendBatch.addrs[i] );
+	sendBatch.hdrs[i].msg_hdr.msg_iov = &sendBatch.iovs[i];
+	sendBatch.hdrs[i].msg_hdr.msg_iovlen = 1;
+}
+#endif
 
 /*
 ==================
@@ -312,6 +660,17 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 
 	NetadrToSockadr( &to, &addr );
 
+#ifdef USE_NET_MMSG
+	if( sendBatching && !usingSocks ) {
+		if( length <= NET_MMSG_SENDLEN ) {
+			NET_QueueBatchedPacket( length, data, &addr, to.type );
+			return;
+		}
+		// too big for a batch slot, keep the packets in order
+		NET_FlushSendBatch();
+	}
+#endif
+
 	if( usingSocks && to.type == NA_IP ) {
 		socksBuf[0] = 0;	// reserved
 		socksBuf[1] = 0;
@@ -326,20 +685,35 @@ void Sys_SendPacket( int length, const void *data, netadr_t to ) {
 		ret = sendto( ip_socket, data, length, 0, &addr, sizeof(addr) );
 	}
 	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
-
-		// wouldblock is silent
-		if( err == EAGAIN ) {
-			return;
-		}
+		NET_SendError( to.type );
+	}
+}
 
-		// some PPP links do not allow broadcasts and return an error
-		if( ( err == EADDRNOTAVAIL ) && ( ( to.type == NA_BROADCAST ) ) ) {
-			return;
-		}
+/*
+==================
+Sys_BeginPacketBatch
 
-		Com_Printf( "NET_SendPacket: %s\n", NET_ErrorString() );
+Queue everything passed to Sys_SendPacket until Sys_FlushPacketBatch
+==================
+*/
+void Sys_BeginPacketBatch( void ) {
+#ifdef USE_NET_MMSG
+	if( ip_socket && net_mmsg->integer ) {
+		sendBatching = qtrue;
 	}
+#endif
+}
+
+/*
+==================
+Sys_FlushPacketBatch
+==================
+*/
+void Sys_FlushPacketBatch( void ) {
+#ifdef USE_NET_MMSG
+	NET_FlushSendBatch();
+	sendBatching = qfalse;
+#endif
 }
 
 
@@ -897,6 +1271,10 @@ static qboolean NET_GetCvars( void ) {
 	}
 	net_socksPassword = Cvar_Get( "net_socksPassword", "", CVAR_LATCH | CVAR_ARCHIVE );
 
+#ifdef USE_NET_MMSG
+	// takes effect on the next packet, no need to reopen the socket
+	net_mmsg = Cvar_Get( "net_mmsg", "1", CVAR_ARCHIVE );
+#endif
 
 	return modified;
 }
@@ -947,10 +1325,21 @@ void NET_Config( qboolean enableNetworking ) {
 	}
 
 	if( stop ) {
+#ifdef USE_NET_MMSG
+		NET_FlushSendBatch();
+		sendBatching = qfalse;
+		NET_DropBatchedPackets();
+#endif
+
 		if ( ip_socket && ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = 0;
 		}
+#ifdef __linux__
+		// the new socket has to be registered with the sleep set again
+		sleepSocket = INVALID_SOCKET;
+		sleepFailed = qfalse;
+#endif
 
 		if ( socks_socket && socks_socket != INVALID_SOCKET ) {
 			closesocket( socks_socket );
@@ -966,6 +1355,24 @@ void NET_Config( qboolean enableNetworking ) {
 }
 
 
+#ifdef USE_NET_MMSG
+/*
+====================
+NET_BatchStats_f
+====================
+*/
+static void NET_BatchStats_f( void ) {
+	Com_Printf( "recvmmsg: %u packets in %u calls (%.2f per call)\n", netBatchStats.recvPackets, netBatchStats.recvCalls,
+		netBatchStats.recvCalls ? (float)netBatchStats.recvPackets / netBatchStats.recvCalls : 0.0f );
+	Com_Printf( "sendmmsg: %u packets in %u calls (%.2f per call)\n", netBatchStats.sendPackets, netBatchStats.sendCalls,
+		netBatchStats.sendCalls ? (float)netBatchStats.sendPackets / netBatchStats.sendCalls : 0.0f );
+
+	if( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &netBatchStats, 0, sizeof( netBatchStats ) );
+	}
+}
+#endif
+
 /*
 ====================
 NET_Init
@@ -988,6 +1395,10 @@ void NET_Init( void ) {
 	// this is really just to get the cvars registered
 	NET_GetCvars();
 
+#ifdef USE_NET_MMSG
+	Cmd_AddCommand( "net_mmsgstats", NET_BatchStats_f );
+#endif
+
 	NET_Config( qtrue );
 }
 
@@ -1033,6 +1444,11 @@ void NET_Sleep( int msec ) {
 	if (!com_dedicated->integer)
 		return; // we're not a server, just run full speed
 
+#ifdef USE_NET_MMSG
+	if (recvBatch.current < recvBatch.count)
+		return; // packets already waiting in the receive ring
+#endif
+
 	FD_ZERO(&fdset);
 
 	#ifndef __linux__
@@ -1071,6 +1487,117 @@ void NET_Sleep( int msec ) {
 }
 
 
+#ifdef __linux__
+/*
+====================
+NET_InitSleepTimer
+====================
+*/
+static qboolean NET_InitSleepTimer( void ) {
+	struct epoll_event	ev;
+
+	if( sleepEpoll == -1 ) {
+		sleepEpoll = epoll_create( 2 );
+		if( sleepEpoll == -1 ) {
+			Com_Printf( "WARNING: NET_SleepUntil: epoll_create: %s\n", NET_ErrorString() );
+			return qfalse;
+		}
+
+		sleepTimer = timerfd_create( CLOCK_MONOTONIC, TFD_NONBLOCK );
+		if( sleepTimer == -1 ) {
+			Com_Printf( "WARNING: NET_SleepUntil: timerfd_create: %s\n", NET_ErrorString() );
+			close( sleepEpoll );
+			sleepEpoll = -1;
+			return qfalse;
+		}
+
+		Com_Memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = sleepTimer;
+		if( epoll_ctl( sleepEpoll, EPOLL_CTL_ADD, sleepTimer, &ev ) == -1 ) {
+			Com_Printf( "WARNING: NET_SleepUntil: epoll_ctl: %s\n", NET_ErrorString() );
+			close( sleepTimer );
+			sleepTimer = -1;
+			close( sleepEpoll );
+			sleepEpoll = -1;
+			return qfalse;
+		}
+		sleepSocket = INVALID_SOCKET;
+	}
+
+	if( sleepFailed ) {
+		return qfalse;
+	}
+
+	// NET_Config clears sleepSocket when it closes the socket, which
+	// drops it from the set, even if the new one gets the same number
+	if( sleepSocket == INVALID_SOCKET && ip_socket && ip_socket != INVALID_SOCKET ) {
+		Com_Memset( &ev, 0, sizeof( ev ) );
+		ev.events = EPOLLIN;
+		ev.data.fd = ip_socket;
+		if( epoll_ctl( sleepEpoll, EPOLL_CTL_ADD, ip_socket, &ev ) == -1 ) {
+			Com_Printf( "WARNING: NET_SleepUntil: epoll_ctl: %s\n", NET_ErrorString() );
+			sleepFailed = qtrue;
+			return qfalse;
+		}
+		sleepSocket = ip_socket;
+	}
+
+	return qtrue;
+}
+#endif
+
+/*
+====================
+NET_SleepUntil
+
+Sleeps until the absolute Sys_Microseconds time deadline or until
+something happens on the network.  Uses a timerfd on linux so the
+wakeup is not rounded to milliseconds.
+====================
+*/
+void NET_SleepUntil( int64_t deadline ) {
+#ifdef __linux__
+	struct itimerspec	its;
+	struct epoll_event	ev;
+	uint64_t			expirations;
+#endif
+
+	if (!com_dedicated->integer)
+		return; // we're not a server, just run full speed
+
+#ifdef USE_NET_MMSG
+	if (recvBatch.current < recvBatch.count)
+		return; // packets already waiting in the receive ring
+#endif
+
+	if (deadline <= Sys_Microseconds())
+		return;
+
+#ifdef __linux__
+	if (NET_InitSleepTimer())
+	{
+		// both clocks are CLOCK_MONOTONIC, so the deadline can be armed as is
+		Com_Memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = deadline / 1000000;
+		its.it_value.tv_nsec = (deadline % 1000000) * 1000;
+		if (timerfd_settime(sleepTimer, TFD_TIMER_ABSTIME, &its, NULL) == 0)
+		{
+			epoll_wait(sleepEpoll, &ev, 1, -1);
+
+			// clear a pending expiration so the next wait blocks
+			if (read(sleepTimer, &expirations, sizeof(expirations)) < 0) {
+				expirations = 0;
+			}
+			return;
+		}
+	}
+#endif
+
+	NET_Sleep((int)((deadline - Sys_Microseconds() + 999) / 1000));
+}
+
+
 /*
 ====================
 NET_Restart_f
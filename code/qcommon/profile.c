@@ -0,0 +1,199 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// profile.c -- per subsystem frame timers
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+=============================================================================
+
+With com_profile 1 the parts of a frame wrapped in Com_ProfileStart /
+Com_ProfileStop add their time up per zone, and Com_ProfileFrame files
+the total of every zone that ran as one sample.  The last PROFILE_SAMPLES
+samples of each zone are kept, so "frameprofile" shows percentiles of
+the recent past rather than averages since startup, which hide spikes.
+
+com_profileLog <seconds> prints the same table to the console and log
+every so many seconds.
+
+Only the main thread may start and stop zones.
+
+=============================================================================
+*/
+
+#define	PROFILE_SAMPLES		1024		// power of two
+
+typedef struct {
+	int			samples[PROFILE_SAMPLES];	// usec
+	int			numSamples;					// total filed, the ring wraps
+	int64_t		frameUsec;					// added up in the current frame
+	qboolean	ran;						// started in the current frame
+} profZoneData_t;
+
+static const char *profZoneNames[NUM_PROF_ZONES] = {
+	"events",
+	"server",
+	"game",
+	"modplayers",
+	"snapbuild",
+	"snapencode",
+	"send"
+};
+
+static profZoneData_t	profZones[NUM_PROF_ZONES];
+static int64_t			profNextLog;
+
+cvar_t		*com_profile;
+cvar_t		*com_profileLog;
+
+/*
+=================
+Com_ProfileStart
+
+Returns the time to hand to Com_ProfileStop, 0 when profiling is off
+=================
+*/
+int64_t Com_ProfileStart( void ) {
+	if ( !com_profile || !com_profile->integer ) {
+		return 0;
+	}
+	return Sys_Microseconds();
+}
+
+/*
+=================
+Com_ProfileStop
+=================
+*/
+void Com_ProfileStop( profZone_t zone, int64_t start ) {
+	if ( !start ) {
+		return;
+	}
+	profZones[zone].frameUsec += Sys_Microseconds() - start;
+	profZones[zone].ran = qtrue;
+}
+
+/*
+=================
+Com_ProfileCompare
+=================
+*/
+static int Com_ProfileCompare( const void *a, const void *b ) {
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+=================
+Com_ProfilePrint
+=================
+*/
+static void Com_ProfilePrint( void ) {
+	static int		sorted[PROFILE_SAMPLES];
+	profZoneData_t	*z;
+	int				i, count;
+
+	Com_Printf( "zone        samples     p50     p99     max   (msec)\n" );
+	for ( i = 0, z = profZones ; i < NUM_PROF_ZONES ; i++, z++ ) {
+		count = z->numSamples < PROFILE_SAMPLES ? z->numSamples : PROFILE_SAMPLES;
+		if ( !count ) {
+			continue;
+		}
+
+		Com_Memcpy( sorted, z->samples, count * sizeof( sorted[0] ) );
+		qsort( sorted, count, sizeof( sorted[0] ), Com_ProfileCompare );
+
+		Com_Printf( "%-10s %8i %7.3f %7.3f %7.3f\n", profZoneNames[i], z->numSamples,
+			sorted[count / 2] / 1000.0f, sorted[count * 99 / 100] / 1000.0f,
+			sorted[count - 1] / 1000.0f );
+	}
+}
+
+/*
+=================
+Com_ProfileFrame
+
+Files the zones that ran this frame, called at the end of Com_Frame
+=================
+*/
+void Com_ProfileFrame( void ) {
+	profZoneData_t	*z;
+	int64_t			now;
+	int				i;
+
+	if ( !com_profile->integer ) {
+		profNextLog = 0;
+		return;
+	}
+
+	for ( i = 0, z = profZones ; i < NUM_PROF_ZONES ; i++, z++ ) {
+		if ( !z->ran ) {
+			continue;
+		}
+		z->samples[z->numSamples & ( PROFILE_SAMPLES - 1 )] = z->frameUsec;
+		z->numSamples++;
+		z->frameUsec = 0;
+		z->ran = qfalse;
+	}
+
+	if ( com_profileLog->integer <= 0 ) {
+		return;
+	}
+
+	now = Sys_Microseconds();
+	if ( !profNextLog ) {
+		profNextLog = now + com_profileLog->integer * (int64_t)1000000;
+	} else if ( now >= profNextLog ) {
+		profNextLog = now + com_profileLog->integer * (int64_t)1000000;
+		Com_ProfilePrint();
+	}
+}
+
+/*
+=================
+Com_FrameProfile_f
+
+"frameprofile [reset]"
+=================
+*/
+static void Com_FrameProfile_f( void ) {
+	if ( !com_profile->integer ) {
+		Com_Printf( "Set com_profile 1 to time the frame.\n" );
+	}
+
+	Com_ProfilePrint();
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( profZones, 0, sizeof( profZones ) );
+	}
+}
+
+/*
+=================
+Com_InitProfile
+=================
+*/
+void Com_InitProfile( void ) {
+	com_profile = Cvar_Get( "com_profile", "0", 0 );
+	com_profileLog = Cvar_Get( "com_profileLog", "0", 0 );
+	Cmd_AddCommand( "frameprofile", Com_FrameProfile_f );
+}
@@ -67,6 +67,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteEncodedBits( msg_t *msg, const byte *data, int startBit, int numBits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -110,6 +111,7 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct pl
 
 
 void MSG_ReportChangeVectors_f( void );
+void MSG_HuffBench_f( void );
 
 //============================================================================
 
@@ -169,11 +171,23 @@ const char	*NET_AdrToString (netadr_t a);
 qboolean	NET_StringToAdr ( const char *s, netadr_t *a);
 qboolean	NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_message);
 void		NET_Sleep(int msec);
+void		NET_SleepUntil(int64_t deadline);
 
 
 #define	MAX_MSGLEN				16384		// max length of a message, which may
 											// be fragmented into multiple packets
 
+// incoming packets are received straight into a ring of these owned by
+// net_ip.c, the evPtr of a SE_PACKET event points at one until the event
+// is handled and NET_ReleasePacket hands it back
+typedef struct {
+	netadr_t	from;
+	byte		data[MAX_MSGLEN];	// big enough to reassemble fragments in place
+} netPacket_t;
+
+void		NET_ReleasePacket( netPacket_t *packet );
+qboolean	NET_IsRingPacket( const void *ptr );
+
 #define MAX_DOWNLOAD_WINDOW			8		// max of eight download frames
 #define MAX_DOWNLOAD_BLKSIZE		2048	// 2048 byte block chunks
 
@@ -236,6 +250,32 @@ PROTOCOL
 // NOTE: that stuff only works with two digits protocols
 extern int demo_protocols[];
 
+// a compressed demo starts with DEMO_COMPRESSED_MAGIC in place of the
+// stream, which follows in blocks, each independently deflated.  A block
+// that starts at a keyframe leads with a gamestate message that is only
+// parsed when seeking to it.  After the last block comes a header with a
+// packedLength of -1, the keyframe count and the keyframes, then the
+// offset of that header and DEMO_INDEX_MAGIC.  All little endian.
+#define	DEMO_COMPRESSED_MAGIC	0x315a4455		// "UDZ1"
+#define	DEMO_INDEX_MAGIC		0x495a4455		// "UDZI"
+#define	DEMO_BLOCK_SIZE			0x8000			// most raw bytes in a block
+
+#define	DEMO_BLOCK_STORED		0
+#define	DEMO_BLOCK_DEFLATED		1
+
+typedef struct {
+	int		packedLength;		// bytes that follow, -1 after the last block
+	int		rawLength;
+	int		keyframeLength;		// leading raw bytes that are a keyframe gamestate, 0 for none
+	int		serverTime;			// when the block was started
+	int		method;				// DEMO_BLOCK_*
+} demoBlockHeader_t;
+
+typedef struct {
+	int		serverTime;
+	int		offset;				// of the block header in the file
+} demoKeyframe_t;
+
 #define	UPDATE_SERVER_NAME	"update.quake3arena.com"
 // override on command line, config files etc.
 #ifndef MASTER_SERVER_NAME
@@ -325,9 +365,27 @@ typedef enum {
 	TRAP_TESTPRINTFLOAT
 } sharedTraps_t;
 
+// pure math traps the compiler may do in line instead of calling func
+typedef enum {
+	VM_INLINE_NONE,
+	VM_INLINE_SQRT,
+	VM_INLINE_FLOOR,
+	VM_INLINE_CEIL
+} vmInline_t;
+
+// a system call the module handles outside its systemCall switch,
+// indexed by the syscall number.  Compiled code calls func directly,
+// so it must not call back into the vm.
+typedef struct {
+	const char	*name;
+	intptr_t	(*func)( intptr_t *args );
+	int			numArgs;			// only these are copied from the vm stack
+	vmInline_t	inlined;
+} vmSyscall_t;
+
 void	VM_Init( void );
 vm_t	*VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
-				   vmInterpret_t interpret );
+				   const vmSyscall_t *syscalls, int numSyscalls, vmInterpret_t interpret );
 // module should be bare: "cgame", not "cgame.dll" or "vm/cgame.qvm"
 
 void	VM_Free( vm_t *vm );
@@ -622,6 +680,19 @@ void	FS_ForceFlush( fileHandle_t f );
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+int		FS_ReadFileView( const char *qpath, const void **buffer );
+// like FS_ReadFile, but a file stored uncompressed in a pk3 comes back
+// as a view of the mapped pk3 with no copy and no trailing 0.
+// the buffer is read-only and must go back through FS_FreeFileView
+
+void	FS_FreeFileView( const void *buffer );
+
+void	FS_PrefetchMap( const char *name );
+// starts reading the files loading the bsp will need in the background,
+// and timing the file reads of the load
+void	FS_PrefetchDone( const char *loader, qboolean release );
+// prints the load times, and frees the prefetched files if release
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
@@ -633,6 +704,9 @@ int		FS_FTell( fileHandle_t f );
 
 void	FS_Flush( fileHandle_t f );
 
+FILE	*FS_FileForHandle( fileHandle_t f );
+// the stdio stream of a file opened for writing, so another thread can write it
+
 void 	QDECL FS_Printf( fileHandle_t f, const char *fmt, ... ) __attribute__ ((format (printf, 2, 3)));
 // like fprintf
 
@@ -752,6 +826,7 @@ void 		QDECL Com_DPrintf( const char *fmt, ... ) __attribute__ ((format (printf,
 void 		QDECL Com_Error( int code, const char *fmt, ... ) __attribute__ ((format (printf, 2, 3)));
 void 		Com_Quit_f( void );
 int			Com_EventLoop( void );
+void		Com_FreeEventPtr( void *ptr );
 int			Com_Milliseconds( void );	// will be journaled properly
 unsigned	Com_BlockChecksum( const void *buffer, int length );
 char		*Com_MD5File(const char *filename, int length, const char *prefix, int prefix_len);
@@ -761,6 +836,47 @@ int			Com_FilterPath(char *filter, char *name, int casesensitive);
 int			Com_RealTime(qtime_t *qtime);
 qboolean	Com_SafeMode( void );
 
+// jobs.c
+#define	MAX_JOB_THREADS		16
+
+// thread is 0 on the calling thread and 1 .. Com_JobThreadCount() on workers
+typedef void (*jobFunc_t)( void *data, int index, int thread );
+
+void		Com_InitJobs( void );
+void		Com_ShutdownJobs( void );
+int			Com_JobThreadCount( void );
+void		Com_ParallelFor( jobFunc_t func, void *data, int count );
+
+// profile.c
+typedef enum {
+	PROF_EVENTS,		// Com_EventLoop
+	PROF_SERVER,		// a whole SV_Frame that ran the game
+	PROF_GAME,			// GAME_RUN_FRAME
+	PROF_MODPLAYERS,	// SV_ModPlayers
+	PROF_SNAPBUILD,		// gathering snapshot entities
+	PROF_SNAPENCODE,	// delta encoding snapshots
+	PROF_SEND,			// netchan transmit and the packet batch flush
+	NUM_PROF_ZONES
+} profZone_t;
+
+void		Com_InitProfile( void );
+int64_t		Com_ProfileStart( void );
+void		Com_ProfileStop( profZone_t zone, int64_t start );
+void		Com_ProfileFrame( void );
+
+// deflate.c
+#define	DEFLATE_HASH_SIZE	0x4000
+#define	DEFLATE_WINDOW		0x8000
+// room Com_Deflate needs at worst, the input in stored blocks
+#define	DEFLATE_BOUND(n)	( (n) + 5 * ( (n) / 65535 + 1 ) )
+
+typedef struct {
+	int			head[DEFLATE_HASH_SIZE];
+	int			prev[DEFLATE_WINDOW];
+} deflateWork_t;
+
+int			Com_Deflate( byte *out, int outSize, const byte *in, int inLength, deflateWork_t *work );
+
 void		Com_StartupVariable( const char *match );
 // checks for and removes command line "+set var arg" constructs
 // if match is NULL, all set commands will be executed, otherwise
@@ -780,6 +896,7 @@ extern	cvar_t	*com_buildScript;		// for building release pak files
 extern	cvar_t	*com_journal;
 extern	cvar_t	*com_cameraMode;
 extern	cvar_t	*com_altivec;
+extern	cvar_t	*com_jobThreads;
 
 //@Barbatos - name of the console log file (default: qconsole.log)
 // It allows you to keep the logs of multiple servers using the same executable
@@ -811,7 +928,8 @@ typedef enum {
 	TAG_BOTLIB,
 	TAG_RENDERER,
 	TAG_SMALL,
-	TAG_STATIC
+	TAG_STATIC,
+	TAG_POOLED				// free, kept in a zone size class
 } memtag_t;
 
 /*
@@ -985,7 +1103,8 @@ typedef enum {
 	SE_MOUSE,	// evValue and evValue2 are reletive signed x / y moves
 	SE_JOYSTICK_AXIS,	// evValue is an axis number and evValue2 is the current state (-127 to 127)
 	SE_CONSOLE,	// evPtr is a char*
-	SE_PACKET	// evPtr is a netadr_t followed by data bytes to evPtrLength
+	SE_PACKET	// evPtr is a netadr_t followed by data bytes to evPtrLength,
+				// a netPacket_t unless it was read from a journal
 } sysEventType_t;
 
 typedef struct {
@@ -1036,6 +1155,9 @@ int	(*Sys_GetTimeStamp)(void);
 int	Sys_Milliseconds(void);
 #endif
 
+// monotonic, for frame scheduling and profiling
+int64_t	Sys_Microseconds(void);
+
 void	Sys_SnapVector( float *v );
 
 qboolean Sys_RandomBytes( byte *string, int len );
@@ -1054,6 +1176,8 @@ void	Sys_ShowConsole( int level, qboolean quitOnClose );
 void	Sys_SetErrorText( const char *text );
 
 void	Sys_SendPacket( int length, const void *data, netadr_t to );
+void	Sys_BeginPacketBatch( void );
+void	Sys_FlushPacketBatch( void );
 
 qboolean	Sys_StringToAdr( const char *s, netadr_t *a );
 //Does NOT parse port numbers, only base addresses.
@@ -1074,6 +1198,9 @@ char	*Sys_DefaultHomePath(void);
 
 char **Sys_ListFiles( const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs );
 void	Sys_FreeFileList( char **list );
+qboolean	Sys_FileStat( const char *path, int *size, int *mtime );
+void	*Sys_MapFile( const char *path, int *length );
+void	Sys_UnmapFile( void *base, int length );
 
 void	Sys_BeginProfiling( void );
 void	Sys_EndProfiling( void );
@@ -1121,6 +1248,18 @@ typedef struct {
 	huff_t		decompressor;
 } huffman_t;
 
+// fixed trees can be coded through tables, see Huff_BuildCodec
+#define	HUFF_LOOKUP_BITS	11
+#define	HUFF_MAX_CODE_BITS	32
+
+typedef struct {
+	huff_t			*huff;
+	node_t			*tree;
+	unsigned int	code[HMAX];						// first bit sent in bit 0
+	byte			length[HMAX];					// 0 if it has to go through the tree
+	unsigned short	lookup[1<<HUFF_LOOKUP_BITS];	// symbol | length << 9, 0 if longer
+} huffCodec_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
@@ -1131,6 +1270,10 @@ void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
+void	Huff_BuildCodec( huffCodec_t *codec, huff_t *huff );
+void	Huff_putBits( uint64_t value, int count, byte *fout, int *offset );
+void	Huff_codecTransmit( const huffCodec_t *codec, int ch, byte *fout, int *offset );
+void	Huff_codecReceive( const huffCodec_t *codec, int *ch, byte *fin, int *offset );
 
 extern huffman_t clientHuffTables;
 
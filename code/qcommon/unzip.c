@@ -2216,6 +2216,51 @@ extern int unzCloseCurrentFile (unzFile file)
 }
 
 
+static voidp unzlocal_malloc (voidp opaque, unsigned items, unsigned size)
+{
+	return calloc(items, size);
+}
+
+static void unzlocal_free (voidp opaque, voidp ptr)
+{
+	free(ptr);
+}
+
+/*
+  Inflate a whole deflated file that is already in memory straight into
+  buf, in one call and without going through the read buffer.
+  It allocates with malloc instead of the zone, so any thread may call it.
+*/
+extern int unzInflateBuffer (void *buf, unsigned len, const void *source, unsigned sourceLen)
+{
+	z_stream stream;
+	int err;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.zalloc = (alloc_func)unzlocal_malloc;
+	stream.zfree = (free_func)unzlocal_free;
+	stream.next_in = (Byte*)source;
+	stream.avail_in = (uInt)sourceLen;
+	stream.next_out = (Byte*)buf;
+	stream.avail_out = (uInt)len;
+
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+		return UNZ_INTERNALERROR;
+
+	err = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+
+	/* without the dummy byte after the stream it can stop short of
+	   Z_STREAM_END with all of the data out */
+	if (err != Z_STREAM_END && err != Z_OK && err != Z_BUF_ERROR)
+		return UNZ_BADZIPFILE;
+	if (stream.total_out != len)
+		return UNZ_BADZIPFILE;
+
+	return UNZ_OK;
+}
+
+
 /*
   Get the global comment string of the ZipFile, in the szComment buffer.
   uSizeBuf is the size of the szComment buffer.
@@ -322,6 +322,14 @@ extern int unzeof (unzFile file);
 
 extern int unzGetLocalExtrafield (unzFile file, void* buf, unsigned len);
 
+extern int unzInflateBuffer (void *buf, unsigned len, const void *source, unsigned sourceLen);
+
+/*
+  Inflate a deflated file held in memory (source, sourceLen) into buf,
+  which must be exactly its uncompressed size len.
+  return UNZ_OK if all of it came out
+*/
+
 /*
   Read extra field from the current file (opened by unzOpenCurrentFile)
   This is the local-header version of the extra field (sometimes, there is
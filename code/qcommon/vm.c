@@ -40,12 +40,21 @@ vm_t	*currentVM = NULL;
 vm_t	*lastVM    = NULL;
 int		vm_debugLevel;
 
+cvar_t	*vm_syscallProfile;
+
+#ifdef VM_SAMPLING
+static vm_t	*vm_sampled;
+static void VM_StopSampledProfile( void );
+#endif
+
 #define	MAX_VM		3
 vm_t	vmTable[MAX_VM];
 
 
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+void VM_VmBench_f( void );
+void VM_VmCompare_f( void );
 
 
 
@@ -70,9 +79,15 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	Cvar_Get( "vm_cache", "0", CVAR_ARCHIVE );	// reuse compiled code across loads, trusts fs_homepath
+	vm_syscallProfile = Cvar_Get( "vm_syscallProfile", "0", 0 );
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+#ifndef NO_VM_COMPILED
+	Cmd_AddCommand ("vmbench", VM_VmBench_f );
+	Cmd_AddCommand ("vmcompare", VM_VmCompare_f );
+#endif
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -343,12 +358,65 @@ intptr_t QDECL VM_DllSyscall( intptr_t arg, ... ) {
     args[i] = va_arg(ap, intptr_t);
   va_end(ap);
   
-  return currentVM->systemCall( args );
+  return VM_SystemCall( currentVM, args );
 #else // original id code
-	return currentVM->systemCall( &arg );
+	return VM_SystemCall( currentVM, &arg );
 #endif
 }
 
+/*
+============
+VM_ProfiledSystemCall
+============
+*/
+static intptr_t VM_ProfiledSystemCall( vm_t *vm, intptr_t *args ) {
+	vmSyscallProfile_t	*prof;
+	int64_t				start;
+	intptr_t			r;
+	int					num;
+
+	if ( !vm->syscallProfile ) {
+		vm->syscallProfile = Z_Malloc( MAX_VM_SYSCALLS * sizeof( *vm->syscallProfile ) );
+	}
+
+	num = args[0];
+	start = Sys_Microseconds();
+	if ( num >= 0 && num < vm->numSyscalls && vm->syscalls[num].func ) {
+		r = vm->syscalls[num].func( args );
+	} else {
+		r = vm->systemCall( args );
+	}
+
+	if ( num >= 0 && num < MAX_VM_SYSCALLS ) {
+		prof = &vm->syscallProfile[num];
+		prof->calls++;
+		prof->usec += Sys_Microseconds() - start;
+	}
+	return r;
+}
+
+/*
+============
+VM_SystemCall
+
+Every system call from a module comes through here, the ones in the
+module's syscall table go straight to their function
+============
+*/
+intptr_t VM_SystemCall( vm_t *vm, intptr_t *args ) {
+	int		num;
+
+	if ( vm_syscallProfile->integer ) {
+		return VM_ProfiledSystemCall( vm, args );
+	}
+
+	num = args[0];
+	if ( num >= 0 && num < vm->numSyscalls && vm->syscalls[num].func ) {
+		return vm->syscalls[num].func( args );
+	}
+	return vm->systemCall( args );
+}
+
 /*
 =================
 VM_LoadQVM
@@ -472,13 +540,17 @@ vm_t *VM_Restart( vm_t *vm ) {
 	if ( vm->dllHandle ) {
 		char	name[MAX_QPATH];
 		intptr_t	(*systemCall)( intptr_t *parms );
+		const vmSyscall_t	*syscalls;
+		int		numSyscalls;
 		
 		systemCall = vm->systemCall;	
+		syscalls = vm->syscalls;
+		numSyscalls = vm->numSyscalls;
 		Q_strncpyz( name, vm->name, sizeof( name ) );
 
 		VM_Free( vm );
 
-		vm = VM_Create( name, systemCall, VMI_NATIVE );
+		vm = VM_Create( name, systemCall, syscalls, numSyscalls, VMI_NATIVE );
 		return vm;
 	}
 
@@ -508,7 +580,7 @@ it will attempt to load as a system dll
 #define	STACK_SIZE	0x20000
 
 vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *), 
-				vmInterpret_t interpret ) {
+				const vmSyscall_t *syscalls, int numSyscalls, vmInterpret_t interpret ) {
 	vm_t		*vm;
 	vmHeader_t	*header;
 	int			i, remaining;
@@ -542,6 +614,8 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 
 	Q_strncpyz( vm->name, module, sizeof( vm->name ) );
 	vm->systemCall = systemCalls;
+	vm->syscalls = syscalls;
+	vm->numSyscalls = numSyscalls;
 
 	if ( interpret == VMI_NATIVE ) {
 		// try to load as a system dll
@@ -583,6 +657,7 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 	// VM_Compile may have reset vm->compiled if compilation failed
 	if (!vm->compiled)
 	{
+		vm->codeBase = Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
 		VM_PrepareInterpreter( vm, header );
 	}
 
@@ -608,9 +683,19 @@ VM_Free
 */
 void VM_Free( vm_t *vm ) {
 
+#ifdef VM_SAMPLING
+	if ( vm == vm_sampled ) {
+		VM_StopSampledProfile();
+	}
+#endif
+
 	if(vm->destroy)
 		vm->destroy(vm);
 
+	if ( vm->syscallProfile ) {
+		Z_Free( vm->syscallProfile );
+	}
+
 	if ( vm->dllHandle ) {
 		Sys_UnloadDll( vm->dllHandle );
 		Com_Memset( vm, 0, sizeof( *vm ) );
@@ -790,26 +875,14 @@ static int QDECL VM_ProfileSort( const void *a, const void *b ) {
 
 /*
 ==============
-VM_VmProfile_f
-
+VM_PrintSymbolProfile
 ==============
 */
-void VM_VmProfile_f( void ) {
-	vm_t		*vm;
+static void VM_PrintSymbolProfile( vm_t *vm ) {
 	vmSymbol_t	**sorted, *sym;
 	int			i;
 	double		total;
 
-	if ( !lastVM ) {
-		return;
-	}
-
-	vm = lastVM;
-
-	if ( !vm->numSymbols ) {
-		return;
-	}
-
 	sorted = Z_Malloc( vm->numSymbols * sizeof( *sorted ) );
 	sorted[0] = vm->symbols;
 	total = sorted[0]->profileCount;
@@ -835,6 +908,341 @@ void VM_VmProfile_f( void ) {
 	Z_Free( sorted );
 }
 
+static vmSyscallProfile_t	*vm_sortProfile;
+
+static int QDECL VM_SyscallProfileSort( const void *a, const void *b ) {
+	int64_t		ua, ub;
+
+	ua = vm_sortProfile[ *(const int *)a ].usec;
+	ub = vm_sortProfile[ *(const int *)b ].usec;
+
+	if ( ua > ub ) {
+		return -1;
+	}
+	if ( ua < ub ) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+==============
+VM_PrintSyscallProfile
+
+Most expensive first
+==============
+*/
+static void VM_PrintSyscallProfile( vm_t *vm ) {
+	vmSyscallProfile_t	*prof;
+	int			sorted[MAX_VM_SYSCALLS];
+	int			i, count;
+	const char	*name;
+
+	if ( !vm->syscallProfile ) {
+		Com_Printf( "Set vm_syscallProfile 1 to profile the system calls.\n" );
+		return;
+	}
+
+	count = 0;
+	for ( i = 0 ; i < MAX_VM_SYSCALLS ; i++ ) {
+		if ( vm->syscallProfile[i].calls ) {
+			sorted[count++] = i;
+		}
+	}
+
+	vm_sortProfile = vm->syscallProfile;
+	qsort( sorted, count, sizeof( sorted[0] ), VM_SyscallProfileSort );
+
+	Com_Printf( "syscall                        calls      msec  usec/call\n" );
+	for ( i = 0 ; i < count ; i++ ) {
+		prof = &vm->syscallProfile[ sorted[i] ];
+		if ( sorted[i] < vm->numSyscalls && vm->syscalls[ sorted[i] ].name ) {
+			name = vm->syscalls[ sorted[i] ].name;
+		} else {
+			name = va( "%i", sorted[i] );
+		}
+		Com_Printf( "%-24s %11i %9.1f %10.2f\n", name, prof->calls,
+			prof->usec / 1000.0, (double)prof->usec / prof->calls );
+	}
+
+	Com_Memset( vm->syscallProfile, 0, MAX_VM_SYSCALLS * sizeof( *vm->syscallProfile ) );
+}
+
+#ifdef VM_SAMPLING
+/*
+==============================================================================
+
+SAMPLED PROFILES
+
+"vmprofile start <module> [hz]" samples a compiled module until
+"vmprofile stop" or the module is freed, then prints where the time went
+and writes the call stacks to vmprofile/<module>.folded, one line per
+distinct stack, which flamegraph.pl reads as it is.
+
+Functions are named from the module's .map file when developer was set
+at load, otherwise by the instruction they start at.
+
+==============================================================================
+*/
+
+#define	SAMPLE_LINES	30
+
+static int		*vm_sortCounts;
+
+/*
+==============
+VM_SampleName
+==============
+*/
+static const char *VM_SampleName( vm_t *vm, int f ) {
+	if ( f < 0 ) {
+		return "[engine]";
+	}
+	if ( vm->numSymbols ) {
+		return VM_ValueToFunctionSymbol( vm, vm->instructionPointers[ vm->functions[f].start ] )->symName;
+	}
+	return va( "func_%i", vm->functions[f].start );
+}
+
+static int QDECL VM_SampleSort( const void *a, const void *b ) {
+	return vm_sortCounts[ *(const int *)b ] - vm_sortCounts[ *(const int *)a ];
+}
+
+/*
+==============
+VM_PrintSampleTable
+
+Functions are indexed one up, 0 is the engine
+==============
+*/
+static void VM_PrintSampleTable( vm_t *vm, const char *title, int *order, int *self, int *total, int samples ) {
+	int		*sorted;
+	int		i, n, f;
+
+	n = vm->numFunctions + 1;
+	sorted = Z_Malloc( n * sizeof( *sorted ) );
+	for ( i = 0 ; i < n ; i++ ) {
+		sorted[i] = i;
+	}
+	vm_sortCounts = order;
+	qsort( sorted, n, sizeof( *sorted ), VM_SampleSort );
+
+	Com_Printf( "%s\n   self%%   total%%  function\n", title );
+	for ( i = 0 ; i < n && i < SAMPLE_LINES && order[ sorted[i] ] ; i++ ) {
+		f = sorted[i];
+		Com_Printf( "%7.2f  %7.2f  %s\n", 100.0f * self[f] / samples,
+			100.0f * total[f] / samples, VM_SampleName( vm, f - 1 ) );
+	}
+
+	Z_Free( sorted );
+}
+
+/*
+==============
+VM_PrintSamples
+
+A flat profile by the time spent in each function itself, and an
+inclusive one by the time spent under each function
+==============
+*/
+static void VM_PrintSamples( vm_t *vm, vmSamples_t *s ) {
+	int		*self, *total, *seen;
+	int		*rec, *end;
+	int		i, n, f, sample;
+
+	Com_Printf( "%i samples of %s, %i while it wasn't running, %i dropped\n",
+		s->samples, vm->name, s->idle, s->dropped );
+	if ( !s->samples ) {
+		return;
+	}
+
+	n = vm->numFunctions + 1;
+	self = Z_Malloc( n * sizeof( *self ) );
+	total = Z_Malloc( n * sizeof( *total ) );
+	seen = Z_Malloc( n * sizeof( *seen ) );
+
+	sample = 0;
+	end = s->records + s->length;
+	for ( rec = s->records ; rec < end ; rec += 1 + rec[0] ) {
+		sample++;
+		if ( rec[0] ) {
+			self[ rec[1] + 1 ]++;
+		}
+		// recursion counts once
+		for ( i = 1 ; i <= rec[0] ; i++ ) {
+			f = rec[i] + 1;
+			if ( seen[f] != sample ) {
+				seen[f] = sample;
+				total[f]++;
+			}
+		}
+	}
+
+	VM_PrintSampleTable( vm, "flat:", self, self, total, s->samples );
+	VM_PrintSampleTable( vm, "inclusive:", total, self, total, s->samples );
+
+	Z_Free( seen );
+	Z_Free( total );
+	Z_Free( self );
+}
+
+/*
+==============
+VM_WriteFoldedSamples
+==============
+*/
+static void VM_WriteFoldedSamples( vm_t *vm, vmSamples_t *s ) {
+	fileHandle_t	f;
+	int		*hashRecord, *hashCount;
+	int		*rec, *end, *other;
+	int		i, size, h, stacks;
+	char	name[MAX_QPATH];
+
+	for ( size = 256 ; size < s->samples * 2 ; size <<= 1 ) {
+	}
+	hashRecord = Z_Malloc( size * sizeof( *hashRecord ) );
+	hashCount = Z_Malloc( size * sizeof( *hashCount ) );
+
+	// count the distinct stacks
+	end = s->records + s->length;
+	for ( rec = s->records ; rec < end ; rec += 1 + rec[0] ) {
+		h = 0;
+		for ( i = 0 ; i <= rec[0] ; i++ ) {
+			h = h * 31 + rec[i];
+		}
+		for ( h &= size - 1 ; hashCount[h] ; h = ( h + 1 ) & ( size - 1 ) ) {
+			other = s->records + hashRecord[h];
+			if ( !memcmp( other, rec, ( 1 + rec[0] ) * sizeof( *rec ) ) ) {
+				break;
+			}
+		}
+		if ( !hashCount[h] ) {
+			hashRecord[h] = rec - s->records;
+		}
+		hashCount[h]++;
+	}
+
+	Com_sprintf( name, sizeof( name ), "vmprofile/%s.folded", vm->name );
+	f = FS_FOpenFileWrite( name );
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", name );
+	} else {
+		stacks = 0;
+		for ( h = 0 ; h < size ; h++ ) {
+			if ( !hashCount[h] ) {
+				continue;
+			}
+			rec = s->records + hashRecord[h];
+			FS_Printf( f, "%s", vm->name );
+			for ( i = rec[0] ; i >= 1 ; i-- ) {
+				FS_Printf( f, ";%s", VM_SampleName( vm, rec[i] ) );
+			}
+			FS_Printf( f, " %i\n", hashCount[h] );
+			stacks++;
+		}
+		FS_FCloseFile( f );
+		Com_Printf( "wrote %i stacks to %s\n", stacks, name );
+	}
+
+	Z_Free( hashCount );
+	Z_Free( hashRecord );
+}
+
+/*
+==============
+VM_StopSampledProfile
+==============
+*/
+static void VM_StopSampledProfile( void ) {
+	vmSamples_t	s;
+
+	VM_StopSampling( &s );
+	VM_PrintSamples( vm_sampled, &s );
+	if ( s.samples ) {
+		VM_WriteFoldedSamples( vm_sampled, &s );
+	}
+	vm_sampled = NULL;
+}
+
+/*
+==============
+VM_StartSampledProfile
+
+"vmprofile start <module> [hz]"
+==============
+*/
+static void VM_StartSampledProfile( void ) {
+	vm_t	*vm;
+	int		i, hz;
+
+	if ( vm_sampled ) {
+		Com_Printf( "%s is being sampled already\n", vm_sampled->name );
+		return;
+	}
+
+	vm = NULL;
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( vmTable[i].name[0] && !Q_stricmp( vmTable[i].name, Cmd_Argv( 2 ) ) ) {
+			vm = &vmTable[i];
+		}
+	}
+	if ( !vm ) {
+		Com_Printf( "usage: vmprofile start <module> [hz]\n" );
+		return;
+	}
+
+	hz = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : 1000;
+	if ( hz < 10 ) {
+		hz = 10;
+	} else if ( hz > 10000 ) {
+		hz = 10000;
+	}
+
+	if ( !VM_StartSampling( vm, hz ) ) {
+		Com_Printf( "%s can't be sampled, only compiled modules can\n", vm->name );
+		return;
+	}
+	vm_sampled = vm;
+	Com_Printf( "sampling %s %i times a second of cpu time\n", vm->name, hz );
+}
+#endif
+
+/*
+==============
+VM_VmProfile_f
+
+"vmprofile [start <module> [hz] | stop]"
+==============
+*/
+void VM_VmProfile_f( void ) {
+	vm_t		*vm;
+
+#ifdef VM_SAMPLING
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "start" ) ) {
+		VM_StartSampledProfile();
+		return;
+	}
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "stop" ) ) {
+		if ( vm_sampled ) {
+			VM_StopSampledProfile();
+		}
+		return;
+	}
+#endif
+
+	if ( !lastVM ) {
+		return;
+	}
+
+	vm = lastVM;
+
+	if ( vm->numSymbols ) {
+		VM_PrintSymbolProfile( vm );
+	}
+
+	VM_PrintSyscallProfile( vm );
+}
+
 /*
 ==============
 VM_VmInfo_f
@@ -867,6 +1275,289 @@ void VM_VmInfo_f( void ) {
 	}
 }
 
+#ifndef NO_VM_COMPILED
+/*
+==============
+VM_VmBench_f
+
+"vmbench <module> [count]"
+Compiles vm/<module>.qvm count times and reports the time per compile
+==============
+*/
+void VM_VmBench_f( void ) {
+	vm_t		vm;
+	vmHeader_t	*header;
+	char		filename[MAX_QPATH];
+	int			count, i, dataLength;
+	int			start, msec;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: vmbench <module> [count]\n" );
+		return;
+	}
+
+	count = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 10;
+	if ( count < 1 ) {
+		count = 1;
+	}
+
+	Com_sprintf( filename, sizeof( filename ), "vm/%s.qvm", Cmd_Argv( 1 ) );
+	FS_ReadFile( filename, (void **)&header );
+	if ( !header ) {
+		Com_Printf( "Couldn't load %s\n", filename );
+		return;
+	}
+
+	if ( LittleLong( header->vmMagic ) != VM_MAGIC
+		&& LittleLong( header->vmMagic ) != VM_MAGIC_VER2 ) {
+		Com_Printf( "%s does not have a recognisable magic number in its header\n", filename );
+		FS_FreeFile( header );
+		return;
+	}
+
+	// the 1.32b header fields the compiler looks at
+	for ( i = 0 ; i < ( sizeof( vmHeader_t ) - sizeof( int ) ) / 4 ; i++ ) {
+		((int *)header)[i] = LittleLong( ((int *)header)[i] );
+	}
+
+	dataLength = header->dataLength + header->litLength + header->bssLength;
+	for ( i = 0 ; dataLength > ( 1 << i ) ; i++ ) {
+	}
+
+	Com_Memset( &vm, 0, sizeof( vm ) );
+	Q_strncpyz( vm.name, Cmd_Argv( 1 ), sizeof( vm.name ) );
+	vm.dataMask = ( 1 << i ) - 1;
+	vm.instructionPointersLength = header->instructionCount * 4;
+	vm.instructionPointers = Z_Malloc( vm.instructionPointersLength );
+
+	start = Sys_Milliseconds();
+	for ( i = 0 ; i < count ; i++ ) {
+		vm.compiled = qfalse;		// keeps the compiler quiet
+		VM_Compile( &vm, header );
+		if ( vm.destroy ) {
+			vm.destroy( &vm );
+		}
+	}
+	msec = Sys_Milliseconds() - start;
+
+	Com_Printf( "%s: %i instructions to %i bytes, %i compiles in %i msec, %.3f msec each\n",
+		vm.name, header->instructionCount, vm.codeLength, count, msec, (float)msec / count );
+
+	Z_Free( vm.instructionPointers );
+	FS_FreeFile( header );
+}
+
+static vm_t	*vm_compareInterpreted;
+static int	vm_compareCalls[2];
+static int	vm_compareOrder[2];
+
+/*
+==============
+VM_CompareSystemCall
+
+Stands in for every syscall of both copies, so neither touches the
+running game.  Records the order of the calls and answers how many
+there have been, which is never 0 for a module to divide by.
+==============
+*/
+static intptr_t VM_CompareSystemCall( intptr_t *args ) {
+	int		i;
+
+	i = currentVM == vm_compareInterpreted ? 0 : 1;
+	vm_compareCalls[i]++;
+	vm_compareOrder[i] = vm_compareOrder[i] * 31 + args[0];
+	return vm_compareCalls[i];
+}
+
+/*
+==============
+VM_VmCompare_f
+
+"vmcompare <module> [callnum] [args]"
+Loads vm/<module>.qvm twice, runs the call in the interpreter and in
+the compiler and reports any difference in the return value, the
+syscalls made or the data, lit and bss segments.  The pure math
+traps of a loaded module with the same name are kept, so the inline
+versions get checked too.
+==============
+*/
+void VM_VmCompare_f( void ) {
+	vm_t		vms[2], *oldVM;
+	vm_t		*loaded;
+	vmHeader_t	*header;
+	vmSyscall_t	*syscalls;
+	char		filename[MAX_QPATH];
+	int			args[11];
+	int			r[2];
+	int			i, j, dataLength, jtrgLength, length, first, diffs;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: vmcompare <module> [callnum] [args]\n" );
+		return;
+	}
+
+	Com_Memset( args, 0, sizeof( args ) );
+	for ( i = 2 ; i < Cmd_Argc() && i - 2 < sizeof( args ) / sizeof( args[0] ) ; i++ ) {
+		args[i - 2] = atoi( Cmd_Argv( i ) );
+	}
+
+	Com_sprintf( filename, sizeof( filename ), "vm/%s.qvm", Cmd_Argv( 1 ) );
+	FS_ReadFile( filename, (void **)&header );
+	if ( !header ) {
+		Com_Printf( "Couldn't load %s\n", filename );
+		return;
+	}
+
+	if ( LittleLong( header->vmMagic ) == VM_MAGIC_VER2 ) {
+		for ( i = 0 ; i < sizeof( vmHeader_t ) / 4 ; i++ ) {
+			((int *)header)[i] = LittleLong( ((int *)header)[i] );
+		}
+		jtrgLength = header->jtrgLength;
+	} else if ( LittleLong( header->vmMagic ) == VM_MAGIC ) {
+		for ( i = 0 ; i < ( sizeof( vmHeader_t ) - sizeof( int ) ) / 4 ; i++ ) {
+			((int *)header)[i] = LittleLong( ((int *)header)[i] );
+		}
+		jtrgLength = 0;		// the 1.32b header ends before it
+	} else {
+		Com_Printf( "%s does not have a recognisable magic number in its header\n", filename );
+		FS_FreeFile( header );
+		return;
+	}
+
+	if ( jtrgLength < 0
+		|| header->bssLength < 0
+		|| header->dataLength < 0
+		|| header->litLength < 0
+		|| header->codeLength <= 0 ) {
+		Com_Printf( "%s has bad header\n", filename );
+		FS_FreeFile( header );
+		return;
+	}
+
+	dataLength = header->dataLength + header->litLength + header->bssLength;
+	for ( i = 0 ; dataLength > ( 1 << i ) ; i++ ) {
+	}
+	dataLength = 1 << i;
+
+	// only the pure math traps, the rest would reach into the game
+	syscalls = NULL;
+	loaded = NULL;
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( vmTable[i].syscalls && !Q_stricmp( vmTable[i].name, Cmd_Argv( 1 ) ) ) {
+			loaded = &vmTable[i];
+			syscalls = Z_Malloc( loaded->numSyscalls * sizeof( *syscalls ) );
+			for ( j = 0 ; j < loaded->numSyscalls ; j++ ) {
+				if ( loaded->syscalls[j].inlined != VM_INLINE_NONE ) {
+					syscalls[j] = loaded->syscalls[j];
+				}
+			}
+			break;
+		}
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		Com_Memset( &vms[i], 0, sizeof( vms[i] ) );
+		Q_strncpyz( vms[i].name, Cmd_Argv( 1 ), sizeof( vms[i].name ) );
+		vms[i].systemCall = VM_CompareSystemCall;
+		vms[i].syscalls = syscalls;
+		vms[i].numSyscalls = syscalls ? loaded->numSyscalls : 0;
+
+		vms[i].dataBase = Hunk_AllocateTempMemory( dataLength );
+		vms[i].dataMask = dataLength - 1;
+		Com_Memset( vms[i].dataBase, 0, dataLength );
+		Com_Memcpy( vms[i].dataBase, (byte *)header + header->dataOffset, header->dataLength + header->litLength );
+		for ( length = 0 ; length < header->dataLength ; length += 4 ) {
+			*(int *)(vms[i].dataBase + length) = LittleLong( *(int *)(vms[i].dataBase + length) );
+		}
+
+		vms[i].numJumpTableTargets = jtrgLength >> 2;
+		if ( jtrgLength ) {
+			vms[i].jumpTableTargets = Hunk_AllocateTempMemory( jtrgLength );
+			Com_Memcpy( vms[i].jumpTableTargets, (byte *)header + header->dataOffset +
+					header->dataLength + header->litLength, jtrgLength );
+			for ( length = 0 ; length < jtrgLength ; length += 4 ) {
+				*(int *)(vms[i].jumpTableTargets + length) = LittleLong( *(int *)(vms[i].jumpTableTargets + length) );
+			}
+		}
+
+		vms[i].instructionPointersLength = header->instructionCount * 4;
+		vms[i].instructionPointers = Hunk_AllocateTempMemory( vms[i].instructionPointersLength );
+		vms[i].codeLength = header->codeLength;
+		vms[i].programStack = vms[i].dataMask + 1;
+		vms[i].stackBottom = vms[i].programStack - STACK_SIZE;
+	}
+
+	vms[0].codeBase = Hunk_AllocateTempMemory( vms[0].codeLength * 4 );
+	VM_PrepareInterpreter( &vms[0], header );
+
+	vms[1].compiled = qfalse;		// keeps the compiler quiet
+	VM_Compile( &vms[1], header );
+
+	if ( vms[1].destroy ) {
+		oldVM = currentVM;
+		vm_compareInterpreted = &vms[0];
+		for ( i = 0 ; i < 2 ; i++ ) {
+			vm_compareCalls[i] = 0;
+			vm_compareOrder[i] = 0;
+			currentVM = &vms[i];
+			r[i] = i ? VM_CallCompiled( &vms[i], args ) : VM_CallInterpreted( &vms[i], args );
+		}
+		currentVM = oldVM;
+		vm_compareInterpreted = NULL;
+		vms[1].destroy( &vms[1] );
+
+		// the stack holds return addresses, which differ, and
+		// q3asm puts it at the end of bss
+		length = header->dataLength + header->litLength + header->bssLength - 0x10000;
+		if ( length < header->dataLength + header->litLength ) {
+			length = header->dataLength + header->litLength;
+		}
+		first = -1;
+		diffs = 0;
+		for ( i = 0 ; i < length ; i++ ) {
+			if ( vms[0].dataBase[i] != vms[1].dataBase[i] ) {
+				if ( first < 0 ) {
+					first = i;
+				}
+				diffs++;
+			}
+		}
+
+		Com_Printf( "%s call %i: returned %i interpreted, %i compiled\n", vms[0].name, args[0], r[0], r[1] );
+		Com_Printf( "%i syscalls interpreted, %i compiled%s\n", vm_compareCalls[0], vm_compareCalls[1],
+			vm_compareOrder[0] != vm_compareOrder[1] ? ", in a different order" : "" );
+		if ( diffs ) {
+			Com_Printf( "%i of %i data bytes differ, the first at 0x%x\n", diffs, length, first );
+		}
+		if ( r[0] == r[1] && vm_compareCalls[0] == vm_compareCalls[1]
+			&& vm_compareOrder[0] == vm_compareOrder[1] && !diffs ) {
+			Com_Printf( "match\n" );
+		} else {
+			Com_Printf( S_COLOR_RED "MISMATCH\n" );
+		}
+	} else {
+		Com_Printf( "Couldn't compile %s\n", filename );
+	}
+
+	// temp memory goes back in the order it was taken
+	Hunk_FreeTempMemory( vms[0].codeBase );
+	for ( i = 1 ; i >= 0 ; i-- ) {
+		Hunk_FreeTempMemory( vms[i].instructionPointers );
+		if ( vms[i].jumpTableTargets ) {
+			Hunk_FreeTempMemory( vms[i].jumpTableTargets );
+		}
+		Hunk_FreeTempMemory( vms[i].dataBase );
+		if ( vms[i].syscallProfile ) {
+			Z_Free( vms[i].syscallProfile );
+		}
+	}
+	if ( syscalls ) {
+		Z_Free( syscalls );
+	}
+	FS_FreeFile( header );
+}
+#endif
+
 /*
 ===============
 VM_LogSyscalls
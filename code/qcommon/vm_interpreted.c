@@ -165,6 +165,8 @@ void VM_StackTrace( vm_t *vm, int programCounter, int programStack ) {
 /*
 ====================
 VM_PrepareInterpreter
+
+Fills vm->codeBase, which holds codeLength ints
 ====================
 */
 void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
@@ -174,7 +176,6 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 	int		instruction;
 	int		*codeBase;
 
-	vm->codeBase = Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
 //	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
 
 	// we don't need to translate the instructions, but we still need
@@ -545,7 +546,7 @@ nextInstruction2:
 					}
 					argptr = argarr;
 				#endif
-					r = vm->systemCall( argptr );
+					r = VM_SystemCall( vm, argptr );
 				}
 
 #ifdef DEBUG_VM
@@ -120,6 +120,35 @@ typedef struct vmSymbol_s {
 	char	symName[1];		// variable sized
 } vmSymbol_t;
 
+#define	MAX_VM_SYSCALLS		1024		// profiled ones
+
+typedef struct vmSyscallProfile_s {
+	int			calls;
+	int64_t		usec;
+} vmSyscallProfile_t;
+
+// compiled code that the sampling profiler can walk
+#if !defined( NO_VM_COMPILED ) && defined( __x86_64__ )
+#define	VM_SAMPLING
+#endif
+
+typedef struct {
+	int			start;				// instruction of the OP_ENTER
+	int			frameSize;
+} vmFunction_t;
+
+#define	MAX_SAMPLE_DEPTH	32
+
+typedef struct {
+	// each sample is its depth, then the vm->functions index of each
+	// frame from the innermost out, -1 for engine code called by the vm
+	int			*records;
+	int			length;				// ints used in records
+	int			samples;
+	int			idle;				// the vm wasn't running
+	int			dropped;			// records was full
+} vmSamples_t;
+
 #define	VM_OFFSET_PROGRAM_STACK		0
 #define	VM_OFFSET_SYSTEM_CALL		4
 
@@ -164,11 +193,19 @@ struct vm_s {
 
 	byte		*jumpTableTargets;
 	int			numJumpTableTargets;
+
+	const vmSyscall_t	*syscalls;
+	int			numSyscalls;
+	vmSyscallProfile_t	*syscallProfile;	// vm_syscallProfile
+
+	vmFunction_t	*functions;		// by start, compiled code only
+	int			numFunctions;
 };
 
 
 extern	vm_t	*currentVM;
 extern	int		vm_debugLevel;
+extern	cvar_t	*vm_syscallProfile;
 
 void VM_Compile( vm_t *vm, vmHeader_t *header );
 int	VM_CallCompiled( vm_t *vm, int *args );
@@ -180,4 +217,8 @@ vmSymbol_t *VM_ValueToFunctionSymbol( vm_t *vm, int value );
 int VM_SymbolToValue( vm_t *vm, const char *symbol );
 const char *VM_ValueToSymbol( vm_t *vm, int value );
 void VM_LogSyscalls( int *args );
+intptr_t VM_SystemCall( vm_t *vm, intptr_t *args );
+
+qboolean VM_StartSampling( vm_t *vm, int hz );
+void VM_StopSampling( vmSamples_t *samples );
 
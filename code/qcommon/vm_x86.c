@@ -159,7 +159,7 @@ systemCall:
 	currentVM->programStack = programStack - 4;
 	*(int *)((byte *)currentVM->dataBase + programStack + 4) = syscallNum;
 //VM_LogSyscalls(  (int *)((byte *)currentVM->dataBase + programStack + 4) );
-	*(opStack+1) = currentVM->systemCall( (int *)((byte *)currentVM->dataBase + programStack + 4) );
+	*(opStack+1) = VM_SystemCall( currentVM, (intptr_t *)((byte *)currentVM->dataBase + programStack + 4) );
 
 	currentVM = savedVM;
 
@@ -201,7 +201,7 @@ void callAsmCall(void)
 	currentVM->programStack = callProgramStack - 4;
 	*(int *)((byte *)currentVM->dataBase + callProgramStack + 4) = callSyscallNum;
 	//VM_LogSyscalls((int *)((byte *)currentVM->dataBase + callProgramStack + 4) );
-	*(callOpStack2+1) = currentVM->systemCall( (intptr_t *)((byte *)currentVM->dataBase + callProgramStack + 4) );
+	*(callOpStack2+1) = VM_SystemCall( currentVM, (intptr_t *)((byte *)currentVM->dataBase + callProgramStack + 4) );
 
  	currentVM = savedVM;
 }
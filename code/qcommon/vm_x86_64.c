@@ -22,20 +22,25 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 // vm_x86_64.c -- load time compiler and execution environment for x86-64
 
+#define _GNU_SOURCE		// REG_RIP for the sampler
+
 #include "vm_local.h"
 
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <sys/time.h>
 #include <time.h>
 #include <fcntl.h>
-#include <errno.h>
 #include <unistd.h>
-#include <stdarg.h>
+#include <cpuid.h>
+#include <signal.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <ucontext.h>
+#include <sys/syscall.h>
+#endif
 
-//#define USE_GAS
 //#define DEBUG_VM
 
 #ifdef DEBUG_VM
@@ -45,19 +50,6 @@ static FILE* qdasmout;
 #define Dfprintf(args...)
 #endif
 
-#define VM_X86_64_MMAP
-
-#ifndef USE_GAS
-void assembler_set_output(char* buf);
-size_t assembler_get_code_size(void);
-void assembler_init(int pass);
-void assemble_line(const char* input, size_t len);
-#ifdef Dfprintf
-#undef Dfprintf
-#define Dfprintf(args...)
-#endif
-#endif // USE_GAS
-
 static void VM_Destroy_Compiled(vm_t* self);
 
 /*
@@ -101,7 +93,7 @@ static long callAsmCall(long callProgramStack, long callSyscallNum)
 //		iargs[i+1] = *(int *)((byte *)currentVM->dataBase + callProgramStack + 8 + 4*i);
 		args[i+1] = *(int *)((byte *)currentVM->dataBase + callProgramStack + 8 + 4*i);
 	}
-	ret = currentVM->systemCall(args);
+	ret = VM_SystemCall(currentVM, args);
 
  	currentVM = savedVM;
 //	Com_Printf("<- callAsmCall %s, level %d, num %ld\n", currentVM->name, currentVM->callLevel, callSyscallNum);
@@ -225,212 +217,471 @@ static unsigned char op_argsize[256] =
 	[OP_BLOCK_COPY] = 4,
 };
 
-#ifdef USE_GAS
-#define emit(x...) \
-	do { fprintf(fh_s, ##x); fputc('\n', fh_s); } while(0)
-#else
-void emit(const char* fmt, ...)
-{
-	va_list ap;
-	char line[4096];
-	va_start(ap, fmt);
-	vsnprintf(line, sizeof(line), fmt, ap);
-	va_end(ap);
-	assemble_line(line, strlen(line));
-}
-#endif // USE_GAS
+/*
+=============================================================================
 
-#ifdef USE_GAS
-#define JMPIARG \
-	emit("jmp i_%08x", iarg);
-#else
-#define JMPIARG \
-	emit("movq $%lu, %%rax", vm->codeBase+vm->instructionPointers[iarg]); \
-	emit("jmpq *%rax");
-#endif
- 
-// integer compare and jump
-#define IJ(op) \
-	emit("subq $8, %%rsi"); \
-	emit("movl 4(%%rsi), %%eax"); \
-	emit("cmpl 8(%%rsi), %%eax"); \
-	emit(op " i_%08x", instruction+1); \
-	JMPIARG \
-	neednilabel = 1;
-
-#ifdef USE_X87
-#define FJ(bits, op) \
-	emit("subq $8, %%rsi");\
-	emit("flds 4(%%rsi)");\
-	emit("fcomps 8(%%rsi)");\
-	emit("fnstsw %%ax");\
-	emit("testb $" #bits ", %%ah");\
-	emit(op " i_%08x", instruction+1);\
-	JMPIARG \
-	neednilabel = 1;
-#define XJ(x)
-#else
-#define FJ(x, y)
-#define XJ(op) \
-	emit("subq $8, %%rsi");\
-	emit("movss 4(%%rsi), %%xmm0");\
-	emit("ucomiss 8(%%rsi), %%xmm0");\
-	emit("jp i_%08x", instruction+1);\
-	emit(op " i_%08x", instruction+1);\
-	JMPIARG \
-	neednilabel = 1;
-#endif
+The compiler writes the machine code directly, in two passes over the
+bytecode.  The first one only counts bytes to find where every
+instruction starts, the second one writes the code into the buffer
+sized by the first, where all jump targets are known.
 
-#define SIMPLE(op) \
-	emit("subq $4, %%rsi"); \
-	emit("movl 4(%%rsi), %%eax"); \
-	emit(op " %%eax, 0(%%rsi)");
-
-#ifdef USE_X87
-#define FSIMPLE(op) \
-	emit("subq $4, %%rsi"); \
-	emit("flds 0(%%rsi)"); \
-	emit(op " 4(%%rsi)"); \
-	emit("fstps 0(%%rsi)");
-#define XSIMPLE(op)
-#else
-#define FSIMPLE(op)
-#define XSIMPLE(op) \
-	emit("subq $4, %%rsi"); \
-	emit("movss 0(%%rsi), %%xmm0"); \
-	emit(op " 4(%%rsi), %%xmm0"); \
-	emit("movss %%xmm0, 0(%%rsi)");
-#endif
+Jumps with targets known at compile time go straight to the target
+instruction.  The value on top of the opstack is usually also left in
+eax, so the next instruction doesn't have to load it again, and common
+pairs like OP_LOCAL OP_LOAD4 or OP_CONST OP_ADD are compiled together.
+Neither is done across an instruction something may jump to.
 
-#define SHIFT(op) \
-	emit("subq $4, %%rsi"); \
-	emit("movl 4(%%rsi), %%ecx"); \
-	emit("movl 0(%%rsi), %%eax"); \
-	emit(op " %%cl, %%eax"); \
-	emit("movl %%eax, 0(%%rsi)");
-
-#if 1
-#define RANGECHECK(reg) \
-	emit("andl $0x%x, %%" #reg, vm->dataMask);
-#elif 0
-#define RANGECHECK(reg) \
-	emit("pushl %%" #reg); \
-	emit("andl $0x%x, %%" #reg, ~vm->dataMask); \
-	emit("jz rangecheck_ok_i_%08x", instruction); \
-	emit("int3"); \
-	emit("rangecheck_ok_i_%08x:", instruction); \
-	emit("popl %%" #reg); \
-	emit("andl $0x%x, %%" #reg, vm->dataMask);
-#else
-#define RANGECHECK(reg)
-#endif
+With DEBUG_VM each instruction starts with a marker that loads its
+number into r15.
 
-#ifdef DEBUG_VM
-#define NOTIMPL(x) \
-	do { Com_Error(ERR_DROP, "instruction not implemented: %s\n", opnames[x]); } while(0)
-#else
-#define NOTIMPL(x) \
-	do { Com_Printf(S_COLOR_RED "instruction not implemented: %x\n", x); vm->compiled = qfalse; return; } while(0)
-#endif
+=============================================================================
+*/
 
-static void* getentrypoint(vm_t* vm)
-{
-#ifdef USE_GAS
-       return vm->codeBase+64; // skip ELF header
-#else
-       return vm->codeBase;
-#endif // USE_GAS
+static	byte	*buf;				// NULL while counting
+static	int		compiledOfs;
+
+// jumps to the following instruction, patched once it starts
+#define	MAX_NEXT_JUMPS	4
+
+static	int		nextJumps[MAX_NEXT_JUMPS];
+static	int		nextJumpSizes[MAX_NEXT_JUMPS];
+static	int		numNextJumps;
+
+// absolute addresses in the code, see VM_SaveCompiled
+typedef enum {
+	RELOC_INSTRUCTIONPOINTERS,
+	RELOC_CALLASMCALL,
+	RELOC_BLOCKCOPY,
+	RELOC_SYSCALLS,
+	RELOC_VM,
+	NUM_RELOCS
+} relocType_t;
+
+typedef struct {
+	int		ofs;
+	int		type;
+} jitReloc_t;
+
+static	jitReloc_t	*relocs;		// NULL while counting
+static	int			numRelocs;
+
+static	byte		*jused;			// instructions jumped to from somewhere
+static	qboolean	topInEax;		// eax holds 0(%rsi) after this instruction
+static	qboolean	cachedTop;		// eax holds 0(%rsi) before this instruction
+
+static void Emit1( int v ) {
+	if ( buf ) {
+		buf[ compiledOfs ] = v;
+	}
+	compiledOfs++;
 }
 
-#ifdef USE_GAS
-char* mmapfile(const char* fn, size_t* size)
-{
-	int fd = -1;
-	char* mem = NULL;
-	struct stat stb;
+static void Emit4( int v ) {
+	Emit1( v & 255 );
+	Emit1( ( v >> 8 ) & 255 );
+	Emit1( ( v >> 16 ) & 255 );
+	Emit1( ( v >> 24 ) & 255 );
+}
 
-	fd = open(fn, O_RDONLY);
-	if(fd == -1)
-		goto out;
+static void Emit8( unsigned long v ) {
+	Emit4( v & 0xFFFFFFFF );
+	Emit4( ( v >> 32 ) & 0xFFFFFFFF );
+}
 
-	if(fstat(fd, &stb) == -1)
-		goto out;
+/*
+=================
+EmitAddress
 
-	*size = stb.st_size;
+Emits an address that moves from one load to the next
+=================
+*/
+static void EmitAddress( relocType_t type, unsigned long v ) {
+	if ( relocs ) {
+		relocs[ numRelocs ].ofs = compiledOfs;
+		relocs[ numRelocs ].type = type;
+	}
+	numRelocs++;
+	Emit8( v );
+}
 
-	mem = mmap(NULL, stb.st_size, PROT_READ|PROT_EXEC, MAP_SHARED, fd, 0);
-	if(mem == (void*)-1)
-		mem = NULL;
+static int Hex( int c ) {
+	if ( c >= 'a' && c <= 'f' ) {
+		return 10 + c - 'a';
+	}
+	if ( c >= 'A' && c <= 'F' ) {
+		return 10 + c - 'A';
+	}
+	if ( c >= '0' && c <= '9' ) {
+		return c - '0';
+	}
 
-out:
-	if(fd != -1)
-		close(fd);
+	Com_Error( ERR_DROP, "Hex: bad char '%c'", c );
 
-	return mem;
+	return 0;
 }
 
-static int doas(char* in, char* out, unsigned char** compiledcode)
-{
-	unsigned char* mem;
-	size_t size = -1;
-	pid_t pid;
+static void EmitString( const char *string ) {
+	int		c1, c2;
+	int		v;
 
-	Com_Printf("running assembler < %s > %s\n", in, out);
-	pid = fork();
-	if(pid == -1)
-	{
-		Com_Printf(S_COLOR_RED "can't fork\n");
-		return -1;
+	while ( 1 ) {
+		c1 = string[0];
+		c2 = string[1];
+
+		v = ( Hex( c1 ) << 4 ) | Hex( c2 );
+		Emit1( v );
+
+		if ( !string[2] ) {
+			break;
+		}
+		string += 3;
 	}
+}
 
-	if(!pid)
-	{
-		char* const argv[] = {
-			"as",
-			"-o",
-			out,
-			in,
-			NULL
-		};
-
-		execvp(argv[0], argv);
-		_exit(-1);
+/*
+=================
+EmitJumpToNext
+
+Jump with an 8 or 32 bit displacement to the following instruction
+=================
+*/
+static void EmitJumpToNext( const char *opcode, int size ) {
+	EmitString( opcode );
+	nextJumps[ numNextJumps ] = compiledOfs;
+	nextJumpSizes[ numNextJumps ] = size;
+	numNextJumps++;
+	if ( size == 1 ) {
+		Emit1( 0 );
+	} else {
+		Emit4( 0 );
 	}
-	else
-	{
-		int status;
-		if(waitpid(pid, &status, 0) == -1)
-		{
-			Com_Printf(S_COLOR_RED "can't wait for as: %s\n", strerror(errno));
-			return -1;
-		}
+}
 
-		if(!WIFEXITED(status))
-		{
-			Com_Printf(S_COLOR_RED "as died\n");
-			return -1;
+/*
+=================
+PatchJumpsToNext
+=================
+*/
+static void PatchJumpsToNext( void ) {
+	int		i, disp;
+
+	for ( i = 0 ; i < numNextJumps ; i++ ) {
+		disp = compiledOfs - ( nextJumps[i] + nextJumpSizes[i] );
+		if ( !buf ) {
+			continue;
 		}
-		if(WEXITSTATUS(status))
-		{
-			Com_Printf(S_COLOR_RED "as failed with status %d\n", WEXITSTATUS(status));
-			return -1;
+		if ( nextJumpSizes[i] == 1 ) {
+			if ( disp > 127 ) {
+				Com_Error( ERR_DROP, "VM_CompileX86: short jump out of range" );
+			}
+			buf[ nextJumps[i] ] = disp;
+		} else {
+			buf[ nextJumps[i] ] = disp & 255;
+			buf[ nextJumps[i] + 1 ] = ( disp >> 8 ) & 255;
+			buf[ nextJumps[i] + 2 ] = ( disp >> 16 ) & 255;
+			buf[ nextJumps[i] + 3 ] = ( disp >> 24 ) & 255;
 		}
 	}
+	numNextJumps = 0;
+}
 
-	Com_Printf("done\n");
+/*
+=================
+EmitJump
 
-	mem = (unsigned char*)mmapfile(out, &size);
-	if(!mem)
-	{
-		Com_Printf(S_COLOR_RED "can't mmap object file %s: %s\n", out, strerror(errno));
-		return -1;
+Jump with a 32 bit displacement to an instruction, instructions only
+move between the passes when they are later than this one, and the
+second pass is only written once their places are known
+=================
+*/
+static void EmitJump( vm_t *vm, const char *opcode, unsigned target ) {
+	EmitString( opcode );
+	Emit4( vm->instructionPointers[ target ] - ( compiledOfs + 4 ) );
+}
+
+/*
+=================
+EmitRangeCheck
+
+andl $dataMask, reg
+=================
+*/
+static void EmitRangeCheck( vm_t *vm, const char *opcode ) {
+	EmitString( opcode );
+	Emit4( vm->dataMask );
+}
+
+#define	RANGECHECK_EAX	"81 E0"
+#define	RANGECHECK_EBX	"81 E3"
+#define	RANGECHECK_EDI	"81 E7"
+
+#define	SUB_RSI_4	"48 81 EE 04 00 00 00"	// subq $4, %rsi
+#define	SUB_RSI_8	"48 81 EE 08 00 00 00"	// subq $8, %rsi
+#define	ADD_RSI_4	"48 81 C6 04 00 00 00"	// addq $4, %rsi
+
+#define	PUSH_REGS	"56 57 41 50 41 51 41 52"	// push %rsi, %rdi, %r8, %r9, %r10
+#define	POP_REGS	"41 5A 41 59 41 58 5F 5E"	// pop %r10, %r9, %r8, %rdi, %rsi
+
+/*
+=================
+EmitLoadTop
+
+movl 0(%rsi), %eax unless eax still holds it
+=================
+*/
+static void EmitLoadTop( void ) {
+	if ( !cachedTop ) {
+		EmitString( "8B 06" );		// movl 0(%rsi), %eax
+	}
+}
+
+/*
+=================
+EmitStoreTop
+
+movl %eax, 0(%rsi), which the next instruction may skip loading
+=================
+*/
+static void EmitStoreTop( void ) {
+	EmitString( "89 06" );			// movl %eax, 0(%rsi)
+	topInEax = qtrue;
+}
+
+// integer compare and jump
+static void EmitIntJump( vm_t *vm, const char *jcc, unsigned target ) {
+	EmitString( SUB_RSI_8 );
+	if ( cachedTop ) {
+		EmitString( "39 46 04" );	// cmpl %eax, 4(%rsi)
+	} else {
+		EmitString( "8B 46 04" );	// movl 4(%rsi), %eax
+		EmitString( "3B 46 08" );	// cmpl 8(%rsi), %eax
+	}
+	EmitJump( vm, jcc, target );
+}
+
+// integer compare against a constant and jump
+static void EmitIntConstJump( vm_t *vm, int value, const char *jcc, unsigned target ) {
+	EmitLoadTop();
+	EmitString( SUB_RSI_4 );
+	EmitString( "3D" );				// cmpl $value, %eax
+	Emit4( value );
+	EmitJump( vm, jcc, target );
+}
+
+// float compare and jump, unordered never jumps
+static void EmitFloatJump( vm_t *vm, const char *jcc, unsigned target ) {
+	EmitString( SUB_RSI_8 );
+	EmitString( "F3 0F 10 46 04" );	// movss 4(%rsi), %xmm0
+	EmitString( "0F 2E 46 08" );	// ucomiss 8(%rsi), %xmm0
+	EmitString( "7A 06" );			// jp over the jcc
+	EmitJump( vm, jcc, target );
+}
+
+// op 4(%rsi), %eax, or op %eax, 0(%rsi) when eax holds the second operand
+static void EmitSimple( const char *op, const char *memOp ) {
+	EmitString( SUB_RSI_4 );
+	if ( cachedTop ) {
+		EmitString( memOp );
+		return;
+	}
+	EmitString( "8B 06" );			// movl 0(%rsi), %eax
+	EmitString( op );
+	EmitStoreTop();
+}
+
+// op $value, %eax
+static void EmitSimpleConst( const char *op, int value ) {
+	EmitLoadTop();
+	EmitString( op );
+	Emit4( value );
+	EmitStoreTop();
+}
+
+// op 4(%rsi), %xmm0
+static void EmitFloatSimple( const char *op ) {
+	EmitString( SUB_RSI_4 );
+	EmitString( "F3 0F 10 06" );	// movss 0(%rsi), %xmm0
+	EmitString( op );
+	EmitString( "F3 0F 11 06" );	// movss %xmm0, 0(%rsi)
+}
+
+// op %cl, %eax
+static void EmitShift( const char *op ) {
+	if ( cachedTop ) {
+		EmitString( "89 C1" );		// movl %eax, %ecx
+		EmitString( SUB_RSI_4 );
+	} else {
+		EmitString( SUB_RSI_4 );
+		EmitString( "8B 4E 04" );	// movl 4(%rsi), %ecx
+	}
+	EmitString( "8B 06" );			// movl 0(%rsi), %eax
+	EmitString( op );
+	EmitStoreTop();
+}
+
+// op $value, %eax
+static void EmitShiftConst( const char *op, int value ) {
+	EmitLoadTop();
+	EmitString( op );
+	Emit1( value & 31 );
+	EmitStoreTop();
+}
+
+/*
+=================
+EmitSaveProgramStack
+
+Leaves programStack in vm->programStack for the sampler before the code
+calls out, as callAsmCall does
+=================
+*/
+static void EmitSaveProgramStack( vm_t *vm ) {
+	EmitString( "48 B8" );			// movq $vm->programStack, %rax
+	EmitAddress( RELOC_VM, (unsigned long)&vm->programStack );
+	EmitString( "8D 5F FC" );		// leal -4(%rdi), %ebx
+	EmitString( "89 18" );			// movl %ebx, 0(%rax)
+}
+
+/*
+=================
+EmitSyscall
+
+Calls the system call numbered by eax, which is negative
+=================
+*/
+static void EmitSyscall( void ) {
+	EmitString( PUSH_REGS );
+	EmitString( "48 89 E3" );		// movq %rsp, %rbx		we need to align the stack pointer
+	EmitString( "48 81 EB 08 00 00 00" );	// subq $8, %rbx
+	EmitString( "48 81 E3 7F 00 00 00" );	// andq $127, %rbx
+	EmitString( "48 29 DC" );		// subq %rbx, %rsp
+	EmitString( "53" );				// push %rbx
+	EmitString( "F7 D8" );			// negl %eax			convert to actual number
+	EmitString( "FF C8" );			// decl %eax
+									// first argument already in rdi
+	EmitString( "48 89 C6" );		// movq %rax, %rsi		second argument in rsi
+	EmitString( "48 B8" );			// movq $callAsmCall, %rax
+	EmitAddress( RELOC_CALLASMCALL, (unsigned long)callAsmCall );
+	EmitString( "FF D0" );			// callq *%rax
+	EmitString( "5B" );				// pop %rbx
+	EmitString( "48 01 DC" );		// addq %rbx, %rsp
+	EmitString( POP_REGS );
+	EmitString( ADD_RSI_4 );
+	EmitStoreTop();					// store return value
+}
+
+/*
+=================
+EmitDirectSyscall
+
+Calls a system call from the module's table without going through
+callAsmCall and the module's switch, only its own arguments are copied
+=================
+*/
+static void EmitDirectSyscall( vm_t *vm, int num ) {
+	const vmSyscall_t	*sc;
+	int					i, frame;
+
+	sc = &vm->syscalls[num];
+	frame = ( ( sc->numArgs + 1 ) * 8 + 15 ) & ~15;
+
+	EmitSaveProgramStack( vm );
+	EmitString( PUSH_REGS );
+	EmitString( "48 89 E3" );		// movq %rsp, %rbx		we need to align the stack pointer
+	EmitString( "48 81 EB 08 00 00 00" );	// subq $8, %rbx
+	EmitString( "48 81 E3 7F 00 00 00" );	// andq $127, %rbx
+	EmitString( "48 29 DC" );		// subq %rbx, %rsp
+	EmitString( "53" );				// push %rbx
+	EmitString( "48 81 EC" );		// subq $frame, %rsp	intptr_t args[]
+	Emit4( frame );
+	EmitString( "48 C7 04 24" );	// movq $num, 0(%rsp)
+	Emit4( num );
+	for ( i = 1 ; i <= sc->numArgs ; i++ ) {
+		EmitString( "49 63 84 38" );	// movslq disp(%r8, %rdi, 1), %rax
+		Emit4( 4 + 4 * i );
+		EmitString( "48 89 84 24" );	// movq %rax, disp(%rsp)
+		Emit4( 8 * i );
+	}
+	EmitString( "48 89 E7" );		// movq %rsp, %rdi
+	EmitString( "48 B8" );			// movq $sc, %rax
+	EmitAddress( RELOC_SYSCALLS, (unsigned long)sc );
+	EmitString( "FF 50" );			// callq *func(%rax)
+	Emit1( (int)(intptr_t)&((vmSyscall_t *)0)->func );
+	EmitString( "48 81 C4" );		// addq $frame, %rsp
+	Emit4( frame );
+	EmitString( "5B" );				// pop %rbx
+	EmitString( "48 01 DC" );		// addq %rbx, %rsp
+	EmitString( POP_REGS );
+	EmitString( ADD_RSI_4 );
+	EmitStoreTop();					// store return value
+}
+
+/*
+=================
+EmitInlineSyscall
+
+Does a pure math trap in line, qfalse when it has to be called.
+The results are the same as the float casts of the libm double
+functions the modules call.
+=================
+*/
+static qboolean EmitInlineSyscall( vm_t *vm, int num ) {
+	unsigned	eax, ebx, ecx, edx;
+
+	switch ( vm->syscalls[num].inlined ) {
+	case VM_INLINE_SQRT:
+		EmitString( "F3 41 0F 51 44 38 08" );		// sqrtss 8(%r8, %rdi, 1), %xmm0
+		break;
+	case VM_INLINE_FLOOR:
+	case VM_INLINE_CEIL:
+		if ( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) || !( ecx & bit_SSE4_1 ) ) {
+			return qfalse;
+		}
+		EmitString( "66 41 0F 3A 0A 44 38 08" );	// roundss $mode, 8(%r8, %rdi, 1), %xmm0
+		Emit1( vm->syscalls[num].inlined == VM_INLINE_FLOOR ? 0x09 : 0x0A );
+		break;
+	default:
+		return qfalse;
 	}
+	EmitString( "66 0F 7E C0" );	// movd %xmm0, %eax
+	EmitString( ADD_RSI_4 );
+	EmitStoreTop();
+	return qtrue;
+}
 
-	*compiledcode = mem;
+/*
+=================
+EmitLoad
 
-	return size;
+movzbl, movzwl or movl from the address in modrm into eax
+=================
+*/
+static void EmitLoad( int op, const char *modrm ) {
+	switch ( op ) {
+	case OP_LOAD1:
+		EmitString( "41 0F B6" );
+		break;
+	case OP_LOAD2:
+		EmitString( "41 0F B7" );
+		break;
+	default:
+		EmitString( "41 8B" );
+		break;
+	}
+	EmitString( modrm );
 }
-#endif // USE_GAS
+
+#define	MODRM_R8_RAX	"04 00"		// 0(%r8, %rax, 1)
+#define	MODRM_R8_RBX	"04 18"		// 0(%r8, %rbx, 1)
+#define	MODRM_R8_DISP32	"80"		// disp32(%r8)
+
+#ifdef DEBUG_VM
+#define NOTIMPL(x) \
+	do { Com_Error(ERR_DROP, "instruction not implemented: %s\n", opnames[x]); } while(0)
+#else
+#define NOTIMPL(x) \
+	do { Com_Printf(S_COLOR_RED "instruction not implemented: %x\n", x); vm->compiled = qfalse; return; } while(0)
+#endif
 
 static void block_copy_vm(unsigned dest, unsigned src, unsigned count)
 {
@@ -447,6 +698,348 @@ static void block_copy_vm(unsigned dest, unsigned src, unsigned count)
 	memcpy(currentVM->dataBase+dest, currentVM->dataBase+src, count);
 }
 
+/*
+=============================================================================
+
+COMPILED CODE CACHE
+
+With vm_cache 1 the compiled code is written to vmcache/<name>-<key>.x86_64
+under fs_homepath, and the next VM_Compile of the same image by the same
+build on the same kind of cpu reads the file instead of compiling again.
+The key is a checksum of everything the code depends on, so servers with
+different builds or mods sharing a homepath keep apart.  Files are
+written under a temporary name and renamed into place, and the code is
+read into memory rather than run from the file, so a file being
+replaced never changes code that is already loaded.
+
+The files are run as native code, so they are kept out of the game
+directories, which a QVM can write to, and go straight through the OS
+rather than the file system.  They are only checked against the key,
+not authenticated, so vm_cache is off by default and trusts anything
+that can write to fs_homepath.
+
+The code holds absolute addresses of the instruction pointer table,
+two helper functions and the module's syscall table, none of which are
+the same from one load to the next.  Those are written relative to
+their base and relocated after the file is read.  Data is always
+addressed through r8, so nothing in the code depends on vm->dataBase.
+
+Code compiled with vm_syscallProfile set sends every syscall through
+callAsmCall so they can be counted, and is cached apart from the rest.
+
+=============================================================================
+*/
+
+#define	JIT_CACHE_MAGIC		0x4A495433		// "JIT3"
+#define	JIT_CACHE_BUILD		Q3_VERSION " " __DATE__ " " __TIME__
+
+typedef struct {
+	int			magic;
+	char		build[64];
+	unsigned	cpuFeatures[2];		// cpuid 1, ecx and edx
+	unsigned	imageChecksum;		// of the qvm code segment
+	int			instructionCount;
+	int			dataMask;
+	unsigned	syscallsChecksum;	// of the table calls are made from, 0 when profiled
+
+	int			codeOffset;			// everything before it is the key
+	int			codeLength;
+	int			numRelocs;
+	unsigned	checksum;			// of the code, instruction pointers and relocs as stored
+} jitCacheHeader_t;
+
+/*
+=================
+VM_CacheKey
+=================
+*/
+static void VM_CacheKey( vm_t *vm, vmHeader_t *header, jitCacheHeader_t *key ) {
+	const vmSyscall_t	*sc;
+	unsigned	eax, ebx;
+	int			i;
+
+	Com_Memset( key, 0, sizeof( *key ) );
+	key->magic = JIT_CACHE_MAGIC;
+	Q_strncpyz( key->build, JIT_CACHE_BUILD, sizeof( key->build ) );
+	__get_cpuid( 1, &eax, &ebx, &key->cpuFeatures[0], &key->cpuFeatures[1] );
+	key->imageChecksum = Com_BlockChecksum( (byte *)header + header->codeOffset, header->codeLength );
+	key->instructionCount = header->instructionCount;
+	key->dataMask = vm->dataMask;
+
+	// direct and inline syscalls depend on the table
+	if ( !vm_syscallProfile->integer ) {
+		for ( i = 0 ; i < vm->numSyscalls ; i++ ) {
+			sc = &vm->syscalls[i];
+			if ( sc->func ) {
+				key->syscallsChecksum = key->syscallsChecksum * 31 + ( i << 16 | sc->numArgs << 8 | sc->inlined );
+			}
+		}
+		key->syscallsChecksum ^= vm->numSyscalls + 1;
+	}
+}
+
+/*
+=================
+VM_RelocBase
+=================
+*/
+static unsigned long VM_RelocBase( vm_t *vm, int type ) {
+	switch ( type ) {
+	case RELOC_INSTRUCTIONPOINTERS:
+		return (unsigned long)vm->instructionPointers;
+	case RELOC_CALLASMCALL:
+		return (unsigned long)callAsmCall;
+	case RELOC_BLOCKCOPY:
+		return (unsigned long)block_copy_vm;
+	case RELOC_SYSCALLS:
+		return (unsigned long)vm->syscalls;
+	case RELOC_VM:
+		return (unsigned long)vm;
+	}
+	return 0;
+}
+
+/*
+=================
+VM_CachePath
+
+The OS path of the cache file, never under a game directory
+=================
+*/
+static void VM_CachePath( vm_t *vm, const jitCacheHeader_t *key, char *path, int size ) {
+	Com_sprintf( path, size, "%s/vmcache/%s-%08x.x86_64", Cvar_VariableString( "fs_homepath" ), vm->name,
+		Com_BlockChecksum( key, (byte *)&key->codeOffset - (byte *)key ) );
+}
+
+/*
+=================
+VM_CacheChecksum
+=================
+*/
+static unsigned VM_CacheChecksum( const jitCacheHeader_t *h, const byte *code, const int *ips, const jitReloc_t *r ) {
+	return Com_BlockChecksum( code, h->codeLength )
+		^ Com_BlockChecksum( ips, h->instructionCount * 4 )
+		^ Com_BlockChecksum( r, h->numRelocs * sizeof( *r ) );
+}
+
+/*
+=================
+VM_LoadCompiled
+
+Reads the cached code for this image, qfalse if there is none that fits
+=================
+*/
+static qboolean VM_LoadCompiled( vm_t *vm, vmHeader_t *header ) {
+	jitCacheHeader_t	key, h;
+	jitReloc_t			*r;
+	unsigned long		*slot;
+	char				path[MAX_OSPATH];
+	int					fd, tableLength, i;
+	qboolean			ok;
+
+	VM_CacheKey( vm, header, &key );
+	VM_CachePath( vm, &key, path, sizeof( path ) );
+
+	fd = open( path, O_RDONLY );
+	if ( fd == -1 ) {
+		return qfalse;
+	}
+
+	if ( read( fd, &h, sizeof( h ) ) != sizeof( h )
+		|| memcmp( &h, &key, (byte *)&key.codeOffset - (byte *)&key )
+		|| h.codeOffset < (int)sizeof( h )
+		|| h.codeLength <= 0 || h.numRelocs < 0 ) {
+		close( fd );
+		return qfalse;
+	}
+
+	// anonymous memory like a fresh compile, never backed by the file
+	vm->codeBase = mmap( NULL, h.codeLength, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( vm->codeBase == (void *)-1 ) {
+		vm->codeBase = NULL;
+		close( fd );
+		return qfalse;
+	}
+	vm->codeLength = h.codeLength;
+
+	tableLength = h.numRelocs * sizeof( *r );
+	r = Z_Malloc( tableLength + 1 );
+	ok = pread( fd, vm->codeBase, h.codeLength, h.codeOffset ) == h.codeLength
+		&& pread( fd, vm->instructionPointers, h.instructionCount * 4, h.codeOffset + h.codeLength ) == h.instructionCount * 4
+		&& pread( fd, r, tableLength, h.codeOffset + h.codeLength + h.instructionCount * 4 ) == tableLength
+		&& VM_CacheChecksum( &h, vm->codeBase, vm->instructionPointers, r ) == h.checksum;
+	close( fd );
+
+	for ( i = 0 ; ok && i < h.numRelocs ; i++ ) {
+		if ( r[i].ofs < 0 || r[i].ofs > h.codeLength - 8 || r[i].type >= NUM_RELOCS ) {
+			ok = qfalse;
+			break;
+		}
+		slot = (unsigned long *)( vm->codeBase + r[i].ofs );
+		*slot += VM_RelocBase( vm, r[i].type );
+	}
+	Z_Free( r );
+
+	if ( !ok || mprotect( vm->codeBase, vm->codeLength, PROT_READ|PROT_EXEC ) ) {
+		munmap( vm->codeBase, vm->codeLength );
+		vm->codeBase = NULL;
+		Com_Printf( S_COLOR_YELLOW "WARNING: ignoring bad compiled code cache for %s\n", vm->name );
+		return qfalse;
+	}
+
+	vm->destroy = VM_Destroy_Compiled;
+
+	Com_Printf( "VM file %s loaded %i bytes of compiled code from the cache\n", vm->name, vm->codeLength );
+	return qtrue;
+}
+
+/*
+=================
+VM_SaveCompiled
+=================
+*/
+static void VM_SaveCompiled( vm_t *vm, vmHeader_t *header ) {
+	jitCacheHeader_t	h;
+	byte				*code;
+	unsigned long		*slot;
+	char				path[MAX_OSPATH], temp[MAX_OSPATH];
+	int					fd, i;
+	qboolean			ok;
+
+	VM_CacheKey( vm, header, &h );
+	h.codeOffset = sizeof( h );
+	h.codeLength = vm->codeLength;
+	h.numRelocs = numRelocs;
+
+	// addresses are stored relative to their base
+	code = Z_Malloc( vm->codeLength );
+	Com_Memcpy( code, vm->codeBase, vm->codeLength );
+	for ( i = 0 ; i < numRelocs ; i++ ) {
+		slot = (unsigned long *)( code + relocs[i].ofs );
+		*slot -= VM_RelocBase( vm, relocs[i].type );
+	}
+
+	h.checksum = VM_CacheChecksum( &h, code, vm->instructionPointers, relocs );
+
+	// another process may be running from the old file, or writing
+	// the same one, so it is only replaced once complete
+	Com_sprintf( path, sizeof( path ), "%s/vmcache", Cvar_VariableString( "fs_homepath" ) );
+	mkdir( path, 0700 );
+	VM_CachePath( vm, &h, path, sizeof( path ) );
+	Com_sprintf( temp, sizeof( temp ), "%s.%i.tmp", path, (int)getpid() );
+
+	fd = open( temp, O_WRONLY|O_CREAT|O_TRUNC, 0600 );
+	if ( fd == -1 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write the compiled code cache for %s\n", vm->name );
+		Z_Free( code );
+		return;
+	}
+
+	ok = write( fd, &h, sizeof( h ) ) == sizeof( h )
+		&& write( fd, code, h.codeLength ) == h.codeLength
+		&& write( fd, vm->instructionPointers, h.instructionCount * 4 ) == h.instructionCount * 4
+		&& write( fd, relocs, h.numRelocs * sizeof( *relocs ) ) == h.numRelocs * sizeof( *relocs );
+	if ( close( fd ) ) {
+		ok = qfalse;
+	}
+
+	if ( !ok || rename( temp, path ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write the compiled code cache for %s\n", vm->name );
+		unlink( temp );
+	}
+
+	Z_Free( code );
+}
+
+/*
+=================
+VM_FindJumpTargets
+
+Marks every instruction the code may jump to, and checks the targets
+of the conditional jumps.  OP_JUMP and OP_CALL targets only known at
+run time come from jump tables in vm->jumpTableTargets, everything
+else jumped to is the start of a statement, with nothing on the opstack.
+=================
+*/
+static void VM_FindJumpTargets( vm_t *vm, vmHeader_t *header ) {
+	byte	*code;
+	int		i, op, pc, v;
+
+	jused = Z_Malloc( header->instructionCount + 2 );
+	Com_Memset( jused, 0, header->instructionCount + 2 );
+
+	for ( i = 0 ; i < vm->numJumpTableTargets ; i++ ) {
+		v = ((int *)vm->jumpTableTargets)[i];
+		if ( (unsigned)v < header->instructionCount ) {
+			jused[v] = 1;
+		}
+	}
+
+	code = (byte *)header + header->codeOffset;
+	pc = 0;
+	for ( i = 0 ; i < header->instructionCount ; i++ ) {
+		if ( pc >= header->codeLength ) {
+			Com_Error( ERR_DROP, "VM_CompileX86: pc > header->codeLength" );
+		}
+		op = code[pc];
+		v = 0;
+		if ( op_argsize[op] == 4 ) {
+			v = *(int *)( code + pc + 1 );
+		}
+		pc += 1 + op_argsize[op];
+
+		switch ( op ) {
+		case OP_EQ: case OP_NE:
+		case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+		case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+		case OP_EQF: case OP_NEF:
+		case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+			if ( (unsigned)v >= header->instructionCount ) {
+				Com_Error( ERR_DROP, "VM_CompileX86: jump target out of range at %d", i );
+			}
+			jused[v] = 1;
+			break;
+		case OP_CONST:
+			if ( ( code[pc] == OP_JUMP || code[pc] == OP_CALL ) && (unsigned)v < header->instructionCount ) {
+				jused[v] = 1;
+			}
+			break;
+		}
+	}
+}
+
+/*
+=================
+VM_FindFunctions
+
+Lists the functions for the sampler to walk the program stack with
+=================
+*/
+static void VM_FindFunctions( vm_t *vm, vmHeader_t *header ) {
+	byte	*code;
+	int		i, op, pc, pass;
+
+	code = (byte *)header + header->codeOffset;
+	for ( pass = 0 ; pass < 2 ; pass++ ) {
+		if ( pass ) {
+			vm->functions = Hunk_Alloc( vm->numFunctions * sizeof( *vm->functions ), h_high );
+		}
+		vm->numFunctions = 0;
+		pc = 0;
+		for ( i = 0 ; i < header->instructionCount && pc < header->codeLength ; i++ ) {
+			op = code[pc];
+			if ( op == OP_ENTER ) {
+				if ( pass ) {
+					vm->functions[vm->numFunctions].start = i;
+					vm->functions[vm->numFunctions].frameSize = *(int *)( code + pc + 1 );
+				}
+				vm->numFunctions++;
+			}
+			pc += 1 + op_argsize[op];
+		}
+	}
+}
+
 /*
 =================
 VM_Compile
@@ -459,91 +1052,62 @@ void VM_Compile( vm_t *vm, vmHeader_t *header ) {
 	char* code;
 	unsigned iarg = 0;
 	unsigned char barg = 0;
-	int neednilabel = 0;
+	int pass;
+	int syscallJump;
+	int next, narg, fused, n;
 	struct timeval tvstart =  {0, 0};
 
-#ifdef USE_GAS
-	byte* compiledcode;
-	int   compiledsize;
-	void* entryPoint;
-	char fn_s[2*MAX_QPATH]; // output file for assembler code
-	char fn_o[2*MAX_QPATH]; // file written by as
-#ifdef DEBUG_VM
-	char fn_d[MAX_QPATH]; // disassembled
-#endif
-	FILE* fh_s;
-	int fd_s, fd_o;
-
 	gettimeofday(&tvstart, NULL);
 
-	Com_Printf("compiling %s\n", vm->name);
+	// vm->compiled is clear for vmbench, which times the compiler itself
+	if ( vm->compiled ) {
+		VM_FindFunctions( vm, header );
+		if ( Cvar_VariableIntegerValue( "vm_cache" ) && VM_LoadCompiled( vm, header ) ) {
+			return;
+		}
+	}
 
 #ifdef DEBUG_VM
-	snprintf(fn_s, sizeof(fn_s), "%.63s.s", vm->name);
-	snprintf(fn_o, sizeof(fn_o), "%.63s.o", vm->name);
-	fd_s = open(fn_s, O_CREAT|O_WRONLY|O_TRUNC, 0644);
-	fd_o = open(fn_o, O_CREAT|O_WRONLY|O_TRUNC, 0644);
-#else
-	snprintf(fn_s, sizeof(fn_s), "/tmp/%.63s.s_XXXXXX", vm->name);
-	snprintf(fn_o, sizeof(fn_o), "/tmp/%.63s.o_XXXXXX", vm->name);
-	fd_s = mkstemp(fn_s);
-	fd_o = mkstemp(fn_o);
-#endif
-	if(fd_s == -1 || fd_o == -1)
 	{
-		if(fd_s != -1) close(fd_s);
-		if(fd_o != -1) close(fd_o);
-		unlink(fn_s);
-		unlink(fn_o);
+		char fn_d[MAX_QPATH]; // disassembled
 
-		Com_Printf(S_COLOR_RED "can't create temporary file %s for vm\n", fn_s);
-		vm->compiled = qfalse;
-		return;
+		Q_strncpyz(fn_d, vm->name, sizeof(fn_d) - 6);
+		strcat(fn_d, ".qdasm");
+		qdasmout = fopen(fn_d, "w");
 	}
-
-#ifdef DEBUG_VM
-	strcpy(fn_d,vm->name);
-	strcat(fn_d, ".qdasm");
-
-	qdasmout = fopen(fn_d, "w");
 #endif
 
-	fh_s = fdopen(fd_s, "wb");
-	if(!fh_s)
-	{
-		Com_Printf(S_COLOR_RED "can't write %s\n", fn_s);
-		vm->compiled = qfalse;
-		return;
-	}
-
-	emit("start:");
-	emit("or %%r8, %%r8"); // check whether to set up instruction pointers
-	emit("jnz main");
-	emit("jmp setupinstructionpointers");
+	buf = NULL;
 
-	emit("main:");
-#else  // USE_GAS
-	int pass;
-	size_t compiledOfs = 0;
+	// left over when the last compile failed
+	if ( relocs ) {
+		Z_Free( relocs );
+		relocs = NULL;
+	}
+	if ( jused ) {
+		Z_Free( jused );
+		jused = NULL;
+	}
 
-	gettimeofday(&tvstart, NULL);
+	VM_FindJumpTargets( vm, header );
 
 	for (pass = 0; pass < 2; ++pass) {
 
 	if(pass)
 	{
-		compiledOfs = assembler_get_code_size();
 		vm->codeLength = compiledOfs;
 		vm->codeBase = mmap(NULL, compiledOfs, PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
 		if(vm->codeBase == (void*)-1)
 			Com_Error(ERR_DROP, "VM_CompileX86: can't mmap memory");
 
-		assembler_set_output((char*)vm->codeBase);
+		buf = vm->codeBase;
+		relocs = Z_Malloc( numRelocs * sizeof( *relocs ) + 1 );
 	}
 
-	assembler_init(pass);
-
-#endif // USE_GAS
+	compiledOfs = 0;
+	numNextJumps = 0;
+	numRelocs = 0;
+	topInEax = qfalse;
 
 	// translate all instructions
 	pc = 0;
@@ -554,17 +1118,21 @@ void VM_Compile( vm_t *vm, vmHeader_t *header ) {
 		op = code[ pc ];
 		++pc;
 
-#ifndef USE_GAS
-		vm->instructionPointers[instruction] = assembler_get_code_size();
-#endif
+		vm->instructionPointers[instruction] = compiledOfs;
 
+#ifdef DEBUG_VM
 		/* store current instruction number in r15 for debugging */
-#if 1
-		emit("nop");
-		emit("movq $%d, %%r15", instruction);
-		emit("nop");
+		EmitString( "90" );				// nop
+		EmitString( "49 BF" );			// movq $instruction, %r15
+		Emit8( instruction );
+		EmitString( "90" );				// nop
 #endif
 
+		PatchJumpsToNext();
+
+		cachedTop = topInEax && !jused[ instruction ];
+		topInEax = qfalse;
+
 		if(op_argsize[op] == 4)
 		{
 			iarg = *(int*)(code+pc);
@@ -581,15 +1149,16 @@ void VM_Compile( vm_t *vm, vmHeader_t *header ) {
 			Dfprintf(qdasmout, "%s\n", opnames[op]);
 		}
 
-#ifdef USE_GAS
-		emit("i_%08x:", instruction);
-#else
-		if(neednilabel)
-		{
-			emit("i_%08x:", instruction);
-			neednilabel = 0;
+		// the following instruction, if it may be compiled together with this one
+		next = OP_UNDEF;
+		narg = 0;
+		if ( instruction + 1 < header->instructionCount && !jused[ instruction + 1 ] ) {
+			next = code[ pc ];
+			if ( op_argsize[ next ] == 4 ) {
+				narg = *(int *)( code + pc + 1 );
+			}
 		}
-#endif
+		fused = 0;
 
 		switch ( op )
 		{
@@ -597,431 +1166,440 @@ void VM_Compile( vm_t *vm, vmHeader_t *header ) {
 				NOTIMPL(op);
 				break;
 			case OP_IGNORE:
-				emit("nop");
+				EmitString( "90" );				// nop
 				break;
 			case OP_BREAK:
-				emit("int3");
+				EmitString( "CC" );				// int3
 				break;
 			case OP_ENTER:
-				emit("subl $%d, %%edi", iarg);
-				RANGECHECK(edi);
+				EmitString( "81 EF" );			// subl $iarg, %edi
+				Emit4( iarg );
+				EmitRangeCheck( vm, RANGECHECK_EDI );
 				break;
 			case OP_LEAVE:
-				emit("addl $%d, %%edi", iarg);          // get rid of stack frame
-				emit("ret");
+				EmitString( "81 C7" );			// addl $iarg, %edi
+				Emit4( iarg );					// get rid of stack frame
+				EmitString( "C3" );				// ret
 				break;
 			case OP_CALL:
-				emit("movl 0(%%rsi), %%eax");  // get instr from stack
-				emit("subq $4, %%rsi");
-				emit("movl $%d, 0(%%r8, %%rdi, 1)", instruction+1);  // save next instruction
-				emit("orl %%eax, %%eax");
-				emit("jl callSyscall%d", instruction);
-				emit("movq $%lu, %%rbx", (unsigned long)vm->instructionPointers);
-				emit("movl (%%rbx, %%rax, 4), %%eax"); // load new relative jump address
-				emit("addq %%r10, %%rax");
-				emit("callq *%%rax");
-				emit("jmp i_%08x", instruction+1);
-				emit("callSyscall%d:", instruction);
-//				emit("fnsave 4(%%rsi)");
-				emit("push %%rsi");
-				emit("push %%rdi");
-				emit("push %%r8");
-				emit("push %%r9");
-				emit("push %%r10");
-				emit("movq %%rsp, %%rbx"); // we need to align the stack pointer
-				emit("subq $8, %%rbx");    //   |
-				emit("andq $127, %%rbx");  //   |
-				emit("subq %%rbx, %%rsp"); // <-+
-				emit("push %%rbx");
-				emit("negl %%eax");        // convert to actual number
-				emit("decl %%eax");
-				                           // first argument already in rdi
-				emit("movq %%rax, %%rsi"); // second argument in rsi
-				emit("movq $%lu, %%rax", (unsigned long)callAsmCall);
-				emit("callq *%%rax");
-				emit("pop %%rbx");
-				emit("addq %%rbx, %%rsp");
-				emit("pop %%r10");
-				emit("pop %%r9");
-				emit("pop %%r8");
-				emit("pop %%rdi");
-				emit("pop %%rsi");
-//				emit("frstor 4(%%rsi)");
-				emit("addq $4, %%rsi");
-				emit("movl %%eax, (%%rsi)"); // store return value
-				neednilabel = 1;
+				EmitLoadTop();					// get instr from stack
+				EmitString( SUB_RSI_4 );
+				EmitString( "41 C7 04 38" );	// movl $next, 0(%r8, %rdi, 1)	save next instruction
+				Emit4( instruction+1 );
+				EmitString( "09 C0" );			// orl %eax, %eax
+				EmitString( "7C" );				// jl callSyscall
+				syscallJump = compiledOfs;
+				Emit1( 0 );
+				EmitString( "48 BB" );			// movq $instructionPointers, %rbx
+				EmitAddress( RELOC_INSTRUCTIONPOINTERS, (unsigned long)vm->instructionPointers );
+				EmitString( "8B 04 83" );		// movl (%rbx, %rax, 4), %eax	load new relative jump address
+				EmitString( "4C 01 D0" );		// addq %r10, %rax
+				EmitString( "FF D0" );			// callq *%rax
+				EmitJumpToNext( "E9", 4 );		// jmp
+				// callSyscall:
+				if ( buf ) {
+					buf[ syscallJump ] = compiledOfs - ( syscallJump + 1 );
+				}
+				EmitSyscall();
+				topInEax = qfalse;				// not after a vm call
 				break;
 			case OP_PUSH:
-				emit("addq $4, %%rsi");
+				EmitString( ADD_RSI_4 );
 				break;
 			case OP_POP:
-				emit("subq $4, %%rsi");
+				EmitString( SUB_RSI_4 );
 				break;
 			case OP_CONST:
-				emit("addq $4, %%rsi");
-				emit("movl $%d, 0(%%rsi)", iarg);
+				fused = 1;
+				switch ( next ) {
+				case OP_LOAD1:
+				case OP_LOAD2:
+				case OP_LOAD4:
+					EmitLoad( next, MODRM_R8_DISP32 );
+					Emit4( iarg & vm->dataMask );
+					EmitString( ADD_RSI_4 );
+					EmitStoreTop();
+					break;
+				case OP_ADD:
+					EmitSimpleConst( "81 C0", iarg );	// addl $iarg, %eax
+					break;
+				case OP_SUB:
+					EmitSimpleConst( "81 E8", iarg );	// subl $iarg, %eax
+					break;
+				case OP_BAND:
+					EmitSimpleConst( "81 E0", iarg );	// andl $iarg, %eax
+					break;
+				case OP_BOR:
+					EmitSimpleConst( "81 C8", iarg );	// orl $iarg, %eax
+					break;
+				case OP_BXOR:
+					EmitSimpleConst( "81 F0", iarg );	// xorl $iarg, %eax
+					break;
+				case OP_LSH:
+					EmitShiftConst( "C1 E0", iarg );	// shll $iarg, %eax
+					break;
+				case OP_RSHI:
+					EmitShiftConst( "C1 F8", iarg );	// sarl $iarg, %eax
+					break;
+				case OP_RSHU:
+					EmitShiftConst( "C1 E8", iarg );	// shrl $iarg, %eax
+					break;
+				case OP_EQ:
+					EmitIntConstJump( vm, iarg, "0F 84", narg );	// je
+					break;
+				case OP_NE:
+					EmitIntConstJump( vm, iarg, "0F 85", narg );	// jne
+					break;
+				case OP_LTI:
+					EmitIntConstJump( vm, iarg, "0F 8C", narg );	// jl
+					break;
+				case OP_LEI:
+					EmitIntConstJump( vm, iarg, "0F 8E", narg );	// jle
+					break;
+				case OP_GTI:
+					EmitIntConstJump( vm, iarg, "0F 8F", narg );	// jg
+					break;
+				case OP_GEI:
+					EmitIntConstJump( vm, iarg, "0F 8D", narg );	// jge
+					break;
+				case OP_LTU:
+					EmitIntConstJump( vm, iarg, "0F 82", narg );	// jb
+					break;
+				case OP_LEU:
+					EmitIntConstJump( vm, iarg, "0F 86", narg );	// jbe
+					break;
+				case OP_GTU:
+					EmitIntConstJump( vm, iarg, "0F 87", narg );	// ja
+					break;
+				case OP_GEU:
+					EmitIntConstJump( vm, iarg, "0F 83", narg );	// jae
+					break;
+				case OP_JUMP:
+					if ( iarg >= header->instructionCount ) {
+						fused = 0;
+						break;
+					}
+					EmitJump( vm, "E9", iarg );	// jmp
+					break;
+				case OP_CALL:
+					if ( (int)iarg >= 0 && iarg >= header->instructionCount ) {
+						fused = 0;
+						break;
+					}
+					EmitString( "41 C7 04 38" );	// movl $next, 0(%r8, %rdi, 1)	save next instruction
+					Emit4( instruction+2 );
+					if ( (int)iarg < 0 ) {
+						n = -1 - (int)iarg;
+						if ( n < vm->numSyscalls && vm->syscalls[n].func && !vm_syscallProfile->integer ) {
+							if ( !EmitInlineSyscall( vm, n ) ) {
+								EmitDirectSyscall( vm, n );
+							}
+							break;
+						}
+						EmitString( "B8" );			// movl $iarg, %eax
+						Emit4( iarg );
+						EmitSyscall();
+					} else {
+						EmitJump( vm, "E8", iarg );	// call
+					}
+					break;
+				default:
+					fused = 0;
+					break;
+				}
+				if ( fused ) {
+					break;
+				}
+				EmitString( ADD_RSI_4 );
+				EmitString( "B8" );				// movl $iarg, %eax
+				Emit4( iarg );
+				EmitStoreTop();
 				break;
 			case OP_LOCAL:
-				emit("movl %%edi, %%ebx");
-				emit("addl $%d,%%ebx", iarg);
-				emit("addq $4, %%rsi");
-				emit("movl %%ebx, 0(%%rsi)");
+				if ( next == OP_LOAD1 || next == OP_LOAD2 || next == OP_LOAD4 ) {
+					EmitString( "8D 9F" );		// leal iarg(%rdi), %ebx
+					Emit4( iarg );
+					EmitRangeCheck( vm, RANGECHECK_EBX );
+					EmitLoad( next, MODRM_R8_RBX );
+					EmitString( ADD_RSI_4 );
+					EmitStoreTop();
+					fused = 1;
+					break;
+				}
+				if ( next == OP_CONST && instruction + 2 < header->instructionCount
+					&& code[ pc + 5 ] == OP_STORE4 && !jused[ instruction + 2 ] ) {
+					EmitString( "8D 9F" );		// leal iarg(%rdi), %ebx
+					Emit4( iarg );
+					EmitRangeCheck( vm, RANGECHECK_EBX );
+					EmitString( "41 C7 04 18" );	// movl $narg, 0(%r8, %rbx, 1)
+					Emit4( narg );
+					topInEax = cachedTop;		// neither eax nor rsi changed
+					fused = 2;
+					break;
+				}
+				EmitString( "8D 87" );			// leal iarg(%rdi), %eax
+				Emit4( iarg );
+				EmitString( ADD_RSI_4 );
+				EmitStoreTop();
 				break;
 			case OP_JUMP:
-				emit("movl 0(%%rsi), %%eax"); // get instr from stack
-				emit("subq $4, %%rsi");
-				emit("movq $%lu, %%rbx", (unsigned long)vm->instructionPointers);
-				emit("movl (%%rbx, %%rax, 4), %%eax"); // load new relative jump address
-				emit("addq %%r10, %%rax");
-				emit("jmp *%%rax");
+				EmitLoadTop();					// get instr from stack
+				EmitString( SUB_RSI_4 );
+				EmitString( "48 BB" );			// movq $instructionPointers, %rbx
+				EmitAddress( RELOC_INSTRUCTIONPOINTERS, (unsigned long)vm->instructionPointers );
+				EmitString( "8B 04 83" );		// movl (%rbx, %rax, 4), %eax	load new relative jump address
+				EmitString( "4C 01 D0" );		// addq %r10, %rax
+				EmitString( "FF E0" );			// jmp *%rax
 				break;
 			case OP_EQ:
-				IJ("jne");
+				EmitIntJump( vm, "0F 84", iarg );	// je
 				break;
 			case OP_NE:
-				IJ("je");
+				EmitIntJump( vm, "0F 85", iarg );	// jne
 				break;
 			case OP_LTI:
-				IJ("jnl");
+				EmitIntJump( vm, "0F 8C", iarg );	// jl
 				break;
 			case OP_LEI:
-				IJ("jnle");
+				EmitIntJump( vm, "0F 8E", iarg );	// jle
 				break;
 			case OP_GTI:
-				IJ("jng");
+				EmitIntJump( vm, "0F 8F", iarg );	// jg
 				break;
 			case OP_GEI:
-				IJ("jnge");
+				EmitIntJump( vm, "0F 8D", iarg );	// jge
 				break;
 			case OP_LTU:
-				IJ("jnb");
+				EmitIntJump( vm, "0F 82", iarg );	// jb
 				break;
 			case OP_LEU:
-				IJ("jnbe");
+				EmitIntJump( vm, "0F 86", iarg );	// jbe
 				break;
 			case OP_GTU:
-				IJ("jna");
+				EmitIntJump( vm, "0F 87", iarg );	// ja
 				break;
 			case OP_GEU:
-				IJ("jnae");
+				EmitIntJump( vm, "0F 83", iarg );	// jae
 				break;
 			case OP_EQF:
-				FJ(0x40, "jz");
-				XJ("jnz");
+				EmitFloatJump( vm, "0F 84", iarg );	// je
 				break;
 			case OP_NEF:
-				FJ(0x40, "jnz");
-#ifndef USE_X87
-				emit("subq $8, %%rsi");
-				emit("movss 4(%%rsi), %%xmm0");
-				emit("ucomiss 8(%%rsi), %%xmm0");
-				emit("jp dojump_i_%08x", instruction);
-				emit("jz i_%08x", instruction+1);
-				emit("dojump_i_%08x:", instruction);
-				JMPIARG
-				neednilabel = 1;
-#endif
+				EmitString( SUB_RSI_8 );
+				EmitString( "F3 0F 10 46 04" );	// movss 4(%rsi), %xmm0
+				EmitString( "0F 2E 46 08" );	// ucomiss 8(%rsi), %xmm0
+				EmitJump( vm, "0F 8A", iarg );	// jp
+				EmitJump( vm, "0F 85", iarg );	// jne
 				break;
 			case OP_LTF:
-				FJ(0x01, "jz");
-				XJ("jnc");
+				EmitFloatJump( vm, "0F 82", iarg );	// jb
 				break;
 			case OP_LEF:
-				FJ(0x41, "jz");
-				XJ("ja");
+				EmitFloatJump( vm, "0F 86", iarg );	// jbe
 				break;
 			case OP_GTF:
-				FJ(0x41, "jnz");
-				XJ("jbe");
+				EmitFloatJump( vm, "0F 87", iarg );	// ja
 				break;
 			case OP_GEF:
-				FJ(0x01, "jnz");
-				XJ("jb");
+				EmitFloatJump( vm, "0F 83", iarg );	// jae
 				break;
 			case OP_LOAD1:
-				emit("movl 0(%%rsi), %%eax"); // get value from stack
-				RANGECHECK(eax);
-				emit("movb 0(%%r8, %%rax, 1), %%al"); // deref into eax
-				emit("andq $255, %%rax");
-				emit("movl %%eax, 0(%%rsi)"); // store on stack
-				break;
 			case OP_LOAD2:
-				emit("movl 0(%%rsi), %%eax"); // get value from stack
-				RANGECHECK(eax);
-				emit("movw 0(%%r8, %%rax, 1), %%ax"); // deref into eax
-				emit("movl %%eax, 0(%%rsi)"); // store on stack
-				break;
 			case OP_LOAD4:
-				emit("movl 0(%%rsi), %%eax"); // get value from stack
-				RANGECHECK(eax); // not a pointer!?
-				emit("movl 0(%%r8, %%rax, 1), %%eax"); // deref into eax
-				emit("movl %%eax, 0(%%rsi)"); // store on stack
+				EmitLoadTop();					// get pointer from stack
+				EmitRangeCheck( vm, RANGECHECK_EAX );
+				EmitLoad( op, MODRM_R8_RAX );	// deref into eax
+				EmitStoreTop();
 				break;
 			case OP_STORE1:
-				emit("movl 0(%%rsi), %%eax"); // get value from stack
-				emit("andq $255, %%rax");
-				emit("movl -4(%%rsi), %%ebx"); // get pointer from stack
-				RANGECHECK(ebx);
-				emit("movb %%al, 0(%%r8, %%rbx, 1)"); // store in memory
-				emit("subq $8, %%rsi");
+				EmitLoadTop();					// get value from stack
+				EmitString( "8B 9E FC FF FF FF" );	// movl -4(%rsi), %ebx	get pointer from stack
+				EmitRangeCheck( vm, RANGECHECK_EBX );
+				EmitString( "41 88 04 18" );	// movb %al, 0(%r8, %rbx, 1)	store in memory
+				EmitString( SUB_RSI_8 );
 				break;
 			case OP_STORE2:
-				emit("movl 0(%%rsi), %%eax"); // get value from stack
-				emit("movl -4(%%rsi), %%ebx"); // get pointer from stack
-				RANGECHECK(ebx);
-				emit("movw %%ax, 0(%%r8, %%rbx, 1)"); // store in memory
-				emit("subq $8, %%rsi");
+				EmitLoadTop();					// get value from stack
+				EmitString( "8B 9E FC FF FF FF" );	// movl -4(%rsi), %ebx	get pointer from stack
+				EmitRangeCheck( vm, RANGECHECK_EBX );
+				EmitString( "66 41 89 04 18" );	// movw %ax, 0(%r8, %rbx, 1)	store in memory
+				EmitString( SUB_RSI_8 );
 				break;
 			case OP_STORE4:
-				emit("movl -4(%%rsi), %%ebx"); // get pointer from stack
-				RANGECHECK(ebx);
-				emit("movl 0(%%rsi), %%ecx"); // get value from stack
-				emit("movl %%ecx, 0(%%r8, %%rbx, 1)"); // store in memory
-				emit("subq $8, %%rsi");
+				EmitLoadTop();					// get value from stack
+				EmitString( "8B 9E FC FF FF FF" );	// movl -4(%rsi), %ebx	get pointer from stack
+				EmitRangeCheck( vm, RANGECHECK_EBX );
+				EmitString( "41 89 04 18" );	// movl %eax, 0(%r8, %rbx, 1)	store in memory
+				EmitString( SUB_RSI_8 );
 				break;
 			case OP_ARG:
-				emit("subq $4, %%rsi");
-				emit("movl 4(%%rsi), %%eax"); // get value from stack
-				emit("movl $0x%hhx, %%ebx", barg);
-				emit("addl %%edi, %%ebx");
-				RANGECHECK(ebx);
-				emit("movl %%eax, 0(%%r8,%%rbx, 1)"); // store in args space
+				EmitLoadTop();					// get value from stack
+				EmitString( SUB_RSI_4 );
+				EmitString( "8D 9F" );			// leal barg(%rdi), %ebx
+				Emit4( barg );
+				EmitRangeCheck( vm, RANGECHECK_EBX );
+				EmitString( "41 89 04 18" );	// movl %eax, 0(%r8, %rbx, 1)	store in args space
 				break;
 			case OP_BLOCK_COPY:
-
-				emit("subq $8, %%rsi");
-				emit("push %%rsi");
-				emit("push %%rdi");
-				emit("push %%r8");
-				emit("push %%r9");
-				emit("push %%r10");
-				emit("movl 4(%%rsi), %%edi");  // 1st argument dest
-				emit("movl 8(%%rsi), %%esi");  // 2nd argument src
-				emit("movl $%d, %%edx", iarg); // 3rd argument count
-				emit("movq $%lu, %%rax", (unsigned long)block_copy_vm);
-				emit("callq *%%rax");
-				emit("pop %%r10");
-				emit("pop %%r9");
-				emit("pop %%r8");
-				emit("pop %%rdi");
-				emit("pop %%rsi");
-
+				EmitSaveProgramStack( vm );
+				EmitString( SUB_RSI_8 );
+				EmitString( PUSH_REGS );
+				EmitString( "8B 7E 04" );		// movl 4(%rsi), %edi		1st argument dest
+				EmitString( "8B 76 08" );		// movl 8(%rsi), %esi		2nd argument src
+				EmitString( "BA" );				// movl $iarg, %edx		3rd argument count
+				Emit4( iarg );
+				EmitString( "48 B8" );			// movq $block_copy_vm, %rax
+				EmitAddress( RELOC_BLOCKCOPY, (unsigned long)block_copy_vm );
+				EmitString( "FF D0" );			// callq *%rax
+				EmitString( POP_REGS );
 				break;
 			case OP_SEX8:
-				emit("movw 0(%%rsi), %%ax");
-				emit("andq $255, %%rax");
-				emit("cbw");
-				emit("cwde");
-				emit("movl %%eax, 0(%%rsi)");
+				if ( cachedTop ) {
+					EmitString( "0F BE C0" );	// movsbl %al, %eax
+				} else {
+					EmitString( "0F BE 06" );	// movsbl 0(%rsi), %eax
+				}
+				EmitStoreTop();
 				break;
 			case OP_SEX16:
-				emit("movw 0(%%rsi), %%ax");
-				emit("cwde");
-				emit("movl %%eax, 0(%%rsi)");
+				if ( cachedTop ) {
+					EmitString( "0F BF C0" );	// movswl %ax, %eax
+				} else {
+					EmitString( "0F BF 06" );	// movswl 0(%rsi), %eax
+				}
+				EmitStoreTop();
 				break;
 			case OP_NEGI:
-				emit("negl 0(%%rsi)");
+				EmitLoadTop();
+				EmitString( "F7 D8" );			// negl %eax
+				EmitStoreTop();
 				break;
 			case OP_ADD:
-				SIMPLE("addl");
+				EmitSimple( "03 46 04", "01 06" );	// addl 4(%rsi), %eax
 				break;
 			case OP_SUB:
-				SIMPLE("subl");
+				EmitSimple( "2B 46 04", "29 06" );	// subl 4(%rsi), %eax
 				break;
 			case OP_DIVI:
-				emit("subq $4, %%rsi");
-				emit("movl 0(%%rsi), %%eax");
-				emit("cdq");
-				emit("idivl 4(%%rsi)");
-				emit("movl %%eax, 0(%%rsi)");
+				EmitString( SUB_RSI_4 );
+				EmitString( "8B 06" );			// movl 0(%rsi), %eax
+				EmitString( "99" );				// cdq
+				EmitString( "F7 7E 04" );		// idivl 4(%rsi)
+				EmitStoreTop();
 				break;
 			case OP_DIVU:
-				emit("subq $4, %%rsi");
-				emit("movl 0(%%rsi), %%eax");
-				emit("xorq %%rdx, %%rdx");
-				emit("divl 4(%%rsi)");
-				emit("movl %%eax, 0(%%rsi)");
+				EmitString( SUB_RSI_4 );
+				EmitString( "8B 06" );			// movl 0(%rsi), %eax
+				EmitString( "31 D2" );			// xorl %edx, %edx
+				EmitString( "F7 76 04" );		// divl 4(%rsi)
+				EmitStoreTop();
 				break;
 			case OP_MODI:
-				emit("subq $4, %%rsi");
-				emit("movl 0(%%rsi), %%eax");
-				emit("xorl %%edx, %%edx");
-				emit("cdq");
-				emit("idivl 4(%%rsi)");
-				emit("movl %%edx, 0(%%rsi)");
+				EmitString( SUB_RSI_4 );
+				EmitString( "8B 06" );			// movl 0(%rsi), %eax
+				EmitString( "99" );				// cdq
+				EmitString( "F7 7E 04" );		// idivl 4(%rsi)
+				EmitString( "89 D0" );			// movl %edx, %eax
+				EmitStoreTop();
 				break;
 			case OP_MODU:
-				emit("subq $4, %%rsi");
-				emit("movl 0(%%rsi), %%eax");
-				emit("xorl %%edx, %%edx");
-				emit("divl 4(%%rsi)");
-				emit("movl %%edx, 0(%%rsi)");
+				EmitString( SUB_RSI_4 );
+				EmitString( "8B 06" );			// movl 0(%rsi), %eax
+				EmitString( "31 D2" );			// xorl %edx, %edx
+				EmitString( "F7 76 04" );		// divl 4(%rsi)
+				EmitString( "89 D0" );			// movl %edx, %eax
+				EmitStoreTop();
 				break;
 			case OP_MULI:
-				emit("subq $4, %%rsi");
-				emit("movl 0(%%rsi), %%eax");
-				emit("imull 4(%%rsi)");
-				emit("movl %%eax, 0(%%rsi)");
+				EmitString( SUB_RSI_4 );
+				EmitString( "8B 06" );			// movl 0(%rsi), %eax
+				EmitString( "F7 6E 04" );		// imull 4(%rsi)
+				EmitStoreTop();
 				break;
 			case OP_MULU:
-				emit("subq $4, %%rsi");
-				emit("movl 0(%%rsi), %%eax");
-				emit("mull 4(%%rsi)");
-				emit("movl %%eax, 0(%%rsi)");
+				EmitString( SUB_RSI_4 );
+				EmitString( "8B 06" );			// movl 0(%rsi), %eax
+				EmitString( "F7 66 04" );		// mull 4(%rsi)
+				EmitStoreTop();
 				break;
 			case OP_BAND:
-				SIMPLE("andl");
+				EmitSimple( "23 46 04", "21 06" );	// andl 4(%rsi), %eax
 				break;
 			case OP_BOR:
-				SIMPLE("orl");
+				EmitSimple( "0B 46 04", "09 06" );	// orl 4(%rsi), %eax
 				break;
 			case OP_BXOR:
-				SIMPLE("xorl");
+				EmitSimple( "33 46 04", "31 06" );	// xorl 4(%rsi), %eax
 				break;
 			case OP_BCOM:
-				emit("notl 0(%%rsi)");
+				EmitLoadTop();
+				EmitString( "F7 D0" );			// notl %eax
+				EmitStoreTop();
 				break;
 			case OP_LSH:
-				SHIFT("shl");
+				EmitShift( "D3 E0" );			// shl %cl, %eax
 				break;
 			case OP_RSHI:
-				SHIFT("sarl");
+				EmitShift( "D3 F8" );			// sarl %cl, %eax
 				break;
 			case OP_RSHU:
-				SHIFT("shrl");
+				EmitShift( "D3 E8" );			// shrl %cl, %eax
 				break;
 			case OP_NEGF:
-#ifdef USE_X87
-				emit("flds 0(%%rsi)");
-				emit("fchs");
-				emit("fstps 0(%%rsi)");
-#else
-				emit("movl $0x80000000, %%eax");
-				emit("xorl %%eax, 0(%%rsi)");
-#endif
+				EmitLoadTop();
+				EmitString( "35 00 00 00 80" );	// xorl $0x80000000, %eax
+				EmitStoreTop();
 				break;
 			case OP_ADDF:
-				FSIMPLE("fadds");
-				XSIMPLE("addss");
+				EmitFloatSimple( "F3 0F 58 46 04" );	// addss 4(%rsi), %xmm0
 				break;
 			case OP_SUBF:
-				FSIMPLE("fsubs");
-				XSIMPLE("subss");
+				EmitFloatSimple( "F3 0F 5C 46 04" );	// subss 4(%rsi), %xmm0
 				break;
 			case OP_DIVF:
-				FSIMPLE("fdivs");
-				XSIMPLE("divss");
+				EmitFloatSimple( "F3 0F 5E 46 04" );	// divss 4(%rsi), %xmm0
 				break;
 			case OP_MULF:
-				FSIMPLE("fmuls");
-				XSIMPLE("mulss");
+				EmitFloatSimple( "F3 0F 59 46 04" );	// mulss 4(%rsi), %xmm0
 				break;
 			case OP_CVIF:
-#ifdef USE_X87
-				emit("filds 0(%%rsi)");
-				emit("fstps 0(%%rsi)");
-#else
-				emit("movl 0(%%rsi), %%eax");
-				emit("cvtsi2ss %%eax, %%xmm0");
-				emit("movss %%xmm0, 0(%%rsi)");
-#endif
+				EmitLoadTop();
+				EmitString( "F3 0F 2A C0" );	// cvtsi2ss %eax, %xmm0
+				EmitString( "F3 0F 11 06" );	// movss %xmm0, 0(%rsi)
 				break;
 			case OP_CVFI:
-#ifdef USE_X87
-				emit("flds 0(%%rsi)");
-				emit("fnstcw 4(%%rsi)");
-				emit("movw $0x0F7F, 8(%%rsi)"); // round toward zero
-				emit("fldcw 8(%%rsi)");
-				emit("fistpl 0(%%rsi)");
-				emit("fldcw 4(%%rsi)");
-#else
-				emit("movss 0(%%rsi), %%xmm0");
-				emit("cvttss2si %%xmm0, %%eax");
-				emit("movl %%eax, 0(%%rsi)");
-#endif
+				EmitString( "F3 0F 10 06" );	// movss 0(%rsi), %xmm0
+				EmitString( "F3 0F 2C C0" );	// cvttss2si %xmm0, %eax
+				EmitStoreTop();
 				break;
 			default:
 				NOTIMPL(op);
 				break;
 		}
-	}
 
-#ifdef USE_GAS
-	emit("setupinstructionpointers:");
-	emit("movq $%lu, %%rax", (unsigned long)vm->instructionPointers);
-	for ( instruction = 0; instruction < header->instructionCount; ++instruction )
-	{
-		emit("movl $i_%08x-start, %d(%%rax)", instruction, instruction*4);
-	}
-	emit("ret");
-
-	emit("debugger:");
-	if(1);
-	{
-		int i = 6;
-		while(i--)
-		{
-			emit("nop");
-			emit("int3");
+		// the instructions compiled along with this one start at the same place
+		while ( fused-- > 0 ) {
+			instruction++;
+			vm->instructionPointers[instruction] = vm->instructionPointers[instruction - 1];
+			pc += 1 + op_argsize[ (byte)code[ pc ] ];
 		}
 	}
+	PatchJumpsToNext();
 
-	fflush(fh_s);
-	fclose(fh_s);
-
-	compiledsize = doas(fn_s, fn_o, &compiledcode);
-	if(compiledsize == -1)
-	{
-		vm->compiled = qfalse;
-		goto out;
 	}
 
-	vm->codeBase   = compiledcode; // remember to skip ELF header!
-	vm->codeLength = compiledsize;
-
-#else  // USE_GAS
-	}
-	assembler_init(0);
+	buf = NULL;
 
 	if(mprotect(vm->codeBase, compiledOfs, PROT_READ|PROT_EXEC))
 		Com_Error(ERR_DROP, "VM_CompileX86: mprotect failed");
-#endif // USE_GAS
 
 	vm->destroy = VM_Destroy_Compiled;
-	
-#ifdef USE_GAS
-	entryPoint = getentrypoint(vm);
-
-//	__asm__ __volatile__ ("int3");
-	Com_Printf("computing jump table\n");
-
-	// call code with r8 set to zero to set up instruction pointers
-	__asm__ __volatile__ (
-		"	xorq %%r8,%%r8		\r\n" \
-		"	movq %0,%%r10		\r\n" \
-		"	callq *%%r10		\r\n" \
-		:
-		: "m" (entryPoint)
-		: "%r8", "%r10", "%rax"
-	);
 
 #ifdef DEBUG_VM
 	fflush(qdasmout);
 	fclose(qdasmout);
 #endif
 
-out:
-	close(fd_o);
-
-#ifndef DEBUG_VM
-	if(!com_developer->integer)
-	{
-		unlink(fn_o);
-		unlink(fn_s);
-	}
-#endif
-#endif // USE_GAS
-
 	if(vm->compiled)
 	{
 		struct timeval tvdone =  {0, 0};
@@ -1031,19 +1609,22 @@ out:
 		gettimeofday(&tvdone, NULL);
 		timersub(&tvdone, &tvstart, &dur);
 		Com_Printf( "compilation took %lu.%06lu seconds\n", dur.tv_sec, dur.tv_usec );
+
+		if ( Cvar_VariableIntegerValue( "vm_cache" ) ) {
+			VM_SaveCompiled( vm, header );
+		}
 	}
+
+	Z_Free( relocs );
+	relocs = NULL;
+	Z_Free( jused );
+	jused = NULL;
 }
 
 
 void VM_Destroy_Compiled(vm_t* self)
 {
-#ifdef USE_GAS
-	munmap(self->codeBase, self->codeLength);
-#elif _WIN32
-	VirtualFree(self->codeBase, self->codeLength, MEM_RELEASE);
-#else
 	munmap(self->codeBase, self->codeLength);
-#endif
 }
 
 /*
@@ -1105,7 +1686,7 @@ int	VM_CallCompiled( vm_t *vm, int *args ) {
 	*(int *)&image[ programStack ] = -1;	// will terminate the loop on return
 
 	// off we go into generated code...
-	entryPoint = getentrypoint(vm);
+	entryPoint = vm->codeBase;
 	opStack = &stack;
 
 	__asm__ __volatile__ (
@@ -1136,3 +1717,244 @@ int	VM_CallCompiled( vm_t *vm, int *args ) {
 
 	return *(int *)opStack;
 }
+
+
+/*
+=============================================================================
+
+SAMPLING PROFILER
+
+SIGPROF interrupts the thread that started sampling every 1/hz seconds
+of its cpu time, from a timer on that thread's clock aimed at that
+thread, so the job threads neither use it up nor get the signals.  When
+it lands in the compiled code rip gives the instruction and rdi the
+program stack; in engine code called from the vm, or in code calling out
+with rdi holding an argument, the program stack is the one the code left
+in vm->programStack.  The stack is walked up through the saved return
+instructions using the frame sizes of vm->functions, so a sample taken
+in the middle of a function's OP_ENTER or OP_LEAVE may lose its callers.
+
+Only linux is sampled, the registers are elsewhere in other ucontexts.
+
+=============================================================================
+*/
+
+#ifdef __linux__
+
+#define	SAMPLE_BUFFER	( 1 << 20 )		// ints
+
+static int				sampleRecords[SAMPLE_BUFFER];
+static vmSamples_t		samples;
+static vm_t * volatile	sampleVM;
+static pthread_t		sampleThread;
+static timer_t			sampleTimer;
+static struct sigaction	sampleOldAction;
+
+#ifndef sigev_notify_thread_id
+#define	sigev_notify_thread_id	_sigev_un._tid
+#endif
+
+/*
+=================
+VM_SampleInstruction
+
+The instruction the code at ofs belongs to
+=================
+*/
+static int VM_SampleInstruction( vm_t *vm, int ofs ) {
+	int		lo, hi, mid;
+
+	lo = 0;
+	hi = ( vm->instructionPointersLength >> 2 ) - 1;
+	while ( lo < hi ) {
+		mid = ( lo + hi + 1 ) >> 1;
+		if ( vm->instructionPointers[mid] <= ofs ) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return lo;
+}
+
+/*
+=================
+VM_SampleFunction
+
+The function the instruction belongs to, -1 if it's before the first
+=================
+*/
+static int VM_SampleFunction( vm_t *vm, int instruction ) {
+	int		lo, hi, mid;
+
+	lo = -1;
+	hi = vm->numFunctions - 1;
+	while ( lo < hi ) {
+		mid = ( lo + hi + 1 ) >> 1;
+		if ( vm->functions[mid].start <= instruction ) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return lo;
+}
+
+/*
+=================
+VM_SampleFrame
+
+qfalse when programStack can't be the frame of the function the
+instruction is in, rdi holds something else while the code calls out
+=================
+*/
+static qboolean VM_SampleFrame( vm_t *vm, int programStack, int instruction ) {
+	int		f, ret;
+
+	if ( programStack < vm->stackBottom || programStack > vm->dataMask || ( programStack & 3 ) ) {
+		return qfalse;
+	}
+	f = VM_SampleFunction( vm, instruction );
+	if ( f < 0 || instruction == vm->functions[f].start ) {
+		return qtrue;
+	}
+	ret = *(int *)&vm->dataBase[ ( programStack + vm->functions[f].frameSize ) & vm->dataMask & ~3 ];
+	return ret == -1 || (unsigned)( ret - 1 ) < ( vm->instructionPointersLength >> 2 );
+}
+
+/*
+=================
+VM_SampleSignal
+=================
+*/
+static void VM_SampleSignal( int sig, siginfo_t *info, void *context ) {
+	ucontext_t	*uc;
+	vm_t		*vm;
+	unsigned long	rip;
+	int			*rec;
+	int			depth, programStack, instruction, numInstructions, f, ret;
+
+	vm = sampleVM;
+	if ( !vm || !pthread_equal( pthread_self(), sampleThread ) ) {
+		return;
+	}
+	if ( currentVM != vm || !vm->callLevel ) {
+		samples.idle++;
+		return;
+	}
+	if ( samples.length + 1 + MAX_SAMPLE_DEPTH > SAMPLE_BUFFER ) {
+		samples.dropped++;
+		return;
+	}
+
+	uc = context;
+	rip = uc->uc_mcontext.gregs[REG_RIP];
+	numInstructions = vm->instructionPointersLength >> 2;
+
+	rec = samples.records + samples.length;
+	depth = 0;
+	if ( rip >= (unsigned long)vm->codeBase && rip < (unsigned long)vm->codeBase + vm->codeLength ) {
+		instruction = VM_SampleInstruction( vm, rip - (unsigned long)vm->codeBase );
+		programStack = uc->uc_mcontext.gregs[REG_RDI];
+		if ( !VM_SampleFrame( vm, programStack, instruction ) ) {
+			programStack = vm->programStack + 4;
+		}
+	} else {
+		rec[1 + depth++] = -1;
+		programStack = vm->programStack + 4;
+		instruction = *(int *)&vm->dataBase[ programStack & vm->dataMask & ~3 ] - 1;
+	}
+
+	while ( depth < MAX_SAMPLE_DEPTH && (unsigned)instruction < numInstructions ) {
+		f = VM_SampleFunction( vm, instruction );
+		if ( f < 0 ) {
+			break;
+		}
+		rec[1 + depth++] = f;
+		if ( instruction == vm->functions[f].start ) {
+			break;		// the frame may not be there yet
+		}
+		programStack += vm->functions[f].frameSize;
+		ret = *(int *)&vm->dataBase[ programStack & vm->dataMask & ~3 ];
+		instruction = ret - 1;
+	}
+
+	rec[0] = depth;
+	samples.length += 1 + depth;
+	samples.samples++;
+}
+
+/*
+=================
+VM_StartSampling
+=================
+*/
+qboolean VM_StartSampling( vm_t *vm, int hz ) {
+	struct sigaction	sa;
+	struct sigevent		sev;
+	struct itimerspec	it;
+
+	if ( sampleVM || !vm->compiled || !vm->functions ) {
+		return qfalse;
+	}
+
+	Com_Memset( &samples, 0, sizeof( samples ) );
+	samples.records = sampleRecords;
+	sampleThread = pthread_self();
+	sampleVM = vm;
+
+	Com_Memset( &sa, 0, sizeof( sa ) );
+	sa.sa_sigaction = VM_SampleSignal;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset( &sa.sa_mask );
+	if ( sigaction( SIGPROF, &sa, &sampleOldAction ) ) {
+		sampleVM = NULL;
+		return qfalse;
+	}
+
+	Com_Memset( &sev, 0, sizeof( sev ) );
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_notify_thread_id = syscall( SYS_gettid );
+	if ( timer_create( CLOCK_THREAD_CPUTIME_ID, &sev, &sampleTimer ) ) {
+		sigaction( SIGPROF, &sampleOldAction, NULL );
+		sampleVM = NULL;
+		return qfalse;
+	}
+
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_nsec = 1000000000 / hz;
+	it.it_value = it.it_interval;
+	if ( timer_settime( sampleTimer, 0, &it, NULL ) ) {
+		timer_delete( sampleTimer );
+		sigaction( SIGPROF, &sampleOldAction, NULL );
+		sampleVM = NULL;
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+=================
+VM_StopSampling
+=================
+*/
+void VM_StopSampling( vmSamples_t *out ) {
+	timer_delete( sampleTimer );
+	sigaction( SIGPROF, &sampleOldAction, NULL );
+	sampleVM = NULL;
+
+	*out = samples;
+}
+
+#else
+
+qboolean VM_StartSampling( vm_t *vm, int hz ) {
+	return qfalse;
+}
+
+void VM_StopSampling( vmSamples_t *out ) {
+	Com_Memset( out, 0, sizeof( *out ) );
+}
+
+#endif
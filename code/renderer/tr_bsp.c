@@ -1791,8 +1791,8 @@ Called directly from cgame
 */
 void RE_LoadWorldMap( const char *name ) {
 	int			i;
-	dheader_t	*header;
-	byte		*buffer;
+	dheader_t	header;
+	const byte	*buffer;
 	byte		*startMarker;
 
 	if ( tr.worldMapLoaded ) {
@@ -1810,7 +1810,8 @@ void RE_LoadWorldMap( const char *name ) {
 	tr.worldMapLoaded = qtrue;
 
 	// load it
-    ri.FS_ReadFile( name, (void **)&buffer );
+	// the bsp may be a read only view of its pk3
+	ri.FS_ReadFileView( name, (const void **)&buffer );
 	if ( !buffer ) {
 		ri.Error (ERR_DROP, "RE_LoadWorldMap: %s not found", name);
 	}
@@ -1828,10 +1829,10 @@ void RE_LoadWorldMap( const char *name ) {
 	startMarker = ri.Hunk_Alloc(0, h_low);
 	c_gridVerts = 0;
 
-	header = (dheader_t *)buffer;
-	fileBase = (byte *)header;
+	header = *(dheader_t *)buffer;
+	fileBase = (byte *)buffer;
 
-	i = LittleLong (header->version);
+	i = LittleLong (header.version);
 	if ( i != BSP_VERSION ) {
 		ri.Error (ERR_DROP, "RE_LoadWorldMap: %s has wrong version number (%i should be %i)", 
 			name, i, BSP_VERSION);
@@ -1839,27 +1840,40 @@ void RE_LoadWorldMap( const char *name ) {
 
 	// swap all the lumps
 	for (i=0 ; i<sizeof(dheader_t)/4 ; i++) {
-		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
+		((int *)&header)[i] = LittleLong ( ((int *)&header)[i]);
 	}
 
+	// the map's textures are decoded together once the surfaces have
+	// found them all
+	R_BeginImageBatch();
+
 	// load into heap
-	R_LoadShaders( &header->lumps[LUMP_SHADERS] );
-	R_LoadLightmaps( &header->lumps[LUMP_LIGHTMAPS] );
-	R_LoadPlanes (&header->lumps[LUMP_PLANES]);
-	R_LoadFogs( &header->lumps[LUMP_FOGS], &header->lumps[LUMP_BRUSHES], &header->lumps[LUMP_BRUSHSIDES] );
-	R_LoadSurfaces( &header->lumps[LUMP_SURFACES], &header->lumps[LUMP_DRAWVERTS], &header->lumps[LUMP_DRAWINDEXES] );
-	R_LoadMarksurfaces (&header->lumps[LUMP_LEAFSURFACES]);
-	R_LoadNodesAndLeafs (&header->lumps[LUMP_NODES], &header->lumps[LUMP_LEAFS]);
-	R_LoadSubmodels (&header->lumps[LUMP_MODELS]);
-	R_LoadVisibility( &header->lumps[LUMP_VISIBILITY] );
-	R_LoadEntities( &header->lumps[LUMP_ENTITIES] );
-	R_LoadLightGrid( &header->lumps[LUMP_LIGHTGRID] );
+	R_LoadShaders( &header.lumps[LUMP_SHADERS] );
+	R_LoadLightmaps( &header.lumps[LUMP_LIGHTMAPS] );
+	R_LoadPlanes (&header.lumps[LUMP_PLANES]);
+	R_LoadFogs( &header.lumps[LUMP_FOGS], &header.lumps[LUMP_BRUSHES], &header.lumps[LUMP_BRUSHSIDES] );
+	R_LoadSurfaces( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], &header.lumps[LUMP_DRAWINDEXES] );
+	R_LoadMarksurfaces (&header.lumps[LUMP_LEAFSURFACES]);
+	R_LoadNodesAndLeafs (&header.lumps[LUMP_NODES], &header.lumps[LUMP_LEAFS]);
+	R_LoadSubmodels (&header.lumps[LUMP_MODELS]);
+	R_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
+	R_LoadEntities( &header.lumps[LUMP_ENTITIES] );
+	R_LoadLightGrid( &header.lumps[LUMP_LIGHTGRID] );
+
+	R_EndImageBatch();
+
+	// shaders whose images didn't load were only found out by the batch
+	for ( i = 0 ; i < s_worldData.numsurfaces ; i++ ) {
+		if ( s_worldData.surfaces[i].shader->defaultShader ) {
+			s_worldData.surfaces[i].shader = tr.defaultShader;
+		}
+	}
 
 	s_worldData.dataSize = (byte *)ri.Hunk_Alloc(0, h_low) - startMarker;
 
 	// only set tr.world now that we know the entire level has loaded properly
 	tr.world = &s_worldData;
 
-    ri.FS_FreeFile( buffer );
+	ri.FS_FreeFileView( buffer );
 }
 
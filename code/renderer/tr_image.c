@@ -22,6 +22,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // tr_image.c
 #include "tr_local.h"
 
+#include <setjmp.h>
+
 /*
  * Include file for users of JPEG library.
  * You will need to have included system headers that define at least
@@ -36,10 +38,30 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "../qcommon/puff.h"
 
 
-static void LoadBMP( const char *name, byte **pic, int *width, int *height );
-static void LoadTGA( const char *name, byte **pic, int *width, int *height );
-static void LoadJPG( const char *name, byte **pic, int *width, int *height );
-static void LoadPNG( const char *name, byte **pic, int *width, int *height );
+// an image file read into memory for the loaders, which can run on a
+// job thread and then keep their warning for the main thread
+typedef struct {
+	char		name[MAX_QPATH];
+	byte		*buffer;
+	int			length;
+
+	jmp_buf		*abort;			// set while decoding on a job
+	int			warningLevel;
+	char		warning[MAX_STRING_CHARS];	// only the first one is kept
+} imageFile_t;
+
+// an image ready to upload, every mip level in one buffer
+typedef struct {
+	byte		*data;
+	int			numLevels;
+	int			width, height;		// of the first level
+	GLenum		internalFormat;
+} imageLevels_t;
+
+static void LoadBMP( imageFile_t *file, byte **pic, int *width, int *height );
+static void LoadTGA( imageFile_t *file, byte **pic, int *width, int *height );
+static void LoadJPG( imageFile_t *file, byte **pic, int *width, int *height );
+static void LoadPNG( imageFile_t *file, byte **pic, int *width, int *height );
 
 static byte			 s_intensitytable[256];
 static unsigned char s_gammatable[256];
@@ -50,6 +72,80 @@ int		gl_filter_max = GL_LINEAR;
 #define FILE_HASH_SIZE		1024
 static	image_t*		hashTable[FILE_HASH_SIZE];
 
+/*
+================
+R_ImageMalloc
+
+Image memory comes from malloc rather than the zone so that it can
+be used on the job threads
+================
+*/
+static void *R_ImageMalloc( int size ) {
+	void	*buf;
+
+	buf = malloc( size );
+	if ( !buf ) {
+		ri.Error( ERR_FATAL, "R_ImageMalloc: failed on allocation of %i bytes", size );
+	}
+	return buf;
+}
+
+/*
+================
+R_ImageFree
+================
+*/
+static void R_ImageFree( void *buf ) {
+	free( buf );
+}
+
+/*
+================
+R_ImageError
+
+Loaders report errors through here.  On a job decoding is abandoned,
+the main thread then loads the file again and raises the error itself.
+================
+*/
+static void QDECL R_ImageError( imageFile_t *file, int code, const char *fmt, ... ) {
+	va_list		argptr;
+	char		msg[MAX_STRING_CHARS];
+
+	if ( file->abort ) {
+		longjmp( *file->abort, 1 );
+	}
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+	va_end( argptr );
+
+	ri.Error( code, "%s", msg );
+}
+
+/*
+================
+R_ImageWarning
+================
+*/
+static void QDECL R_ImageWarning( imageFile_t *file, int level, const char *fmt, ... ) {
+	va_list		argptr;
+	char		msg[MAX_STRING_CHARS];
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !file->abort ) {
+		ri.Printf( level, "%s", msg );
+		return;
+	}
+
+	if ( !file->warning[0] ) {
+		file->warningLevel = level;
+		Q_strncpyz( file->warning, msg, sizeof( file->warning ) );
+	}
+}
+
 /*
 ** R_GammaCorrect
 */
@@ -365,7 +461,7 @@ static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
 
 	outWidth = inWidth >> 1;
 	outHeight = inHeight >> 1;
-	temp = ri.Hunk_AllocateTempMemory( outWidth * outHeight * 4 );
+	temp = R_ImageMalloc( outWidth * outHeight * 4 );
 
 	inWidthMask = inWidth - 1;
 	inHeightMask = inHeight - 1;
@@ -400,7 +496,7 @@ static void R_MipMap2( unsigned *in, int inWidth, int inHeight ) {
 	}
 
 	Com_Memcpy( in, temp, outWidth * outHeight * 4 );
-	ri.Hunk_FreeTempMemory( temp );
+	R_ImageFree( temp );
 }
 
 /*
@@ -497,24 +593,28 @@ byte	mipBlendColors[16][4] = {
 
 /*
 ===============
-Upload32
+R_PrepareImage
 
+Does all the work of an upload short of GL: power of two resampling,
+picmip, the internal format, gamma and every mip level.  Everything
+comes from malloc, so images can be prepared on the job threads.
+Returns qfalse if the image is too wide to resample.
 ===============
 */
 extern qboolean charSet;
-static void Upload32( unsigned *data, 
+static qboolean R_PrepareImage( unsigned *data, 
 						  int width, int height, 
 						  qboolean mipmap, 
 						  qboolean picmip, 
 							qboolean lightMap,
-						  int *format, 
-						  int *pUploadWidth, int *pUploadHeight )
+						  imageLevels_t *levels )
 {
 	int			samples;
 	unsigned	*scaledBuffer = NULL;
 	unsigned	*resampledBuffer = NULL;
+	byte		*out;
 	int			scaled_width, scaled_height;
-	int			i, c;
+	int			i, c, size;
 	byte		*scan;
 	GLenum		internalFormat = GL_RGB;
 	float		rMax = 0, gMax = 0, bMax = 0;
@@ -532,7 +632,10 @@ static void Upload32( unsigned *data,
 		scaled_height >>= 1;
 
 	if ( scaled_width != width || scaled_height != height ) {
-		resampledBuffer = ri.Hunk_AllocateTempMemory( scaled_width * scaled_height * 4 );
+		if ( scaled_width > 2048 ) {
+			return qfalse;
+		}
+		resampledBuffer = R_ImageMalloc( scaled_width * scaled_height * 4 );
 		ResampleTexture (data, width, height, resampledBuffer, scaled_width, scaled_height);
 		data = resampledBuffer;
 		width = scaled_width;
@@ -568,8 +671,6 @@ static void Upload32( unsigned *data,
 		scaled_height >>= 1;
 	}
 
-	scaledBuffer = ri.Hunk_AllocateTempMemory( sizeof( unsigned ) * scaled_width * scaled_height );
-
 	//
 	// scan the texture for each channel's max values
 	// and verify if the alpha channel is being used or not
@@ -636,18 +737,37 @@ static void Upload32( unsigned *data,
 	} else {
 		internalFormat = 3;
 	}
+
+	levels->width = scaled_width;
+	levels->height = scaled_height;
+	levels->internalFormat = internalFormat;
+	levels->numLevels = 1;
+
+	// all the levels go in one buffer, largest first
+	size = scaled_width * scaled_height * 4;
+	if ( mipmap ) {
+		int		w, h;
+
+		for ( w = scaled_width, h = scaled_height ; w > 1 || h > 1 ; levels->numLevels++ ) {
+			w = w > 1 ? w >> 1 : 1;
+			h = h > 1 ? h >> 1 : 1;
+			size += w * h * 4;
+		}
+	}
+	levels->data = out = R_ImageMalloc( size );
+
 	// copy or resample data as appropriate for first MIP level
 	if ( ( scaled_width == width ) && 
 		( scaled_height == height ) ) {
 		if (!mipmap)
 		{
-			qglTexImage2D (GL_TEXTURE_2D, 0, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-			*pUploadWidth = scaled_width;
-			*pUploadHeight = scaled_height;
-			*format = internalFormat;
+			Com_Memcpy( out, data, width*height*4 );
 
-			goto done;
+			if ( resampledBuffer != 0 )
+				R_ImageFree( resampledBuffer );
+			return qtrue;
 		}
+		scaledBuffer = R_ImageMalloc( sizeof( unsigned ) * scaled_width * scaled_height );
 		Com_Memcpy (scaledBuffer, data, width*height*4);
 	}
 	else
@@ -664,16 +784,14 @@ static void Upload32( unsigned *data,
 				height = 1;
 			}
 		}
+		scaledBuffer = R_ImageMalloc( sizeof( unsigned ) * scaled_width * scaled_height );
 		Com_Memcpy( scaledBuffer, data, width * height * 4 );
 	}
 
 	R_LightScaleTexture (scaledBuffer, scaled_width, scaled_height, !mipmap );
 
-	*pUploadWidth = scaled_width;
-	*pUploadHeight = scaled_height;
-	*format = internalFormat;
-
-	qglTexImage2D (GL_TEXTURE_2D, 0, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaledBuffer );
+	Com_Memcpy( out, scaledBuffer, scaled_width * scaled_height * 4 );
+	out += scaled_width * scaled_height * 4;
 
 	if (mipmap)
 	{
@@ -695,12 +813,53 @@ static void Upload32( unsigned *data,
 				R_BlendOverTexture( (byte *)scaledBuffer, scaled_width * scaled_height, mipBlendColors[miplevel] );
 			}
 
-			qglTexImage2D (GL_TEXTURE_2D, miplevel, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaledBuffer );
+			Com_Memcpy( out, scaledBuffer, scaled_width * scaled_height * 4 );
+			out += scaled_width * scaled_height * 4;
 		}
 	}
-done:
 
-	if (mipmap)
+	R_ImageFree( scaledBuffer );
+	if ( resampledBuffer != 0 )
+		R_ImageFree( resampledBuffer );
+
+	return qtrue;
+}
+
+/*
+===============
+R_UploadImage
+
+Hands prepared levels to GL, this is all of an upload that has to be
+done on the main thread
+===============
+*/
+static void R_UploadImage( image_t *image, const imageLevels_t *levels ) {
+	const byte	*data;
+	int			width, height;
+	int			miplevel;
+
+	if ( qglActiveTextureARB ) {
+		GL_SelectTexture( image->TMU );
+	}
+
+	GL_Bind(image);
+
+	data = levels->data;
+	width = levels->width;
+	height = levels->height;
+	for ( miplevel = 0 ; miplevel < levels->numLevels ; miplevel++ ) {
+		qglTexImage2D (GL_TEXTURE_2D, miplevel, levels->internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+
+		data += width * height * 4;
+		width = width > 1 ? width >> 1 : 1;
+		height = height > 1 ? height >> 1 : 1;
+	}
+
+	image->internalFormat = levels->internalFormat;
+	image->uploadWidth = levels->width;
+	image->uploadHeight = levels->height;
+
+	if (image->mipmap)
 	{
 		if ( textureFilterAnisotropic )
 			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
@@ -720,32 +879,33 @@ done:
 
 	GL_CheckErrors();
 
-	if ( scaledBuffer != 0 )
-		ri.Hunk_FreeTempMemory( scaledBuffer );
-	if ( resampledBuffer != 0 )
-		ri.Hunk_FreeTempMemory( resampledBuffer );
+	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, image->wrapClampMode );
+	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, image->wrapClampMode );
+
+	qglBindTexture( GL_TEXTURE_2D, 0 );
+
+	if ( image->TMU == 1 ) {
+		GL_SelectTexture( 0 );
+	}
 }
 
 
 /*
 ================
-R_CreateImage
+R_AllocImage
 
-This is the only way any image_t are created
+Sets up an image_t and its hash entry, the texture is uploaded
+separately
 ================
 */
-image_t *R_CreateImage( const char *name, const byte *pic, int width, int height, 
+static image_t *R_AllocImage( const char *name, int width, int height, 
 					   qboolean mipmap, qboolean allowPicmip, int glWrapClampMode ) {
 	image_t		*image;
-	qboolean	isLightmap = qfalse;
 	long		hash;
 
 	if (strlen(name) >= MAX_QPATH ) {
 		ri.Error (ERR_DROP, "R_CreateImage: \"%s\" is too long\n", name);
 	}
-	if ( !strncmp( name, "*lightmap", 9 ) ) {
-		isLightmap = qtrue;
-	}
 
 	if ( tr.numImages == MAX_DRAWIMAGES ) {
 		ri.Error( ERR_DROP, "R_CreateImage: MAX_DRAWIMAGES hit\n");
@@ -765,38 +925,39 @@ image_t *R_CreateImage( const char *name, const byte *pic, int width, int height
 	image->wrapClampMode = glWrapClampMode;
 
 	// lightmaps are always allocated on TMU 1
-	if ( qglActiveTextureARB && isLightmap ) {
+	if ( qglActiveTextureARB && !strncmp( name, "*lightmap", 9 ) ) {
 		image->TMU = 1;
 	} else {
 		image->TMU = 0;
 	}
 
-	if ( qglActiveTextureARB ) {
-		GL_SelectTexture( image->TMU );
-	}
+	hash = generateHashValue(name);
+	image->next = hashTable[hash];
+	hashTable[hash] = image;
 
-	GL_Bind(image);
+	return image;
+}
 
-	Upload32( (unsigned *)pic, image->width, image->height, 
-								image->mipmap,
-								allowPicmip,
-								isLightmap,
-								&image->internalFormat,
-								&image->uploadWidth,
-								&image->uploadHeight );
+/*
+================
+R_CreateImage
 
-	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, glWrapClampMode );
-	qglTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, glWrapClampMode );
+Creates and uploads an image from pixels already in memory
+================
+*/
+image_t *R_CreateImage( const char *name, const byte *pic, int width, int height, 
+					   qboolean mipmap, qboolean allowPicmip, int glWrapClampMode ) {
+	image_t			*image;
+	imageLevels_t	levels;
 
-	qglBindTexture( GL_TEXTURE_2D, 0 );
+	image = R_AllocImage( name, width, height, mipmap, allowPicmip, glWrapClampMode );
 
-	if ( image->TMU == 1 ) {
-		GL_SelectTexture( 0 );
+	if ( !R_PrepareImage( (unsigned *)pic, width, height, mipmap, allowPicmip,
+		!strncmp( name, "*lightmap", 9 ), &levels ) ) {
+		ri.Error(ERR_DROP, "ResampleTexture: max width");
 	}
-
-	hash = generateHashValue(name);
-	image->next = hashTable[hash];
-	hashTable[hash] = image;
+	R_UploadImage( image, &levels );
+	R_ImageFree( levels.data );
 
 	return image;
 }
@@ -829,8 +990,9 @@ typedef struct
 	unsigned char palette[256][4];
 } BMPHeader_t;
 
-static void LoadBMP( const char *name, byte **pic, int *width, int *height )
+static void LoadBMP( imageFile_t *file, byte **pic, int *width, int *height )
 {
+	const char	*name = file->name;
 	int		columns, rows;
 	unsigned	numPixels;
 	byte	*pixbuf;
@@ -843,13 +1005,8 @@ static void LoadBMP( const char *name, byte **pic, int *width, int *height )
 
 	*pic = NULL;
 
-	//
-	// load the file
-	//
-	length = ri.FS_ReadFile( ( char * ) name, (void **)&buffer);
-	if (!buffer) {
-		return;
-	}
+	buffer = file->buffer;
+	length = file->length;
 
 	buf_p = buffer;
 
@@ -891,19 +1048,19 @@ static void LoadBMP( const char *name, byte **pic, int *width, int *height )
 
 	if ( bmpHeader.id[0] != 'B' && bmpHeader.id[1] != 'M' ) 
 	{
-		ri.Error( ERR_DROP, "LoadBMP: only Windows-style BMP files supported (%s)\n", name );
+		R_ImageError( file, ERR_DROP, "LoadBMP: only Windows-style BMP files supported (%s)\n", name );
 	}
 	if ( bmpHeader.fileSize != length )
 	{
-		ri.Error( ERR_DROP, "LoadBMP: header size does not match file size (%d vs. %d) (%s)\n", bmpHeader.fileSize, length, name );
+		R_ImageError( file, ERR_DROP, "LoadBMP: header size does not match file size (%d vs. %d) (%s)\n", bmpHeader.fileSize, length, name );
 	}
 	if ( bmpHeader.compression != 0 )
 	{
-		ri.Error( ERR_DROP, "LoadBMP: only uncompressed BMP files supported (%s)\n", name );
+		R_ImageError( file, ERR_DROP, "LoadBMP: only uncompressed BMP files supported (%s)\n", name );
 	}
 	if ( bmpHeader.bitsPerPixel < 8 )
 	{
-		ri.Error( ERR_DROP, "LoadBMP: monochrome and 4-bit BMP files not supported (%s)\n", name );
+		R_ImageError( file, ERR_DROP, "LoadBMP: monochrome and 4-bit BMP files not supported (%s)\n", name );
 	}
 
 	columns = bmpHeader.width;
@@ -915,7 +1072,7 @@ static void LoadBMP( const char *name, byte **pic, int *width, int *height )
 	if(columns <= 0 || !rows || numPixels > 0x1FFFFFFF // 4*1FFFFFFF == 0x7FFFFFFC < 0x7FFFFFFF
 	    || ((numPixels * 4) / columns) / 4 != rows)
 	{
-	  ri.Error (ERR_DROP, "LoadBMP: %s has an invalid image size\n", name);
+	  R_ImageError( file, ERR_DROP, "LoadBMP: %s has an invalid image size\n", name);
 	}
 
 	if ( width ) 
@@ -923,7 +1080,7 @@ static void LoadBMP( const char *name, byte **pic, int *width, int *height )
 	if ( height )
 		*height = rows;
 
-	bmpRGBA = ri.Malloc( numPixels * 4 );
+	bmpRGBA = R_ImageMalloc( numPixels * 4 );
 	*pic = bmpRGBA;
 
 
@@ -975,14 +1132,12 @@ static void LoadBMP( const char *name, byte **pic, int *width, int *height )
 				*pixbuf++ = alpha;
 				break;
 			default:
-				ri.Error( ERR_DROP, "LoadBMP: illegal pixel_size '%d' in file '%s'\n", bmpHeader.bitsPerPixel, name );
+				R_ImageError( file, ERR_DROP, "LoadBMP: illegal pixel_size '%d' in file '%s'\n", bmpHeader.bitsPerPixel, name );
 				break;
 			}
 		}
 	}
 
-	ri.FS_FreeFile( buffer );
-
 }
 
 
@@ -1000,8 +1155,9 @@ PCX LOADING
 LoadPCX
 ==============
 */
-static void LoadPCX ( const char *filename, byte **pic, byte **palette, int *width, int *height)
+static void LoadPCX ( imageFile_t *file, byte **pic, byte **palette, int *width, int *height)
 {
+	const char	*filename = file->name;
 	byte	*raw;
 	pcx_t	*pcx;
 	int		x, y;
@@ -1013,13 +1169,8 @@ static void LoadPCX ( const char *filename, byte **pic, byte **palette, int *wid
 	*pic = NULL;
 	*palette = NULL;
 
-	//
-	// load the file
-	//
-	len = ri.FS_ReadFile( ( char * ) filename, (void **)&raw);
-	if (!raw) {
-		return;
-	}
+	raw = file->buffer;
+	len = file->length;
 
 	//
 	// parse the PCX file
@@ -1037,11 +1188,11 @@ static void LoadPCX ( const char *filename, byte **pic, byte **palette, int *wid
 		|| xmax >= 1024
 		|| ymax >= 1024)
 	{
-		ri.Printf (PRINT_ALL, "Bad pcx file %s (%i x %i) (%i x %i)\n", filename, xmax+1, ymax+1, pcx->xmax, pcx->ymax);
+		R_ImageWarning( file, PRINT_ALL, "Bad pcx file %s (%i x %i) (%i x %i)\n", filename, xmax+1, ymax+1, pcx->xmax, pcx->ymax);
 		return;
 	}
 
-	out = ri.Malloc ( (ymax+1) * (xmax+1) );
+	out = R_ImageMalloc( (ymax+1) * (xmax+1) );
 
 	*pic = out;
 
@@ -1049,7 +1200,7 @@ static void LoadPCX ( const char *filename, byte **pic, byte **palette, int *wid
 
 	if (palette)
 	{
-		*palette = ri.Malloc(768);
+		*palette = R_ImageMalloc(768);
 		Com_Memcpy (*palette, (byte *)pcx + len - 768, 768);
 	}
 
@@ -1081,12 +1232,10 @@ static void LoadPCX ( const char *filename, byte **pic, byte **palette, int *wid
 
 	if ( raw - (byte *)pcx > len)
 	{
-		ri.Printf (PRINT_DEVELOPER, "PCX file %s was malformed", filename);
-		ri.Free (*pic);
+		R_ImageWarning( file, PRINT_DEVELOPER, "PCX file %s was malformed", filename);
+		R_ImageFree(*pic);
 		*pic = NULL;
 	}
-
-	ri.FS_FreeFile (pcx);
 }
 
 
@@ -1095,13 +1244,13 @@ static void LoadPCX ( const char *filename, byte **pic, byte **palette, int *wid
 LoadPCX32
 ==============
 */
-static void LoadPCX32 ( const char *filename, byte **pic, int *width, int *height) {
+static void LoadPCX32 ( imageFile_t *file, byte **pic, int *width, int *height) {
 	byte	*palette;
 	byte	*pic8;
 	int		i, c, p;
 	byte	*pic32;
 
-	LoadPCX (filename, &pic8, &palette, width, height);
+	LoadPCX (file, &pic8, &palette, width, height);
 	if (!pic8) {
 		*pic = NULL;
 		return;
@@ -1109,7 +1258,7 @@ static void LoadPCX32 ( const char *filename, byte **pic, int *width, int *heigh
 
 	// LoadPCX32 ensures width, height < 1024
 	c = (*width) * (*height);
-	pic32 = *pic = ri.Malloc(4 * c );
+	pic32 = *pic = R_ImageMalloc(4 * c );
 	for (i = 0 ; i < c ; i++) {
 		p = pic8[i];
 		pic32[0] = palette[p*3];
@@ -1119,8 +1268,8 @@ static void LoadPCX32 ( const char *filename, byte **pic, int *width, int *heigh
 		pic32 += 4;
 	}
 
-	ri.Free (pic8);
-	ri.Free (palette);
+	R_ImageFree(pic8);
+	R_ImageFree(palette);
 }
 
 /*
@@ -1136,27 +1285,19 @@ TARGA LOADING
 LoadTGA
 =============
 */
-static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
+static void LoadTGA ( imageFile_t *file, byte **pic, int *width, int *height)
 {
+	const char	*name = file->name;
 	unsigned	columns, rows, numPixels;
 	byte	*pixbuf;
 	int		row, column;
 	byte	*buf_p;
-	byte	*buffer;
 	TargaHeader	targa_header;
 	byte		*targa_rgba;
 
 	*pic = NULL;
 
-	//
-	// load the file
-	//
-	ri.FS_ReadFile ( ( char * ) name, (void **)&buffer);
-	if (!buffer) {
-		return;
-	}
-
-	buf_p = buffer;
+	buf_p = file->buffer;
 
 	targa_header.id_length = buf_p[0];
 	targa_header.colormap_type = buf_p[1];
@@ -1185,17 +1326,17 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 		&& targa_header.image_type!=10
 		&& targa_header.image_type != 3 ) 
 	{
-		ri.Error (ERR_DROP, "LoadTGA: Only type 2 (RGB), 3 (gray), and 10 (RGB) TGA images supported\n");
+		R_ImageError( file, ERR_DROP, "LoadTGA: Only type 2 (RGB), 3 (gray), and 10 (RGB) TGA images supported\n");
 	}
 
 	if ( targa_header.colormap_type != 0 )
 	{
-		ri.Error( ERR_DROP, "LoadTGA: colormaps not supported\n" );
+		R_ImageError( file, ERR_DROP, "LoadTGA: colormaps not supported\n" );
 	}
 
 	if ( ( targa_header.pixel_size != 32 && targa_header.pixel_size != 24 ) && targa_header.image_type != 3 )
 	{
-		ri.Error (ERR_DROP, "LoadTGA: Only 32 or 24 bit images supported (no colormaps)\n");
+		R_ImageError( file, ERR_DROP, "LoadTGA: Only 32 or 24 bit images supported (no colormaps)\n");
 	}
 
 	columns = targa_header.width;
@@ -1209,10 +1350,10 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 
 	if(!columns || !rows || numPixels > 0x7FFFFFFF || numPixels / columns / 4 != rows)
 	{
-		ri.Error (ERR_DROP, "LoadTGA: %s has an invalid image size\n", name);
+		R_ImageError( file, ERR_DROP, "LoadTGA: %s has an invalid image size\n", name);
 	}
 
-	targa_rgba = ri.Malloc (numPixels);
+	targa_rgba = R_ImageMalloc(numPixels);
 	*pic = targa_rgba;
 
 	if (targa_header.id_length != 0)
@@ -1260,7 +1401,7 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 					*pixbuf++ = alphabyte;
 					break;
 				default:
-					ri.Error( ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'\n", targa_header.pixel_size, name );
+					R_ImageError( file, ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'\n", targa_header.pixel_size, name );
 					break;
 				}
 			}
@@ -1294,7 +1435,7 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 								alphabyte = *buf_p++;
 								break;
 						default:
-							ri.Error( ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'\n", targa_header.pixel_size, name );
+							R_ImageError( file, ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'\n", targa_header.pixel_size, name );
 							break;
 					}
 	
@@ -1337,7 +1478,7 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 									*pixbuf++ = alphabyte;
 									break;
 							default:
-								ri.Error( ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'\n", targa_header.pixel_size, name );
+								R_ImageError( file, ERR_DROP, "LoadTGA: illegal pixel_size '%d' in file '%s'\n", targa_header.pixel_size, name );
 								break;
 						}
 						column++;
@@ -1377,13 +1518,45 @@ static void LoadTGA ( const char *name, byte **pic, int *width, int *height)
 #endif
   // instead we just print a warning
   if (targa_header.attributes & 0x20) {
-    ri.Printf( PRINT_WARNING, "WARNING: '%s' TGA file header declares top-down image, ignoring\n", name);
+    R_ImageWarning( file, PRINT_WARNING, "WARNING: '%s' TGA file header declares top-down image, ignoring\n", name);
   }
+}
+
+/*
+=================
+R_JPGErrorExit
+
+The jpeg library's errors and messages go through the image file, so
+they can come from a job
+=================
+*/
+typedef struct {
+  struct jpeg_error_mgr pub;
+  imageFile_t *file;
+} imageJpegError_t;
+
+static void R_JPGErrorExit( j_common_ptr cinfo ) {
+  imageFile_t *file = ((imageJpegError_t *)cinfo->err)->file;
+  char buffer[JMSG_LENGTH_MAX];
+
+  (*cinfo->err->format_message) (cinfo, buffer);
+
+  /* Let the memory manager release its pools before we leave */
+  jpeg_destroy(cinfo);
+
+  R_ImageError( file, ERR_FATAL, "%s\n", buffer );
+}
+
+static void R_JPGOutputMessage( j_common_ptr cinfo ) {
+  char buffer[JMSG_LENGTH_MAX];
+
+  (*cinfo->err->format_message) (cinfo, buffer);
 
-  ri.FS_FreeFile (buffer);
+  R_ImageWarning( ((imageJpegError_t *)cinfo->err)->file, PRINT_ALL, "%s\n", buffer );
 }
 
-static void LoadJPG( const char *filename, unsigned char **pic, int *width, int *height ) {
+static void LoadJPG( imageFile_t *file, unsigned char **pic, int *width, int *height ) {
+  const char *filename = file->name;
   /* This struct contains the JPEG decompression parameters and pointers to
    * working space (which is allocated as needed by the JPEG library).
    */
@@ -1400,26 +1573,14 @@ static void LoadJPG( const char *filename, unsigned char **pic, int *width, int
    * Note that this struct must live as long as the main JPEG parameter
    * struct, to avoid dangling-pointer problems.
    */
-  struct jpeg_error_mgr jerr;
+  imageJpegError_t jerr;
   /* More stuff */
   JSAMPARRAY buffer;		/* Output row buffer */
   unsigned row_stride;		/* physical row width in output buffer */
   unsigned pixelcount, memcount;
   unsigned char *out;
-  byte	*fbuffer;
   byte  *buf;
 
-  /* In this example we want to open the input file before doing anything else,
-   * so that the setjmp() error recovery below can assume the file is open.
-   * VERY IMPORTANT: use "b" option to fopen() if you are on a machine that
-   * requires it in order to read binary files.
-   */
-
-  ri.FS_ReadFile ( ( char * ) filename, (void **)&fbuffer);
-  if (!fbuffer) {
-	return;
-  }
-
   /* Step 1: allocate and initialize JPEG decompression object */
 
   /* We have to set up the error handler first, in case the initialization
@@ -1427,14 +1588,17 @@ static void LoadJPG( const char *filename, unsigned char **pic, int *width, int
    * This routine fills in the contents of struct jerr, and returns jerr's
    * address which we place into the link field in cinfo.
    */
-  cinfo.err = jpeg_std_error(&jerr);
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = R_JPGErrorExit;
+  jerr.pub.output_message = R_JPGOutputMessage;
+  jerr.file = file;
 
   /* Now we can initialize the JPEG decompression object. */
   jpeg_create_decompress(&cinfo);
 
   /* Step 2: specify data source (eg, a file) */
 
-  jpeg_stdio_src(&cinfo, fbuffer);
+  jpeg_stdio_src(&cinfo, file->buffer);
 
   /* Step 3: read file parameters with jpeg_read_header() */
 
@@ -1472,14 +1636,17 @@ static void LoadJPG( const char *filename, unsigned char **pic, int *width, int
       || ((pixelcount * 4) / cinfo.output_width) / 4 != cinfo.output_height
       || pixelcount > 0x1FFFFFFF || cinfo.output_components > 4) // 4*1FFFFFFF == 0x7FFFFFFC < 0x7FFFFFFF
   {
-    ri.Error (ERR_DROP, "LoadJPG: %s has an invalid image size: %dx%d*4=%d, components: %d\n", filename,
+    jpeg_destroy_decompress(&cinfo);
+    R_ImageError (file, ERR_DROP, "LoadJPG: %s has an invalid image size: %dx%d*4=%d, components: %d\n", filename,
 		    cinfo.output_width, cinfo.output_height, pixelcount * 4, cinfo.output_components);
   }
 
   memcount = pixelcount * 4;
   row_stride = cinfo.output_width * cinfo.output_components;
 
-  out = ri.Malloc(memcount);
+  // handed out straight away, so a job abandoned while decoding frees it
+  out = R_ImageMalloc(memcount);
+  *pic = out;
 
   *width = cinfo.output_width;
   *height = cinfo.output_height;
@@ -1533,8 +1700,6 @@ static void LoadJPG( const char *filename, unsigned char **pic, int *width, int
 	}
   }
 
-  *pic = out;
-
   /* Step 7: Finish decompression */
 
   (void) jpeg_finish_decompress(&cinfo);
@@ -1547,13 +1712,6 @@ static void LoadJPG( const char *filename, unsigned char **pic, int *width, int
   /* This is an important step since it will release a good deal of memory. */
   jpeg_destroy_decompress(&cinfo);
 
-  /* After finish_decompress, we can close the input file.
-   * Here we postpone it until after no more JPEG errors are possible,
-   * so as to simplify the setjmp error logic above.  (Actually, I don't
-   * think that jpeg_destroy can do an error exit, but why assume anything...)
-   */
-  ri.FS_FreeFile (fbuffer);
-
   /* At this point you may want to check to see whether any corrupt-data
    * warnings occurred (test whether jerr.pub.num_warnings is nonzero).
    */
@@ -2113,10 +2271,10 @@ struct BufferedFile
 };
 
 /*
- *  Read a file into a buffer.
+ *  Wrap a file already in memory.
  */
 
-static struct BufferedFile *ReadBufferedFile(const char *name)
+static struct BufferedFile *ReadBufferedFile(imageFile_t *file)
 {
     struct BufferedFile *BF;
 
@@ -2124,7 +2282,7 @@ static struct BufferedFile *ReadBufferedFile(const char *name)
      *  input verification
      */
 
-    if(!name)
+    if(!file)
     {
         return(NULL);
     }
@@ -2133,7 +2291,7 @@ static struct BufferedFile *ReadBufferedFile(const char *name)
      *  Allocate control struct.
      */
 
-    BF = ri.Malloc(sizeof(struct BufferedFile));
+    BF = R_ImageMalloc(sizeof(struct BufferedFile));
     if(!BF)
     {
         return(NULL);
@@ -2149,10 +2307,11 @@ static struct BufferedFile *ReadBufferedFile(const char *name)
     BF->BytesLeft = 0;
 
     /*
-     *  Read the file.
+     *  Use the file's buffer.
      */
 
-    BF->Length = ri.FS_ReadFile((char *) name, (void **) &BF->Buffer);
+    BF->Buffer = file->buffer;
+    BF->Length = file->length;
 
     /*
      *  Did we get it? Is it big enough?
@@ -2160,7 +2319,7 @@ static struct BufferedFile *ReadBufferedFile(const char *name)
 
     if(!(BF->Buffer && (BF->Length > 0)))
     {
-        ri.Free(BF);
+        R_ImageFree(BF);
 
         return(NULL);
     }
@@ -2183,12 +2342,7 @@ static void CloseBufferedFile(struct BufferedFile *BF)
 {
     if(BF)
     {
-        if(BF->Buffer)
-        {
-            ri.FS_FreeFile(BF->Buffer);
-        }
- 
-        ri.Free(BF);
+        R_ImageFree(BF);
     }
 }
 
@@ -2523,7 +2677,7 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
 
     BufferedFileRewind(BF, BytesToRewind);
 
-    CompressedData = ri.Malloc(CompressedDataLength);
+    CompressedData = R_ImageMalloc(CompressedDataLength);
     if(!CompressedData)
     {
         return(-1);
@@ -2544,7 +2698,7 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
         CH = BufferedFileRead(BF, PNG_ChunkHeader_Size);
         if(!CH)
         {
-            ri.Free(CompressedData); 
+            R_ImageFree(CompressedData); 
   
             return(-1);
         }
@@ -2578,14 +2732,14 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
             OrigCompressedData = BufferedFileRead(BF, Length);
             if(!OrigCompressedData)
             {
-                ri.Free(CompressedData); 
+                R_ImageFree(CompressedData); 
   
                 return(-1);
             }
 
             if(!BufferedFileSkip(BF, PNG_ChunkCRC_Size))
             {
-                ri.Free(CompressedData); 
+                R_ImageFree(CompressedData); 
 
                 return(-1);
             }
@@ -2616,7 +2770,7 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
     puffResult = puff(puffDest, &puffDestLen, puffSrc, &puffSrcLen);
     if(!((puffResult == 0) && (puffDestLen > 0)))
     {
-        ri.Free(CompressedData);
+        R_ImageFree(CompressedData);
  
         return(-1);
     }
@@ -2625,10 +2779,10 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
      *  Allocate the buffer for the uncompressed data.
      */
 
-    DecompressedData = ri.Malloc(puffDestLen);
+    DecompressedData = R_ImageMalloc(puffDestLen);
     if(!DecompressedData)
     {
-        ri.Free(CompressedData);
+        R_ImageFree(CompressedData);
  
         return(-1);
     }
@@ -2651,7 +2805,7 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
      *  The compressed data is not needed anymore.
      */
 
-    ri.Free(CompressedData);
+    R_ImageFree(CompressedData);
 
     /*
      *  Check if the last puff() was successfull.
@@ -2659,7 +2813,7 @@ static uint32_t DecompressIDATs(struct BufferedFile *BF, uint8_t **Buffer)
 
     if(!((puffResult == 0) && (puffDestLen > 0)))
     {
-        ri.Free(DecompressedData);
+        R_ImageFree(DecompressedData);
  
         return(-1);
     }
@@ -3793,7 +3947,7 @@ static qboolean DecodeImageInterlaced(struct PNG_Chunk_IHDR *IHDR,
  *  The PNG loader
  */
 
-static void LoadPNG(const char *name, byte **pic, int *width, int *height)
+static void LoadPNG(imageFile_t *file, byte **pic, int *width, int *height)
 {
     struct BufferedFile *ThePNG;
     byte *OutBuffer;
@@ -3827,7 +3981,7 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
      *  input verification
      */
 
-    if(!(name && pic))
+    if(!(file && pic))
     {
         return;
     }
@@ -3852,7 +4006,7 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
      *  Read the file.
      */
 
-    ThePNG = ReadBufferedFile(name);
+    ThePNG = ReadBufferedFile(file);
     if(!ThePNG)
     {
         return;
@@ -4288,10 +4442,10 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
      *  Allocate output buffer.
      */
 
-    OutBuffer = ri.Malloc(IHDR_Width * IHDR_Height * Q3IMAGE_BYTESPERPIXEL); 
+    OutBuffer = R_ImageMalloc(IHDR_Width * IHDR_Height * Q3IMAGE_BYTESPERPIXEL); 
     if(!OutBuffer)
     {
-        ri.Free(DecompressedData); 
+        R_ImageFree(DecompressedData); 
         CloseBufferedFile(ThePNG);
  
         return;  
@@ -4307,8 +4461,8 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
 	{
 	    if(!DecodeImageNonInterlaced(IHDR, OutBuffer, DecompressedData, DecompressedDataLength, HasTransparentColour, TransparentColour, OutPal))
 	    {
-		ri.Free(OutBuffer); 
-    		ri.Free(DecompressedData); 
+		R_ImageFree(OutBuffer); 
+    		R_ImageFree(DecompressedData); 
     		CloseBufferedFile(ThePNG);
 
 		return;
@@ -4321,8 +4475,8 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
 	{
 	    if(!DecodeImageInterlaced(IHDR, OutBuffer, DecompressedData, DecompressedDataLength, HasTransparentColour, TransparentColour, OutPal))
 	    {
-		ri.Free(OutBuffer); 
-    		ri.Free(DecompressedData); 
+		R_ImageFree(OutBuffer); 
+    		R_ImageFree(DecompressedData); 
     		CloseBufferedFile(ThePNG);
 
 		return;
@@ -4333,8 +4487,8 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
     
 	default :
 	{
-	    ri.Free(OutBuffer); 
-    	    ri.Free(DecompressedData); 
+	    R_ImageFree(OutBuffer); 
+    	    R_ImageFree(DecompressedData); 
     	    CloseBufferedFile(ThePNG);
 
 	    return;
@@ -4365,7 +4519,7 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
      *  DecompressedData is not needed anymore.
      */
 
-    ri.Free(DecompressedData); 
+    R_ImageFree(DecompressedData); 
 
     /*
      *  We have all data, so close the file.
@@ -4379,7 +4533,7 @@ static void LoadPNG(const char *name, byte **pic, int *width, int *height)
 typedef struct
 {
 	char *ext;
-	void (*ImageLoader)( const char *, unsigned char **, int *, int * );
+	void (*ImageLoader)( imageFile_t *, unsigned char **, int *, int * );
 } imageExtToLoaderMap_t;
 
 // Note that the ordering indicates the order of preference used
@@ -4397,24 +4551,31 @@ static imageExtToLoaderMap_t imageLoaders[ ] =
 static int numImageLoaders = sizeof( imageLoaders ) /
 		sizeof( imageLoaders[ 0 ] );
 
+#define	MAX_IMAGE_CANDIDATES	( 1 + sizeof( imageLoaders ) / sizeof( imageLoaders[ 0 ] ) )
+
+// a file name to try for an image, with the loader for it
+typedef struct {
+	char		name[MAX_QPATH];
+	int			loader;
+} imageCandidate_t;
+
 /*
 =================
-R_LoadImage
+R_ImageCandidates
 
-Loads any of the supported image types into a cannonical
-32 bit format.
+Lists the files that can hold an image in the order they are tried:
+the name itself if it has a known extension, then the name with each
+supported extension.  Returns the count, orgName is set when the first
+candidate is the name itself.
 =================
 */
-void R_LoadImage( const char *name, byte **pic, int *width, int *height )
-{
-	qboolean orgNameFailed = qfalse;
-	int i;
-	char localName[ MAX_QPATH ];
-	const char *ext;
+static int R_ImageCandidates( const char *name, imageCandidate_t *list, qboolean *orgName ) {
+	char		localName[ MAX_QPATH ];
+	const char	*ext;
+	int			i, count;
 
-	*pic = NULL;
-	*width = 0;
-	*height = 0;
+	count = 0;
+	*orgName = qfalse;
 
 	Q_strncpyz( localName, name, MAX_QPATH );
 
@@ -4422,31 +4583,19 @@ void R_LoadImage( const char *name, byte **pic, int *width, int *height )
 
 	if( *ext )
 	{
-		// Look for the correct loader and use it
+		// Look for the correct loader
 		for( i = 0; i < numImageLoaders; i++ )
 		{
 			if( !Q_stricmp( ext, imageLoaders[ i ].ext ) )
 			{
-				// Load
-				imageLoaders[ i ].ImageLoader( localName, pic, width, height );
-				break;
-			}
-		}
+				Q_strncpyz( list[ count ].name, localName, MAX_QPATH );
+				list[ count ].loader = i;
+				count++;
+				*orgName = qtrue;
 
-		// A loader was found
-		if( i < numImageLoaders )
-		{
-			if( *pic == NULL )
-			{
-				// Loader failed, most likely because the file isn't there;
-				// try again without the extension
-				orgNameFailed = qtrue;
+				// if it isn't there, try again without the extension
 				COM_StripExtension( name, localName, MAX_QPATH );
-			}
-			else
-			{
-				// Something loaded
-				return;
+				break;
 			}
 		}
 	}
@@ -4455,22 +4604,322 @@ void R_LoadImage( const char *name, byte **pic, int *width, int *height )
 	// the image formats supported
 	for( i = 0; i < numImageLoaders; i++ )
 	{
-		char *altName = va( "%s.%s", localName, imageLoaders[ i ].ext );
+		Com_sprintf( list[ count ].name, MAX_QPATH, "%s.%s", localName, imageLoaders[ i ].ext );
+		list[ count ].loader = i;
+
+		// the original name has already been tried
+		if( *orgName && !Q_stricmp( list[ count ].name, list[ 0 ].name ) )
+		{
+			continue;
+		}
+		count++;
+	}
 
-		// Load
-		imageLoaders[ i ].ImageLoader( altName, pic, width, height );
+	return count;
+}
+
+/*
+=================
+R_LoadImageCandidates
+
+Loads the first candidate from first on that is present and decodes,
+returns the one used or -1
+=================
+*/
+static int R_LoadImageCandidates( const imageCandidate_t *list, int first, int count, byte **pic, int *width, int *height ) {
+	imageFile_t	file;
+	int			i;
+
+	*pic = NULL;
+	*width = 0;
+	*height = 0;
+
+	Com_Memset( &file, 0, sizeof( file ) );
+
+	for( i = first; i < count; i++ )
+	{
+		file.length = ri.FS_ReadFile( list[ i ].name, (void **)&file.buffer );
+		if( !file.buffer )
+		{
+			continue;
+		}
+		Q_strncpyz( file.name, list[ i ].name, sizeof( file.name ) );
+
+		imageLoaders[ list[ i ].loader ].ImageLoader( &file, pic, width, height );
+
+		ri.FS_FreeFile( file.buffer );
+		file.buffer = NULL;
 
 		if( *pic )
 		{
-			if( orgNameFailed )
-			{
-				ri.Printf( PRINT_DEVELOPER, "WARNING: %s not present, using %s instead\n",
-						name, altName );
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/*
+=================
+R_LoadImage
+
+Loads any of the supported image types into a cannonical
+32 bit format.
+=================
+*/
+void R_LoadImage( const char *name, byte **pic, int *width, int *height )
+{
+	imageCandidate_t	list[ MAX_IMAGE_CANDIDATES ];
+	qboolean			orgName;
+	int					count, used;
+
+	count = R_ImageCandidates( name, list, &orgName );
+
+	used = R_LoadImageCandidates( list, 0, count, pic, width, height );
+
+	if( used > 0 && orgName )
+	{
+		ri.Printf( PRINT_DEVELOPER, "WARNING: %s not present, using %s instead\n",
+				name, list[ used ].name );
+	}
+}
+
+/*
+=================================================================
+
+IMAGE BATCHES
+
+While a batch is open R_FindImageFile only reads the file and hands
+out the image_t.  The decoding, gamma and mip levels are done on the
+job threads when the batch is flushed, and the main thread then only
+uploads.  Images whose file doesn't decode on a job are loaded again
+the normal way, so errors and the fallback to other formats are the
+same as without a batch.  An image that doesn't load at all has
+already been handed out, so it is marked failed, and the shaders
+that got it are made default shaders as if R_FindImageFile had
+returned NULL to them.
+
+=================================================================
+*/
+
+#define	MAX_IMAGE_BATCH		64
+#define	IMAGE_FILE_PAD		4096		// the jpeg source reads whole blocks past the end
+
+typedef struct {
+	image_t				*image;
+	imageCandidate_t	candidates[MAX_IMAGE_CANDIDATES];
+	int					numCandidates;
+	int					candidate;		// the one in file
+	qboolean			orgName;
+
+	imageFile_t			file;
+	byte				*pic;
+	int					width, height;
+	imageLevels_t		levels;
+} imageJob_t;
+
+static qboolean		r_imageBatch;
+static int			r_imageBatchSize;
+static imageJob_t	r_imageJobs[MAX_IMAGE_BATCH];
+static int			r_numImageJobs;
+static int			r_imageBatchShaders;	// tr.numShaders when the batch began
+
+/*
+================
+R_DecodeImageJob
+
+Runs on any thread, nothing here may use the zone, the file system
+or ri.Error
+================
+*/
+static void R_DecodeImageJob( void *data, int index, int thread ) {
+	imageJob_t	*job = (imageJob_t *)data + index;
+	jmp_buf		abort;
+
+	job->file.abort = &abort;
+
+	if ( !setjmp( abort ) ) {
+		imageLoaders[ job->candidates[ job->candidate ].loader ].ImageLoader(
+			&job->file, &job->pic, &job->width, &job->height );
+
+		if ( job->pic && !R_PrepareImage( (unsigned *)job->pic, job->width, job->height,
+			job->image->mipmap, job->image->allowPicmip, qfalse, &job->levels ) ) {
+			R_ImageError( &job->file, ERR_DROP, "ResampleTexture: max width" );
+		}
+	}
+
+	job->file.abort = NULL;
+
+	R_ImageFree( job->pic );
+	job->pic = NULL;
+	R_ImageFree( job->file.buffer );
+	job->file.buffer = NULL;
+}
+
+/*
+================
+R_ClearImageBatch
+
+Frees whatever an interrupted batch left behind
+================
+*/
+static void R_ClearImageBatch( void ) {
+	int		i;
+
+	for ( i = 0 ; i < r_numImageJobs ; i++ ) {
+		R_ImageFree( r_imageJobs[i].file.buffer );
+		R_ImageFree( r_imageJobs[i].levels.data );
+	}
+	r_numImageJobs = 0;
+}
+
+/*
+================
+R_FlushImageBatch
+================
+*/
+static void R_FlushImageBatch( void ) {
+	imageJob_t	*job;
+	image_t		*image;
+	int			i, used;
+
+	if ( !r_numImageJobs ) {
+		return;
+	}
+
+	ri.ParallelFor( R_DecodeImageJob, r_imageJobs, r_numImageJobs );
+
+	for ( i = 0 ; i < r_numImageJobs ; i++ ) {
+		job = &r_imageJobs[i];
+		image = job->image;
+
+		if ( !job->levels.data ) {
+			// this reports any error the job ran into
+			used = R_LoadImageCandidates( job->candidates, job->candidate, job->numCandidates,
+				&job->pic, &job->width, &job->height );
+			if ( !job->pic ) {
+				// R_EndImageBatch turns the shaders using it into default shaders
+				ri.Printf( PRINT_WARNING, "WARNING: couldn't load %s\n", image->imgName );
+				image->failed = qtrue;
+				continue;
+			}
+
+			if ( !R_PrepareImage( (unsigned *)job->pic, job->width, job->height,
+				image->mipmap, image->allowPicmip, qfalse, &job->levels ) ) {
+				ri.Error( ERR_DROP, "ResampleTexture: max width" );
+			}
+			R_ImageFree( job->pic );
+			job->pic = NULL;
+		} else {
+			used = job->candidate;
+			if ( job->file.warning[0] ) {
+				ri.Printf( job->file.warningLevel, "%s", job->file.warning );
 			}
+		}
+
+		if ( used > 0 && job->orgName ) {
+			ri.Printf( PRINT_DEVELOPER, "WARNING: %s not present, using %s instead\n",
+					image->imgName, job->candidates[ used ].name );
+		}
+
+		image->width = job->width;
+		image->height = job->height;
+		R_UploadImage( image, &job->levels );
+
+		R_ImageFree( job->levels.data );
+		job->levels.data = NULL;
+	}
+
+	r_numImageJobs = 0;
+}
 
+/*
+================
+R_QueueImageFile
+
+Reads the first candidate file that is present and queues it for the
+next flush
+================
+*/
+static image_t *R_QueueImageFile( const char *name, qboolean mipmap, qboolean allowPicmip, int glWrapClampMode ) {
+	imageJob_t	*job;
+	void		*buffer;
+	int			length = 0;
+
+	if ( r_numImageJobs == r_imageBatchSize ) {
+		R_FlushImageBatch();
+	}
+
+	job = &r_imageJobs[r_numImageJobs];
+	Com_Memset( job, 0, sizeof( *job ) );
+
+	job->numCandidates = R_ImageCandidates( name, job->candidates, &job->orgName );
+
+	for ( job->candidate = 0 ; job->candidate < job->numCandidates ; job->candidate++ ) {
+		length = ri.FS_ReadFile( job->candidates[ job->candidate ].name, &buffer );
+		if ( buffer ) {
 			break;
 		}
 	}
+	if ( job->candidate == job->numCandidates ) {
+		return NULL;
+	}
+
+	// the job gets its own copy, the file system's buffer is temp hunk memory
+	job->file.buffer = R_ImageMalloc( length + IMAGE_FILE_PAD );
+	job->file.length = length;
+	Com_Memcpy( job->file.buffer, buffer, length );
+	Com_Memset( job->file.buffer + length, 0, IMAGE_FILE_PAD );
+	ri.FS_FreeFile( buffer );
+	Q_strncpyz( job->file.name, job->candidates[ job->candidate ].name, sizeof( job->file.name ) );
+
+	r_numImageJobs++;
+
+	job->image = R_AllocImage( name, 0, 0, mipmap, allowPicmip, glWrapClampMode );
+
+	return job->image;
+}
+
+/*
+================
+R_BeginImageBatch
+
+Images found until R_EndImageBatch are decoded together on the job
+threads, there is nothing to gain without any
+================
+*/
+void R_BeginImageBatch( void ) {
+	int		threads;
+
+	R_ClearImageBatch();
+
+	threads = ri.JobThreadCount();
+	if ( threads < 1 ) {
+		return;
+	}
+
+	// each image stays in memory until its batch is uploaded
+	r_imageBatchSize = 4 * ( threads + 1 );
+	if ( r_imageBatchSize > MAX_IMAGE_BATCH ) {
+		r_imageBatchSize = MAX_IMAGE_BATCH;
+	}
+	r_imageBatchShaders = tr.numShaders;
+	r_imageBatch = qtrue;
+}
+
+/*
+================
+R_EndImageBatch
+================
+*/
+void R_EndImageBatch( void ) {
+	if ( !r_imageBatch ) {
+		return;
+	}
+
+	r_imageBatch = qfalse;
+	R_FlushImageBatch();
+	R_DefaultFailedShaders( r_imageBatchShaders );
 }
 
 
@@ -4499,6 +4948,10 @@ image_t	*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmi
 	//
 	for (image=hashTable[hash]; image; image=image->next) {
 		if ( !strcmp( name, image->imgName ) ) {
+			// a batch couldn't load it, and it won't load now either
+			if ( image->failed ) {
+				return NULL;
+			}
 			// the white image can be used with any set of parms, but other mismatches are errors
 			if ( strcmp( name, "*white" ) ) {
 				if ( image->mipmap != mipmap ) {
@@ -4515,6 +4968,10 @@ image_t	*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmi
 		}
 	}
 
+	if ( r_imageBatch ) {
+		return R_QueueImageFile( name, mipmap, allowPicmip, glWrapClampMode );
+	}
+
 	//
 	// load the pic from disk
 	//
@@ -4524,7 +4981,7 @@ image_t	*R_FindImageFile( const char *name, qboolean mipmap, qboolean allowPicmi
 	}
 
 	image = R_CreateImage( ( char * ) name, pic, width, height, mipmap, allowPicmip, glWrapClampMode );
-	ri.Free( pic );
+	R_ImageFree( pic );
 	return image;
 }
 
@@ -4893,6 +5350,11 @@ R_InitImages
 */
 void	R_InitImages( void ) {
 	Com_Memset(hashTable, 0, sizeof(hashTable));
+
+	// an error can leave a batch open
+	r_imageBatch = qfalse;
+	R_ClearImageBatch();
+
 	// build brightness translation tables
 	R_SetColorMappings();
 
@@ -140,6 +140,11 @@ typedef struct {
 
 	void	(*Cmd_ExecuteText) (int exec_when, const char *text);
 
+	// spread a loop over the job threads, func must not call back into
+	// the engine as it can run on any thread
+	int		(*JobThreadCount)( void );
+	void	(*ParallelFor)( void (*func)( void *data, int index, int thread ), void *data, int count );
+
 	// visualization for debugging collision detection
 	void	(*CM_DrawDebugSurface)( void (*drawPoly)(int color, int numPoints, float *points) );
 
@@ -148,6 +153,8 @@ typedef struct {
 	int		(*FS_FileIsInPAK)( const char *name, int *pCheckSum );
 	int		(*FS_ReadFile)( const char *name, void **buf );
 	void	(*FS_FreeFile)( void *buf );
+	int		(*FS_ReadFileView)( const char *name, const void **buf );
+	void	(*FS_FreeFileView)( const void *buf );
 	char **	(*FS_ListFiles)( const char *name, const char *extension, int *numfilesfound );
 	void	(*FS_FreeFileList)( char **filelist );
 	void	(*FS_WriteFile)( const char *qpath, const void *buffer, int size );
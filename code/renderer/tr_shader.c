@@ -2349,6 +2349,48 @@ static char *FindShaderInShaderText( const char *shadername ) {
 }
 
 
+/*
+==================
+R_DefaultFailedShaders
+
+Shaders from firstShader on that use an image an image batch couldn't
+load become default shaders, as they would have if the image hadn't
+been found while parsing them.  Sky boxes take the default image.
+==================
+*/
+void R_DefaultFailedShaders( int firstShader ) {
+	shader_t	*sh;
+	image_t		**image;
+	int			i, j, b, n;
+
+	for ( i = firstShader ; i < tr.numShaders ; i++ ) {
+		sh = tr.shaders[i];
+
+		for ( j = 0 ; j < 6 ; j++ ) {
+			if ( sh->sky.outerbox[j] && sh->sky.outerbox[j]->failed ) {
+				sh->sky.outerbox[j] = tr.defaultImage;
+			}
+			if ( sh->sky.innerbox[j] && sh->sky.innerbox[j]->failed ) {
+				sh->sky.innerbox[j] = tr.defaultImage;
+			}
+		}
+
+		for ( j = 0 ; j < MAX_SHADER_STAGES && sh->stages[j] ; j++ ) {
+			for ( b = 0 ; b < NUM_TEXTURE_BUNDLES ; b++ ) {
+				for ( n = 0 ; n < MAX_IMAGE_ANIMATIONS ; n++ ) {
+					image = &sh->stages[j]->bundle[b].image[n];
+					if ( *image && (*image)->failed ) {
+						// nothing may bind a texture that was never uploaded
+						*image = tr.defaultImage;
+						sh->defaultShader = qtrue;
+					}
+				}
+			}
+		}
+	}
+}
+
+
 /*
 ==================
 R_FindShaderByName
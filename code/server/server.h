@@ -80,7 +80,6 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -98,8 +97,9 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
+	int				frameCarry;			// sub-millisecond part of the frame length carried over, in usec
+	int64_t			frameDeadline;		// Sys_Microseconds() the next frame is due at (sv_frameScheduler)
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	struct cmodel_s	*models[MAX_MODELS];
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -215,6 +215,7 @@ typedef struct client_s {
 	qboolean	demo_waiting;	// are we still waiting for the first non-delta frame?
 	int		demo_backoff;	// how many packets (-1 actually) between non-delta frames?
 	int		demo_deltas;	// how many delta frames did we let through so far?
+	qboolean	demo_fullframe;	// is the snapshot being sent non-delta?
 	
 	int				oldServerTime;
 	qboolean		csUpdated[MAX_CONFIGSTRINGS+1];	
@@ -277,6 +278,35 @@ typedef struct {
 
 #define	MAX_MASTERS	8				// max recipients for heartbeat packets
 
+#define	TICK_JITTER_BUCKETS	8
+
+// how far apart simulated frames actually run, see tickstats
+typedef struct {
+	int64_t			firstFrame;					// Sys_Microseconds() when collection started
+	int64_t			lastFrame;					// Sys_Microseconds() of the previous frame, 0 after a map load
+	unsigned int	frames;
+	int				maxDeviation;				// usec
+	unsigned int	buckets[TICK_JITTER_BUCKETS];	// |interval - frame length|
+} tickStats_t;
+
+// how often clients could share a visibility pass, see sv_snapshotCacheStats
+typedef struct {
+	unsigned int	frames;
+	unsigned int	lookups;				// eye and portal viewpoints looked up
+	unsigned int	builds;					// lists built, every other lookup shared one
+	unsigned int	bypassed;				// cache full or read only, went through the entities directly
+	unsigned int	deltasEncoded;
+	unsigned int	deltasShared;			// copied from an identical delta encoded for another client
+} snapshotCacheStats_t;
+
+// see sv_traceCacheStats
+typedef struct {
+	unsigned int	lookups;				// game traces and point contents with sv_traceCache on
+	unsigned int	hits;
+	unsigned int	invalidations;
+	int64_t			missUsec;				// spent in the traces that missed
+} traceCacheStats_t;
+
 
 // this structure will be cleared only when the game dll changes
 typedef struct {
@@ -296,6 +326,10 @@ typedef struct {
 	netadr_t	redirectAddress;			// for rcon return messages
 
 	netadr_t	authorizeAddress;			// for rcon return messages
+
+	tickStats_t	tickStats;
+	snapshotCacheStats_t	snapshotCacheStats;
+	traceCacheStats_t	traceCacheStats;
 } serverStatic_t;
 
 
@@ -334,6 +368,7 @@ extern	vm_t			*gvm;				// game virtual machine
 #define	MAX_MASTER_SERVERS	5
 
 extern	cvar_t	*sv_fps;
+extern	cvar_t	*sv_frameScheduler;
 extern	cvar_t	*sv_timeout;
 extern	cvar_t	*sv_zombietime;
 extern	cvar_t	*sv_rconPassword;
@@ -362,6 +397,11 @@ extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_newpurelist;
 extern	cvar_t	*sv_floodProtect;
 extern	cvar_t	*sv_lanForceRate;
+extern	cvar_t	*sv_parallelSnapshots;
+extern	cvar_t	*sv_snapshotCache;
+extern	cvar_t	*sv_broadphase;
+extern	cvar_t	*sv_gridCellSize;
+extern	cvar_t	*sv_traceCache;
 extern	cvar_t	*sv_strictAuth;
 extern	cvar_t	*sv_clientsPerIp;
 
@@ -370,6 +410,10 @@ extern	cvar_t	*sv_demonotice;
 extern  cvar_t  *sv_sayprefix;
 extern  cvar_t  *sv_tellprefix;
 extern  cvar_t  *sv_demofolder;
+extern	cvar_t	*sv_demoBuffer;
+extern	cvar_t	*sv_demoSync;
+extern	cvar_t	*sv_demoCompress;
+extern	cvar_t	*sv_demoKeyframe;
 
 extern  cvar_t  *sv_hideCmd;
 extern  cvar_t  *sv_hideCmdList;
@@ -469,6 +513,8 @@ void SV_RemoveOperatorCommands (void);
 void SV_MasterHeartbeat (void);
 void SV_MasterShutdown (void);
 
+void SV_TickStats_f (void);
+
 
 
 
@@ -515,9 +561,21 @@ void SV_WriteDownloadToClient( client_t *cl , msg_t *msg );
 // sv_ccmds.c
 //
 void SV_Heartbeat_f( void );
-void SVD_WriteDemoFile(const client_t*, const msg_t*);
+void SVD_WriteDemoFile(client_t*, const msg_t*);
 client_t *SV_GetPlayerByHandle(void);
 
+//
+// sv_demo.c
+//
+void SVD_OpenWriter( client_t *client, fileHandle_t file );
+qboolean SVD_QueueDemoData( client_t *client, const void *data, int length );
+qboolean SVD_QueueKeyframe( client_t *client, const void *data, int length );
+qboolean SVD_KeyframeDue( client_t *client );
+void SVD_CloseWriter( client_t *client );
+void SVD_WriterFrame( void );
+void SVD_ShutdownWriter( void );
+void SV_ServerDemoStatus_f( void );
+
 //
 // sv_snapshot.c
 //
@@ -527,6 +585,7 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_SnapshotCacheStats_f( void );
 void SV_CheckClientUserinfoTimer( void );
 void SV_UpdateUserinfo_f( client_t *cl );
 
@@ -583,6 +642,8 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_TraceBench_f( void );
+void SV_TraceCacheStats_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -613,6 +674,13 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
+
+void SV_CachedTrace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule );
+int SV_CachedPointContents( const vec3_t p, int passEntityNum );
+// the game module's traces, answered from the trace cache with sv_traceCache 1
+
+void SV_InvalidateTraceCache( void );
+
 //
 // sv_net_chan.c
 //
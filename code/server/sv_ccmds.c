@@ -1141,55 +1141,19 @@ static void SV_KillServer_f(void) {
 //===========================================================
 
 /*
-Start a server-side demo.
-
-This does it all, create the file and adjust the demo-related
-stuff in client_t.
+Put together the demo record of a gamestate message for the client,
+returns its size.
 
 This is mostly ripped from sv_client.c/SV_SendClientGameState
 and cl_main.c/CL_Record_f.
 */
-static void SVD_StartDemoFile(client_t *client, const char *path) {
+static int SVD_GamestateRecord(client_t *client, byte *record) {
 
-    int             i, len;
+    int             i, len, size;
     entityState_t   *base, nullstate;
     msg_t           msg;
-    byte            buffer[MAX_MSGLEN];
-    fileHandle_t    file;
-#ifdef USE_DEMO_FORMAT_42
-    char            *s;
-    int             v, size;
-#endif
-
-    Com_DPrintf("SVD_StartDemoFile\n");
-    assert(!client->demo_recording);
-
-    // create the demo file and write the necessary header
-    file = FS_FOpenFileWrite(path);
-    assert(file != 0);
-
-    /* File_write_header_demo // ADD this fx */
-    /* HOLBLIN  entete demo */
-    #ifdef USE_DEMO_FORMAT_42
-        //@Barbatos: get the mod version from the server
-        s = Cvar_VariableString("g_modversion");
-
-        size = strlen(s);
-        len = LittleLong(size);
-        FS_Write(&len, 4, file);
-        FS_Write(s, size, file);
-
-        v = LittleLong(DEMO_VERSION);
-        FS_Write (&v, 4, file);
-
-        len = 0;
-        len = LittleLong(len);
-        FS_Write(&len, 4, file);
-        FS_Write(&len, 4, file);
-    #endif
-    /* END HOLBLIN  entete demo */
 
-    MSG_Init(&msg, buffer, sizeof(buffer));
+    MSG_Init(&msg, record + 8, MAX_MSGLEN);
     MSG_Bitstream(&msg); // XXX server code doesn't do this, client code does
     MSG_WriteLong(&msg, client->lastClientCommand); // TODO: or is it client->reliableSequence?
     MSG_WriteByte(&msg, svc_gamestate);
@@ -1219,18 +1183,68 @@ static void SVD_StartDemoFile(client_t *client, const char *path) {
     MSG_WriteByte(&msg, svc_EOF); // XXX server code doesn't do this, SV_Netchan_Transmit adds it!
 
     len = LittleLong(client->netchan.outgoingSequence - 1);
-    FS_Write(&len, 4, file);
+    Com_Memcpy(record, &len, 4);
 
-    len = LittleLong (msg.cursize);
-    FS_Write(&len, 4, file);
-    FS_Write(msg.data, msg.cursize, file);
+    len = LittleLong(msg.cursize);
+    Com_Memcpy(record + 4, &len, 4);
+    size = 8 + msg.cursize;
 
     #ifdef USE_DEMO_FORMAT_42
         // add size of packet in the end for backward play /* holblin */
-        FS_Write(&len, 4, file);
+        Com_Memcpy(record + size, &len, 4);
+        size += 4;
     #endif
 
-    FS_Flush(file);
+    return size;
+}
+
+/*
+Start a server-side demo.
+
+This does it all, create the file and adjust the demo-related
+stuff in client_t.
+*/
+static void SVD_StartDemoFile(client_t *client, const char *path) {
+
+    static byte     record[8 + MAX_MSGLEN + 4];
+    fileHandle_t    file;
+#ifdef USE_DEMO_FORMAT_42
+    char            *s;
+    int             v, len, size;
+#endif
+
+    Com_DPrintf("SVD_StartDemoFile\n");
+    assert(!client->demo_recording);
+
+    // create the demo file and write the necessary header
+    file = FS_FOpenFileWrite(path);
+    assert(file != 0);
+
+    // everything goes through the writer thread from here on
+    SVD_OpenWriter(client, file);
+
+    /* File_write_header_demo // ADD this fx */
+    /* HOLBLIN  entete demo */
+    #ifdef USE_DEMO_FORMAT_42
+        //@Barbatos: get the mod version from the server
+        s = Cvar_VariableString("g_modversion");
+
+        size = strlen(s);
+        len = LittleLong(size);
+        SVD_QueueDemoData(client, &len, 4);
+        SVD_QueueDemoData(client, s, size);
+
+        v = LittleLong(DEMO_VERSION);
+        SVD_QueueDemoData(client, &v, 4);
+
+        len = 0;
+        len = LittleLong(len);
+        SVD_QueueDemoData(client, &len, 4);
+        SVD_QueueDemoData(client, &len, 4);
+    #endif
+    /* END HOLBLIN  entete demo */
+
+    SVD_QueueDemoData(client, record, SVD_GamestateRecord(client, record));
 
     // adjust client_t to reflect demo started
     client->demo_recording = qtrue;
@@ -1242,22 +1256,39 @@ static void SVD_StartDemoFile(client_t *client, const char *path) {
 
 /*
 Write a message to a server-side demo file.
+
+The whole record is put together in one buffer and queued for the
+writer thread in one go, so it is either written or dropped whole.
+A compressed demo that is due a keyframe gets one before a full
+snapshot.
 */
-void SVD_WriteDemoFile(const client_t *client, const msg_t *msg) {
+void SVD_WriteDemoFile(client_t *client, const msg_t *msg) {
 
-    int len;
+    static byte record[8 + MAX_MSGLEN + 4];
+    int len, size;
     msg_t cmsg;
-    byte cbuf[MAX_MSGLEN];
-    fileHandle_t file = client->demo_file;
+    qboolean fullframe;
+
+    fullframe = client->demo_fullframe;
+    client->demo_fullframe = qfalse;
 
     if (*(int *)msg->data == -1) { // TODO: do we need this?
         Com_DPrintf("Ignored connectionless packet, not written to demo!\n");
         return;
     }
 
+    if (fullframe && SVD_KeyframeDue(client)) {
+        if (!SVD_QueueKeyframe(client, record, SVD_GamestateRecord(client, record))) {
+            client->demo_waiting = qtrue;
+            client->demo_backoff = 1;
+            client->demo_deltas = 0;
+            return;
+        }
+    }
+
     // TODO: we only copy because we want to add svc_EOF; can we add it and then
     // "back off" from it, thus avoiding the copy?
-    MSG_Copy(&cmsg, cbuf, sizeof(cbuf), (msg_t*) msg);
+    MSG_Copy(&cmsg, record + 8, MAX_MSGLEN, (msg_t*) msg);
     MSG_WriteByte(&cmsg, svc_EOF); // XXX server code doesn't do this, SV_Netchan_Transmit adds it!
 
     // TODO: the headerbytes stuff done in the client seems unnecessary
@@ -1265,19 +1296,25 @@ void SVD_WriteDemoFile(const client_t *client, const msg_t *msg) {
     // with it; just not sure that's really true :-/
 
     len = LittleLong(client->netchan.outgoingSequence);
-    FS_Write(&len, 4, file);
+    Com_Memcpy(record, &len, 4);
 
     len = LittleLong(cmsg.cursize);
-    FS_Write(&len, 4, file);
-
-    FS_Write(cmsg.data, cmsg.cursize, file); // XXX don't use len!
+    Com_Memcpy(record + 4, &len, 4);
+    size = 8 + cmsg.cursize;
 
     #ifdef USE_DEMO_FORMAT_42
         // add size of packet in the end for backward play /* holblin */
-        FS_Write(&len, 4, file);
+        Com_Memcpy(record + size, &len, 4);
+        size += 4;
     #endif
 
-    FS_Flush(file);
+    if (!SVD_QueueDemoData(client, record, size)) {
+        // the writer is behind, the deltas that follow would refer to
+        // the dropped message so start over from a full frame
+        client->demo_waiting = qtrue;
+        client->demo_backoff = 1;
+        client->demo_deltas = 0;
+    }
 }
 
 /*
@@ -1288,17 +1325,15 @@ in client_t again.
 */
 static void SVD_StopDemoFile(client_t *client) {
 
-    int marker = -1;
-    fileHandle_t file = client->demo_file;
+    int marker[2] = { -1, -1 };
 
     Com_DPrintf("SVD_StopDemoFile\n");
     assert(client->demo_recording);
 
-    // write the necessary trailer and close the demo file
-    FS_Write(&marker, 4, file);
-    FS_Write(&marker, 4, file);
-    FS_Flush(file);
-    FS_FCloseFile(file);
+    // write the necessary trailer and close the demo file once the
+    // writer is done with it
+    SVD_QueueDemoData(client, marker, sizeof(marker));
+    SVD_CloseWriter(client);
 
     // adjust client_t to reflect demo stopped
     client->demo_recording = qfalse;
@@ -2814,6 +2849,10 @@ void SV_AddOperatorCommands( void ) {
     Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
     Cmd_AddCommand ("map_restart", SV_MapRestart_f);
     Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+    Cmd_AddCommand ("tracebench", SV_TraceBench_f);
+    Cmd_AddCommand ("tickstats", SV_TickStats_f);
+    Cmd_AddCommand ("sv_snapshotCacheStats", SV_SnapshotCacheStats_f);
+    Cmd_AddCommand ("sv_traceCacheStats", SV_TraceCacheStats_f);
     Cmd_AddCommand ("map", SV_Map_f);
 #ifndef PRE_RELEASE_DEMO
     Cmd_AddCommand ("devmap", SV_Map_f);
@@ -2826,6 +2865,7 @@ void SV_AddOperatorCommands( void ) {
         Cmd_AddCommand ("tell", SV_ConTell_f);
         Cmd_AddCommand("startserverdemo", SV_StartServerDemo_f);
         Cmd_AddCommand("stopserverdemo", SV_StopServerDemo_f);
+        Cmd_AddCommand("serverdemostatus", SV_ServerDemoStatus_f);
 
         //@Barbatos: auth system commands
         #ifdef USE_AUTH
@@ -2888,5 +2928,6 @@ void SV_RemoveOperatorCommands( void ) {
     Cmd_RemoveCommand ("tell");
     Cmd_RemoveCommand ("startserverdemo");
     Cmd_RemoveCommand ("stopserverdemo");
+    Cmd_RemoveCommand ("serverdemostatus");
 #endif
 }
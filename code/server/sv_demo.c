@@ -0,0 +1,804 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// sv_demo.c -- background writer for server-side demos
+
+#include "server.h"
+
+/*
+=============================================================================
+
+The data of a server-side demo is queued into a ring buffer of the
+recorded client and a writer thread drains the rings every
+DEMO_WRITE_MSEC, with one fwrite per stretch of ring and one fflush per
+demo, so the frame never waits on the disk.  A message that doesn't fit
+in the ring is dropped whole and the demo waits for the next full
+snapshot, so it stays playable.  The thread also fsyncs the demos it
+wrote to every sv_demoSync seconds.
+
+With sv_demoCompress 1 the main thread gathers the demo into blocks of
+up to DEMO_BLOCK_SIZE instead and queues them whole, and the thread
+deflates each on its own before writing it (the format is described by
+demoBlockHeader_t).  Every sv_demoKeyframe seconds the server sends the
+client a full snapshot and a new block is started with a gamestate of
+that moment, so a player can start parsing at any keyframe.  The
+keyframes are listed at the end of the file when the demo is stopped.
+
+Without pthreads (win32) SVD_WriterFrame writes the backlogs on the main
+thread, still batched.
+
+=============================================================================
+*/
+
+#define	DEMO_WRITE_MSEC		100
+#define	DEMO_MAX_KEYFRAMES	2048
+
+typedef struct {
+	unsigned int	raw;			// demo bytes written
+	unsigned int	written;		// file bytes, less than raw when compressed
+	unsigned int	dropped;		// bytes
+	int				drops;			// messages, or blocks when compressed
+	int				maxBacklog;		// bytes
+	int				writes;			// fwrite + fflush batches
+	int				syncs;
+	int				errors;			// failed fwrites
+} demoWriterStats_t;
+
+typedef struct {
+	qboolean		active;			// the thread may write it
+	fileHandle_t	file;
+	FILE			*stream;
+	byte			*buffer;
+	int				size;			// power of two
+	unsigned int	head;			// bytes queued, moved by the main thread
+	unsigned int	tail;			// bytes written, moved by the writer
+	int				syncMsec;
+	int				lastSync;
+	demoWriterStats_t	stats;
+
+	// compressed demos
+	qboolean		compress;
+	byte			*block;			// being filled by the main thread
+	int				blockLength;
+	int				blockKeyframe;	// leading bytes of the block that are a keyframe
+	int				blockTime;
+	int				keyframeMsec;
+	int				nextKeyframe;	// sv.time
+	int				offset;			// in the file of the next block, moved by the writer
+	demoKeyframe_t	*keyframes;		// filled in by the writer
+	int				numKeyframes;
+} demoWriter_t;
+
+static demoWriter_t			svdWriters[MAX_CLIENTS];
+static demoWriterStats_t	svdTotals;		// of the demos that were closed
+static int					svdClosed;
+static qboolean				svdThreadRunning;
+
+// used by whoever writes the backlogs, the thread when there is one
+static byte				svdRaw[DEMO_BLOCK_SIZE];
+static byte				svdPacked[DEFLATE_BOUND( DEMO_BLOCK_SIZE )];
+static deflateWork_t	svdDeflate;
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static pthread_t		svdThread;
+static qboolean			svdQuit;
+static qboolean			svdUrgent;			// don't wait for the next batch
+
+static pthread_mutex_t	svdMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	svdWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	svdDrained = PTHREAD_COND_INITIALIZER;
+
+#define	SVD_Lock()		pthread_mutex_lock( &svdMutex )
+#define	SVD_Unlock()	pthread_mutex_unlock( &svdMutex )
+#else
+#define	SVD_Lock()
+#define	SVD_Unlock()
+#endif
+
+/*
+==================
+SVD_RingRead
+==================
+*/
+static void SVD_RingRead( demoWriter_t *w, unsigned int pos, void *data, int length ) {
+	int		start, part;
+
+	start = pos & ( w->size - 1 );
+	part = w->size - start;
+	if ( part > length ) {
+		part = length;
+	}
+	Com_Memcpy( data, w->buffer + start, part );
+	Com_Memcpy( (byte *)data + part, w->buffer, length - part );
+}
+
+/*
+==================
+SVD_WriteBlocks
+
+Deflates and writes the blocks queued between tail and head, returns
+the bytes written to the file
+==================
+*/
+static int SVD_WriteBlocks( demoWriter_t *w, unsigned int tail, unsigned int head, int *raw, int *errors ) {
+	demoBlockHeader_t	block, header;
+	const byte			*data;
+	int					packed, written, keyframes;
+
+	written = 0;
+	keyframes = w->numKeyframes;
+	while ( tail != head ) {
+		SVD_RingRead( w, tail, &block, sizeof( block ) );
+		tail += sizeof( block );
+		SVD_RingRead( w, tail, svdRaw, block.rawLength );
+		tail += block.rawLength;
+		*raw += block.rawLength;
+
+		packed = Com_Deflate( svdPacked, block.rawLength, svdRaw, block.rawLength, &svdDeflate );
+		if ( packed >= 0 ) {
+			header.method = LittleLong( DEMO_BLOCK_DEFLATED );
+			data = svdPacked;
+		} else {
+			// didn't shrink
+			packed = block.rawLength;
+			header.method = LittleLong( DEMO_BLOCK_STORED );
+			data = svdRaw;
+		}
+
+		if ( block.keyframeLength && keyframes < DEMO_MAX_KEYFRAMES ) {
+			w->keyframes[keyframes].serverTime = block.serverTime;
+			w->keyframes[keyframes].offset = w->offset;
+			keyframes++;
+		}
+
+		w->offset += sizeof( header ) + packed;
+		written += sizeof( header ) + packed;
+
+		header.packedLength = LittleLong( packed );
+		header.rawLength = LittleLong( block.rawLength );
+		header.keyframeLength = LittleLong( block.keyframeLength );
+		header.serverTime = LittleLong( block.serverTime );
+		if ( fwrite( &header, sizeof( header ), 1, w->stream ) != 1
+			|| fwrite( data, 1, packed, w->stream ) != (size_t)packed ) {
+			(*errors)++;
+		}
+	}
+
+	// only read by the main thread once the demo is drained
+	w->numKeyframes = keyframes;
+
+	return written;
+}
+
+/*
+==================
+SVD_WriteBacklog
+
+Writes out what is queued in the ring, with the lock held.  The lock is
+let go for the writes, the main thread only appends past the head.
+==================
+*/
+static void SVD_WriteBacklog( demoWriter_t *w ) {
+	unsigned int	head, tail;
+	int				start, length;
+	int				errors, raw, written;
+	qboolean		sync;
+
+	head = w->head;
+	tail = w->tail;
+	if ( head == tail ) {
+		return;
+	}
+
+	SVD_Unlock();
+
+	errors = 0;
+	raw = 0;
+	if ( w->compress ) {
+		written = SVD_WriteBlocks( w, tail, head, &raw, &errors );
+	} else {
+		raw = written = head - tail;
+		while ( tail != head ) {
+			start = tail & ( w->size - 1 );
+			length = head - tail;
+			if ( length > w->size - start ) {
+				length = w->size - start;
+			}
+			if ( fwrite( w->buffer + start, 1, length, w->stream ) != (size_t)length ) {
+				errors++;
+			}
+			tail += length;
+		}
+	}
+	fflush( w->stream );
+
+	sync = qfalse;
+#ifndef _WIN32
+	if ( w->syncMsec > 0 && Sys_Milliseconds() - w->lastSync >= w->syncMsec ) {
+		fsync( fileno( w->stream ) );
+		w->lastSync = Sys_Milliseconds();
+		sync = qtrue;
+	}
+#endif
+
+	SVD_Lock();
+
+	w->stats.raw += raw;
+	w->stats.written += written;
+	w->stats.writes++;
+	w->stats.errors += errors;
+	if ( sync ) {
+		w->stats.syncs++;
+	}
+	w->tail = head;
+
+#ifndef _WIN32
+	pthread_cond_broadcast( &svdDrained );
+#endif
+}
+
+#ifndef _WIN32
+/*
+==================
+SVD_WriterThread
+==================
+*/
+static void *SVD_WriterThread( void *arg ) {
+	struct timeval	now;
+	struct timespec	until;
+	int				i;
+
+	SVD_Lock();
+	while ( !svdQuit ) {
+		for ( i = 0 ; i < MAX_CLIENTS ; i++ ) {
+			if ( svdWriters[i].active ) {
+				SVD_WriteBacklog( &svdWriters[i] );
+			}
+		}
+
+		if ( !svdUrgent && !svdQuit ) {
+			gettimeofday( &now, NULL );
+			until.tv_sec = now.tv_sec;
+			until.tv_nsec = ( now.tv_usec + DEMO_WRITE_MSEC * 1000 ) * 1000;
+			if ( until.tv_nsec >= 1000000000 ) {
+				until.tv_sec++;
+				until.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait( &svdWake, &svdMutex, &until );
+		}
+		svdUrgent = qfalse;
+	}
+	SVD_Unlock();
+
+	return NULL;
+}
+
+/*
+==================
+SVD_WakeWriter
+
+Has the thread write right away instead of at the next batch, with the
+lock held
+==================
+*/
+static void SVD_WakeWriter( void ) {
+	svdUrgent = qtrue;
+	pthread_cond_signal( &svdWake );
+}
+
+/*
+==================
+SVD_StartWriter
+==================
+*/
+static void SVD_StartWriter( void ) {
+	if ( svdThreadRunning ) {
+		return;
+	}
+
+	svdQuit = qfalse;
+	if ( pthread_create( &svdThread, NULL, SVD_WriterThread, NULL ) ) {
+		Com_Printf( "WARNING: SVD_StartWriter: couldn't create the demo writer thread\n" );
+		return;
+	}
+	svdThreadRunning = qtrue;
+}
+
+/*
+==================
+SVD_StopWriter
+==================
+*/
+static void SVD_StopWriter( void ) {
+	if ( !svdThreadRunning ) {
+		return;
+	}
+
+	SVD_Lock();
+	svdQuit = qtrue;
+	pthread_cond_signal( &svdWake );
+	SVD_Unlock();
+
+	pthread_join( svdThread, NULL );
+	svdThreadRunning = qfalse;
+}
+
+#else
+
+static void SVD_WakeWriter( void ) {
+}
+
+static void SVD_StartWriter( void ) {
+}
+
+static void SVD_StopWriter( void ) {
+}
+
+#endif
+
+/*
+==================
+SVD_WriterFrame
+
+Writes the backlogs when there is no writer thread
+==================
+*/
+void SVD_WriterFrame( void ) {
+	static int	lastWrite;
+	int			i;
+
+	if ( svdThreadRunning ) {
+		return;
+	}
+	if ( svs.time - lastWrite < DEMO_WRITE_MSEC && svs.time >= lastWrite ) {
+		return;
+	}
+	lastWrite = svs.time;
+
+	for ( i = 0 ; i < MAX_CLIENTS ; i++ ) {
+		if ( svdWriters[i].active ) {
+			SVD_WriteBacklog( &svdWriters[i] );
+		}
+	}
+}
+
+/*
+==================
+SVD_OpenWriter
+
+Starts queueing the demo of a client to a file opened for writing
+==================
+*/
+void SVD_OpenWriter( client_t *client, fileHandle_t file ) {
+	demoWriter_t	*w = &svdWriters[client - svs.clients];
+	int				size, magic;
+
+	assert( !w->active );
+
+	// at least a few full messages, rounded down to a power of two
+	size = sv_demoBuffer->integer;
+	if ( size < 64 ) {
+		size = 64;
+	} else if ( size > 1024 ) {
+		size = 1024;
+	}
+	size *= 1024;
+	while ( size & ( size - 1 ) ) {
+		size &= size - 1;
+	}
+
+	Com_Memset( w, 0, sizeof( *w ) );
+	w->file = file;
+	w->stream = FS_FileForHandle( file );
+	w->syncMsec = sv_demoSync->integer * 1000;
+	w->lastSync = Sys_Milliseconds();
+
+	if ( sv_demoCompress->integer ) {
+		// a few blocks
+		if ( size < 4 * DEMO_BLOCK_SIZE ) {
+			size = 4 * DEMO_BLOCK_SIZE;
+		}
+		w->compress = qtrue;
+		w->block = Z_Malloc( DEMO_BLOCK_SIZE );
+		w->keyframes = Z_Malloc( DEMO_MAX_KEYFRAMES * sizeof( demoKeyframe_t ) );
+		w->keyframeMsec = sv_demoKeyframe->integer * 1000;
+		if ( w->keyframeMsec < 1000 ) {
+			w->keyframeMsec = 1000;
+		}
+		w->nextKeyframe = sv.time + w->keyframeMsec;
+
+		magic = LittleLong( DEMO_COMPRESSED_MAGIC );
+		fwrite( &magic, sizeof( magic ), 1, w->stream );
+		w->offset = sizeof( magic );
+	}
+
+	w->buffer = Z_Malloc( size );
+	w->size = size;
+
+	SVD_StartWriter();
+
+	SVD_Lock();
+	w->active = qtrue;
+	SVD_Unlock();
+}
+
+/*
+==================
+SVD_RingWrite
+
+The writer stays behind the head, so this needs no lock
+==================
+*/
+static void SVD_RingWrite( demoWriter_t *w, unsigned int pos, const void *data, int length ) {
+	int		start, part;
+
+	start = pos & ( w->size - 1 );
+	part = w->size - start;
+	if ( part > length ) {
+		part = length;
+	}
+	Com_Memcpy( w->buffer + start, data, part );
+	Com_Memcpy( w->buffer, (const byte *)data + part, length - part );
+}
+
+/*
+==================
+SVD_QueueRing
+
+Returns qfalse when there is no room for both pieces, which go in as
+one so the writer never sees just the first
+==================
+*/
+static qboolean SVD_QueueRing( demoWriter_t *w, const void *data, int length, const void *data2, int length2 ) {
+	int		backlog;
+
+	SVD_Lock();
+	backlog = w->head - w->tail;
+	SVD_Unlock();
+
+	if ( length + length2 > w->size - backlog ) {
+		return qfalse;
+	}
+
+	SVD_RingWrite( w, w->head, data, length );
+	if ( length2 ) {
+		SVD_RingWrite( w, w->head + length, data2, length2 );
+	}
+
+	SVD_Lock();
+	w->head += length + length2;
+	backlog = w->head - w->tail;
+	if ( backlog > w->stats.maxBacklog ) {
+		w->stats.maxBacklog = backlog;
+	}
+	if ( backlog >= w->size / 2 ) {
+		SVD_WakeWriter();
+	}
+	SVD_Unlock();
+
+	return qtrue;
+}
+
+/*
+==================
+SVD_QueueBlock
+
+Hands the block being filled to the writer, returns qfalse when there
+is no room for it
+==================
+*/
+static qboolean SVD_QueueBlock( demoWriter_t *w ) {
+	demoBlockHeader_t	block;
+
+	if ( !w->blockLength ) {
+		return qtrue;
+	}
+
+	Com_Memset( &block, 0, sizeof( block ) );
+	block.rawLength = w->blockLength;
+	block.keyframeLength = w->blockKeyframe;
+	block.serverTime = w->blockTime;
+	if ( !SVD_QueueRing( w, &block, sizeof( block ), w->block, w->blockLength ) ) {
+		return qfalse;
+	}
+
+	w->blockLength = 0;
+	w->blockKeyframe = 0;
+	return qtrue;
+}
+
+/*
+==================
+SVD_DropBlock
+
+The demo goes on from the next full snapshot, which is made a keyframe
+==================
+*/
+static void SVD_DropBlock( demoWriter_t *w ) {
+	w->stats.dropped += w->blockLength;
+	w->stats.drops++;
+	w->blockLength = 0;
+	w->blockKeyframe = 0;
+	w->nextKeyframe = sv.time;
+}
+
+/*
+==================
+SVD_QueueDemoData
+
+Returns qfalse when it didn't fit and was dropped
+==================
+*/
+qboolean SVD_QueueDemoData( client_t *client, const void *data, int length ) {
+	demoWriter_t	*w = &svdWriters[client - svs.clients];
+
+	if ( !w->compress ) {
+		if ( !SVD_QueueRing( w, data, length, NULL, 0 ) ) {
+			w->stats.dropped += length;
+			w->stats.drops++;
+			return qfalse;
+		}
+		return qtrue;
+	}
+
+	if ( w->blockLength + length > DEMO_BLOCK_SIZE && !SVD_QueueBlock( w ) ) {
+		SVD_DropBlock( w );
+		return qfalse;
+	}
+	if ( !w->blockLength ) {
+		w->blockTime = sv.time;
+	}
+	Com_Memcpy( w->block + w->blockLength, data, length );
+	w->blockLength += length;
+
+	return qtrue;
+}
+
+/*
+==================
+SVD_KeyframeDue
+
+Compressed demos want a full snapshot every keyframeMsec
+==================
+*/
+qboolean SVD_KeyframeDue( client_t *client ) {
+	demoWriter_t	*w = &svdWriters[client - svs.clients];
+
+	if ( !w->compress ) {
+		return qfalse;
+	}
+
+	// sv.time starts over with the map
+	return sv.time >= w->nextKeyframe || w->nextKeyframe - sv.time > w->keyframeMsec;
+}
+
+/*
+==================
+SVD_QueueKeyframe
+
+Starts a new block with a gamestate message for seeking, the full
+snapshot is queued right after.  Returns qfalse when the block before
+had to be dropped.
+==================
+*/
+qboolean SVD_QueueKeyframe( client_t *client, const void *data, int length ) {
+	demoWriter_t	*w = &svdWriters[client - svs.clients];
+
+	if ( !w->compress ) {
+		return qtrue;
+	}
+
+	if ( !SVD_QueueBlock( w ) ) {
+		SVD_DropBlock( w );
+		return qfalse;
+	}
+
+	Com_Memcpy( w->block, data, length );
+	w->blockLength = length;
+	w->blockKeyframe = length;
+	w->blockTime = sv.time;
+	w->nextKeyframe = sv.time + w->keyframeMsec;
+
+	return qtrue;
+}
+
+/*
+==================
+SVD_DrainWriter
+
+Waits for the thread to write the backlog, or writes it when there is
+no thread
+==================
+*/
+static void SVD_DrainWriter( demoWriter_t *w ) {
+	SVD_Lock();
+	if ( svdThreadRunning ) {
+#ifndef _WIN32
+		while ( w->tail != w->head ) {
+			SVD_WakeWriter();
+			pthread_cond_wait( &svdDrained, &svdMutex );
+		}
+#endif
+	} else {
+		SVD_WriteBacklog( w );
+	}
+	SVD_Unlock();
+}
+
+/*
+==================
+SVD_WriteIndex
+
+Ends a compressed demo with the list of its keyframes
+==================
+*/
+static void SVD_WriteIndex( demoWriter_t *w ) {
+	demoBlockHeader_t	end;
+	int					i, v[2];
+
+	Com_Memset( &end, 0, sizeof( end ) );
+	end.packedLength = LittleLong( -1 );
+	fwrite( &end, sizeof( end ), 1, w->stream );
+
+	v[0] = LittleLong( w->numKeyframes );
+	fwrite( v, sizeof( int ), 1, w->stream );
+	for ( i = 0 ; i < w->numKeyframes ; i++ ) {
+		v[0] = LittleLong( w->keyframes[i].serverTime );
+		v[1] = LittleLong( w->keyframes[i].offset );
+		fwrite( v, sizeof( v ), 1, w->stream );
+	}
+
+	v[0] = LittleLong( w->offset );
+	v[1] = LittleLong( DEMO_INDEX_MAGIC );
+	fwrite( v, sizeof( v ), 1, w->stream );
+}
+
+/*
+==================
+SVD_FinishWriter
+
+Writes what is left and closes the file
+==================
+*/
+static void SVD_FinishWriter( demoWriter_t *w ) {
+	SVD_DrainWriter( w );
+
+	// the last block can always go once the ring is empty
+	if ( w->compress && w->blockLength ) {
+		SVD_QueueBlock( w );
+		SVD_DrainWriter( w );
+	}
+
+	SVD_Lock();
+	w->active = qfalse;
+	SVD_Unlock();
+
+	if ( w->compress ) {
+		SVD_WriteIndex( w );
+		Z_Free( w->block );
+		Z_Free( w->keyframes );
+	}
+
+	svdTotals.raw += w->stats.raw;
+	svdTotals.written += w->stats.written;
+	svdTotals.dropped += w->stats.dropped;
+	svdTotals.drops += w->stats.drops;
+	svdTotals.writes += w->stats.writes;
+	svdTotals.syncs += w->stats.syncs;
+	svdTotals.errors += w->stats.errors;
+	if ( w->stats.maxBacklog > svdTotals.maxBacklog ) {
+		svdTotals.maxBacklog = w->stats.maxBacklog;
+	}
+	svdClosed++;
+
+	Z_Free( w->buffer );
+	FS_FCloseFile( w->file );
+	Com_Memset( w, 0, sizeof( *w ) );
+}
+
+/*
+==================
+SVD_CloseWriter
+
+Waits for the backlog to be written and closes the file
+==================
+*/
+void SVD_CloseWriter( client_t *client ) {
+	demoWriter_t	*w = &svdWriters[client - svs.clients];
+
+	if ( !w->active ) {
+		return;
+	}
+
+	if ( w->stats.drops || w->stats.errors ) {
+		Com_Printf( "%s: %i %s (%u bytes) dropped, %i failed writes\n", client->name,
+			w->stats.drops, w->compress ? "blocks" : "messages", w->stats.dropped, w->stats.errors );
+	}
+
+	SVD_FinishWriter( w );
+}
+
+/*
+==================
+SVD_ShutdownWriter
+
+Called once the demos are stopped, closes any the server lost track of
+==================
+*/
+void SVD_ShutdownWriter( void ) {
+	int		i;
+
+	SVD_StopWriter();
+
+	for ( i = 0 ; i < MAX_CLIENTS ; i++ ) {
+		if ( svdWriters[i].active ) {
+			SVD_FinishWriter( &svdWriters[i] );
+		}
+	}
+}
+
+/*
+==================
+SV_ServerDemoStatus_f
+
+"serverdemostatus", the writer counters of the demos being recorded and
+the totals of the finished ones
+==================
+*/
+void SV_ServerDemoStatus_f( void ) {
+	demoWriter_t		*w;
+	demoWriterStats_t	st;
+	int					i, backlog, recording;
+
+	Com_Printf( "slot  backlog  max backlog        raw    written    dropped  drops  writes  syncs  name\n" );
+	recording = 0;
+	for ( i = 0, w = svdWriters ; i < MAX_CLIENTS ; i++, w++ ) {
+		if ( !w->active ) {
+			continue;
+		}
+		SVD_Lock();
+		backlog = w->head - w->tail;
+		st = w->stats;
+		SVD_Unlock();
+
+		Com_Printf( "%4i %8i %12i %10u %10u %10u %6i %7i %6i  %s\n", i, backlog, st.maxBacklog,
+			st.raw, st.written, st.dropped, st.drops, st.writes, st.syncs, svs.clients ? svs.clients[i].name : "" );
+		if ( st.errors ) {
+			Com_Printf( "      %i failed writes\n", st.errors );
+		}
+		recording++;
+	}
+	Com_Printf( "%i demos recording\n", recording );
+	if ( recording && !svdThreadRunning ) {
+		Com_Printf( "no writer thread, the demos are written on the main thread\n" );
+	}
+
+	if ( svdClosed ) {
+		Com_Printf( "%i finished demos: %u bytes written for %u demo bytes, %u bytes in %i "
+			"messages or blocks dropped, max backlog %i, %i writes, %i syncs, %i failed writes\n",
+			svdClosed, svdTotals.written, svdTotals.raw, svdTotals.dropped, svdTotals.drops, svdTotals.maxBacklog,
+			svdTotals.writes, svdTotals.syncs, svdTotals.errors );
+	}
+}
@@ -124,6 +124,33 @@ void SV_Auth_GameDropClient( int clientNum, const char *reason, const char *mess
 }
 #endif
 
+/*
+=================
+SV_GameTraceBatch
+
+Runs numTraces traces in one system call, at most MAX_TRACE_BATCH
+=================
+*/
+static void SV_GameTraceBatch( gameTrace_t *traces, int numTraces ) {
+	int		i;
+
+	if ( !traces || numTraces < 0 ) {
+		return;
+	}
+	if ( numTraces > MAX_TRACE_BATCH ) {
+		Com_DPrintf( "SV_GameTraceBatch: %i traces, only %i run\n", numTraces, MAX_TRACE_BATCH );
+		numTraces = MAX_TRACE_BATCH;
+	}
+
+	for ( i = 0 ; i < numTraces ; i++, traces++ ) {
+		SV_CachedTrace( &traces->results, traces->start, traces->mins, traces->maxs, traces->end,
+			traces->passEntityNum, traces->contentmask, traces->capsule );
+		if ( !traces->capsule && sv_noFallDamage->integer > 0 ) {
+			traces->results.surfaceFlags |= SURF_NODAMAGE;
+		}
+	}
+}
+
 /*
 =================
 SV_SetBrushModel
@@ -997,6 +1024,163 @@ void Check_Com_Printf ( const char *text ) {
 }
 
 
+/*
+====================
+Game system call table
+
+The calls made every frame, looked up by number through
+sv_gameSyscalls instead of the SV_GameSystemCalls switch
+====================
+*/
+static intptr_t SV_GameMilliseconds( intptr_t *args ) {
+	return Sys_Milliseconds();
+}
+
+static intptr_t SV_GameLinkEntity( intptr_t *args ) {
+	SV_LinkEntity( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameUnlinkEntity( intptr_t *args ) {
+	SV_UnlinkEntity( VMA(1) );
+	return 0;
+}
+
+static intptr_t SV_GameEntitiesInBox( intptr_t *args ) {
+	return SV_AreaEntities( VMA(1), VMA(2), VMA(3), args[4] );
+}
+
+static intptr_t SV_GameEntityContact( intptr_t *args ) {
+	return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qfalse );
+}
+
+static intptr_t SV_GameEntityContactCapsule( intptr_t *args ) {
+	return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qtrue );
+}
+
+static intptr_t SV_GameTrace( intptr_t *args ) {
+	SV_CachedTrace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qfalse );
+	if ( sv_noFallDamage->integer > 0 ) {
+		((trace_t *)VMA(1))->surfaceFlags |= SURF_NODAMAGE;
+	}
+	return 0;
+}
+
+static intptr_t SV_GameTraceCapsule( intptr_t *args ) {
+	SV_CachedTrace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
+	return 0;
+}
+
+static intptr_t SV_GamePointContents( intptr_t *args ) {
+	return SV_CachedPointContents( VMA(1), args[2] );
+}
+
+static intptr_t SV_GameInPVS( intptr_t *args ) {
+	return SV_inPVS( VMA(1), VMA(2) );
+}
+
+static intptr_t SV_GameInPVSIgnorePortals( intptr_t *args ) {
+	return SV_inPVSIgnorePortals( VMA(1), VMA(2) );
+}
+
+static intptr_t SV_GameMemset( intptr_t *args ) {
+	Com_Memset( VMA(1), args[2], args[3] );
+	return 0;
+}
+
+static intptr_t SV_GameMemcpy( intptr_t *args ) {
+	Com_Memcpy( VMA(1), VMA(2), args[3] );
+	return 0;
+}
+
+static intptr_t SV_GameStrncpy( intptr_t *args ) {
+	strncpy( VMA(1), VMA(2), args[3] );
+	return args[1];
+}
+
+static intptr_t SV_GameSin( intptr_t *args ) {
+	return FloatAsInt( sin( VMF(1) ) );
+}
+
+static intptr_t SV_GameCos( intptr_t *args ) {
+	return FloatAsInt( cos( VMF(1) ) );
+}
+
+static intptr_t SV_GameAtan2( intptr_t *args ) {
+	return FloatAsInt( atan2( VMF(1), VMF(2) ) );
+}
+
+static intptr_t SV_GameSqrt( intptr_t *args ) {
+	return FloatAsInt( sqrt( VMF(1) ) );
+}
+
+static intptr_t SV_GameMatrixMultiply( intptr_t *args ) {
+	MatrixMultiply( VMA(1), VMA(2), VMA(3) );
+	return 0;
+}
+
+static intptr_t SV_GameAngleVectors( intptr_t *args ) {
+	AngleVectors( VMA(1), VMA(2), VMA(3), VMA(4) );
+	return 0;
+}
+
+static intptr_t SV_GamePerpendicularVector( intptr_t *args ) {
+	PerpendicularVector( VMA(1), VMA(2) );
+	return 0;
+}
+
+static intptr_t SV_GameFloor( intptr_t *args ) {
+	return FloatAsInt( floor( VMF(1) ) );
+}
+
+static intptr_t SV_GameCeil( intptr_t *args ) {
+	return FloatAsInt( ceil( VMF(1) ) );
+}
+
+#define	MAX_GAME_SYSCALLS	( TRAP_CEIL + 1 )
+
+static vmSyscall_t	sv_gameSyscalls[MAX_GAME_SYSCALLS];
+
+static void SV_AddGameSyscall( int num, const char *name, intptr_t (*func)( intptr_t * ),
+							  int numArgs, vmInline_t inlined ) {
+	sv_gameSyscalls[num].name = name;
+	sv_gameSyscalls[num].func = func;
+	sv_gameSyscalls[num].numArgs = numArgs;
+	sv_gameSyscalls[num].inlined = inlined;
+}
+
+/*
+====================
+SV_InitGameSyscalls
+====================
+*/
+static void SV_InitGameSyscalls( void ) {
+	SV_AddGameSyscall( G_MILLISECONDS, "milliseconds", SV_GameMilliseconds, 0, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_LINKENTITY, "linkentity", SV_GameLinkEntity, 1, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_UNLINKENTITY, "unlinkentity", SV_GameUnlinkEntity, 1, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_ENTITIES_IN_BOX, "entitiesinbox", SV_GameEntitiesInBox, 4, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_ENTITY_CONTACT, "entitycontact", SV_GameEntityContact, 3, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_ENTITY_CONTACTCAPSULE, "entitycontactcapsule", SV_GameEntityContactCapsule, 3, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_TRACE, "trace", SV_GameTrace, 7, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_TRACECAPSULE, "tracecapsule", SV_GameTraceCapsule, 7, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_POINT_CONTENTS, "pointcontents", SV_GamePointContents, 2, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_IN_PVS, "inpvs", SV_GameInPVS, 2, VM_INLINE_NONE );
+	SV_AddGameSyscall( G_IN_PVS_IGNORE_PORTALS, "inpvsignoreportals", SV_GameInPVSIgnorePortals, 2, VM_INLINE_NONE );
+
+	SV_AddGameSyscall( TRAP_MEMSET, "memset", SV_GameMemset, 3, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_MEMCPY, "memcpy", SV_GameMemcpy, 3, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_STRNCPY, "strncpy", SV_GameStrncpy, 3, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_SIN, "sin", SV_GameSin, 1, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_COS, "cos", SV_GameCos, 1, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_ATAN2, "atan2", SV_GameAtan2, 2, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_SQRT, "sqrt", SV_GameSqrt, 1, VM_INLINE_SQRT );
+	SV_AddGameSyscall( TRAP_MATRIXMULTIPLY, "matrixmultiply", SV_GameMatrixMultiply, 3, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_ANGLEVECTORS, "anglevectors", SV_GameAngleVectors, 4, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_PERPENDICULARVECTOR, "perpendicularvector", SV_GamePerpendicularVector, 2, VM_INLINE_NONE );
+	SV_AddGameSyscall( TRAP_FLOOR, "floor", SV_GameFloor, 1, VM_INLINE_FLOOR );
+	SV_AddGameSyscall( TRAP_CEIL, "ceil", SV_GameCeil, 1, VM_INLINE_CEIL );
+}
+
 /*
 ====================
 SV_GameSystemCalls
@@ -1014,7 +1198,7 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		Com_Error( ERR_DROP, "%s", (const char*)VMA(1) );
 		return 0;
 	case G_MILLISECONDS:
-		return Sys_Milliseconds();
+		return SV_GameMilliseconds( args );
 	case G_CVAR_REGISTER:
 		Cvar_Register( VMA(1), VMA(2), VMA(3), args[4] ); 
 		return 0;
@@ -1071,35 +1255,31 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		SV_GameSendServerCommand( args[1], VMA(2) );
 		return 0;
 	case G_LINKENTITY:
-		SV_LinkEntity( VMA(1) );
-		return 0;
+		return SV_GameLinkEntity( args );
 	case G_UNLINKENTITY:
-		SV_UnlinkEntity( VMA(1) );
-		return 0;
+		return SV_GameUnlinkEntity( args );
 	case G_ENTITIES_IN_BOX:
-		return SV_AreaEntities( VMA(1), VMA(2), VMA(3), args[4] );
+		return SV_GameEntitiesInBox( args );
 	case G_ENTITY_CONTACT:
-		return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qfalse );
+		return SV_GameEntityContact( args );
 	case G_ENTITY_CONTACTCAPSULE:
-		return SV_EntityContact( VMA(1), VMA(2), VMA(3), /*int capsule*/ qtrue );
+		return SV_GameEntityContactCapsule( args );
 	case G_TRACE:
-		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qfalse );
-            if (sv_noFallDamage->integer>0) {
-                ((trace_t*)(VMA(1)))->surfaceFlags |= SURF_NODAMAGE;
-            }    
-		return 0;
+		return SV_GameTrace( args );
 	case G_TRACECAPSULE:
-		SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
+		return SV_GameTraceCapsule( args );
+	case G_TRACE_BATCH:
+		SV_GameTraceBatch( VMA(1), args[2] );
 		return 0;
 	case G_POINT_CONTENTS:
-		return SV_PointContents( VMA(1), args[2] );
+		return SV_GamePointContents( args );
 	case G_SET_BRUSH_MODEL:
 		SV_SetBrushModel( VMA(1), VMA(2) );
 		return 0;
 	case G_IN_PVS:
-		return SV_inPVS( VMA(1), VMA(2) );
+		return SV_GameInPVS( args );
 	case G_IN_PVS_IGNORE_PORTALS:
-		return SV_inPVSIgnorePortals( VMA(1), VMA(2) );
+		return SV_GameInPVSIgnorePortals( args );
 
 	case G_SET_CONFIGSTRING:
 		SV_SetConfigstring( args[1], VMA(2) );
@@ -1542,46 +1722,40 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
 	#endif
 	
 	case TRAP_MEMSET:
-		Com_Memset( VMA(1), args[2], args[3] );
-		return 0;
+		return SV_GameMemset( args );
 
 	case TRAP_MEMCPY:
-		Com_Memcpy( VMA(1), VMA(2), args[3] );
-		return 0;
+		return SV_GameMemcpy( args );
 
 	case TRAP_STRNCPY:
-		strncpy( VMA(1), VMA(2), args[3] );
-		return args[1];
+		return SV_GameStrncpy( args );
 
 	case TRAP_SIN:
-		return FloatAsInt( sin( VMF(1) ) );
+		return SV_GameSin( args );
 
 	case TRAP_COS:
-		return FloatAsInt( cos( VMF(1) ) );
+		return SV_GameCos( args );
 
 	case TRAP_ATAN2:
-		return FloatAsInt( atan2( VMF(1), VMF(2) ) );
+		return SV_GameAtan2( args );
 
 	case TRAP_SQRT:
-		return FloatAsInt( sqrt( VMF(1) ) );
+		return SV_GameSqrt( args );
 
 	case TRAP_MATRIXMULTIPLY:
-		MatrixMultiply( VMA(1), VMA(2), VMA(3) );
-		return 0;
+		return SV_GameMatrixMultiply( args );
 
 	case TRAP_ANGLEVECTORS:
-		AngleVectors( VMA(1), VMA(2), VMA(3), VMA(4) );
-		return 0;
+		return SV_GameAngleVectors( args );
 
 	case TRAP_PERPENDICULARVECTOR:
-		PerpendicularVector( VMA(1), VMA(2) );
-		return 0;
+		return SV_GamePerpendicularVector( args );
 
 	case TRAP_FLOOR:
-		return FloatAsInt( floor( VMF(1) ) );
+		return SV_GameFloor( args );
 
 	case TRAP_CEIL:
-		return FloatAsInt( ceil( VMF(1) ) );
+		return SV_GameCeil( args );
 
 	default:
 		Com_Error( ERR_DROP, "Bad game system trap: %ld", (long int) args[0] );
@@ -1690,7 +1864,9 @@ void SV_InitGameProgs( void ) {
 	}
 
 	// load the dll or bytecode
-	gvm = VM_Create( "qagame", SV_GameSystemCalls, Cvar_VariableValue( "vm_game" ) );
+	SV_InitGameSyscalls();
+	gvm = VM_Create( "qagame", SV_GameSystemCalls, sv_gameSyscalls, MAX_GAME_SYSCALLS,
+		Cvar_VariableValue( "vm_game" ) );
 	if ( !gvm ) {
 		Com_Error( ERR_FATAL, "VM_Create on game failed" );
 	}
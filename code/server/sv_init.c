@@ -769,6 +769,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	// wipe the entire per-level structure
 	SV_ClearServer();
+	svs.tickStats.lastFrame = 0;
 	for ( i = 0 ; i < MAX_CONFIGSTRINGS ; i++ ) {
 		sv.configstrings[i] = CopyString("");
 	}
@@ -781,6 +782,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	sv.checksumFeed = ( ((int) rand() << 16) ^ rand() ) ^ Com_Milliseconds();
 	FS_Restart( sv.checksumFeed );
 
+	FS_PrefetchMap( va("maps/%s.bsp", server) );
 	CM_LoadMap( va("maps/%s.bsp", server), qfalse, &checksum );
 
 	// set serverinfo visible name
@@ -972,6 +974,9 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	Hunk_SetMark();
 
+	// a listen server's client is still to load the map
+	FS_PrefetchDone( "SV_SpawnServer", !com_cl_running || !com_cl_running->integer );
+
 	Com_Printf ("-----------------------------------\n");
 }
 
@@ -1022,6 +1027,7 @@ void SV_Init (void) {
 	sv_rconAllowedSpamIP = Cvar_Get ("rconAllowedSpamIP", "", CVAR_INIT );
 	sv_privatePassword = Cvar_Get ("sv_privatePassword", "", CVAR_TEMP );
 	sv_fps = Cvar_Get ("sv_fps", "20", CVAR_TEMP );
+	sv_frameScheduler = Cvar_Get ("sv_frameScheduler", "0", CVAR_ARCHIVE );
 	sv_timeout = Cvar_Get ("sv_timeout", "200", CVAR_TEMP );
 	sv_zombietime = Cvar_Get ("sv_zombietime", "2", CVAR_TEMP );
 	Cvar_Get ("nextmap", "", CVAR_TEMP );
@@ -1039,6 +1045,11 @@ void SV_Init (void) {
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
+	sv_parallelSnapshots = Cvar_Get ("sv_parallelSnapshots", "0", CVAR_ARCHIVE );
+	sv_snapshotCache = Cvar_Get ("sv_snapshotCache", "1", CVAR_ARCHIVE );
+	sv_broadphase = Cvar_Get ("sv_broadphase", "0", CVAR_ARCHIVE );
+	sv_gridCellSize = Cvar_Get ("sv_gridCellSize", "256", CVAR_ARCHIVE );
+	sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE );
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "1", CVAR_ARCHIVE );
 
 	sv_demonotice = Cvar_Get ("sv_demonotice", "Smile! You're on camera!", CVAR_ARCHIVE);
@@ -1046,6 +1057,10 @@ void SV_Init (void) {
 	sv_sayprefix = Cvar_Get ("sv_sayprefix", "console: ", CVAR_ARCHIVE );	
 	sv_tellprefix = Cvar_Get ("sv_tellprefix", "console_tell: ", CVAR_ARCHIVE );
 	sv_demofolder = Cvar_Get ("sv_demofolder", "serverdemos", CVAR_ARCHIVE );
+	sv_demoBuffer = Cvar_Get ("sv_demoBuffer", "128", CVAR_ARCHIVE );
+	sv_demoSync = Cvar_Get ("sv_demoSync", "10", CVAR_ARCHIVE );
+	sv_demoCompress = Cvar_Get ("sv_demoCompress", "0", CVAR_ARCHIVE );
+	sv_demoKeyframe = Cvar_Get ("sv_demoKeyframe", "10", CVAR_ARCHIVE );
 	
     // mod
 	sv_hideCmd = Cvar_Get("hideCmd", "1", CVAR_ARCHIVE);
@@ -1187,6 +1202,7 @@ void SV_Shutdown( char *finalmsg ) {
 
 	// stop server-side demos (if any)
 	Cbuf_ExecuteText(EXEC_NOW, "stopserverdemo all");
+	SVD_ShutdownWriter();
 	
 	if ( svs.clients && !com_errorEntered ) {
 		SV_FinalMessage( finalmsg );
@@ -27,6 +27,7 @@ server_t		sv;					// local server
 vm_t			*gvm = NULL;		// game virtual machine
 
 cvar_t	*sv_fps;					// time rate for running non-clients
+cvar_t	*sv_frameScheduler;			// drift free frame length and usec accurate sleeps
 cvar_t	*sv_timeout;				// seconds without any message
 cvar_t	*sv_zombietime;				// seconds to sink messages after disconnect
 cvar_t	*sv_rconPassword;			// password for remote server commands
@@ -55,6 +56,11 @@ cvar_t	*sv_pure;
 cvar_t	*sv_newpurelist;
 cvar_t	*sv_floodProtect;
 cvar_t	*sv_lanForceRate;			// dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
+cvar_t	*sv_parallelSnapshots;		// build and encode snapshots on the com_jobThreads workers
+cvar_t	*sv_snapshotCache;			// share visibility passes and encoded snapshots between clients
+cvar_t	*sv_broadphase;				// 0 = area node tree, 1 = spatial hash, on the next map load
+cvar_t	*sv_gridCellSize;			// spatial hash cell size
+cvar_t	*sv_traceCache;				// answer repeated game traces within a frame from a cache
 cvar_t	*sv_strictAuth;
 cvar_t	*sv_clientsPerIp;
 
@@ -62,6 +68,10 @@ cvar_t	*sv_demonotice;				// notice to print to a client being recorded server-s
 cvar_t  *sv_tellprefix;
 cvar_t  *sv_sayprefix;
 cvar_t 	*sv_demofolder;				//@Barbatos - the name of the folder that contains server-side demos
+cvar_t	*sv_demoBuffer;				// KB queued per server-side demo for the writer thread
+cvar_t	*sv_demoSync;				// seconds between fsyncs of server-side demos, 0 = never
+cvar_t	*sv_demoCompress;			// write server-side demos as deflated blocks with a seek index
+cvar_t	*sv_demoKeyframe;			// seconds between the keyframes of compressed demos
 
 cvar_t  *sv_hideCmd;
 cvar_t  *sv_hideCmdList;
@@ -1692,6 +1702,111 @@ void SV_GivePlayerHealth(int clId, int h) {
     //Cmd_ExecuteString(cmd);
 }
 
+/*
+==================
+SV_TickStats_f
+
+Histogram of how far apart simulated frames ran compared to the
+frame length sv_fps asks for
+==================
+*/
+static const int tickJitterBounds[TICK_JITTER_BUCKETS - 1] = { 100, 250, 500, 1000, 2000, 5000, 10000 };
+
+void SV_TickStats_f( void ) {
+	tickStats_t	*ts = &svs.tickStats;
+	int			i;
+	double		seconds;
+
+	if ( !ts->frames ) {
+		Com_Printf( "No frames recorded.\n" );
+		return;
+	}
+
+	seconds = ( ts->lastFrame - ts->firstFrame ) / 1000000.0;
+	Com_Printf( "%u frames, %.3f frames/sec (sv_fps %i), max deviation %i usec\n", ts->frames,
+		seconds > 0 ? ts->frames / seconds : 0.0, sv_fps->integer, ts->maxDeviation );
+
+	for ( i = 0 ; i < TICK_JITTER_BUCKETS ; i++ ) {
+		if ( i == TICK_JITTER_BUCKETS - 1 ) {
+			Com_Printf( "     >= %5i usec: ", tickJitterBounds[i - 1] );
+		} else {
+			Com_Printf( "%5i - %5i usec: ", i ? tickJitterBounds[i - 1] : 0, tickJitterBounds[i] );
+		}
+		Com_Printf( "%8u (%5.1f%%)\n", ts->buckets[i], 100.0f * ts->buckets[i] / ts->frames );
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( ts, 0, sizeof( *ts ) );
+	}
+}
+
+/*
+==================
+SV_RecordTick
+==================
+*/
+static void SV_RecordTick( int frameUsec ) {
+	tickStats_t	*ts = &svs.tickStats;
+	int64_t		now;
+	int			deviation;
+	int			i;
+
+	now = Sys_Microseconds();
+
+	if ( !ts->lastFrame ) {
+		// first frame since a map load, nothing to compare with
+		if ( !ts->firstFrame ) {
+			ts->firstFrame = now;
+		}
+		ts->lastFrame = now;
+		return;
+	}
+
+	deviation = (int)( now - ts->lastFrame ) - frameUsec;
+	if ( deviation < 0 ) {
+		deviation = -deviation;
+	}
+	if ( deviation > ts->maxDeviation ) {
+		ts->maxDeviation = deviation;
+	}
+
+	for ( i = 0 ; i < TICK_JITTER_BUCKETS - 1 ; i++ ) {
+		if ( deviation < tickJitterBounds[i] ) {
+			break;
+		}
+	}
+	ts->buckets[i]++;
+	ts->frames++;
+	ts->lastFrame = now;
+}
+
+/*
+==================
+SV_SleepUntilFrame
+
+Sleeps until the absolute time the next frame is due, so the
+wakeups don't pick up the rounding of each relative sleep
+==================
+*/
+static void SV_SleepUntilFrame( int frameMsec, int frameUsec ) {
+	int64_t		now;
+
+	now = Sys_Microseconds();
+
+	// first frame, or the deadline lost track of the frame clock after
+	// a hitch or an sv_fps change
+	if ( !sv.frameDeadline || sv.frameDeadline - now > frameUsec || now - sv.frameDeadline > 1000000 ) {
+		sv.frameDeadline = now + ( frameMsec - sv.timeResidual ) * 1000;
+	}
+
+	if ( sv.frameDeadline > now ) {
+		NET_SleepUntil( sv.frameDeadline );
+	} else {
+		// the millisecond frame clock hasn't caught up with the deadline yet
+		NET_SleepUntil( now + 250 );
+	}
+}
+
 /*
 ==================
 SV_Frame
@@ -1702,7 +1817,9 @@ happen before SV_Frame is called
 */
 void SV_Frame( int msec ) {
 	int		frameMsec;
+	int		frameUsec;
 	int		startTime;
+	int64_t	frameStart, profStart;
 
 	// the menu kills the server with this cvar
 	if ( sv_killserver->integer ) {
@@ -1733,12 +1850,23 @@ void SV_Frame( int msec ) {
 		Cvar_Set( "sv_fps", "10" );
 	}
 
-	frameMsec = 1000 / sv_fps->integer * com_timescale->value;
+	frameUsec = 1000000 / sv_fps->integer * com_timescale->value;
+	if ( sv_frameScheduler->integer ) {
+		// carry the fraction of a millisecond over to the next frame
+		// so sv_fps 30 averages 33.3 msec instead of running at 33
+		frameMsec = ( frameUsec + sv.frameCarry ) / 1000;
+	} else {
+		frameMsec = 1000 / sv_fps->integer * com_timescale->value;
+		sv.frameCarry = 0;
+		sv.frameDeadline = 0;
+	}
 	// don't let it scale below 1ms
 	if(frameMsec < 1)
 	{
 		Cvar_Set("timescale", va("%f", sv_fps->integer / 1000.0f));
 		frameMsec = 1;
+		frameUsec = 1000;
+		sv.frameCarry = 0;
 	}
 
 	sv.timeResidual += msec;
@@ -1748,7 +1876,11 @@ void SV_Frame( int msec ) {
 	if ( com_dedicated->integer && sv.timeResidual < frameMsec ) {
 		// NET_Sleep will give the OS time slices until either get a packet
 		// or time enough for a server frame has gone by
-		NET_Sleep(frameMsec - sv.timeResidual);
+		if ( sv_frameScheduler->integer ) {
+			SV_SleepUntilFrame( frameMsec, frameUsec );
+		} else {
+			NET_Sleep(frameMsec - sv.timeResidual);
+		}
 		return;
 	}
 
@@ -1790,26 +1922,40 @@ void SV_Frame( int msec ) {
 		startTime = 0;	// quite a compiler warning
 	}
 
+	frameStart = Com_ProfileStart();
+
 	// update ping based on the all received frames
 	SV_CalcPings();
 
 	if (com_dedicated->integer) SV_BotFrame (sv.time);
 
+	SV_RecordTick( frameUsec );
+
 	// run the game simulation in chunks
 	while ( sv.timeResidual >= frameMsec ) {
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
 		sv.time += frameMsec;
 
+		if ( sv_frameScheduler->integer ) {
+			sv.frameCarry = ( frameUsec + sv.frameCarry ) % 1000;
+			sv.frameDeadline += frameUsec;
+			frameMsec = ( frameUsec + sv.frameCarry ) / 1000;
+		}
+
 		// let everything in the world think and move
+		profStart = Com_ProfileStart();
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
+		Com_ProfileStop( PROF_GAME, profStart );
 	}
 
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
     if (sv_mod->integer > 0){
+        profStart = Com_ProfileStart();
         SV_ModPlayers();
+        Com_ProfileStop( PROF_MODPLAYERS, profStart );
     }
     
     SV_FreshWeapons();
@@ -1823,8 +1969,12 @@ void SV_Frame( int msec ) {
 	// send messages back to the clients
 	SV_SendClientMessages();
 
+	SVD_WriterFrame();
+
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat();
+
+	Com_ProfileStop( PROF_SERVER, frameStart );
 }
 
 //============================================================================
@@ -116,17 +116,16 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the frame the next snapshot is delta compressed from, NULL for
+a full snapshot.  Also keeps the server side demo bookkeeping, so it
+has to run on the main thread.
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
+static clientSnapshot_t *SV_SnapshotDeltaFrame( client_t *client, int *deltaFrame ) {
+	clientSnapshot_t	*oldframe;
 	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
@@ -151,6 +150,10 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 			client->demo_backoff *= 2;
 		}
 		client->demo_deltas = client->demo_backoff;
+	} else if (client->demo_recording && !client->demo_waiting && SVD_KeyframeDue(client)) {
+		// a compressed demo wants a full frame to seek to
+		oldframe = NULL;
+		lastframe = 0;
 	} else {
 		// count down delta frames to know when we need to send the next full frame
 		if (client->demo_recording) {
@@ -175,7 +178,20 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 		client->demo_waiting = qfalse;
 		Com_DPrintf("Got non-delta frame, recording %s now\n", client->name);
 	}
-	
+	client->demo_fullframe = (client->demo_recording && !oldframe);
+
+	*deltaFrame = lastframe;
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshotHeader
+==================
+*/
+static void SV_WriteSnapshotHeader( client_t *client, msg_t *msg, int lastframe ) {
+	int					snapFlags;
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -208,7 +224,18 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	}
 
 	MSG_WriteByte (msg, snapFlags);
+}
 
+/*
+==================
+SV_EncodeSnapshotDelta
+
+The part of a snapshot that only depends on the two frames.  Only
+writes to the message and reads the frames, so snapshots for different
+clients can be encoded in parallel.
+==================
+*/
+static void SV_EncodeSnapshotDelta( msg_t *msg, clientSnapshot_t *oldframe, clientSnapshot_t *frame ) {
 	// send over the areabits
 	MSG_WriteByte (msg, frame->areabytes);
 	MSG_WriteData (msg, frame->areabits, frame->areabytes);
@@ -222,6 +249,15 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 
 	// delta encode the entities
 	SV_EmitPacketEntities (oldframe, frame, msg);
+}
+
+/*
+==================
+SV_WriteSnapshotPadding
+==================
+*/
+static void SV_WriteSnapshotPadding( msg_t *msg ) {
+	int		i;
 
 	// padding for rate debugging
 	if ( sv_padPackets->integer ) {
@@ -231,6 +267,126 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	}
 }
 
+/*
+=============================================================================
+
+Shared snapshots
+
+While SV_SendClientMessages runs, clients that see exactly the same
+entities get one copy of them in svs.snapshotEntities, so frames with
+the same range hold the same entities.  Spectators following the same
+player then have the same areabits, playerstate and range, and when
+they also delta from identical frames their encoded deltas are the same
+bits.  Those are encoded once and copied into the other messages.
+
+=============================================================================
+*/
+
+#define	SHARED_DELTA_BYTES	(MAX_MSGLEN*4)
+
+typedef struct {
+	clientSnapshot_t	*oldframe;
+	clientSnapshot_t	*frame;
+	int					startBit;		// into snapshotShare.deltaBuf
+	int					numBits;
+} sharedDelta_t;
+
+static struct {
+	qboolean			active;
+	int					numFrames;
+	clientSnapshot_t	*frames[MAX_CLIENTS];		// stored this frame
+	int					numDeltas;
+	sharedDelta_t		deltas[MAX_CLIENTS];
+	msg_t				deltaMsg;
+	byte				deltaBuf[SHARED_DELTA_BYTES];
+} snapshotShare;
+
+/*
+==================
+SV_SameSnapshotDelta
+==================
+*/
+static qboolean SV_SameSnapshotDelta( clientSnapshot_t *oldA, clientSnapshot_t *a, clientSnapshot_t *oldB, clientSnapshot_t *b ) {
+	if ( a->first_entity != b->first_entity || a->num_entities != b->num_entities ) {
+		return qfalse;
+	}
+	if ( a->areabytes != b->areabytes || memcmp( a->areabits, b->areabits, a->areabytes ) ) {
+		return qfalse;
+	}
+	if ( !oldA || !oldB ) {
+		if ( oldA != oldB ) {
+			return qfalse;
+		}
+	} else {
+		if ( oldA->first_entity != oldB->first_entity || oldA->num_entities != oldB->num_entities ) {
+			return qfalse;
+		}
+		if ( memcmp( &oldA->ps, &oldB->ps, sizeof( oldA->ps ) ) ) {
+			return qfalse;
+		}
+	}
+
+	return !memcmp( &a->ps, &b->ps, sizeof( a->ps ) );
+}
+
+/*
+==================
+SV_WriteSnapshotDelta
+
+Main thread only
+==================
+*/
+static void SV_WriteSnapshotDelta( msg_t *msg, clientSnapshot_t *oldframe, clientSnapshot_t *frame ) {
+	sharedDelta_t	*delta;
+	int				i;
+	int				startBit;
+
+	if ( snapshotShare.active ) {
+		for ( i = 0, delta = snapshotShare.deltas ; i < snapshotShare.numDeltas ; i++, delta++ ) {
+			if ( SV_SameSnapshotDelta( delta->oldframe, delta->frame, oldframe, frame ) ) {
+				MSG_WriteEncodedBits( msg, snapshotShare.deltaBuf, delta->startBit, delta->numBits );
+				svs.snapshotCacheStats.deltasShared++;
+				return;
+			}
+		}
+	}
+
+	startBit = msg->bit;
+	SV_EncodeSnapshotDelta( msg, oldframe, frame );
+	svs.snapshotCacheStats.deltasEncoded++;
+
+	// keep a copy for the next client, the message itself gets
+	// scrambled by the netchan once it's sent
+	if ( !snapshotShare.active || msg->overflowed || snapshotShare.numDeltas == MAX_CLIENTS ) {
+		return;
+	}
+
+	delta = &snapshotShare.deltas[snapshotShare.numDeltas];
+	delta->oldframe = oldframe;
+	delta->frame = frame;
+	delta->startBit = snapshotShare.deltaMsg.bit;
+	delta->numBits = msg->bit - startBit;
+
+	MSG_WriteEncodedBits( &snapshotShare.deltaMsg, msg->data, startBit, delta->numBits );
+	if ( !snapshotShare.deltaMsg.overflowed ) {
+		snapshotShare.numDeltas++;
+	}
+}
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe ) {
+	SV_WriteSnapshotHeader( client, msg, lastframe );
+
+	// areabits, playerstate and entities
+	SV_WriteSnapshotDelta( msg, oldframe, &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ] );
+
+	SV_WriteSnapshotPadding( msg );
+}
+
 
 /*
 ==================
@@ -263,6 +419,11 @@ Build a client snapshot structure
 typedef struct {
 	int		numSnapshotEntities;
 	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];	
+	byte	added[MAX_GENTITIES/8];		// to prevent double adding from portal views
+	qboolean	gathered;				// qfalse if there was no entity to build it for
+	const char	*error;					// raised by SV_StoreClientSnapshot on the main thread
+	int		cacheLookups;				// counted into svs.snapshotCacheStats on the main thread
+	int		cacheBypassed;
 } snapshotEntityNumbers_t;
 
 /*
@@ -276,8 +437,9 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 	ea = (int *)a;
 	eb = (int *)b;
 
+	// duplicates are looked for after the sort, this can run on a job thread
 	if ( *ea == *eb ) {
-		Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
+		return 0;
 	}
 
 	if ( *ea < *eb ) {
@@ -293,22 +455,348 @@ static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+	int		num = gEnt->s.number;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( eNums->added[num >> 3] & (1 << (num & 7)) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[num >> 3] |= 1 << (num & 7);
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
 		return;
 	}
 
-	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = gEnt->s.number;
+	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = num;
 	eNums->numSnapshotEntities++;
 }
 
+/*
+===============
+SV_SkipEntityForClient
+
+The checks on an entity that depend on who the snapshot is for
+===============
+*/
+static qboolean SV_SkipEntityForClient( sharedEntity_t *ent, clientSnapshot_t *frame, snapshotEntityNumbers_t *eNums ) {
+	int		e = ent->s.number;
+
+	// entities can be flagged to be sent to only one client
+	if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
+		if ( ent->r.singleClient != frame->ps.clientNum ) {
+			return qtrue;
+		}
+	}
+	// entities can be flagged to be sent to everyone but one client
+	if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
+		if ( ent->r.singleClient == frame->ps.clientNum ) {
+			return qtrue;
+		}
+	}
+	// entities can be flagged to be sent to a given mask of clients
+	if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+		if (frame->ps.clientNum >= 32) {
+			eNums->error = "SVF_CLIENTMASK: clientNum > 32\n";
+			return qtrue;
+		}
+		if (~ent->r.singleClient & (1 << frame->ps.clientNum))
+			return qtrue;
+	}
+
+	// don't double add an entity through portals
+	if ( eNums->added[e >> 3] & (1 << (e & 7)) ) {
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+/*
+===============
+SV_EntityInPVS
+===============
+*/
+static qboolean SV_EntityInPVS( svEntity_t *svEnt, int clientarea, byte *clientpvs ) {
+	int		i, l;
+	byte	*bitvector;
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			return qfalse;		// blocked by a door
+		}
+	}
+
+	bitvector = clientpvs;
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			break;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			for ( ; l <= svEnt->lastCluster ; l++ ) {
+				if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+					break;
+				}
+			}
+			if ( l == svEnt->lastCluster ) {
+				return qfalse;	// not visible
+			}
+		} else {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=============================================================================
+
+Visibility cache
+
+Which entities pass the linked, SVF_NOCLIENT, area and PVS tests only
+depends on the cluster and area of the viewpoint.  While
+SV_SendClientMessages runs, the entities passing them are listed once
+per (cluster, area) and the list is shared by every viewpoint in it.
+The per client flags, portals and double add checks are still done for
+each viewpoint in entity order, so the snapshots are the same as
+without the cache.
+
+=============================================================================
+*/
+
+#define	MAX_VIS_LISTS		64
+
+typedef struct {
+	int			cluster;
+	int			area;
+	qboolean	clientMask;				// a SVF_CLIENTMASK entity was seen anywhere
+	int			numEntities;
+	short		entities[MAX_GENTITIES];
+} visList_t;
+
+static struct {
+	qboolean	active;					// lists are only valid inside SV_SendClientMessages
+	qboolean	readOnly;				// job threads are gathering, no new lists
+	int			numLists;
+	visList_t	lists[MAX_VIS_LISTS];
+} visCache;
+
+/*
+===============
+SV_FindVisList
+
+Returns NULL if the list doesn't exist and can't be built right now
+===============
+*/
+static visList_t *SV_FindVisList( int cluster, int area ) {
+	visList_t		*list;
+	sharedEntity_t	*ent;
+	byte			*clientpvs;
+	int				e, i;
+
+	for ( i = 0, list = visCache.lists ; i < visCache.numLists ; i++, list++ ) {
+		if ( list->cluster == cluster && list->area == area ) {
+			return list;
+		}
+	}
+
+	if ( visCache.readOnly || visCache.numLists == MAX_VIS_LISTS ) {
+		return NULL;
+	}
+
+	list = &visCache.lists[visCache.numLists++];
+	list->cluster = cluster;
+	list->area = area;
+	list->clientMask = qfalse;
+	list->numEntities = 0;
+
+	clientpvs = CM_ClusterPVS( cluster );
+
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum(e);
+
+		// never send entities that aren't linked in
+		if ( !ent->r.linked ) {
+			continue;
+		}
+
+		// entities can be flagged to explicitly not be sent to the client
+		if ( ent->r.svFlags & SVF_NOCLIENT ) {
+			continue;
+		}
+
+		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+			list->clientMask = qtrue;
+		}
+
+		// broadcast entities are always sent
+		if ( !(ent->r.svFlags & SVF_BROADCAST) && !SV_EntityInPVS( SV_SvEntityForGentity( ent ), area, clientpvs ) ) {
+			continue;
+		}
+
+		list->entities[list->numEntities++] = e;
+	}
+
+	svs.snapshotCacheStats.builds++;
+
+	return list;
+}
+
+/*
+===============
+SV_PrimeVisCache
+
+Builds the list for a client's eye before the job threads run
+===============
+*/
+static void SV_PrimeVisCache( client_t *client ) {
+	playerState_t	*ps;
+	vec3_t			org;
+	int				leafnum;
+
+	if ( !client->gentity || client->state == CS_ZOMBIE ) {
+		return;
+	}
+
+	ps = SV_GameClientNum( client - svs.clients );
+	VectorCopy( ps->origin, org );
+	org[2] += ps->viewheight;
+
+	leafnum = CM_PointLeafnum( org );
+	SV_FindVisList( CM_LeafCluster( leafnum ), CM_LeafArea( leafnum ) );
+}
+
+/*
+===============
+SV_BeginVisCache
+===============
+*/
+static void SV_BeginVisCache( void ) {
+	sharedEntity_t	*ent;
+	int				e;
+
+	visCache.active = sv_snapshotCache->integer && sv.state;
+	visCache.readOnly = qfalse;
+	visCache.numLists = 0;
+
+	if ( !sv.state ) {
+		return;
+	}
+
+	if ( visCache.active ) {
+		svs.snapshotCacheStats.frames++;
+	}
+
+	// the visibility pass fixes up bad entity numbers with a developer
+	// print, do it once here so neither the lists nor the job threads
+	// have to
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum( e );
+		if ( ent->r.linked && ent->s.number != e ) {
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+	}
+}
+
+/*
+===============
+SV_SnapshotCacheStats_f
+===============
+*/
+void SV_SnapshotCacheStats_f( void ) {
+	snapshotCacheStats_t	*st = &svs.snapshotCacheStats;
+	unsigned int			shared;
+
+	if ( !st->lookups ) {
+		Com_Printf( "No snapshots built with sv_snapshotCache.\n" );
+		return;
+	}
+
+	shared = st->lookups - st->builds - st->bypassed;
+
+	Com_Printf( "%u frames, %u viewpoints (%.1f per frame)\n", st->frames, st->lookups,
+		st->frames ? (float)st->lookups / st->frames : 0.0f );
+	Com_Printf( "%u lists built, %u viewpoints bypassed the cache\n", st->builds, st->bypassed );
+	Com_Printf( "hit rate %.1f%%\n", 100.0f * shared / st->lookups );
+	Com_Printf( "%u snapshot deltas encoded, %u copied from an identical one\n", st->deltasEncoded, st->deltasShared );
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( st, 0, sizeof( *st ) );
+	}
+}
+
+static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
+									snapshotEntityNumbers_t *eNums, qboolean portal );
+
+/*
+===============
+SV_AddPortalView
+===============
+*/
+static void SV_AddPortalView( sharedEntity_t *ent, vec3_t origin, clientSnapshot_t *frame, snapshotEntityNumbers_t *eNums ) {
+	if ( ent->s.generic1 ) {
+		vec3_t dir;
+		VectorSubtract(ent->s.origin, origin, dir);
+		if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
+			return;
+		}
+	}
+	SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
+}
+
+/*
+===============
+SV_AddVisListEntities
+===============
+*/
+static void SV_AddVisListEntities( visList_t *list, vec3_t origin, clientSnapshot_t *frame,
+									snapshotEntityNumbers_t *eNums ) {
+	sharedEntity_t	*ent;
+	int				i;
+
+	if ( list->clientMask && frame->ps.clientNum >= 32 ) {
+		eNums->error = "SVF_CLIENTMASK: clientNum > 32\n";
+		return;
+	}
+
+	for ( i = 0 ; i < list->numEntities ; i++ ) {
+		ent = SV_GentityNum( list->entities[i] );
+
+		if ( SV_SkipEntityForClient( ent, frame, eNums ) ) {
+			continue;
+		}
+
+		SV_AddEntToSnapshot( ent, eNums );
+
+		// if its a portal entity, add everything visible from its camera position
+		if ( (ent->r.svFlags & (SVF_PORTAL|SVF_BROADCAST)) == SVF_PORTAL ) {
+			SV_AddPortalView( ent, origin, frame, eNums );
+			if ( eNums->error ) {
+				return;
+			}
+		}
+	}
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -316,14 +804,13 @@ SV_AddEntitiesVisibleFromPoint
 */
 static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
 									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		        e, i;
+	int		        e;
 	sharedEntity_t  *ent;
 	svEntity_t	    *svEnt;
-	int		        l;
 	int		        clientarea, clientcluster;
 	int		        leafnum;
 	byte	        *clientpvs;
-	byte	        *bitvector;
+	visList_t		*list;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -339,6 +826,16 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	// calculate the visible areas
 	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
 
+	if ( visCache.active ) {
+		eNums->cacheLookups++;
+		list = SV_FindVisList( clientcluster, clientarea );
+		if ( list ) {
+			SV_AddVisListEntities( list, origin, frame, eNums );
+			return;
+		}
+		eNums->cacheBypassed++;
+	}
+
 	clientpvs = CM_ClusterPVS (clientcluster);
 
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
@@ -359,93 +856,34 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
-		// entities can be flagged to be sent to only one client
-		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
-			if ( ent->r.singleClient != frame->ps.clientNum ) {
-				continue;
+		if ( SV_SkipEntityForClient( ent, frame, eNums ) ) {
+			if ( eNums->error ) {
+				return;
 			}
-		}
-		// entities can be flagged to be sent to everyone but one client
-		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
-			if ( ent->r.singleClient == frame->ps.clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to a given mask of clients
-		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum > 32\n" );
-			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
-				continue;
+			continue;
 		}
 
 		svEnt = SV_SvEntityForGentity( ent );
 
-		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
-		}
-
 		// broadcast entities are always sent
 		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( ent, eNums );
 			continue;
 		}
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
-			}
-		}
-
-		bitvector = clientpvs;
-
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
+		if ( !SV_EntityInPVS( svEnt, clientarea, clientpvs ) ) {
 			continue;
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
-		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
-				continue;
-			}
-		}
 
 		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+		SV_AddEntToSnapshot( ent, eNums );
 
 		// if its a portal entity, add everything visible from its camera position
 		if ( ent->r.svFlags & SVF_PORTAL ) {
-			if ( ent->s.generic1 ) {
-				vec3_t dir;
-				VectorSubtract(ent->s.origin, origin, dir);
-				if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
-					continue;
-				}
+			SV_AddPortalView( ent, origin, frame, eNums );
+			if ( eNums->error ) {
+				return;
 			}
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
 		}
 
 	}
@@ -453,7 +891,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_GatherClientSnapshot
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -461,29 +899,30 @@ copies off the playerstate and areabits.
 This properly handles multiple recursive portals, but the render
 currently doesn't.
 
+Only reads the world and writes to the client's own frame, so it
+can run on a job thread.  Errors are left in eNums->error.
+
 For viewing through other player's eyes, clent can be something other than client->gentity
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static void SV_GatherClientSnapshot( client_t *client, snapshotEntityNumbers_t *eNums ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	eNums->numSnapshotEntities = 0;
+	eNums->gathered = qfalse;
+	eNums->error = NULL;
+	eNums->cacheLookups = 0;
+	eNums->cacheBypassed = 0;
+	Com_Memset( eNums->added, 0, sizeof( eNums->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -502,11 +941,10 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		eNums->error = "SV_SvEntityForGentity: bad gEnt";
+		return;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
-
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[clientNum >> 3] |= 1 << (clientNum & 7);
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -514,14 +952,23 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, eNums, qfalse );
+	if ( eNums->error ) {
+		return;
+	}
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities, 
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	qsort( eNums->snapshotEntities, eNums->numSnapshotEntities, 
+		sizeof( eNums->snapshotEntities[0] ), SV_QsortEntityNumbers );
+	for ( i = 1 ; i < eNums->numSnapshotEntities ; i++ ) {
+		if ( eNums->snapshotEntities[i] == eNums->snapshotEntities[i - 1] ) {
+			eNums->error = "SV_QsortEntityStates: duplicated entity";
+			return;
+		}
+	}
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
@@ -529,11 +976,82 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
 
+	eNums->gathered = qtrue;
+}
+
+/*
+=============
+SV_ShareSnapshotEntities
+
+Points the frame at the entity states of a frame stored earlier in
+this SV_SendClientMessages if it has the same entities
+=============
+*/
+static qboolean SV_ShareSnapshotEntities( clientSnapshot_t *frame, snapshotEntityNumbers_t *eNums ) {
+	clientSnapshot_t	*other;
+	int					i, j;
+
+	if ( !snapshotShare.active ) {
+		return qfalse;
+	}
+
+	for ( i = 0 ; i < snapshotShare.numFrames ; i++ ) {
+		other = snapshotShare.frames[i];
+		if ( other->num_entities != eNums->numSnapshotEntities ) {
+			continue;
+		}
+		for ( j = 0 ; j < eNums->numSnapshotEntities ; j++ ) {
+			if ( svs.snapshotEntities[(other->first_entity + j) % svs.numSnapshotEntities].number != eNums->snapshotEntities[j] ) {
+				break;
+			}
+		}
+		if ( j == eNums->numSnapshotEntities ) {
+			frame->first_entity = other->first_entity;
+			frame->num_entities = other->num_entities;
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+/*
+=============
+SV_StoreClientSnapshot
+
+Copies the entity states picked by SV_GatherClientSnapshot out to
+svs.snapshotEntities.  Main thread only, the ring is shared by all clients.
+=============
+*/
+static void SV_StoreClientSnapshot( client_t *client, snapshotEntityNumbers_t *eNums ) {
+	clientSnapshot_t			*frame;
+	int							i;
+	sharedEntity_t				*ent;
+	entityState_t				*state;
+
+	svs.snapshotCacheStats.lookups += eNums->cacheLookups;
+	svs.snapshotCacheStats.bypassed += eNums->cacheBypassed;
+
+	if ( eNums->error ) {
+		Com_Error( ERR_DROP, "%s", eNums->error );
+	}
+
+	if ( !eNums->gathered ) {
+		return;
+	}
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	// reuse the states another client already got this frame
+	if ( SV_ShareSnapshotEntities( frame, eNums ) ) {
+		return;
+	}
+
 	// copy the entity states out
 	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
+	for ( i = 0 ; i < eNums->numSnapshotEntities ; i++ ) {
+		ent = SV_GentityNum(eNums->snapshotEntities[i]);
 		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
 		*state = ent->s;
 		svs.nextSnapshotEntities++;
@@ -543,6 +1061,22 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		}
 		frame->num_entities++;
 	}
+
+	if ( snapshotShare.active ) {
+		snapshotShare.frames[snapshotShare.numFrames++] = frame;
+	}
+}
+
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client ) {
+	snapshotEntityNumbers_t		entityNumbers;
+
+	SV_GatherClientSnapshot( client, &entityNumbers );
+	SV_StoreClientSnapshot( client, &entityNumbers );
 }
 
 
@@ -641,6 +1175,55 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client ) {
 }
 
 
+/*
+=======================
+SV_WriteSnapshotPreamble
+
+Safe to run on a job thread
+=======================
+*/
+static void SV_WriteSnapshotPreamble( client_t *client, msg_t *msg ) {
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong( msg, client->lastClientCommand );
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient( client, msg );
+}
+
+/*
+=======================
+SV_WriteSnapshotMessage
+
+Everything that goes into a snapshot message besides the download data
+=======================
+*/
+static void SV_WriteSnapshotMessage( client_t *client, msg_t *msg, clientSnapshot_t *oldframe, int lastframe ) {
+	SV_WriteSnapshotPreamble( client, msg );
+
+	// send over all the relevant entityState_t
+	// and the playerState_t
+	SV_WriteSnapshotToClient( client, msg, oldframe, lastframe );
+}
+
+/*
+=======================
+SV_FinishSnapshotMessage
+=======================
+*/
+static void SV_FinishSnapshotMessage( client_t *client, msg_t *msg ) {
+	// Add any download data if the client is downloading
+	SV_WriteDownloadToClient( client, msg );
+
+	// check for overflow
+	if ( msg->overflowed ) {
+		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+		MSG_Clear (msg);
+	}
+
+	SV_SendMessageToClient( msg, client );
+}
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -650,11 +1233,16 @@ Also called by SV_FinalMessage
 =======================
 */
 void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[MAX_MSGLEN];
-	msg_t		msg;
+	byte				msg_buf[MAX_MSGLEN];
+	msg_t				msg;
+	clientSnapshot_t	*oldframe;
+	int					lastframe;
+	int64_t				profStart;
 
 	// build the snapshot
+	profStart = Com_ProfileStart();
 	SV_BuildClientSnapshot( client );
+	Com_ProfileStop( PROF_SNAPBUILD, profStart );
 
 	// bots need to have their snapshots build, but
 	// the query them directly without needing to be sent
@@ -665,27 +1253,210 @@ void SV_SendClientSnapshot( client_t *client ) {
 	MSG_Init (&msg, msg_buf, sizeof(msg_buf));
 	msg.allowoverflow = qtrue;
 
-	// NOTE, MRE: all server->client messages now acknowledge
-	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	profStart = Com_ProfileStart();
+	oldframe = SV_SnapshotDeltaFrame( client, &lastframe );
+	SV_WriteSnapshotMessage( client, &msg, oldframe, lastframe );
+	Com_ProfileStop( PROF_SNAPENCODE, profStart );
 
-	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	profStart = Com_ProfileStart();
+	SV_FinishSnapshotMessage( client, &msg );
+	Com_ProfileStop( PROF_SEND, profStart );
+}
 
-	// send over all the relevant entityState_t
-	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+/*
+=============================================================================
 
-	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+Parallel snapshots
 
-	// check for overflow
-	if ( msg.overflowed ) {
-		Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		MSG_Clear (&msg);
+With sv_parallelSnapshots and com_jobThreads set, the visibility pass
+and the delta encoding of all snapshots due this frame run on the job
+threads.  Jobs with the same delta as an earlier one only write their
+header there and get the delta copied in afterwards.  Copying entity
+states into svs.snapshotEntities, picking the delta frame, download
+data and the transmission stay on the main thread and happen in
+client order, so each client gets the message the serial path would
+send it.  The order on the wire is not the same: fragments owed to
+some clients go out before any of this frame's snapshots.
+
+=============================================================================
+*/
+
+typedef struct snapshotJob_s {
+	client_t				*client;
+	qboolean				bot;
+	clientSnapshot_t		*oldframe;
+	clientSnapshot_t		*frame;
+	int						lastframe;
+	struct snapshotJob_s	*source;		// encodes the same delta, copied from it
+	int						deltaStart;		// bits of msg holding the delta
+	int						deltaEnd;
+	msg_t					msg;
+	byte					msgBuf[MAX_MSGLEN];
+	snapshotEntityNumbers_t	entities;
+	const char				*error;			// raised on the main thread after the jobs
+} snapshotJob_t;
+
+static snapshotJob_t	snapshotJobs[MAX_CLIENTS];
+
+/*
+=======================
+SV_GatherSnapshotJob
+=======================
+*/
+static void SV_GatherSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t	*job = &((snapshotJob_t *)data)[index];
+
+	SV_GatherClientSnapshot( job->client, &job->entities );
+}
+
+/*
+=======================
+SV_EncodeSnapshotJob
+=======================
+*/
+static void SV_EncodeSnapshotJob( void *data, int index, int thread ) {
+	snapshotJob_t	*job = &((snapshotJob_t *)data)[index];
+	entityState_t	*state;
+	int				i;
+
+	if ( job->bot ) {
+		return;
+	}
+
+	// MSG_WriteDeltaEntity would Com_Error on these, that can't be
+	// done from a job thread
+	for ( i = 0 ; i < job->frame->num_entities ; i++ ) {
+		state = &svs.snapshotEntities[(job->frame->first_entity + i) % svs.numSnapshotEntities];
+		if ( state->number < 0 || state->number >= MAX_GENTITIES ) {
+			job->error = "MSG_WriteDeltaEntity: Bad entity number";
+			return;
+		}
+	}
+
+	SV_WriteSnapshotPreamble( job->client, &job->msg );
+	SV_WriteSnapshotHeader( job->client, &job->msg, job->lastframe );
+
+	// copied in from the source once all of them are done
+	if ( job->source ) {
+		return;
+	}
+
+	job->deltaStart = job->msg.bit;
+	SV_EncodeSnapshotDelta( &job->msg, job->oldframe, job->frame );
+	job->deltaEnd = job->msg.bit;
+
+	SV_WriteSnapshotPadding( &job->msg );
+}
+
+/*
+=======================
+SV_FindSourceJob
+
+An earlier job encoding the same delta
+=======================
+*/
+static snapshotJob_t *SV_FindSourceJob( snapshotJob_t *jobs, snapshotJob_t *job ) {
+	snapshotJob_t	*other;
+
+	if ( !snapshotShare.active ) {
+		return NULL;
+	}
+
+	for ( other = jobs ; other < job ; other++ ) {
+		if ( other->bot || other->source ) {
+			continue;
+		}
+		if ( SV_SameSnapshotDelta( other->oldframe, other->frame, job->oldframe, job->frame ) ) {
+			return other;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+=======================
+SV_SendParallelSnapshots
+=======================
+*/
+static void SV_SendParallelSnapshots( snapshotJob_t *jobs, int numJobs ) {
+	snapshotJob_t	*job;
+	int				i;
+	int64_t			profStart;
+
+	profStart = Com_ProfileStart();
+
+	// the job threads can only read the visibility cache, so build
+	// the lists for everyone's eye up front
+	if ( visCache.active ) {
+		for ( i = 0 ; i < numJobs ; i++ ) {
+			SV_PrimeVisCache( jobs[i].client );
+		}
+	}
+
+	visCache.readOnly = qtrue;
+	Com_ParallelFor( SV_GatherSnapshotJob, jobs, numJobs );
+	visCache.readOnly = qfalse;
+
+	for ( i = 0, job = jobs ; i < numJobs ; i++, job++ ) {
+		SV_StoreClientSnapshot( job->client, &job->entities );
+
+		// bots need to have their snapshots build, but
+		// the query them directly without needing to be sent
+		if ( job->bot ) {
+			continue;
+		}
+
+		MSG_Init( &job->msg, job->msgBuf, sizeof( job->msgBuf ) );
+		job->msg.allowoverflow = qtrue;
+		job->error = NULL;
+		job->oldframe = SV_SnapshotDeltaFrame( job->client, &job->lastframe );
+		job->frame = &job->client->frames[ job->client->netchan.outgoingSequence & PACKET_MASK ];
+		job->source = SV_FindSourceJob( jobs, job );
+	}
+
+	Com_ProfileStop( PROF_SNAPBUILD, profStart );
+	profStart = Com_ProfileStart();
+
+	Com_ParallelFor( SV_EncodeSnapshotJob, jobs, numJobs );
+
+	for ( i = 0, job = jobs ; i < numJobs ; i++, job++ ) {
+		if ( !job->bot && job->error ) {
+			Com_Error( ERR_FATAL, "%s", job->error );
+		}
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	// copy the shared deltas before any message is sent, the netchan
+	// scrambles them in place
+	for ( i = 0, job = jobs ; i < numJobs ; i++, job++ ) {
+		if ( job->bot ) {
+			continue;
+		}
+		if ( !job->source ) {
+			svs.snapshotCacheStats.deltasEncoded++;
+			continue;
+		}
+		if ( job->source->msg.overflowed ) {
+			SV_EncodeSnapshotDelta( &job->msg, job->oldframe, job->frame );
+			svs.snapshotCacheStats.deltasEncoded++;
+		} else {
+			MSG_WriteEncodedBits( &job->msg, job->source->msg.data, job->source->deltaStart,
+				job->source->deltaEnd - job->source->deltaStart );
+			svs.snapshotCacheStats.deltasShared++;
+		}
+		SV_WriteSnapshotPadding( &job->msg );
+	}
+
+	Com_ProfileStop( PROF_SNAPENCODE, profStart );
+	profStart = Com_ProfileStart();
+
+	for ( i = 0, job = jobs ; i < numJobs ; i++, job++ ) {
+		if ( !job->bot ) {
+			SV_FinishSnapshotMessage( job->client, &job->msg );
+		}
+	}
+
+	Com_ProfileStop( PROF_SEND, profStart );
 }
 
 
@@ -697,6 +1468,23 @@ SV_SendClientMessages
 void SV_SendClientMessages( void ) {
 	int			i;
 	client_t	*c;
+	int			numJobs;
+	qboolean	parallel;
+	int64_t		profStart;
+
+	parallel = sv_parallelSnapshots->integer && Com_JobThreadCount() > 0;
+	numJobs = 0;
+
+	SV_BeginVisCache();
+
+	snapshotShare.active = sv_snapshotCache->integer;
+	snapshotShare.numFrames = 0;
+	snapshotShare.numDeltas = 0;
+	MSG_Init( &snapshotShare.deltaMsg, snapshotShare.deltaBuf, sizeof( snapshotShare.deltaBuf ) );
+	snapshotShare.deltaMsg.allowoverflow = qtrue;
+
+	// queue the datagrams and hand them to the kernel together
+	Sys_BeginPacketBatch();
 
 	// send a message to each connected client
 	for (i=0, c = svs.clients ; i < sv_maxclients->integer ; i++, c++) {
@@ -713,13 +1501,33 @@ void SV_SendClientMessages( void ) {
 		if ( c->netchan.unsentFragments ) {
 			c->nextSnapshotTime = svs.time + 
 				SV_RateMsec( c, c->netchan.unsentLength - c->netchan.unsentFragmentStart );
+			profStart = Com_ProfileStart();
 			SV_Netchan_TransmitNextFragment( c );
+			Com_ProfileStop( PROF_SEND, profStart );
+			continue;
+		}
+
+		if ( parallel ) {
+			snapshotJobs[numJobs].client = c;
+			snapshotJobs[numJobs].bot = c->gentity && (c->gentity->r.svFlags & SVF_BOT);
+			numJobs++;
 			continue;
 		}
 
 		// generate and send a new message
 		SV_SendClientSnapshot( c );
 	}
+
+	if ( numJobs ) {
+		SV_SendParallelSnapshots( snapshotJobs, numJobs );
+	}
+
+	visCache.active = qfalse;
+	snapshotShare.active = qfalse;
+
+	profStart = Com_ProfileStart();
+	Sys_FlushPacketBatch();
+	Com_ProfileStop( PROF_SEND, profStart );
 }
 
 
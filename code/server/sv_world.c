@@ -75,27 +75,6 @@ worldSector_t	sv_worldSectors[AREA_NODES];
 int			sv_numworldSectors;
 
 
-/*
-===============
-SV_SectorList_f
-===============
-*/
-void SV_SectorList_f( void ) {
-	int				i, c;
-	worldSector_t	*sec;
-	svEntity_t		*ent;
-
-	for ( i = 0 ; i < AREA_NODES ; i++ ) {
-		sec = &sv_worldSectors[i];
-
-		c = 0;
-		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
-			c++;
-		}
-		Com_Printf( "sector %i: %i entities\n", i, c );
-	}
-}
-
 /*
 ===============
 SV_CreateworldSector
@@ -140,39 +119,41 @@ worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs ) {
 
 /*
 ===============
-SV_ClearWorld
-
+SV_SectorLink
 ===============
 */
-void SV_ClearWorld( void ) {
-	clipHandle_t	h;
-	vec3_t			mins, maxs;
-
-	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
-	sv_numworldSectors = 0;
+static void SV_SectorLink( svEntity_t *ent, sharedEntity_t *gEnt ) {
+	worldSector_t	*node;
 
-	// get world map bounds
-	h = CM_InlineModel( 0 );
-	CM_ModelBounds( h, mins, maxs );
-	SV_CreateworldSector( 0, mins, maxs );
+	// find the first world sector node that the ent's box crosses
+	node = sv_worldSectors;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( gEnt->r.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if ( gEnt->r.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
+	}
+	
+	// link it in
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
 }
 
-
 /*
 ===============
-SV_UnlinkEntity
-
+SV_SectorUnlink
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
+static void SV_SectorUnlink( svEntity_t *ent ) {
 	svEntity_t		*scan;
 	worldSector_t	*ws;
 
-	ent = SV_SvEntityForGentity( gEnt );
-
-	gEnt->r.linked = qfalse;
-
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
@@ -194,6 +175,271 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
 }
 
+/*
+===============================================================================
+
+SPATIAL HASH
+
+With sv_broadphase 1 the world is covered by a uniform grid of
+sv_gridCellSize units on x and y instead.  An entity is linked into
+the hash bucket of every cell its box touches, so nothing piles up at
+the top of a tree just because it straddles a split plane.  Entities
+touching more than MAX_GRID_LINKS cells go into a list every query
+checks.
+
+===============================================================================
+*/
+
+#define	GRID_BUCKETS		4096		// power of two
+#define	MAX_GRID_LINKS		16
+
+typedef struct gridLink_s {
+	struct gridLink_s	*prev, *next;
+	int					bucket;			// -1 for the oversize list
+	int					entityNum;
+} gridLink_t;
+
+typedef struct {
+	int			numLinks;
+	gridLink_t	links[MAX_GRID_LINKS];
+} gridEntity_t;
+
+static int			sv_broadphaseMode;			// sv_broadphase at the last SV_ClearWorld
+static float		sv_gridScale;				// 1 / cell size
+static gridLink_t	*sv_gridBuckets[GRID_BUCKETS];
+static gridLink_t	*sv_gridOversize;
+static gridEntity_t	sv_gridEntities[MAX_GENTITIES];
+static int			sv_gridQuery;				// stamps entities already checked by a query
+static int			sv_gridStamps[MAX_GENTITIES];
+
+#define	GRID_CELL(x)		((int)floor( (x) * sv_gridScale ))
+#define	GRID_HASH(cx,cy)	((((unsigned)(cx) * 73856093u) ^ ((unsigned)(cy) * 19349663u)) & (GRID_BUCKETS-1))
+
+/*
+===============
+SV_GridInsert
+===============
+*/
+static void SV_GridInsert( gridEntity_t *ge, int entityNum, int bucket ) {
+	gridLink_t	*link, **head;
+
+	head = bucket == -1 ? &sv_gridOversize : &sv_gridBuckets[bucket];
+
+	link = &ge->links[ge->numLinks++];
+	link->bucket = bucket;
+	link->entityNum = entityNum;
+	link->prev = NULL;
+	link->next = *head;
+	if ( *head ) {
+		(*head)->prev = link;
+	}
+	*head = link;
+}
+
+/*
+===============
+SV_GridLink
+===============
+*/
+static void SV_GridLink( svEntity_t *ent, sharedEntity_t *gEnt ) {
+	gridEntity_t	*ge;
+	int				entityNum;
+	int				x0, x1, y0, y1, x, y;
+	int				bucket, i;
+
+	entityNum = ent - sv.svEntities;
+	ge = &sv_gridEntities[entityNum];
+
+	x0 = GRID_CELL( gEnt->r.absmin[0] );
+	x1 = GRID_CELL( gEnt->r.absmax[0] );
+	y0 = GRID_CELL( gEnt->r.absmin[1] );
+	y1 = GRID_CELL( gEnt->r.absmax[1] );
+
+	if ( ( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) > MAX_GRID_LINKS ) {
+		SV_GridInsert( ge, entityNum, -1 );
+		return;
+	}
+
+	for ( y = y0 ; y <= y1 ; y++ ) {
+		for ( x = x0 ; x <= x1 ; x++ ) {
+			bucket = GRID_HASH( x, y );
+
+			// cells can share a bucket
+			for ( i = 0 ; i < ge->numLinks ; i++ ) {
+				if ( ge->links[i].bucket == bucket ) {
+					break;
+				}
+			}
+			if ( i == ge->numLinks ) {
+				SV_GridInsert( ge, entityNum, bucket );
+			}
+		}
+	}
+}
+
+/*
+===============
+SV_GridUnlink
+===============
+*/
+static void SV_GridUnlink( svEntity_t *ent ) {
+	gridEntity_t	*ge;
+	gridLink_t		*link;
+	int				i;
+
+	ge = &sv_gridEntities[ent - sv.svEntities];
+
+	for ( i = 0, link = ge->links ; i < ge->numLinks ; i++, link++ ) {
+		if ( link->prev ) {
+			link->prev->next = link->next;
+		} else if ( link->bucket == -1 ) {
+			sv_gridOversize = link->next;
+		} else {
+			sv_gridBuckets[link->bucket] = link->next;
+		}
+		if ( link->next ) {
+			link->next->prev = link->prev;
+		}
+	}
+
+	ge->numLinks = 0;
+}
+
+/*
+===============
+SV_InitBroadphase
+===============
+*/
+static void SV_InitBroadphase( int mode ) {
+	clipHandle_t	h;
+	vec3_t			mins, maxs;
+	float			cellSize;
+
+	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
+	sv_numworldSectors = 0;
+
+	Com_Memset( sv_gridBuckets, 0, sizeof( sv_gridBuckets ) );
+	Com_Memset( sv_gridEntities, 0, sizeof( sv_gridEntities ) );
+	sv_gridOversize = NULL;
+
+	sv_broadphaseMode = mode;
+
+	if ( mode == 1 ) {
+		cellSize = sv_gridCellSize->value;
+		if ( cellSize < 16 ) {
+			cellSize = 16;
+		}
+		sv_gridScale = 1.0f / cellSize;
+		return;
+	}
+
+	// get world map bounds
+	h = CM_InlineModel( 0 );
+	CM_ModelBounds( h, mins, maxs );
+	SV_CreateworldSector( 0, mins, maxs );
+}
+
+/*
+===============
+SV_InBroadphase
+===============
+*/
+static qboolean SV_InBroadphase( svEntity_t *ent ) {
+	if ( sv_broadphaseMode == 1 ) {
+		return sv_gridEntities[ent - sv.svEntities].numLinks != 0;
+	}
+	return ent->worldSector != NULL;
+}
+
+/*
+===============
+SV_SectorList_f
+===============
+*/
+void SV_SectorList_f( void ) {
+	int				i, c, total, max, used, oversize;
+	worldSector_t	*sec;
+	svEntity_t		*ent;
+	gridLink_t		*link;
+
+	if ( sv_broadphaseMode == 1 ) {
+		total = max = used = 0;
+		for ( i = 0 ; i < GRID_BUCKETS ; i++ ) {
+			c = 0;
+			for ( link = sv_gridBuckets[i] ; link ; link = link->next ) {
+				c++;
+			}
+			if ( c ) {
+				used++;
+			}
+			if ( c > max ) {
+				max = c;
+			}
+			total += c;
+		}
+		oversize = 0;
+		for ( link = sv_gridOversize ; link ; link = link->next ) {
+			oversize++;
+		}
+		c = 0;
+		for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+			if ( sv_gridEntities[i].numLinks ) {
+				c++;
+			}
+		}
+		Com_Printf( "spatial hash, %g unit cells, %i buckets\n", 1.0f / sv_gridScale, GRID_BUCKETS );
+		Com_Printf( "%i entities, %i links (%.1f per entity), %i oversize\n", c, total + oversize,
+			c ? (float)( total + oversize ) / c : 0.0f, oversize );
+		Com_Printf( "%i buckets in use, %.1f entities per used bucket, %i at most\n", used,
+			used ? (float)total / used : 0.0f, max );
+		return;
+	}
+
+	for ( i = 0 ; i < AREA_NODES ; i++ ) {
+		sec = &sv_worldSectors[i];
+
+		c = 0;
+		for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
+			c++;
+		}
+		Com_Printf( "sector %i: %i entities\n", i, c );
+	}
+}
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld( void ) {
+	SV_InvalidateTraceCache();
+	SV_InitBroadphase( sv_broadphase->integer == 1 ? 1 : 0 );
+}
+
+
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	SV_InvalidateTraceCache();
+
+	if ( sv_broadphaseMode == 1 ) {
+		SV_GridUnlink( ent );
+	} else {
+		SV_SectorUnlink( ent );
+	}
+}
+
 
 /*
 ===============
@@ -203,7 +449,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -215,7 +460,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
-	if ( ent->worldSector ) {
+	SV_InvalidateTraceCache();
+
+	if ( SV_InBroadphase( ent ) ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
 
@@ -333,24 +580,11 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+	if ( sv_broadphaseMode == 1 ) {
+		SV_GridLink( ent, gEnt );
+	} else {
+		SV_SectorLink( ent, gEnt );
 	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
 
 	gEnt->r.linked = qtrue;
 }
@@ -420,6 +654,88 @@ void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+/*
+====================
+SV_GridAreaEntities_r
+
+Returns qfalse once the list is full
+====================
+*/
+static qboolean SV_GridAreaEntities_r( gridLink_t *link, areaParms_t *ap ) {
+	sharedEntity_t *gcheck;
+
+	for ( ; link ; link = link->next ) {
+		// entities can be in several of the buckets a query looks at
+		if ( sv_gridStamps[link->entityNum] == sv_gridQuery ) {
+			continue;
+		}
+		sv_gridStamps[link->entityNum] = sv_gridQuery;
+
+		gcheck = SV_GEntityForSvEntity( sv.svEntities + link->entityNum );
+
+		if ( gcheck->r.absmin[0] > ap->maxs[0]
+		|| gcheck->r.absmin[1] > ap->maxs[1]
+		|| gcheck->r.absmin[2] > ap->maxs[2]
+		|| gcheck->r.absmax[0] < ap->mins[0]
+		|| gcheck->r.absmax[1] < ap->mins[1]
+		|| gcheck->r.absmax[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( ap->count == ap->maxcount ) {
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			return qfalse;
+		}
+
+		ap->list[ap->count] = link->entityNum;
+		ap->count++;
+	}
+
+	return qtrue;
+}
+
+/*
+====================
+SV_GridAreaEntities
+====================
+*/
+static void SV_GridAreaEntities( areaParms_t *ap ) {
+	int		x0, x1, y0, y1, x, y;
+	int		i;
+
+	if ( ++sv_gridQuery == 0 ) {
+		Com_Memset( sv_gridStamps, 0, sizeof( sv_gridStamps ) );
+		sv_gridQuery = 1;
+	}
+
+	if ( !SV_GridAreaEntities_r( sv_gridOversize, ap ) ) {
+		return;
+	}
+
+	x0 = GRID_CELL( ap->mins[0] );
+	x1 = GRID_CELL( ap->maxs[0] );
+	y0 = GRID_CELL( ap->mins[1] );
+	y1 = GRID_CELL( ap->maxs[1] );
+
+	// a query covering more cells than there are buckets sees all of them
+	if ( (float)( x1 - x0 + 1 ) * ( y1 - y0 + 1 ) >= GRID_BUCKETS ) {
+		for ( i = 0 ; i < GRID_BUCKETS ; i++ ) {
+			if ( !SV_GridAreaEntities_r( sv_gridBuckets[i], ap ) ) {
+				return;
+			}
+		}
+		return;
+	}
+
+	for ( y = y0 ; y <= y1 ; y++ ) {
+		for ( x = x0 ; x <= x1 ; x++ ) {
+			if ( !SV_GridAreaEntities_r( sv_gridBuckets[GRID_HASH( x, y )], ap ) ) {
+				return;
+			}
+		}
+	}
+}
+
 /*
 ================
 SV_AreaEntities
@@ -434,11 +750,139 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_broadphaseMode == 1 ) {
+		SV_GridAreaEntities( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
 
+/*
+============================================================================
+
+BROADPHASE BENCHMARK
+
+"tracebench record <count>" keeps the boxes of the next count SV_Trace
+calls, "tracebench" then runs them through both the area node tree and
+the spatial hash with the entities as they are linked right now, and
+checks they find the same entities.
+
+============================================================================
+*/
+
+#define	MAX_BENCH_TRACES	16384
+
+static vec3_t	sv_benchBoxes[MAX_BENCH_TRACES][2];
+static int		sv_benchCount;
+static int		sv_benchRecord;					// traces still to record
+
+/*
+================
+SV_RelinkBroadphase
+
+Moves all linked entities over to the other structure
+================
+*/
+static void SV_RelinkBroadphase( int mode ) {
+	static byte		relink[MAX_GENTITIES];
+	svEntity_t		*ent;
+	int				i;
+
+	for ( i = 0, ent = sv.svEntities ; i < MAX_GENTITIES ; i++, ent++ ) {
+		relink[i] = SV_InBroadphase( ent );
+		ent->worldSector = NULL;
+		ent->nextEntityInWorldSector = NULL;
+	}
+
+	SV_InitBroadphase( mode );
+
+	for ( i = 0, ent = sv.svEntities ; i < MAX_GENTITIES ; i++, ent++ ) {
+		if ( !relink[i] ) {
+			continue;
+		}
+		if ( mode == 1 ) {
+			SV_GridLink( ent, SV_GentityNum( i ) );
+		} else {
+			SV_SectorLink( ent, SV_GentityNum( i ) );
+		}
+	}
+}
+
+/*
+================
+SV_TraceBench_f
+================
+*/
+void SV_TraceBench_f( void ) {
+	static int	touchlist[MAX_GENTITIES];
+	static unsigned	checks[MAX_BENCH_TRACES];
+	unsigned	check;
+	int			mode, restore, pass, passes, i, j;
+	int			num, found, mismatches;
+	int64_t		start, usec;
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "record" ) ) {
+		sv_benchRecord = atoi( Cmd_Argv( 2 ) );
+		if ( sv_benchRecord <= 0 || sv_benchRecord > MAX_BENCH_TRACES ) {
+			sv_benchRecord = MAX_BENCH_TRACES;
+		}
+		sv_benchCount = 0;
+		Com_Printf( "Recording %i traces.\n", sv_benchRecord );
+		return;
+	}
+
+	if ( !sv_benchCount ) {
+		Com_Printf( "usage: tracebench record <count>, then tracebench once traces are recorded\n" );
+		return;
+	}
+
+	restore = sv_broadphaseMode;
+	passes = 1 + 65536 / sv_benchCount;
+	mismatches = 0;
+
+	for ( mode = 0 ; mode < 2 ; mode++ ) {
+		SV_RelinkBroadphase( mode );
+
+		found = 0;
+		start = Sys_Microseconds();
+		for ( pass = 0 ; pass < passes ; pass++ ) {
+			for ( i = 0 ; i < sv_benchCount ; i++ ) {
+				num = SV_AreaEntities( sv_benchBoxes[i][0], sv_benchBoxes[i][1], touchlist, MAX_GENTITIES );
+				found += num;
+
+				// order doesn't matter, the set does
+				if ( pass == 0 ) {
+					check = num;
+					for ( j = 0 ; j < num ; j++ ) {
+						check += touchlist[j] * 2654435761u;
+					}
+					if ( mode == 0 ) {
+						checks[i] = check;
+					} else if ( checks[i] != check ) {
+						mismatches++;
+					}
+				}
+			}
+		}
+		usec = Sys_Microseconds() - start;
+
+		Com_Printf( "%s: %.3f usec per query, %.1f entities per query\n",
+			mode ? "spatial hash" : "area nodes", (double)usec / ( passes * sv_benchCount ),
+			(float)found / ( passes * sv_benchCount ) );
+	}
+
+	SV_RelinkBroadphase( restore );
+
+	Com_Printf( "%i traces, %i passes, %i mismatches\n", sv_benchCount, passes, mismatches );
+}
+
 
 
 //===========================================================================
@@ -639,6 +1083,13 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 		}
 	}
 
+	if ( sv_benchRecord ) {
+		VectorCopy( clip.boxmins, sv_benchBoxes[sv_benchCount][0] );
+		VectorCopy( clip.boxmaxs, sv_benchBoxes[sv_benchCount][1] );
+		sv_benchCount++;
+		sv_benchRecord--;
+	}
+
 	// clip to other solid entities
 	SV_ClipMoveToEntities ( &clip );
 
@@ -688,3 +1139,241 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 }
 
 
+/*
+============================================================================
+
+TRACE CACHE
+
+With sv_traceCache 1 the traces and point contents the game module asks
+for are remembered until the next entity link or unlink, brush model
+change or server frame, and a request with exactly the same arguments
+gets the stored result back.  Hit scans and movement code often trace
+the same line several times in a row.
+
+Entries are stamped with a generation, so invalidating is just bumping
+it.  The game module is trusted to relink anything it moves, as it
+already has to for the area queries to see it.
+
+============================================================================
+*/
+
+#define	TRACE_CACHE_SIZE	1024			// power of two
+#define	TRACE_CACHE_PROBES	4
+
+typedef enum {
+	TC_TRACE,
+	TC_CAPSULE,
+	TC_CONTENTS
+} traceCacheKind_t;
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			kind;					// traceCacheKind_t
+} traceCacheKey_t;
+
+typedef struct {
+	traceCacheKey_t	key;
+	unsigned int	generation;			// 0 is never current
+	trace_t			trace;
+	int				contents;
+} traceCacheEntry_t;
+
+static traceCacheEntry_t	sv_traceEntries[TRACE_CACHE_SIZE];
+static unsigned int			sv_traceGeneration = 1;
+static qboolean				sv_traceCacheUsed;	// something stored since the last invalidation
+static int					sv_traceCacheTime;	// sv.time the generation belongs to
+
+/*
+================
+SV_InvalidateTraceCache
+
+Called whenever the world the traces ran against changes
+================
+*/
+void SV_InvalidateTraceCache( void ) {
+	if ( !sv_traceCacheUsed ) {
+		return;
+	}
+	sv_traceCacheUsed = qfalse;
+	sv_traceGeneration++;
+	if ( !sv_traceGeneration ) {
+		Com_Memset( sv_traceEntries, 0, sizeof( sv_traceEntries ) );
+		sv_traceGeneration = 1;
+	}
+	svs.traceCacheStats.invalidations++;
+}
+
+/*
+================
+SV_TraceCacheKey
+================
+*/
+static void SV_TraceCacheKey( traceCacheKey_t *key, const vec3_t start, const vec3_t mins, const vec3_t maxs,
+							 const vec3_t end, int passEntityNum, int contentmask, int kind ) {
+	// memset so the key can be hashed and compared as bytes
+	Com_Memset( key, 0, sizeof( *key ) );
+	VectorCopy( start, key->start );
+	VectorCopy( end, key->end );
+	VectorCopy( mins, key->mins );
+	VectorCopy( maxs, key->maxs );
+	key->passEntityNum = passEntityNum;
+	key->contentmask = contentmask;
+	key->kind = kind;
+}
+
+/*
+================
+SV_TraceCacheFind
+
+Returns the entry holding key, or NULL and the slot to store it in
+================
+*/
+static traceCacheEntry_t *SV_TraceCacheFind( const traceCacheKey_t *key, traceCacheEntry_t **slot ) {
+	const byte			*b;
+	traceCacheEntry_t	*entry;
+	unsigned int		hash;
+	int					i;
+
+	if ( sv_traceCacheTime != sv.time ) {
+		sv_traceCacheTime = sv.time;
+		SV_InvalidateTraceCache();
+	}
+
+	svs.traceCacheStats.lookups++;
+
+	// FNV-1a
+	hash = 2166136261u;
+	for ( i = 0, b = (const byte *)key ; i < sizeof( *key ) ; i++ ) {
+		hash = ( hash ^ b[i] ) * 16777619u;
+	}
+
+	*slot = NULL;
+	for ( i = 0 ; i < TRACE_CACHE_PROBES ; i++ ) {
+		entry = &sv_traceEntries[( hash + i ) & ( TRACE_CACHE_SIZE - 1 )];
+		if ( entry->generation != sv_traceGeneration ) {
+			if ( !*slot ) {
+				*slot = entry;
+			}
+			continue;
+		}
+		if ( !memcmp( &entry->key, key, sizeof( *key ) ) ) {
+			svs.traceCacheStats.hits++;
+			return entry;
+		}
+	}
+
+	// all probes current, evict the first one
+	if ( !*slot ) {
+		*slot = &sv_traceEntries[hash & ( TRACE_CACHE_SIZE - 1 )];
+	}
+
+	return NULL;
+}
+
+/*
+================
+SV_TraceCacheStore
+================
+*/
+static void SV_TraceCacheStore( traceCacheEntry_t *slot, const traceCacheKey_t *key, int64_t start ) {
+	slot->key = *key;
+	slot->generation = sv_traceGeneration;
+	sv_traceCacheUsed = qtrue;
+	svs.traceCacheStats.missUsec += Sys_Microseconds() - start;
+}
+
+/*
+==================
+SV_CachedTrace
+
+SV_Trace for the game module
+==================
+*/
+void SV_CachedTrace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	traceCacheKey_t		key;
+	traceCacheEntry_t	*entry, *slot;
+	int64_t				t;
+
+	if ( !sv_traceCache->integer ) {
+		SV_Trace( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+		return;
+	}
+
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	SV_TraceCacheKey( &key, start, mins, maxs, end, passEntityNum, contentmask, capsule ? TC_CAPSULE : TC_TRACE );
+	entry = SV_TraceCacheFind( &key, &slot );
+	if ( entry ) {
+		*results = entry->trace;
+		return;
+	}
+
+	t = Sys_Microseconds();
+	SV_Trace( &slot->trace, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+	*results = slot->trace;
+	SV_TraceCacheStore( slot, &key, t );
+}
+
+/*
+==================
+SV_CachedPointContents
+
+SV_PointContents for the game module
+==================
+*/
+int SV_CachedPointContents( const vec3_t p, int passEntityNum ) {
+	traceCacheKey_t		key;
+	traceCacheEntry_t	*entry, *slot;
+	int64_t				t;
+
+	if ( !sv_traceCache->integer ) {
+		return SV_PointContents( p, passEntityNum );
+	}
+
+	SV_TraceCacheKey( &key, p, vec3_origin, vec3_origin, p, passEntityNum, 0, TC_CONTENTS );
+	entry = SV_TraceCacheFind( &key, &slot );
+	if ( entry ) {
+		return entry->contents;
+	}
+
+	t = Sys_Microseconds();
+	slot->contents = SV_PointContents( p, passEntityNum );
+	SV_TraceCacheStore( slot, &key, t );
+
+	return slot->contents;
+}
+
+/*
+================
+SV_TraceCacheStats_f
+================
+*/
+void SV_TraceCacheStats_f( void ) {
+	traceCacheStats_t	*st = &svs.traceCacheStats;
+	unsigned int		misses;
+	double				perMiss;
+
+	if ( !st->lookups ) {
+		Com_Printf( "No traces looked up with sv_traceCache.\n" );
+		return;
+	}
+
+	misses = st->lookups - st->hits;
+	perMiss = misses ? (double)st->missUsec / misses : 0.0;
+
+	Com_Printf( "%u lookups, %u hits (%.1f%%), %u invalidations\n", st->lookups, st->hits,
+		100.0f * st->hits / st->lookups, st->invalidations );
+	Com_Printf( "%.3f usec per miss, about %.1f msec saved\n", perMiss, perMiss * st->hits / 1000.0 );
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( st, 0, sizeof( *st ) );
+	}
+}
@@ -1076,7 +1076,6 @@ sysEvent_t  eventQue[MAX_QUED_EVENTS];
 // bk000306: initialize
 int   eventHead = 0;
 int             eventTail = 0;
-byte    sys_packetReceived[MAX_MSGLEN];
 
 /*
 ================
@@ -1084,7 +1083,7 @@ Sys_QueEvent
 
 A time of 0 will get the current time
 Ptr should either be null, or point to a block of data that can
-be freed by the game later.
+be freed by the game later with Com_FreeEventPtr.
 ================
 */
 void Sys_QueEvent( int time, sysEventType_t type, int value, int value2, int ptrLength, void *ptr ) {
@@ -1099,7 +1098,7 @@ void Sys_QueEvent( int time, sysEventType_t type, int value, int value2, int ptr
     // we are discarding an event, but don't leak memory
     if ( ev->evPtr )
     {
-      Z_Free( ev->evPtr );
+      Com_FreeEventPtr( ev->evPtr );
     }
     eventTail++;
   }
@@ -1128,8 +1127,8 @@ Sys_GetEvent
 sysEvent_t Sys_GetEvent( void ) {
   sysEvent_t  ev;
   char    *s;
-  msg_t   netmsg;
-  netadr_t  adr;
+  netPacket_t *packet;
+  int     packetLength;
 
   // return if we have data
   if ( eventHead > eventTail )
@@ -1158,19 +1157,11 @@ sysEvent_t Sys_GetEvent( void ) {
   // check for other input devices
   IN_Frame();
 
-  // check for network packets
-  MSG_Init( &netmsg, sys_packetReceived, sizeof( sys_packetReceived ) );
-  if ( Sys_GetPacket ( &adr, &netmsg ) )
+  // check for network packets, the event keeps the packet ring slot
+  packet = Sys_GetPacket( &packetLength );
+  if ( packet )
   {
-    netadr_t    *buf;
-    int       len;
-
-    // copy out to a seperate buffer for qeueing
-    len = sizeof( netadr_t ) + netmsg.cursize;
-    buf = Z_Malloc( len );
-    *buf = adr;
-    memcpy( buf+1, netmsg.data, netmsg.cursize );
-    Sys_QueEvent( 0, SE_PACKET, 0, 0, len, buf );
+    Sys_QueEvent( 0, SE_PACKET, 0, 0, sizeof( netadr_t ) + packetLength, packet );
   }
 
   // return if we have data
@@ -1608,7 +1599,6 @@ int main ( int argc, char* argv[] )
 
   // bk000306 - clear queues
   memset( &eventQue[0], 0, MAX_QUED_EVENTS*sizeof(sysEvent_t) ); 
-  memset( &sys_packetReceived[0], 0, MAX_MSGLEN*sizeof(byte) );
 
   Com_Init(cmdline);
   NET_Init();
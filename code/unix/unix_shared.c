@@ -25,8 +25,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <stdio.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <time.h>
 #include <pwd.h>
 
 #include "../qcommon/q_shared.h"
@@ -77,6 +79,30 @@ int Sys_Milliseconds(void)
 	return curtime;
 }
 
+/*
+================
+Sys_Microseconds
+
+Monotonic clock, NET_SleepUntil arms its timer against it on linux
+================
+*/
+int64_t Sys_Microseconds(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tp;
+
+	gettimeofday(&tp, NULL);
+
+	return (int64_t)tp.tv_sec * 1000000 + tp.tv_usec;
+#endif
+}
+
 #if (defined(__linux__) || defined(__FreeBSD__) || defined(__sun)) && !defined(DEDICATED)
 /*
 ================
@@ -247,6 +273,68 @@ void Sys_ListFilteredFiles( const char *basedir, char *subdirs, char *filter, ch
 	closedir(fdir);
 }
 
+/*
+==================
+Sys_FileStat
+
+The size and modification time of a file, qfalse if it isn't there
+==================
+*/
+qboolean Sys_FileStat( const char *path, int *size, int *mtime )
+{
+	struct stat st;
+
+	if (stat(path, &st) == -1)
+		return qfalse;
+
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return qtrue;
+}
+
+/*
+==================
+Sys_MapFile
+
+Maps a whole file read only, NULL if it can't be.  The mapping is
+private, but pages not read yet still come from the file, so the
+caller has to make sure it hasn't been cut short.
+==================
+*/
+void *Sys_MapFile( const char *path, int *length )
+{
+	struct stat st;
+	void	*base;
+	int		fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == -1 || st.st_size <= 0 || st.st_size > 0x7fffffff) {
+		close(fd);
+		return NULL;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	*length = st.st_size;
+	return base;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *base, int length )
+{
+	munmap(base, length);
+}
+
 // bk001129 - in 1.17 this used to be
 // char **Sys_ListFiles( const char *directory, const char *extension, int *numfiles, qboolean wantsubs )
 char **Sys_ListFiles( const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs )
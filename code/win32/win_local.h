@@ -46,7 +46,7 @@ void	Sys_DestroyConsole( void );
 
 char	*Sys_ConsoleInput (void);
 
-qboolean	Sys_GetPacket ( netadr_t *net_from, msg_t *net_message );
+netPacket_t	*Sys_GetPacket( int *length );
 
 // Input subsystem
 
@@ -356,6 +356,72 @@ static qboolean strgtr(const char *s0, const char *s1) {
 	return qfalse;
 }
 
+/*
+==================
+Sys_FileStat
+
+The size and modification time of a file, qfalse if it isn't there
+==================
+*/
+qboolean Sys_FileStat( const char *path, int *size, int *mtime )
+{
+	struct _stat st;
+
+	if (_stat(path, &st) == -1)
+		return qfalse;
+
+	*size = st.st_size;
+	*mtime = st.st_mtime;
+	return qtrue;
+}
+
+/*
+==================
+Sys_MapFile
+
+Maps a whole file read only, NULL if it can't be
+==================
+*/
+void *Sys_MapFile( const char *path, int *length )
+{
+	HANDLE	file, mapping;
+	DWORD	size, sizeHigh;
+	void	*base;
+
+	file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize(file, &sizeHigh);
+	if (size == INVALID_FILE_SIZE || sizeHigh || !size || size > 0x7fffffff) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping)
+		return NULL;
+
+	base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!base)
+		return NULL;
+
+	*length = size;
+	return base;
+}
+
+/*
+==================
+Sys_UnmapFile
+==================
+*/
+void Sys_UnmapFile( void *base, int length )
+{
+	UnmapViewOfFile(base);
+}
+
 char **Sys_ListFiles( const char *directory, const char *extension, char *filter, int *numfiles, qboolean wantsubs ) {
 	char		search[MAX_OSPATH];
 	int			nfiles;
@@ -967,7 +1033,6 @@ EVENT LOOP
 
 sysEvent_t	eventQue[MAX_QUED_EVENTS];
 int			eventHead, eventTail;
-byte		sys_packetReceived[MAX_MSGLEN];
 
 /*
 ================
@@ -975,7 +1040,7 @@ Sys_QueEvent
 
 A time of 0 will get the current time
 Ptr should either be null, or point to a block of data that can
-be freed by the game later.
+be freed by the game later with Com_FreeEventPtr.
 ================
 */
 void Sys_QueEvent( int time, sysEventType_t type, int value, int value2, int ptrLength, void *ptr ) {
@@ -990,7 +1055,7 @@ void Sys_QueEvent( int time, sysEventType_t type, int value, int value2, int ptr
                 }
 		// we are discarding an event, but don't leak memory
 		if ( ev->evPtr ) {
-			Z_Free( ev->evPtr );
+			Com_FreeEventPtr( ev->evPtr );
 		}
 		eventTail++;
 	} else {
@@ -1021,8 +1086,8 @@ sysEvent_t Sys_GetEvent( void ) {
     MSG			msg;
 	sysEvent_t	ev;
 	char		*s;
-	msg_t		netmsg;
-	netadr_t	adr;
+	netPacket_t	*packet;
+	int			packetLength;
 
 	// return if we have data
 	if ( eventHead > eventTail ) {
@@ -1055,19 +1120,10 @@ sysEvent_t Sys_GetEvent( void ) {
 		Sys_QueEvent( 0, SE_CONSOLE, 0, 0, len, b );
 	}
 
-	// check for network packets
-	MSG_Init( &netmsg, sys_packetReceived, sizeof( sys_packetReceived ) );
-	if ( Sys_GetPacket ( &adr, &netmsg ) ) {
-		netadr_t		*buf;
-		int				len;
-
-		// copy out to a seperate buffer for qeueing
-		// the readcount stepahead is for SOCKS support
-		len = sizeof( netadr_t ) + netmsg.cursize - netmsg.readcount;
-		buf = Z_Malloc( len );
-		*buf = adr;
-		memcpy( buf+1, &netmsg.data[netmsg.readcount], netmsg.cursize - netmsg.readcount );
-		Sys_QueEvent( 0, SE_PACKET, 0, 0, len, buf );
+	// check for network packets, the event keeps the packet ring slot
+	packet = Sys_GetPacket( &packetLength );
+	if ( packet ) {
+		Sys_QueEvent( 0, SE_PACKET, 0, 0, sizeof( netadr_t ) + packetLength, packet );
 	}
 
 	// return if we have data
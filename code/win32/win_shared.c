@@ -106,6 +106,26 @@ int Sys_GetTimeStamp_INIT(void)
 	return Sys_GetTimeStamp();
 }
 
+/*
+================
+Sys_Microseconds
+================
+*/
+int64_t Sys_Microseconds(void)
+{
+	static __int64 freq;
+	__int64 cur;
+
+	if (!freq && !QueryPerformanceFrequency((LARGE_INTEGER*)&freq))
+		freq = -1;
+
+	if (freq <= 0)
+		return (int64_t)timeGetTime() * 1000;
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&cur);
+	return (int64_t)(cur / freq) * 1000000 + (cur % freq) * 1000000 / freq;
+}
+
 /*int Sys_Milliseconds (void)
 {
 	return fp_Sys_Milliseconds();